@@ -0,0 +1,172 @@
+#include "arena.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// Block headers are followed by their memory, aligned to at least this.
+static constexpr size_t arena_block_alignment = 64;
+
+struct Arena_Block
+{
+    // The block that was current before this one was chained on.
+    Arena_Block *previous;
+    size_t capacity;
+    size_t used;
+};
+
+static size_t arena_block_header_size()
+{
+    return (sizeof(Arena_Block) + arena_block_alignment - 1) &
+           ~(arena_block_alignment - 1);
+}
+
+static void *arena_aligned_alloc(size_t size)
+{
+#if defined(_WIN32)
+    return _aligned_malloc(size, arena_block_alignment);
+#else
+    return aligned_alloc(arena_block_alignment, size);
+#endif
+}
+
+static void arena_aligned_free(void *memory)
+{
+#if defined(_WIN32)
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+static uint8_t *arena_block_base(Arena_Block *block)
+{
+    return reinterpret_cast<uint8_t *>(block) + arena_block_header_size();
+}
+
+static Arena_Block *arena_make_block(size_t capacity, Arena_Block *previous)
+{
+    size_t size = arena_block_header_size() + capacity;
+    size = (size + arena_block_alignment - 1) & ~(arena_block_alignment - 1);
+    void *memory = arena_aligned_alloc(size);
+    assert(memory);
+
+    auto *block = static_cast<Arena_Block *>(memory);
+    block->previous = previous;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+static void arena_free_blocks(Arena_Block *block)
+{
+    while (block)
+    {
+        Arena_Block *previous = block->previous;
+        arena_aligned_free(block);
+        block = previous;
+    }
+}
+
+void arena_init(Arena &a, size_t capacity)
+{
+    a.block = arena_make_block(capacity, nullptr);
+    a.used = 0;
+    a.high_water_mark = 0;
+    a.grow_count = 0;
+}
+
+void arena_shutdown(Arena &a)
+{
+    arena_free_blocks(a.block);
+    a.block = nullptr;
+}
+
+void arena_reset(Arena &a)
+{
+    // Merge the chain into one block that fits everything the arena held at
+    // its peak, so the same workload fits without growing next time.
+    if (a.block->previous)
+    {
+        size_t capacity = std::max(a.high_water_mark, arena_capacity(a));
+        arena_free_blocks(a.block);
+        a.block = arena_make_block(capacity, nullptr);
+    }
+    a.block->used = 0;
+    a.used = 0;
+}
+
+void *arena_push(Arena &a, size_t size, size_t alignment)
+{
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    assert(alignment <= arena_block_alignment);
+
+    Arena_Block *block = a.block;
+    size_t offset = (block->used + alignment - 1) & ~(alignment - 1);
+    if (offset + size > block->capacity)
+    {
+        // Double the whole arena, not just the block, to keep the chain
+        // short when a frame needs a lot more than before.
+        size_t capacity = std::max(size, arena_capacity(a));
+        block = arena_make_block(capacity, block);
+        a.block = block;
+        a.grow_count += 1;
+        offset = 0;
+    }
+
+    a.used += offset - block->used + size;
+    a.high_water_mark = std::max(a.high_water_mark, a.used);
+    block->used = offset + size;
+    return arena_block_base(block) + offset;
+}
+
+size_t arena_capacity(const Arena &a)
+{
+    size_t capacity = 0;
+    for (Arena_Block *block = a.block; block; block = block->previous)
+    {
+        capacity += block->capacity;
+    }
+    return capacity;
+}
+
+void frame_arena_init(Frame_Arena &fa, size_t capacity)
+{
+    arena_init(fa.arenas[0], capacity);
+    arena_init(fa.arenas[1], capacity);
+    fa.current = 0;
+}
+
+void frame_arena_shutdown(Frame_Arena &fa)
+{
+    arena_shutdown(fa.arenas[0]);
+    arena_shutdown(fa.arenas[1]);
+}
+
+void frame_arena_begin(Frame_Arena &fa)
+{
+    fa.current = 1 - fa.current;
+    arena_reset(fa.arenas[fa.current]);
+}
+
+Arena &frame_arena_current(Frame_Arena &fa)
+{
+    return fa.arenas[fa.current];
+}
+
+void frame_arena_print_report(const Frame_Arena &fa)
+{
+    static constexpr double mb = 1024.0 * 1024.0;
+
+    for (int i = 0; i < 2; i += 1)
+    {
+        const auto &a = fa.arenas[i];
+        printf("frame arena %d: high water mark %.2fMB of %.2fMB, grew %d "
+               "times\n",
+               i, static_cast<double>(a.high_water_mark) / mb,
+               static_cast<double>(arena_capacity(a)) / mb, a.grow_count);
+    }
+}
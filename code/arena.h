@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+struct Arena_Block;
+
+// Bump allocator, memory is only given back all at once by arena_reset().
+// When the current block runs out a new one is chained on, and the next
+// reset merges them into one block large enough for everything. An arena
+// that is reset every frame therefore stops allocating as soon as it has
+// seen its peak usage. Not thread safe: allocate on one thread, then hand
+// the memory to the workers to fill in.
+struct Arena
+{
+    Arena_Block *block;
+    // Bytes allocated since the last reset, across all blocks, including
+    // alignment padding.
+    size_t used;
+    size_t high_water_mark;
+    int grow_count;
+};
+
+void arena_init(Arena &a, size_t capacity);
+void arena_shutdown(Arena &a);
+void arena_reset(Arena &a);
+// alignment has to be a power of two.
+void *arena_push(Arena &a, size_t size, size_t alignment);
+size_t arena_capacity(const Arena &a);
+
+template <typename T>
+T *arena_push_array(Arena &a, int count)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    return static_cast<T *>(
+        arena_push(a, sizeof(T) * static_cast<size_t>(count), alignof(T)));
+}
+
+// Two arenas used on alternate frames. Everything allocated during a frame
+// stays valid through the next one, so the previous frame's data can still
+// be read while the current one is being built.
+struct Frame_Arena
+{
+    Arena arenas[2];
+    int current;
+};
+
+void frame_arena_init(Frame_Arena &fa, size_t capacity);
+void frame_arena_shutdown(Frame_Arena &fa);
+// Switches to the other arena and resets it.
+void frame_arena_begin(Frame_Arena &fa);
+Arena &frame_arena_current(Frame_Arena &fa);
+void frame_arena_print_report(const Frame_Arena &fa);
+
+// An array in an arena that can grow while it is being filled. Growing
+// moves it to a new, larger allocation and leaves the old one to the next
+// reset, so reserve enough up front when the size can be guessed.
+template <typename T>
+struct Arena_Array
+{
+    T *items;
+    int count;
+    int capacity;
+};
+
+template <typename T>
+void arena_array_reserve(Arena &a, Arena_Array<T> &array, int capacity)
+{
+    if (capacity <= array.capacity)
+    {
+        return;
+    }
+
+    T *items = arena_push_array<T>(a, capacity);
+    if (array.count > 0)
+    {
+        memcpy(items, array.items, sizeof(T) * array.count);
+    }
+    array.items = items;
+    array.capacity = capacity;
+}
+
+// Returns count consecutive, uninitialized items at the end of the array.
+template <typename T>
+T *arena_array_push(Arena &a, Arena_Array<T> &array, int count)
+{
+    if (array.count + count > array.capacity)
+    {
+        int capacity = array.capacity > 0 ? array.capacity * 2 : 64;
+        while (capacity < array.count + count)
+        {
+            capacity *= 2;
+        }
+        arena_array_reserve(a, array, capacity);
+    }
+
+    T *items = &array.items[array.count];
+    array.count += count;
+    return items;
+}
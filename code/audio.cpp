@@ -0,0 +1,493 @@
+#include "audio.h"
+#include "simd.h"
+#include "sokol_time.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+static_assert((audio_commands_max_count & (audio_commands_max_count - 1)) ==
+              0);
+static_assert(audio_buffer_frames_count % 4 == 0);
+
+static constexpr int audio_channels_count = 2;
+static constexpr float audio_master_volume = 0.5f;
+// Fade in, so sounds don't click when they start at a non-zero sample.
+static constexpr float audio_attack_secs = 0.002f;
+
+enum Audio_Command_Type
+{
+    AUDIO_COMMAND_PLAY,
+    AUDIO_COMMAND_STOP,
+};
+
+struct Audio_Command
+{
+    Audio_Command_Type type;
+    Audio_Sound sound;
+    float volume;
+    float pan;
+    // stm_now() when it was queued.
+    uint64_t time;
+};
+
+// One buffer worth of mono samples. Voices always start at a buffer
+// boundary, so they are mixed a whole, aligned block at a time.
+struct alignas(16) Audio_Block
+{
+    float samples[audio_buffer_frames_count];
+};
+
+// Synthesized once at init, padded with silence to whole blocks.
+struct Audio_Clip
+{
+    Audio_Block *blocks;
+    int blocks_count;
+};
+
+struct Audio_Voice
+{
+    // Null when the voice is free.
+    const Audio_Clip *clip;
+    Audio_Sound sound;
+    int block_index;
+    float gain_left;
+    float gain_right;
+};
+
+struct Audio_Mixer
+{
+    std::thread thread;
+    std::atomic<bool> running;
+
+    // Single producer, single consumer ring. The game thread only writes
+    // head and the audio thread only writes tail, so neither ever waits on
+    // the other. They live on separate cache lines so the two threads
+    // don't keep stealing the line from each other.
+    Audio_Command commands[audio_commands_max_count];
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+
+    Audio_Backend backend;
+    Audio_Clip clips[AUDIO_SOUND_COUNT];
+    Audio_Voice voices[audio_voices_max_count];
+    Audio_Block mix_left;
+    Audio_Block mix_right;
+    float frames[audio_buffer_frames_count * audio_channels_count];
+
+    // Written by the audio thread, read after it has been joined.
+    uint64_t buffers_count;
+    uint64_t late_buffers_count;
+    uint64_t commands_count;
+    uint64_t stolen_voices_count;
+    uint64_t max_command_latency;
+};
+
+struct Audio_Wav_Writer
+{
+    FILE *file;
+    uint64_t frames_count;
+};
+
+static void audio_null_write(void *data, const float *frames,
+                             int frames_count)
+{
+    (void)data;
+    (void)frames;
+    (void)frames_count;
+}
+
+static void audio_null_close(void *data)
+{
+    (void)data;
+}
+
+static void audio_put_u16_le(uint8_t *dst, uint32_t value)
+{
+    dst[0] = static_cast<uint8_t>(value);
+    dst[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void audio_put_u32_le(uint8_t *dst, uint32_t value)
+{
+    dst[0] = static_cast<uint8_t>(value);
+    dst[1] = static_cast<uint8_t>(value >> 8);
+    dst[2] = static_cast<uint8_t>(value >> 16);
+    dst[3] = static_cast<uint8_t>(value >> 24);
+}
+
+// The sizes are unknown until the file is closed, they are filled in then.
+static void audio_wav_write_header(FILE *file, uint64_t frames_count)
+{
+    static constexpr uint32_t bytes_per_frame = audio_channels_count * 2;
+    uint32_t data_size = static_cast<uint32_t>(frames_count * bytes_per_frame);
+
+    uint8_t header[44];
+    memcpy(header + 0, "RIFF", 4);
+    audio_put_u32_le(header + 4, 36 + data_size);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + 12, "fmt ", 4);
+    audio_put_u32_le(header + 16, 16);
+    // PCM.
+    audio_put_u16_le(header + 20, 1);
+    audio_put_u16_le(header + 22, audio_channels_count);
+    audio_put_u32_le(header + 24, audio_sample_rate);
+    audio_put_u32_le(header + 28, audio_sample_rate * bytes_per_frame);
+    audio_put_u16_le(header + 32, bytes_per_frame);
+    audio_put_u16_le(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    audio_put_u32_le(header + 40, data_size);
+    fwrite(header, 1, sizeof(header), file);
+}
+
+static void audio_wav_write(void *data, const float *frames, int frames_count)
+{
+    auto *w = static_cast<Audio_Wav_Writer *>(data);
+    uint8_t samples[audio_buffer_frames_count * audio_channels_count * 2];
+    int samples_count = frames_count * audio_channels_count;
+    for (int i = 0; i < samples_count; i += 1)
+    {
+        auto sample = static_cast<int16_t>(lrintf(frames[i] * 32767.0f));
+        audio_put_u16_le(samples + i * 2, static_cast<uint16_t>(sample));
+    }
+    fwrite(samples, 1, static_cast<size_t>(samples_count) * 2, w->file);
+    w->frames_count += static_cast<uint64_t>(frames_count);
+}
+
+static void audio_wav_close(void *data)
+{
+    auto *w = static_cast<Audio_Wav_Writer *>(data);
+    fseek(w->file, 0, SEEK_SET);
+    audio_wav_write_header(w->file, w->frames_count);
+    fclose(w->file);
+    delete w;
+}
+
+static bool audio_open_backend(Audio &a, Audio_Backend &backend)
+{
+    switch (a.output)
+    {
+    case AUDIO_OUTPUT_NULL:
+        backend.write = audio_null_write;
+        backend.close = audio_null_close;
+        return true;
+    case AUDIO_OUTPUT_WAV:
+    {
+        FILE *file = fopen(a.path, "wb");
+        if (!file)
+        {
+            printf("audio: can't open %s\n", a.path);
+            return false;
+        }
+        audio_wav_write_header(file, 0);
+        auto *w = new Audio_Wav_Writer();
+        w->file = file;
+        backend.data = w;
+        backend.write = audio_wav_write;
+        backend.close = audio_wav_close;
+        return true;
+    }
+    }
+    return false;
+}
+
+template <typename F>
+static void audio_synth_clip(Audio_Clip &clip, float duration_secs, F &&f)
+{
+    int frames_count = static_cast<int>(duration_secs * audio_sample_rate);
+    clip.blocks_count = (frames_count + audio_buffer_frames_count - 1) /
+                        audio_buffer_frames_count;
+    clip.blocks = new Audio_Block[clip.blocks_count]();
+
+    for (int i = 0; i < frames_count; i += 1)
+    {
+        float t = static_cast<float>(i) / audio_sample_rate;
+        float attack = std::min(t / audio_attack_secs, 1.0f);
+        clip.blocks[i / audio_buffer_frames_count]
+            .samples[i % audio_buffer_frames_count] = f(t) * attack;
+    }
+}
+
+static float audio_sine(float frequency, float t)
+{
+    return sinf(2.0f * 3.14159265f * frequency * t);
+}
+
+static void audio_synth_clips(Audio_Mixer &m)
+{
+    // A bright, short knock.
+    audio_synth_clip(m.clips[AUDIO_SOUND_PADDLE_HIT], 0.15f,
+                     [](float t)
+                     {
+                         return audio_sine(660.0f, t) * expf(-30.0f * t) +
+                                0.3f * audio_sine(1320.0f, t) *
+                                    expf(-60.0f * t);
+                     });
+    // Lower and duller than the paddles.
+    audio_synth_clip(m.clips[AUDIO_SOUND_WALL_HIT], 0.12f,
+                     [](float t)
+                     {
+                         return 0.8f * audio_sine(330.0f, t) *
+                                expf(-40.0f * t);
+                     });
+    // Two rising notes.
+    audio_synth_clip(m.clips[AUDIO_SOUND_SCORE], 0.45f,
+                     [](float t)
+                     {
+                         static constexpr float second_note_secs = 0.12f;
+                         if (t < second_note_secs)
+                         {
+                             return 0.7f * audio_sine(523.25f, t) *
+                                    expf(-10.0f * t);
+                         }
+                         float u = t - second_note_secs;
+                         float attack = std::min(u / audio_attack_secs, 1.0f);
+                         return 0.7f * attack * audio_sine(783.99f, u) *
+                                expf(-8.0f * u);
+                     });
+}
+
+static void audio_mixer_play(Audio_Mixer &m, const Audio_Command &command)
+{
+    // Take a free voice, or steal the one that has played the longest.
+    Audio_Voice *voice = &m.voices[0];
+    for (auto &v : m.voices)
+    {
+        if (!v.clip)
+        {
+            voice = &v;
+            break;
+        }
+        if (v.block_index > voice->block_index)
+        {
+            voice = &v;
+        }
+    }
+    if (voice->clip)
+    {
+        m.stolen_voices_count += 1;
+    }
+
+    // Constant power panning.
+    float angle = (std::clamp(command.pan, -1.0f, 1.0f) + 1.0f) * 0.25f *
+                  3.14159265f;
+    voice->clip = &m.clips[command.sound];
+    voice->sound = command.sound;
+    voice->block_index = 0;
+    voice->gain_left = command.volume * cosf(angle);
+    voice->gain_right = command.volume * sinf(angle);
+}
+
+static void audio_mixer_process_commands(Audio_Mixer &m)
+{
+    uint32_t tail = m.tail.load(std::memory_order_relaxed);
+    uint32_t head = m.head.load(std::memory_order_acquire);
+    uint64_t now = stm_now();
+    for (; tail != head; tail += 1)
+    {
+        const auto &command = m.commands[tail % audio_commands_max_count];
+        m.max_command_latency =
+            std::max(m.max_command_latency, stm_diff(now, command.time));
+        m.commands_count += 1;
+
+        switch (command.type)
+        {
+        case AUDIO_COMMAND_PLAY:
+            audio_mixer_play(m, command);
+            break;
+        case AUDIO_COMMAND_STOP:
+            for (auto &v : m.voices)
+            {
+                if (v.clip && v.sound == command.sound)
+                {
+                    v.clip = nullptr;
+                }
+            }
+            break;
+        }
+    }
+    m.tail.store(tail, std::memory_order_release);
+}
+
+static void audio_mixer_mix(Audio_Mixer &m)
+{
+    memset(&m.mix_left, 0, sizeof(m.mix_left));
+    memset(&m.mix_right, 0, sizeof(m.mix_right));
+
+    for (auto &v : m.voices)
+    {
+        if (!v.clip)
+        {
+            continue;
+        }
+
+        const float *src = v.clip->blocks[v.block_index].samples;
+        F32x4 gain_left = f32x4_set1(v.gain_left);
+        F32x4 gain_right = f32x4_set1(v.gain_right);
+        for (int i = 0; i < audio_buffer_frames_count; i += 4)
+        {
+            F32x4 sample = f32x4_load(&src[i]);
+            f32x4_store(&m.mix_left.samples[i],
+                        f32x4_mul_add(sample, gain_left,
+                                      f32x4_load(&m.mix_left.samples[i])));
+            f32x4_store(&m.mix_right.samples[i],
+                        f32x4_mul_add(sample, gain_right,
+                                      f32x4_load(&m.mix_right.samples[i])));
+        }
+
+        v.block_index += 1;
+        if (v.block_index == v.clip->blocks_count)
+        {
+            v.clip = nullptr;
+        }
+    }
+
+    for (int i = 0; i < audio_buffer_frames_count; i += 1)
+    {
+        m.frames[i * 2 + 0] = std::clamp(
+            m.mix_left.samples[i] * audio_master_volume, -1.0f, 1.0f);
+        m.frames[i * 2 + 1] = std::clamp(
+            m.mix_right.samples[i] * audio_master_volume, -1.0f, 1.0f);
+    }
+}
+
+static void audio_mixer_main(Audio_Mixer *m)
+{
+    using Clock = std::chrono::steady_clock;
+    auto buffer_duration = std::chrono::nanoseconds(
+        static_cast<int64_t>(audio_buffer_frames_count) * 1000000000 /
+        audio_sample_rate);
+
+    auto deadline = Clock::now();
+    while (m->running.load(std::memory_order_acquire))
+    {
+        audio_mixer_process_commands(*m);
+        audio_mixer_mix(*m);
+        m->backend.write(m->backend.data, m->frames,
+                         audio_buffer_frames_count);
+        m->buffers_count += 1;
+
+        if (!m->backend.paced)
+        {
+            // Late buffers aren't caught up on, that would only play the
+            // next ones early.
+            deadline += buffer_duration;
+            auto now = Clock::now();
+            if (now > deadline)
+            {
+                m->late_buffers_count += 1;
+                deadline = now;
+            }
+            std::this_thread::sleep_until(deadline);
+        }
+    }
+}
+
+bool audio_parse(Audio &a, const char *spec)
+{
+    if (strcmp(spec, "null") == 0)
+    {
+        a.output = AUDIO_OUTPUT_NULL;
+        a.path = nullptr;
+        return true;
+    }
+    if (strncmp(spec, "wav:", 4) == 0 && spec[4])
+    {
+        a.output = AUDIO_OUTPUT_WAV;
+        a.path = spec + 4;
+        return true;
+    }
+    return false;
+}
+
+void audio_init(Audio &a)
+{
+    auto *m = new Audio_Mixer();
+    if (!audio_open_backend(a, m->backend))
+    {
+        delete m;
+        return;
+    }
+    audio_synth_clips(*m);
+
+    a.mixer = m;
+    a.active = true;
+    m->running = true;
+    m->thread = std::thread(audio_mixer_main, m);
+    printf("audio: mixing to %s\n",
+           a.output == AUDIO_OUTPUT_WAV ? a.path : "null");
+}
+
+void audio_shutdown(Audio &a)
+{
+    if (!a.active)
+    {
+        return;
+    }
+
+    auto *m = a.mixer;
+    m->running.store(false, std::memory_order_release);
+    m->thread.join();
+    m->backend.close(m->backend.data);
+
+    printf("audio: %llu buffers, %llu late, %llu commands, %llu dropped, "
+           "%llu voices stolen\n",
+           static_cast<unsigned long long>(m->buffers_count),
+           static_cast<unsigned long long>(m->late_buffers_count),
+           static_cast<unsigned long long>(m->commands_count),
+           static_cast<unsigned long long>(a.dropped_commands_count),
+           static_cast<unsigned long long>(m->stolen_voices_count));
+    printf("audio: max command latency %.2fms, buffer %.2fms\n",
+           stm_ms(m->max_command_latency),
+           1000.0 * audio_buffer_frames_count / audio_sample_rate);
+
+    for (auto &clip : m->clips)
+    {
+        delete[] clip.blocks;
+    }
+    delete m;
+    a.mixer = nullptr;
+    a.active = false;
+}
+
+static void audio_push_command(Audio &a, const Audio_Command &command)
+{
+    if (!a.active)
+    {
+        return;
+    }
+
+    auto &m = *a.mixer;
+    uint32_t head = m.head.load(std::memory_order_relaxed);
+    uint32_t tail = m.tail.load(std::memory_order_acquire);
+    if (head - tail == audio_commands_max_count)
+    {
+        a.dropped_commands_count += 1;
+        return;
+    }
+    m.commands[head % audio_commands_max_count] = command;
+    m.head.store(head + 1, std::memory_order_release);
+}
+
+void audio_play(Audio &a, Audio_Sound sound, float volume, float pan)
+{
+    Audio_Command command = {};
+    command.type = AUDIO_COMMAND_PLAY;
+    command.sound = sound;
+    command.volume = volume;
+    command.pan = pan;
+    command.time = stm_now();
+    audio_push_command(a, command);
+}
+
+void audio_stop(Audio &a, Audio_Sound sound)
+{
+    Audio_Command command = {};
+    command.type = AUDIO_COMMAND_STOP;
+    command.sound = sound;
+    command.time = stm_now();
+    audio_push_command(a, command);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+inline constexpr int audio_sample_rate = 48000;
+// Frames mixed at a time. Commands are picked up at the start of every
+// buffer, so this bounds the latency from the game to the mix: 256 frames
+// are 5.3ms.
+inline constexpr int audio_buffer_frames_count = 256;
+inline constexpr int audio_voices_max_count = 32;
+// Commands waiting for the audio thread, a power of two. Commands are
+// dropped, not waited on, when it falls further behind than this.
+inline constexpr int audio_commands_max_count = 256;
+
+enum Audio_Sound
+{
+    AUDIO_SOUND_PADDLE_HIT,
+    AUDIO_SOUND_WALL_HIT,
+    AUDIO_SOUND_SCORE,
+    AUDIO_SOUND_COUNT,
+};
+
+enum Audio_Output
+{
+    // Mixes in real time and throws the result away.
+    AUDIO_OUTPUT_NULL,
+    // Mixes in real time into a 16-bit stereo WAV file.
+    AUDIO_OUTPUT_WAV,
+};
+
+// Where the mixed audio ends up. write() gets one buffer of interleaved
+// stereo frames on the audio thread. A backend that feeds a device blocks
+// in write() until the device wants more and sets paced, for the others the
+// mixer keeps real time itself.
+struct Audio_Backend
+{
+    void *data;
+    bool paced;
+    void (*write)(void *data, const float *frames, int frames_count);
+    void (*close)(void *data);
+};
+
+struct Audio_Mixer;
+
+struct Audio
+{
+    Audio_Output output;
+    const char *path;
+    bool active;
+    uint64_t dropped_commands_count;
+    Audio_Mixer *mixer;
+};
+
+// Parses an audio spec, "null" or "wav:<file>". The spec string has to
+// outlive the audio.
+bool audio_parse(Audio &a, const char *spec);
+// Synthesizes every sound and starts the audio thread.
+void audio_init(Audio &a);
+void audio_shutdown(Audio &a);
+// Queues a sound to start at the next buffer. pan goes from -1 (left) to 1
+// (right). Never blocks.
+void audio_play(Audio &a, Audio_Sound sound, float volume, float pan);
+// Queues stopping every voice playing sound. Never blocks.
+void audio_stop(Audio &a, Audio_Sound sound);
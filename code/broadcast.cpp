@@ -0,0 +1,1258 @@
+#include "broadcast.h"
+#include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+// One thread serves every socket through epoll, which only Linux has.
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#define BROADCAST_EPOLL
+#endif
+
+struct Broadcast_Address
+{
+    bool unix_socket;
+    // Empty for any interface, or localhost when connecting.
+    char host[64];
+    int port;
+    char path[108];
+};
+
+static bool broadcast_parse_address(Broadcast_Address &a, const char *address)
+{
+    a = {};
+    if (strncmp(address, "unix:", 5) == 0)
+    {
+        a.unix_socket = true;
+        size_t length = strlen(address + 5);
+        if (length == 0 || length >= sizeof(a.path))
+        {
+            return false;
+        }
+        memcpy(a.path, address + 5, length + 1);
+        return true;
+    }
+    if (strncmp(address, "tcp:", 4) == 0)
+    {
+        const char *port = address + 4;
+        const char *colon = strrchr(port, ':');
+        if (colon)
+        {
+            size_t length = static_cast<size_t>(colon - port);
+            if (length == 0 || length >= sizeof(a.host))
+            {
+                return false;
+            }
+            memcpy(a.host, port, length);
+            port = colon + 1;
+        }
+        a.port = atoi(port);
+        return a.port > 0 && a.port < 65536;
+    }
+    return false;
+}
+
+bool broadcast_parse(const char *address)
+{
+    Broadcast_Address a;
+    return broadcast_parse_address(a, address);
+}
+
+#if defined(BROADCAST_EPOLL)
+
+// Positions go out in 1/64ths of a unit, far below a pixel.
+static constexpr float broadcast_position_scale = 64.0f;
+// Size, type, tick and send time.
+static constexpr int broadcast_header_size = 15;
+static constexpr int broadcast_iovecs_max_count = 16;
+static constexpr int broadcast_epoll_events_max_count = 256;
+static constexpr int broadcast_listen_backlog = 1024;
+
+enum Broadcast_Message_Type
+{
+    BROADCAST_MESSAGE_SNAPSHOT,
+    BROADCAST_MESSAGE_DELTA,
+};
+
+// A snapshot is a delta against all zeros.
+static constexpr int32_t broadcast_zero_values[BROADCAST_FIELD_COUNT] = {};
+
+static uint64_t broadcast_now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 +
+           static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Spectators and the load generator each hold a socket, a thousand of
+// them need more than the usual soft limit of 1024 files.
+static void broadcast_raise_files_limit()
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+        limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static int broadcast_socket(const Broadcast_Address &a, bool listening,
+                            sockaddr_storage &addr, socklen_t &addr_size)
+{
+    addr = {};
+    if (a.unix_socket)
+    {
+        auto &un = reinterpret_cast<sockaddr_un &>(addr);
+        un.sun_family = AF_UNIX;
+        memcpy(un.sun_path, a.path, sizeof(a.path));
+        addr_size = sizeof(sockaddr_un);
+        return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+
+    auto &in = reinterpret_cast<sockaddr_in &>(addr);
+    in.sin_family = AF_INET;
+    in.sin_port = htons(static_cast<uint16_t>(a.port));
+    if (a.host[0])
+    {
+        if (inet_pton(AF_INET, a.host, &in.sin_addr) != 1)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        in.sin_addr.s_addr = htonl(listening ? INADDR_ANY : INADDR_LOOPBACK);
+    }
+    addr_size = sizeof(sockaddr_in);
+    return socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+}
+
+
+static void broadcast_configure(int fd, bool unix_socket)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (!unix_socket)
+    {
+        // Messages are tiny and go out every tick, Nagle would only hold
+        // them back.
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+}
+
+static void broadcast_put(uint8_t *data, uint64_t value, int size)
+{
+    for (int i = 0; i < size; i += 1)
+    {
+        data[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+static uint64_t broadcast_get(const uint8_t *data, int size)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < size; i += 1)
+    {
+        value |= static_cast<uint64_t>(data[i]) << (i * 8);
+    }
+    return value;
+}
+
+struct Broadcast_Bit_Writer
+{
+    uint8_t *data;
+    int size;
+    uint64_t bits;
+    int bits_count;
+};
+
+// count is at most 32.
+static void broadcast_write_bits(Broadcast_Bit_Writer &w, uint32_t value,
+                                 int count)
+{
+    w.bits |= static_cast<uint64_t>(value) << w.bits_count;
+    w.bits_count += count;
+    while (w.bits_count >= 8)
+    {
+        w.data[w.size] = static_cast<uint8_t>(w.bits);
+        w.size += 1;
+        w.bits >>= 8;
+        w.bits_count -= 8;
+    }
+}
+
+static void broadcast_flush_bits(Broadcast_Bit_Writer &w)
+{
+    if (w.bits_count > 0)
+    {
+        w.data[w.size] = static_cast<uint8_t>(w.bits);
+        w.size += 1;
+        w.bits = 0;
+        w.bits_count = 0;
+    }
+}
+
+struct Broadcast_Bit_Reader
+{
+    const uint8_t *data;
+    int size;
+    int offset;
+    uint64_t bits;
+    int bits_count;
+};
+
+static bool broadcast_read_bits(Broadcast_Bit_Reader &r, int count,
+                                uint32_t &value)
+{
+    while (r.bits_count < count)
+    {
+        if (r.offset == r.size)
+        {
+            return false;
+        }
+        r.bits |= static_cast<uint64_t>(r.data[r.offset]) << r.bits_count;
+        r.offset += 1;
+        r.bits_count += 8;
+    }
+    value = static_cast<uint32_t>(r.bits & ((uint64_t(1) << count) - 1));
+    r.bits >>= count;
+    r.bits_count -= count;
+    return true;
+}
+
+// A field that didn't change is one bit. One that did is a bit, 5 bits of
+// length and the zigzagged difference in just as many bits as it needs.
+static void broadcast_write_field(Broadcast_Bit_Writer &w, int32_t value,
+                                  int32_t base)
+{
+    uint32_t delta = static_cast<uint32_t>(value) - static_cast<uint32_t>(base);
+    uint32_t zigzag =
+        (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+    if (zigzag == 0)
+    {
+        broadcast_write_bits(w, 0, 1);
+        return;
+    }
+    int bits_count = 1;
+    while (bits_count < 32 && (zigzag >> bits_count) != 0)
+    {
+        bits_count += 1;
+    }
+    broadcast_write_bits(w, 1, 1);
+    broadcast_write_bits(w, static_cast<uint32_t>(bits_count - 1), 5);
+    broadcast_write_bits(w, zigzag, bits_count);
+}
+
+static bool broadcast_read_field(Broadcast_Bit_Reader &r, int32_t base,
+                                 int32_t &value)
+{
+    uint32_t changed;
+    if (!broadcast_read_bits(r, 1, changed))
+    {
+        return false;
+    }
+    if (!changed)
+    {
+        value = base;
+        return true;
+    }
+    uint32_t bits_count;
+    uint32_t zigzag;
+    if (!broadcast_read_bits(r, 5, bits_count) ||
+        !broadcast_read_bits(r, static_cast<int>(bits_count) + 1, zigzag))
+    {
+        return false;
+    }
+    uint32_t delta = (zigzag >> 1) ^ (0u - (zigzag & 1));
+    value = static_cast<int32_t>(static_cast<uint32_t>(base) + delta);
+    return true;
+}
+
+static void broadcast_quantize(const Game &g, int32_t *values)
+{
+    Game_Entities e;
+    game_get_entities(g, e);
+    float scale = broadcast_position_scale;
+    values[BROADCAST_FIELD_BALL_X] = lrintf(e.ball_position.X * scale);
+    values[BROADCAST_FIELD_BALL_Y] = lrintf(e.ball_position.Y * scale);
+    values[BROADCAST_FIELD_PADDLE_LEFT_Y] = lrintf(e.paddle_left_y * scale);
+    values[BROADCAST_FIELD_PADDLE_RIGHT_Y] = lrintf(e.paddle_right_y * scale);
+    values[BROADCAST_FIELD_SCORE_LEFT] = e.score_left;
+    values[BROADCAST_FIELD_SCORE_RIGHT] = e.score_right;
+}
+
+static void broadcast_dequantize(const int32_t *values, Game_Entities &e)
+{
+    float scale = 1.0f / broadcast_position_scale;
+    e.ball_position.X = values[BROADCAST_FIELD_BALL_X] * scale;
+    e.ball_position.Y = values[BROADCAST_FIELD_BALL_Y] * scale;
+    e.paddle_left_y = values[BROADCAST_FIELD_PADDLE_LEFT_Y] * scale;
+    e.paddle_right_y = values[BROADCAST_FIELD_PADDLE_RIGHT_Y] * scale;
+    e.score_left = values[BROADCAST_FIELD_SCORE_LEFT];
+    e.score_right = values[BROADCAST_FIELD_SCORE_RIGHT];
+}
+
+// Little endian u16 size, u8 type, u32 tick, u64 send time, then the bit
+// packed fields. Returns the size.
+static int broadcast_encode(uint8_t *data, Broadcast_Message_Type type,
+                            uint32_t tick, uint64_t send_time_ns,
+                            const int32_t *values, const int32_t *base)
+{
+    broadcast_put(data + 2, static_cast<uint64_t>(type), 1);
+    broadcast_put(data + 3, tick, 4);
+    broadcast_put(data + 7, send_time_ns, 8);
+    Broadcast_Bit_Writer w = {};
+    w.data = data + broadcast_header_size;
+    for (int i = 0; i < BROADCAST_FIELD_COUNT; i += 1)
+    {
+        broadcast_write_field(w, values[i], base[i]);
+    }
+    broadcast_flush_bits(w);
+    int size = broadcast_header_size + w.size;
+    assert(size <= broadcast_message_max_size);
+    broadcast_put(data, static_cast<uint64_t>(size), 2);
+    return size;
+}
+
+static bool broadcast_decode(Broadcast_Decoder &d, const uint8_t *data,
+                             int size)
+{
+    auto type = static_cast<Broadcast_Message_Type>(data[2]);
+    auto tick = static_cast<uint32_t>(broadcast_get(data + 3, 4));
+    // An unknown type means the stream is corrupt, wait for the next
+    // snapshot.
+    if ((type != BROADCAST_MESSAGE_SNAPSHOT &&
+         type != BROADCAST_MESSAGE_DELTA) ||
+        (type == BROADCAST_MESSAGE_DELTA && (!d.synced || tick != d.tick + 1)))
+    {
+        d.synced = false;
+        d.skipped_messages_count += 1;
+        return false;
+    }
+    const int32_t *base = type == BROADCAST_MESSAGE_SNAPSHOT
+                              ? broadcast_zero_values
+                              : d.values;
+    Broadcast_Bit_Reader r = {};
+    r.data = data + broadcast_header_size;
+    r.size = size - broadcast_header_size;
+    int32_t values[BROADCAST_FIELD_COUNT];
+    for (int i = 0; i < BROADCAST_FIELD_COUNT; i += 1)
+    {
+        if (!broadcast_read_field(r, base[i], values[i]))
+        {
+            d.synced = false;
+            d.skipped_messages_count += 1;
+            return false;
+        }
+    }
+    memcpy(d.values, values, sizeof(values));
+    d.tick = tick;
+    d.send_time_ns = broadcast_get(data + 7, 8);
+    d.synced = true;
+    d.messages_count += 1;
+    return true;
+}
+
+// Splits the stream into messages and calls decoded(d) after each state.
+// Returns false if the stream is corrupt.
+template <typename F>
+static bool broadcast_decoder_feed(Broadcast_Decoder &d, const uint8_t *data,
+                                   size_t size, F &&decoded)
+{
+    while (size > 0)
+    {
+        int needed = 2;
+        if (d.pending_size >= 2)
+        {
+            needed = static_cast<int>(broadcast_get(d.pending, 2));
+            if (needed < broadcast_header_size ||
+                needed > broadcast_message_max_size)
+            {
+                return false;
+            }
+        }
+        size_t count = std::min(size, static_cast<size_t>(needed -
+                                                          d.pending_size));
+        memcpy(d.pending + d.pending_size, data, count);
+        d.pending_size += static_cast<int>(count);
+        data += count;
+        size -= count;
+        if (d.pending_size >= broadcast_header_size &&
+            d.pending_size == needed)
+        {
+            if (broadcast_decode(d, d.pending, d.pending_size))
+            {
+                decoded(d);
+            }
+            d.pending_size = 0;
+        }
+    }
+    return true;
+}
+
+// An encoded message shared by the history and every subscriber queue it
+// is in. Only the server thread touches these.
+struct Broadcast_Buffer
+{
+    Broadcast_Buffer *next_free;
+    int references_count;
+    int size;
+    uint8_t data[broadcast_message_max_size];
+};
+
+struct Broadcast_Subscriber
+{
+    int fd;
+    bool waiting_writable;
+    bool closing;
+    // Messages not fully sent yet, each holding a reference.
+    Broadcast_Buffer *queue[broadcast_subscriber_queue_count];
+    int queue_first;
+    int queue_count;
+    // Bytes of the first message that are already sent.
+    int sent_size;
+};
+
+struct Broadcast_Message
+{
+    int size;
+    uint8_t data[broadcast_message_max_size];
+};
+
+struct Broadcast_Server_Thread
+{
+    std::thread thread;
+    std::atomic<bool> running;
+    int listen_fd;
+    int epoll_fd;
+    // Wakes the server thread when messages are queued.
+    int wake_fd;
+    Broadcast_Address address;
+
+    // Single producer, single consumer ring from the game thread.
+    Broadcast_Message messages[broadcast_messages_max_count];
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+
+    // Everything below belongs to the server thread.
+    alignas(64) Broadcast_Buffer *free_buffers;
+    int buffers_count;
+    // The last snapshot and every delta since, for spectators that join.
+    Broadcast_Buffer *history[broadcast_snapshot_interval];
+    int history_count;
+    Broadcast_Subscriber **subscribers;
+    int subscribers_count;
+    int subscribers_capacity;
+    int subscribers_peak_count;
+    uint64_t accepted_count;
+    uint64_t slow_count;
+    uint64_t sends_count;
+    uint64_t sent_bytes_count;
+};
+
+static Broadcast_Buffer *broadcast_buffer_new(Broadcast_Server_Thread &t)
+{
+    Broadcast_Buffer *b = t.free_buffers;
+    if (b)
+    {
+        t.free_buffers = b->next_free;
+    }
+    else
+    {
+        b = new Broadcast_Buffer;
+        t.buffers_count += 1;
+    }
+    b->references_count = 1;
+    return b;
+}
+
+static void broadcast_buffer_release(Broadcast_Server_Thread &t,
+                                     Broadcast_Buffer *b)
+{
+    b->references_count -= 1;
+    if (b->references_count == 0)
+    {
+        b->next_free = t.free_buffers;
+        t.free_buffers = b;
+    }
+}
+
+static void broadcast_subscriber_watch(Broadcast_Server_Thread &t,
+                                       Broadcast_Subscriber &s, bool writable)
+{
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP | (writable ? EPOLLOUT : 0u);
+    event.data.ptr = &s;
+    epoll_ctl(t.epoll_fd, EPOLL_CTL_MOD, s.fd, &event);
+    s.waiting_writable = writable;
+}
+
+// A spectator that falls a whole queue behind is dropped rather than
+// holding everyone else back.
+static void broadcast_subscriber_push(Broadcast_Server_Thread &t,
+                                      Broadcast_Subscriber &s,
+                                      Broadcast_Buffer *b)
+{
+    if (s.closing)
+    {
+        return;
+    }
+    if (s.queue_count == broadcast_subscriber_queue_count)
+    {
+        s.closing = true;
+        t.slow_count += 1;
+        return;
+    }
+    int index =
+        (s.queue_first + s.queue_count) % broadcast_subscriber_queue_count;
+    s.queue[index] = b;
+    s.queue_count += 1;
+    b->references_count += 1;
+}
+
+// Sends as much of the queue as the socket takes, gathering up to 16
+// messages a call.
+static void broadcast_subscriber_send(Broadcast_Server_Thread &t,
+                                      Broadcast_Subscriber &s)
+{
+    while (s.queue_count > 0 && !s.closing)
+    {
+        iovec iovecs[broadcast_iovecs_max_count];
+        int count = std::min(s.queue_count, broadcast_iovecs_max_count);
+        for (int i = 0; i < count; i += 1)
+        {
+            int index = (s.queue_first + i) % broadcast_subscriber_queue_count;
+            Broadcast_Buffer *b = s.queue[index];
+            int offset = i == 0 ? s.sent_size : 0;
+            iovecs[i].iov_base = b->data + offset;
+            iovecs[i].iov_len = static_cast<size_t>(b->size - offset);
+        }
+        msghdr message = {};
+        message.msg_iov = iovecs;
+        message.msg_iovlen = static_cast<size_t>(count);
+        // No SIGPIPE when the spectator is already gone.
+        ssize_t sent = sendmsg(s.fd, &message, MSG_NOSIGNAL);
+        t.sends_count += 1;
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (!s.waiting_writable)
+                {
+                    broadcast_subscriber_watch(t, s, true);
+                }
+                return;
+            }
+            s.closing = true;
+            return;
+        }
+        t.sent_bytes_count += static_cast<uint64_t>(sent);
+
+        while (sent > 0)
+        {
+            Broadcast_Buffer *b = s.queue[s.queue_first];
+            ssize_t left = b->size - s.sent_size;
+            if (sent < left)
+            {
+                s.sent_size += static_cast<int>(sent);
+                break;
+            }
+            sent -= left;
+            s.sent_size = 0;
+            broadcast_buffer_release(t, b);
+            s.queue_first =
+                (s.queue_first + 1) % broadcast_subscriber_queue_count;
+            s.queue_count -= 1;
+        }
+    }
+    if (s.waiting_writable && s.queue_count == 0)
+    {
+        broadcast_subscriber_watch(t, s, false);
+    }
+}
+
+static void broadcast_accept(Broadcast_Server_Thread &t)
+{
+    for (;;)
+    {
+        int fd = accept4(t.listen_fd, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                printf("broadcast: accept failed: %s\n", strerror(errno));
+            }
+            return;
+        }
+        broadcast_configure(fd, t.address.unix_socket);
+
+        auto *s = new Broadcast_Subscriber();
+        s->fd = fd;
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = s;
+        epoll_ctl(t.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+
+        if (t.subscribers_count == t.subscribers_capacity)
+        {
+            t.subscribers_capacity = std::max(64, t.subscribers_capacity * 2);
+            auto **subscribers = new Broadcast_Subscriber *[
+                static_cast<size_t>(t.subscribers_capacity)];
+            std::copy(t.subscribers, t.subscribers + t.subscribers_count,
+                      subscribers);
+            delete[] t.subscribers;
+            t.subscribers = subscribers;
+        }
+        t.subscribers[t.subscribers_count] = s;
+        t.subscribers_count += 1;
+        t.subscribers_peak_count =
+            std::max(t.subscribers_peak_count, t.subscribers_count);
+        t.accepted_count += 1;
+
+        // Catch up from the last snapshot.
+        for (int i = 0; i < t.history_count; i += 1)
+        {
+            broadcast_subscriber_push(t, *s, t.history[i]);
+        }
+        broadcast_subscriber_send(t, *s);
+    }
+}
+
+static void broadcast_subscriber_close(Broadcast_Server_Thread &t,
+                                       Broadcast_Subscriber *s)
+{
+    epoll_ctl(t.epoll_fd, EPOLL_CTL_DEL, s->fd, nullptr);
+    close(s->fd);
+    for (int i = 0; i < s->queue_count; i += 1)
+    {
+        int index = (s->queue_first + i) % broadcast_subscriber_queue_count;
+        broadcast_buffer_release(t, s->queue[index]);
+    }
+    delete s;
+}
+
+// Removes the subscribers marked closing. Only between batches of epoll
+// events, which may still point at them.
+static void broadcast_sweep(Broadcast_Server_Thread &t)
+{
+    for (int i = t.subscribers_count - 1; i >= 0; i -= 1)
+    {
+        if (t.subscribers[i]->closing)
+        {
+            broadcast_subscriber_close(t, t.subscribers[i]);
+            t.subscribers_count -= 1;
+            t.subscribers[i] = t.subscribers[t.subscribers_count];
+        }
+    }
+}
+
+static void broadcast_history_clear(Broadcast_Server_Thread &t)
+{
+    for (int i = 0; i < t.history_count; i += 1)
+    {
+        broadcast_buffer_release(t, t.history[i]);
+    }
+    t.history_count = 0;
+}
+
+// Takes the messages the game thread queued and sends them to everyone.
+static void broadcast_publish(Broadcast_Server_Thread &t)
+{
+    uint64_t wakes;
+    while (read(t.wake_fd, &wakes, sizeof(wakes)) < 0 && errno == EINTR)
+    {
+    }
+
+    uint32_t tail = t.tail.load(std::memory_order_relaxed);
+    uint32_t head = t.head.load(std::memory_order_acquire);
+    if (tail == head)
+    {
+        return;
+    }
+    for (; tail != head; tail += 1)
+    {
+        const Broadcast_Message &m =
+            t.messages[tail % broadcast_messages_max_count];
+        Broadcast_Buffer *b = broadcast_buffer_new(t);
+        b->size = m.size;
+        memcpy(b->data, m.data, static_cast<size_t>(m.size));
+
+        if (m.data[2] == BROADCAST_MESSAGE_SNAPSHOT ||
+            t.history_count == broadcast_snapshot_interval)
+        {
+            broadcast_history_clear(t);
+        }
+        // The history's reference is the one it was created with.
+        t.history[t.history_count] = b;
+        t.history_count += 1;
+        for (int i = 0; i < t.subscribers_count; i += 1)
+        {
+            broadcast_subscriber_push(t, *t.subscribers[i], b);
+        }
+    }
+    t.tail.store(tail, std::memory_order_release);
+
+    // A subscriber waiting to become writable gets its turn then.
+    for (int i = 0; i < t.subscribers_count; i += 1)
+    {
+        Broadcast_Subscriber &s = *t.subscribers[i];
+        if (!s.waiting_writable)
+        {
+            broadcast_subscriber_send(t, s);
+        }
+    }
+}
+
+static void broadcast_serve(Broadcast_Server_Thread &t)
+{
+    epoll_event events[broadcast_epoll_events_max_count];
+    while (t.running.load(std::memory_order_acquire))
+    {
+        int count = epoll_wait(t.epoll_fd, events,
+                               broadcast_epoll_events_max_count, 100);
+        for (int i = 0; i < count; i += 1)
+        {
+            const epoll_event &event = events[i];
+            if (event.data.ptr == &t.listen_fd)
+            {
+                broadcast_accept(t);
+                continue;
+            }
+            if (event.data.ptr == &t.wake_fd)
+            {
+                broadcast_publish(t);
+                continue;
+            }
+
+            auto &s = *static_cast<Broadcast_Subscriber *>(event.data.ptr);
+            // Spectators never send anything, so readable means closed.
+            if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                uint8_t discard[256];
+                ssize_t size = recv(s.fd, discard, sizeof(discard), 0);
+                if (size == 0 ||
+                    (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                     errno != EINTR))
+                {
+                    s.closing = true;
+                }
+            }
+            if ((event.events & EPOLLOUT) && !s.closing)
+            {
+                broadcast_subscriber_send(t, s);
+            }
+        }
+        broadcast_sweep(t);
+    }
+}
+
+void broadcast_server_init(Broadcast_Server &s, const char *address)
+{
+    s = {};
+    Broadcast_Address a;
+    if (!broadcast_parse_address(a, address))
+    {
+        printf("broadcast: can't parse address %s\n", address);
+        return;
+    }
+    broadcast_raise_files_limit();
+
+    sockaddr_storage addr;
+    socklen_t addr_size;
+    int fd = broadcast_socket(a, true, addr, addr_size);
+    if (fd < 0)
+    {
+        printf("broadcast: can't serve on %s\n", address);
+        return;
+    }
+    if (a.unix_socket)
+    {
+        unlink(a.path);
+    }
+    else
+    {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), addr_size) != 0 ||
+        listen(fd, broadcast_listen_backlog) != 0)
+    {
+        printf("broadcast: can't serve on %s: %s\n", address,
+               strerror(errno));
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    auto *t = new Broadcast_Server_Thread();
+    t->address = a;
+    t->listen_fd = fd;
+    t->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    t->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = &t->listen_fd;
+    epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, t->listen_fd, &event);
+    event.data.ptr = &t->wake_fd;
+    epoll_ctl(t->epoll_fd, EPOLL_CTL_ADD, t->wake_fd, &event);
+
+    t->running.store(true, std::memory_order_relaxed);
+    t->thread = std::thread(broadcast_serve, std::ref(*t));
+    s.thread = t;
+    s.active = true;
+    s.snapshot_needed = true;
+    printf("broadcast: serving on %s\n", address);
+}
+
+void broadcast_server_shutdown(Broadcast_Server &s)
+{
+    if (!s.active)
+    {
+        return;
+    }
+    Broadcast_Server_Thread &t = *s.thread;
+    t.running.store(false, std::memory_order_release);
+    uint64_t one = 1;
+    if (write(t.wake_fd, &one, sizeof(one)) < 0)
+    {
+        // The thread still notices within one epoll timeout.
+    }
+    t.thread.join();
+
+    for (int i = 0; i < t.subscribers_count; i += 1)
+    {
+        broadcast_subscriber_close(t, t.subscribers[i]);
+    }
+    delete[] t.subscribers;
+    broadcast_history_clear(t);
+    while (t.free_buffers)
+    {
+        Broadcast_Buffer *b = t.free_buffers;
+        t.free_buffers = b->next_free;
+        delete b;
+    }
+    close(t.listen_fd);
+    close(t.epoll_fd);
+    close(t.wake_fd);
+    if (t.address.unix_socket)
+    {
+        unlink(t.address.path);
+    }
+
+    printf("broadcast: %llu spectators, at most %d at once, %llu dropped for "
+           "falling behind\n",
+           static_cast<unsigned long long>(t.accepted_count),
+           t.subscribers_peak_count,
+           static_cast<unsigned long long>(t.slow_count));
+    printf("broadcast: %.2fMB in %llu sends, %d buffers, %llu messages "
+           "dropped\n",
+           t.sent_bytes_count / (1024.0 * 1024.0),
+           static_cast<unsigned long long>(t.sends_count), t.buffers_count,
+           static_cast<unsigned long long>(s.dropped_messages_count));
+    delete s.thread;
+    s = {};
+}
+
+void broadcast_server_tick(Broadcast_Server &s, const Game &g, uint64_t tick)
+{
+    if (!s.active)
+    {
+        return;
+    }
+    Broadcast_Server_Thread &t = *s.thread;
+    uint32_t head = t.head.load(std::memory_order_relaxed);
+    uint32_t tail = t.tail.load(std::memory_order_acquire);
+    if (head - tail == broadcast_messages_max_count)
+    {
+        // Deltas after a gap are useless, resync everyone.
+        s.dropped_messages_count += 1;
+        s.snapshot_needed = true;
+        return;
+    }
+
+    int32_t values[BROADCAST_FIELD_COUNT];
+    broadcast_quantize(g, values);
+    bool snapshot = s.snapshot_needed || tick != s.next_tick ||
+                    tick % broadcast_snapshot_interval == 0;
+    Broadcast_Message &m = t.messages[head % broadcast_messages_max_count];
+    m.size = broadcast_encode(
+        m.data, snapshot ? BROADCAST_MESSAGE_SNAPSHOT : BROADCAST_MESSAGE_DELTA,
+        static_cast<uint32_t>(tick), broadcast_now_ns(), values,
+        snapshot ? broadcast_zero_values : s.values);
+    memcpy(s.values, values, sizeof(values));
+    s.next_tick = tick + 1;
+    s.snapshot_needed = false;
+    t.head.store(head + 1, std::memory_order_release);
+
+    uint64_t one = 1;
+    if (write(t.wake_fd, &one, sizeof(one)) < 0)
+    {
+        // Only fails when the counter is full, the thread is awake then.
+    }
+}
+
+void broadcast_client_init(Broadcast_Client &c, const char *address)
+{
+    c = {};
+    c.fd = -1;
+    Broadcast_Address a;
+    if (!broadcast_parse_address(a, address))
+    {
+        printf("broadcast: can't parse address %s\n", address);
+        return;
+    }
+    sockaddr_storage addr;
+    socklen_t addr_size;
+    int fd = broadcast_socket(a, false, addr, addr_size);
+    if (fd < 0 ||
+        connect(fd, reinterpret_cast<sockaddr *>(&addr), addr_size) != 0)
+    {
+        printf("broadcast: can't connect to %s\n", address);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return;
+    }
+    broadcast_configure(fd, a.unix_socket);
+    c.fd = fd;
+    c.active = true;
+    printf("broadcast: spectating %s\n", address);
+}
+
+void broadcast_client_shutdown(Broadcast_Client &c)
+{
+    if (c.fd >= 0)
+    {
+        close(c.fd);
+        printf("broadcast: %llu messages, %llu skipped\n",
+               static_cast<unsigned long long>(c.decoder.messages_count),
+               static_cast<unsigned long long>(
+                   c.decoder.skipped_messages_count));
+    }
+    c = {};
+    c.fd = -1;
+}
+
+static Broadcast_Sample &broadcast_sample(Broadcast_Client &c, int i)
+{
+    return c.samples[(c.samples_first + i) % broadcast_samples_max_count];
+}
+
+static void broadcast_client_push(Broadcast_Client &c,
+                                  const Broadcast_Decoder &d)
+{
+    // The server went back in time, a replay seek.
+    if (c.samples_count > 0 &&
+        d.tick <= broadcast_sample(c, c.samples_count - 1).tick)
+    {
+        c.samples_count = 0;
+        c.playing = false;
+    }
+    if (c.samples_count == broadcast_samples_max_count)
+    {
+        c.samples_first = (c.samples_first + 1) % broadcast_samples_max_count;
+        c.samples_count -= 1;
+    }
+    Broadcast_Sample &sample = broadcast_sample(c, c.samples_count);
+    sample.tick = d.tick;
+    broadcast_dequantize(d.values, sample.entities);
+    c.samples_count += 1;
+}
+
+bool broadcast_client_update(Broadcast_Client &c, double delta_time_secs,
+                             Game_Entities &entities)
+{
+    while (c.active)
+    {
+        uint8_t data[4096];
+        ssize_t size = recv(c.fd, data, sizeof(data), 0);
+        if (size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        if (size <= 0 ||
+            !broadcast_decoder_feed(
+                c.decoder, data, static_cast<size_t>(size),
+                [&c](const Broadcast_Decoder &d) {
+                    broadcast_client_push(c, d);
+                }))
+        {
+            // Keep showing the last state.
+            printf("broadcast: lost the server\n");
+            c.active = false;
+        }
+    }
+    if (c.samples_count == 0)
+    {
+        return false;
+    }
+
+    double newest = broadcast_sample(c, c.samples_count - 1).tick;
+    double target = newest - broadcast_interpolation_delay_ticks;
+    if (!c.playing)
+    {
+        c.playback_tick = target;
+        c.playing = true;
+    }
+    else
+    {
+        c.playback_tick += delta_time_secs / game_tick_secs;
+        // Ease towards the target, so neither clock drift nor jitter run
+        // playback dry or let it lag further and further behind.
+        c.playback_tick += (target - c.playback_tick) * 0.02;
+        if (fabs(target - c.playback_tick) >
+            3 * broadcast_interpolation_delay_ticks)
+        {
+            c.playback_tick = target;
+        }
+        c.playback_tick = std::min(c.playback_tick, newest);
+    }
+
+    int i = c.samples_count - 1;
+    while (i > 0 && broadcast_sample(c, i).tick > c.playback_tick)
+    {
+        i -= 1;
+    }
+    const Broadcast_Sample &a = broadcast_sample(c, i);
+    if (i == c.samples_count - 1 || a.tick >= c.playback_tick)
+    {
+        entities = a.entities;
+        return true;
+    }
+    const Broadcast_Sample &b = broadcast_sample(c, i + 1);
+    float t = static_cast<float>((c.playback_tick - a.tick) /
+                                 (b.tick - a.tick));
+    entities = a.entities;
+    entities.ball_position =
+        HMM_LerpV2(a.entities.ball_position, t, b.entities.ball_position);
+    entities.paddle_left_y =
+        HMM_Lerp(a.entities.paddle_left_y, t, b.entities.paddle_left_y);
+    entities.paddle_right_y =
+        HMM_Lerp(a.entities.paddle_right_y, t, b.entities.paddle_right_y);
+    return true;
+}
+
+struct Broadcast_Load_Spectator
+{
+    int fd;
+    Broadcast_Decoder decoder;
+};
+
+int broadcast_load(const char *address, int count, double secs)
+{
+    Broadcast_Address a;
+    if (!broadcast_parse_address(a, address) || count <= 0)
+    {
+        printf("broadcast: can't parse address %s\n", address);
+        return 1;
+    }
+    broadcast_raise_files_limit();
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    auto *spectators = new Broadcast_Load_Spectator[
+        static_cast<size_t>(count)]();
+    int connected_count = 0;
+    for (; connected_count < count; connected_count += 1)
+    {
+        sockaddr_storage addr;
+        socklen_t addr_size;
+        int fd = broadcast_socket(a, false, addr, addr_size);
+        if (fd < 0 ||
+            connect(fd, reinterpret_cast<sockaddr *>(&addr), addr_size) != 0)
+        {
+            printf("broadcast: connecting spectator %d failed: %s\n",
+                   connected_count + 1, strerror(errno));
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            break;
+        }
+        broadcast_configure(fd, a.unix_socket);
+        Broadcast_Load_Spectator &spectator = spectators[connected_count];
+        spectator.fd = fd;
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = &spectator;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+    printf("broadcast: %d spectators connected to %s\n", connected_count,
+           address);
+
+    uint64_t start_ns = broadcast_now_ns();
+    uint64_t report_ns = start_ns;
+    uint64_t end_ns = start_ns + static_cast<uint64_t>(secs * 1e9);
+    int open_count = connected_count;
+    uint64_t messages_count = 0;
+    uint64_t bytes_count = 0;
+    double latency_sum_ms = 0.0;
+    double latency_max_ms = 0.0;
+    epoll_event events[broadcast_epoll_events_max_count];
+    for (;;)
+    {
+        int events_count = epoll_wait(epoll_fd, events,
+                                      broadcast_epoll_events_max_count, 100);
+        uint64_t now_ns = broadcast_now_ns();
+        for (int i = 0; i < events_count; i += 1)
+        {
+            auto &spectator =
+                *static_cast<Broadcast_Load_Spectator *>(events[i].data.ptr);
+            for (;;)
+            {
+                uint8_t data[4096];
+                ssize_t size = recv(spectator.fd, data, sizeof(data), 0);
+                if (size < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    break;
+                }
+                bool ok =
+                    size > 0 &&
+                    broadcast_decoder_feed(
+                        spectator.decoder, data, static_cast<size_t>(size),
+                        [&](const Broadcast_Decoder &d) {
+                            double ms = (now_ns - d.send_time_ns) * 1e-6;
+                            messages_count += 1;
+                            latency_sum_ms += ms;
+                            latency_max_ms = std::max(latency_max_ms, ms);
+                        });
+                if (!ok)
+                {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, spectator.fd, nullptr);
+                    close(spectator.fd);
+                    spectator.fd = -1;
+                    open_count -= 1;
+                    break;
+                }
+                bytes_count += static_cast<uint64_t>(size);
+            }
+        }
+
+        if (now_ns - report_ns >= 1000000000 || now_ns >= end_ns)
+        {
+            double elapsed = (now_ns - report_ns) * 1e-9;
+            uint64_t skipped_count = 0;
+            for (int i = 0; i < connected_count; i += 1)
+            {
+                skipped_count += spectators[i].decoder.skipped_messages_count;
+            }
+            printf("broadcast: %d spectators, %.0f messages/s, %.2fMB/s, "
+                   "latency %.3fms mean %.3fms max, %llu skipped\n",
+                   open_count, messages_count / elapsed,
+                   bytes_count / elapsed / (1024.0 * 1024.0),
+                   messages_count ? latency_sum_ms / messages_count : 0.0,
+                   latency_max_ms,
+                   static_cast<unsigned long long>(skipped_count));
+            report_ns = now_ns;
+            messages_count = 0;
+            bytes_count = 0;
+            latency_sum_ms = 0.0;
+            latency_max_ms = 0.0;
+        }
+        if (now_ns >= end_ns || open_count == 0)
+        {
+            break;
+        }
+    }
+
+    for (int i = 0; i < connected_count; i += 1)
+    {
+        if (spectators[i].fd >= 0)
+        {
+            close(spectators[i].fd);
+        }
+    }
+    delete[] spectators;
+    close(epoll_fd);
+    return connected_count == count && open_count == count ? 0 : 1;
+}
+
+#else
+
+void broadcast_server_init(Broadcast_Server &s, const char *address)
+{
+    (void)address;
+    s = {};
+    printf("broadcast: not supported on this platform\n");
+}
+
+void broadcast_server_shutdown(Broadcast_Server &s)
+{
+    s = {};
+}
+
+void broadcast_server_tick(Broadcast_Server &s, const Game &g, uint64_t tick)
+{
+    (void)s;
+    (void)g;
+    (void)tick;
+}
+
+void broadcast_client_init(Broadcast_Client &c, const char *address)
+{
+    (void)address;
+    c = {};
+    c.fd = -1;
+    printf("broadcast: not supported on this platform\n");
+}
+
+void broadcast_client_shutdown(Broadcast_Client &c)
+{
+    c = {};
+    c.fd = -1;
+}
+
+bool broadcast_client_update(Broadcast_Client &c, double delta_time_secs,
+                             Game_Entities &entities)
+{
+    (void)c;
+    (void)delta_time_secs;
+    (void)entities;
+    return false;
+}
+
+int broadcast_load(const char *address, int count, double secs)
+{
+    (void)address;
+    (void)count;
+    (void)secs;
+    printf("broadcast: not supported on this platform\n");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "game.h"
+#include <cstdint>
+
+// Ticks between full snapshots. Everything in between is a delta against
+// the tick before. A spectator that joins gets the last snapshot and every
+// delta since.
+inline constexpr int broadcast_snapshot_interval = 60;
+// Largest encoded message, header included.
+inline constexpr int broadcast_message_max_size = 64;
+// Messages on their way from the game thread to the server thread. When
+// the server falls further behind, messages are dropped and the next one
+// is sent as a snapshot.
+inline constexpr int broadcast_messages_max_count = 256;
+// Messages a spectator can fall behind before it is disconnected.
+inline constexpr int broadcast_subscriber_queue_count = 256;
+// How far spectators play behind the newest tick they received, to ride
+// out network jitter.
+inline constexpr int broadcast_interpolation_delay_ticks = 6;
+inline constexpr int broadcast_samples_max_count = 64;
+
+// The broadcast entity fields, quantized to integers.
+enum Broadcast_Field
+{
+    BROADCAST_FIELD_BALL_X,
+    BROADCAST_FIELD_BALL_Y,
+    BROADCAST_FIELD_PADDLE_LEFT_Y,
+    BROADCAST_FIELD_PADDLE_RIGHT_Y,
+    BROADCAST_FIELD_SCORE_LEFT,
+    BROADCAST_FIELD_SCORE_RIGHT,
+    BROADCAST_FIELD_COUNT,
+};
+
+// Turns a stream of messages back into entity states. Deltas are only
+// applied on top of the tick right before them, after a gap it waits for
+// the next snapshot.
+struct Broadcast_Decoder
+{
+    int32_t values[BROADCAST_FIELD_COUNT];
+    uint32_t tick;
+    // CLOCK_MONOTONIC nanoseconds when the server queued the last message.
+    uint64_t send_time_ns;
+    bool synced;
+    // The part of the stream that doesn't make up a whole message yet.
+    uint8_t pending[broadcast_message_max_size];
+    int pending_size;
+    uint64_t messages_count;
+    uint64_t skipped_messages_count;
+};
+
+struct Broadcast_Server_Thread;
+
+// Streams the authoritative game to every connected spectator. Encoding
+// happens on the game thread and costs a couple of microseconds a tick,
+// the sockets are all served by one thread on epoll. Linux only.
+struct Broadcast_Server
+{
+    bool active;
+    // The quantized values of the last message, what the next delta is
+    // against.
+    int32_t values[BROADCAST_FIELD_COUNT];
+    // A tick other than this one, after a seek, goes out as a snapshot.
+    uint64_t next_tick;
+    bool snapshot_needed;
+    uint64_t dropped_messages_count;
+    Broadcast_Server_Thread *thread;
+};
+
+struct Broadcast_Sample
+{
+    uint32_t tick;
+    Game_Entities entities;
+};
+
+struct Broadcast_Client
+{
+    bool active;
+    int fd;
+    Broadcast_Decoder decoder;
+    // Oldest first.
+    Broadcast_Sample samples[broadcast_samples_max_count];
+    int samples_first;
+    int samples_count;
+    // Fractional tick being shown.
+    double playback_tick;
+    bool playing;
+};
+
+// Addresses are "tcp:<port>", "tcp:<ipv4 address>:<port>" or
+// "unix:<path>". A server given just a port listens on every interface, a
+// client connects to localhost.
+bool broadcast_parse(const char *address);
+
+void broadcast_server_init(Broadcast_Server &s, const char *address);
+void broadcast_server_shutdown(Broadcast_Server &s);
+// Sends the state after tick to every spectator. Never blocks.
+void broadcast_server_tick(Broadcast_Server &s, const Game &g, uint64_t tick);
+
+void broadcast_client_init(Broadcast_Client &c, const char *address);
+void broadcast_client_shutdown(Broadcast_Client &c);
+// Reads whatever has arrived and advances playback. Returns false while
+// there is nothing to show yet.
+bool broadcast_client_update(Broadcast_Client &c, double delta_time_secs,
+                             Game_Entities &entities);
+
+// Headless load generator. Connects count spectators that decode every
+// message, and prints throughput and latency every second for secs
+// seconds. Returns an exit code.
+int broadcast_load(const char *address, int count, double secs);
@@ -0,0 +1,500 @@
+#include "capture.h"
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// Readback goes through GL pixel pack buffers and fences, which the other
+// backends don't expose through sokol_gfx.
+#if defined(__linux__) && !defined(__ANDROID__)
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#define CAPTURE_GL
+#endif
+
+// How long shutdown waits for each read still in flight.
+static constexpr uint64_t capture_flush_timeout_ns = 1000000000;
+// Stored deflate blocks hold at most this many bytes.
+static constexpr uint32_t capture_deflate_block_max_size = 65535;
+
+struct Capture_Frame
+{
+    // Bottom row first, as GL reads it.
+    uint8_t *pixels;
+    int width;
+    int height;
+    uint64_t index;
+};
+
+struct Capture_Encoder
+{
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    Capture_Frame frames[capture_queue_max_count];
+    int frames_first;
+    int frames_count;
+    bool running;
+
+    Capture_Format format;
+    const char *path;
+    uint32_t crc_table[256];
+    // Y4M only. The size is fixed by the first frame.
+    FILE *file;
+    int file_width;
+    int file_height;
+    uint64_t mismatched_frames_count;
+};
+
+static void capture_put_u32_be(uint8_t *dst, uint32_t value)
+{
+    dst[0] = static_cast<uint8_t>(value >> 24);
+    dst[1] = static_cast<uint8_t>(value >> 16);
+    dst[2] = static_cast<uint8_t>(value >> 8);
+    dst[3] = static_cast<uint8_t>(value);
+}
+
+static uint32_t capture_crc32(const Capture_Encoder &e, uint32_t crc,
+                              const uint8_t *data, size_t size)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i += 1)
+    {
+        crc = e.crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void capture_write_png_chunk(const Capture_Encoder &e, FILE *file,
+                                    const char *type, const uint8_t *data,
+                                    uint32_t size)
+{
+    uint8_t header[8];
+    capture_put_u32_be(header, size);
+    memcpy(header + 4, type, 4);
+    uint32_t crc = capture_crc32(e, 0, header + 4, 4);
+    crc = capture_crc32(e, crc, data, size);
+    uint8_t footer[4];
+    capture_put_u32_be(footer, crc);
+
+    fwrite(header, 1, sizeof(header), file);
+    fwrite(data, 1, size, file);
+    fwrite(footer, 1, sizeof(footer), file);
+}
+
+// Writes an RGB PNG with stored (uncompressed) deflate blocks. Encoding
+// speed matters more here than file size, and the frames stay bit exact for
+// image diffs.
+static void capture_write_png(const Capture_Encoder &e,
+                              const Capture_Frame &frame)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/frame_%06llu.png", e.path,
+             static_cast<unsigned long long>(frame.index));
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        printf("capture: can't open %s\n", path);
+        return;
+    }
+
+    // Filter type 0 (none) in front of every row, rows top to bottom.
+    size_t row_size = static_cast<size_t>(frame.width) * 3 + 1;
+    size_t raw_size = row_size * frame.height;
+    uint8_t *raw = static_cast<uint8_t *>(malloc(raw_size));
+    for (int y = 0; y < frame.height; y += 1)
+    {
+        const uint8_t *src =
+            frame.pixels +
+            static_cast<size_t>(frame.height - 1 - y) * frame.width * 4;
+        uint8_t *dst = raw + row_size * y;
+        dst[0] = 0;
+        for (int x = 0; x < frame.width; x += 1)
+        {
+            dst[1 + x * 3 + 0] = src[x * 4 + 0];
+            dst[1 + x * 3 + 1] = src[x * 4 + 1];
+            dst[1 + x * 3 + 2] = src[x * 4 + 2];
+        }
+    }
+
+    size_t blocks_count = (raw_size + capture_deflate_block_max_size - 1) /
+                          capture_deflate_block_max_size;
+    size_t zlib_size = 2 + raw_size + blocks_count * 5 + 4;
+    uint8_t *zlib = static_cast<uint8_t *>(malloc(zlib_size));
+    uint8_t *dst = zlib;
+    *dst++ = 0x78;
+    *dst++ = 0x01;
+    uint32_t adler_a = 1;
+    uint32_t adler_b = 0;
+    for (size_t offset = 0; offset < raw_size;)
+    {
+        size_t size = raw_size - offset;
+        if (size > capture_deflate_block_max_size)
+        {
+            size = capture_deflate_block_max_size;
+        }
+        bool last = offset + size == raw_size;
+        *dst++ = last ? 1 : 0;
+        *dst++ = static_cast<uint8_t>(size);
+        *dst++ = static_cast<uint8_t>(size >> 8);
+        *dst++ = static_cast<uint8_t>(~size);
+        *dst++ = static_cast<uint8_t>(~size >> 8);
+        memcpy(dst, raw + offset, size);
+        for (size_t i = 0; i < size; i += 1)
+        {
+            adler_a = (adler_a + dst[i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+        dst += size;
+        offset += size;
+    }
+    capture_put_u32_be(dst, (adler_b << 16) | adler_a);
+
+    static constexpr uint8_t signature[] = {0x89, 'P',  'N',  'G',
+                                            '\r', '\n', 0x1a, '\n'};
+    uint8_t ihdr[13] = {};
+    capture_put_u32_be(ihdr, static_cast<uint32_t>(frame.width));
+    capture_put_u32_be(ihdr + 4, static_cast<uint32_t>(frame.height));
+    ihdr[8] = 8; // Bit depth.
+    ihdr[9] = 2; // Truecolor.
+
+    fwrite(signature, 1, sizeof(signature), file);
+    capture_write_png_chunk(e, file, "IHDR", ihdr, sizeof(ihdr));
+    capture_write_png_chunk(e, file, "IDAT", zlib,
+                            static_cast<uint32_t>(zlib_size));
+    capture_write_png_chunk(e, file, "IEND", nullptr, 0);
+    fclose(file);
+
+    free(zlib);
+    free(raw);
+}
+
+// Converts to limited range BT.601 4:4:4, which keeps full chroma
+// resolution for the thin bright edges the bloom produces.
+static void capture_write_y4m(Capture_Encoder &e, const Capture_Frame &frame)
+{
+    if (!e.file)
+    {
+        e.file = fopen(e.path, "wb");
+        if (!e.file)
+        {
+            printf("capture: can't open %s\n", e.path);
+            return;
+        }
+        e.file_width = frame.width;
+        e.file_height = frame.height;
+        fprintf(e.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+                frame.width, frame.height, capture_frames_per_sec);
+    }
+    if (frame.width != e.file_width || frame.height != e.file_height)
+    {
+        e.mismatched_frames_count += 1;
+        return;
+    }
+
+    size_t plane_size = static_cast<size_t>(frame.width) * frame.height;
+    uint8_t *planes = static_cast<uint8_t *>(malloc(plane_size * 3));
+    uint8_t *y_plane = planes;
+    uint8_t *u_plane = planes + plane_size;
+    uint8_t *v_plane = planes + plane_size * 2;
+    for (int y = 0; y < frame.height; y += 1)
+    {
+        const uint8_t *src =
+            frame.pixels +
+            static_cast<size_t>(frame.height - 1 - y) * frame.width * 4;
+        size_t row = static_cast<size_t>(y) * frame.width;
+        for (int x = 0; x < frame.width; x += 1)
+        {
+            int r = src[x * 4 + 0];
+            int g = src[x * 4 + 1];
+            int b = src[x * 4 + 2];
+            y_plane[row + x] = static_cast<uint8_t>(
+                ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            u_plane[row + x] = static_cast<uint8_t>(
+                ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v_plane[row + x] = static_cast<uint8_t>(
+                ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    fputs("FRAME\n", e.file);
+    fwrite(planes, 1, plane_size * 3, e.file);
+    free(planes);
+}
+
+static void capture_encoder_main(Capture_Encoder *e)
+{
+    while (true)
+    {
+        Capture_Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(e->mutex);
+            auto has_work = [e]()
+            { return e->frames_count > 0 || !e->running; };
+            e->cond.wait(lock, has_work);
+            if (e->frames_count == 0)
+            {
+                break;
+            }
+            frame = e->frames[e->frames_first];
+            e->frames_first = (e->frames_first + 1) % capture_queue_max_count;
+            e->frames_count -= 1;
+        }
+
+        if (e->format == CAPTURE_FORMAT_PNG)
+        {
+            capture_write_png(*e, frame);
+        }
+        else
+        {
+            capture_write_y4m(*e, frame);
+        }
+        free(frame.pixels);
+    }
+}
+
+static bool capture_encoder_push(Capture_Encoder &e,
+                                 const Capture_Frame &frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(e.mutex);
+        if (e.frames_count == capture_queue_max_count)
+        {
+            return false;
+        }
+        int index =
+            (e.frames_first + e.frames_count) % capture_queue_max_count;
+        e.frames[index] = frame;
+        e.frames_count += 1;
+    }
+    e.cond.notify_one();
+    return true;
+}
+
+bool capture_parse(Capture &c, const char *spec)
+{
+    if (strncmp(spec, "png:", 4) == 0)
+    {
+        c.format = CAPTURE_FORMAT_PNG;
+    }
+    else if (strncmp(spec, "y4m:", 4) == 0)
+    {
+        c.format = CAPTURE_FORMAT_Y4M;
+    }
+    else
+    {
+        return false;
+    }
+    c.path = spec + 4;
+    return c.path[0] != '\0';
+}
+
+#if defined(CAPTURE_GL)
+// Hands the completed reads to the encoder, oldest first. Stops at the first
+// read that hasn't completed unless wait is set.
+static void capture_poll(Capture &c, bool wait)
+{
+    while (c.staging_count > 0)
+    {
+        auto &s = c.staging[c.staging_first];
+        GLsync fence = static_cast<GLsync>(s.fence);
+        GLenum status =
+            wait ? glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                    capture_flush_timeout_ns)
+                 : glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED && !wait)
+        {
+            break;
+        }
+        glDeleteSync(fence);
+        s.fence = nullptr;
+
+        bool delivered = false;
+        if (status == GL_ALREADY_SIGNALED ||
+            status == GL_CONDITION_SATISFIED)
+        {
+            size_t size = static_cast<size_t>(s.width) * s.height * 4;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+            const void *data = glMapBufferRange(
+                GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(size),
+                GL_MAP_READ_BIT);
+            if (data)
+            {
+                Capture_Frame frame = {};
+                frame.pixels = static_cast<uint8_t *>(malloc(size));
+                frame.width = s.width;
+                frame.height = s.height;
+                frame.index = s.frame_index;
+                memcpy(frame.pixels, data, size);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+                delivered = capture_encoder_push(*c.encoder, frame);
+                if (!delivered)
+                {
+                    free(frame.pixels);
+                }
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        if (!delivered)
+        {
+            c.frames_dropped_count += 1;
+        }
+
+        c.staging_first = (c.staging_first + 1) % capture_staging_count;
+        c.staging_count -= 1;
+    }
+}
+#endif
+
+void capture_init(Capture &c, int frames_max)
+{
+    if (c.format == CAPTURE_FORMAT_NONE)
+    {
+        return;
+    }
+
+#if defined(CAPTURE_GL)
+    if (sg_query_backend() == SG_BACKEND_GLCORE)
+    {
+        glGenFramebuffers(1, &c.fbo);
+        for (auto &s : c.staging)
+        {
+            glGenBuffers(1, &s.pbo);
+        }
+
+        c.encoder = new Capture_Encoder();
+        c.encoder->format = c.format;
+        c.encoder->path = c.path;
+        c.encoder->running = true;
+        for (uint32_t i = 0; i < 256; i += 1)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit += 1)
+            {
+                crc = (crc & 1) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+            }
+            c.encoder->crc_table[i] = crc;
+        }
+        c.encoder->thread = std::thread(capture_encoder_main, c.encoder);
+
+        c.frames_max = frames_max;
+        c.active = true;
+        printf("capture: writing %s to %s\n",
+               c.format == CAPTURE_FORMAT_PNG ? "png" : "y4m", c.path);
+        return;
+    }
+#endif
+
+    printf("capture: not supported on this backend\n");
+}
+
+void capture_shutdown(Capture &c)
+{
+    if (!c.active)
+    {
+        return;
+    }
+
+#if defined(CAPTURE_GL)
+    capture_poll(c, true);
+    for (auto &s : c.staging)
+    {
+        glDeleteBuffers(1, &s.pbo);
+    }
+    glDeleteFramebuffers(1, &c.fbo);
+    sg_reset_state_cache();
+#endif
+
+    {
+        std::lock_guard<std::mutex> lock(c.encoder->mutex);
+        c.encoder->running = false;
+    }
+    c.encoder->cond.notify_all();
+    c.encoder->thread.join();
+
+    if (c.encoder->file)
+    {
+        fclose(c.encoder->file);
+    }
+    if (c.encoder->mismatched_frames_count > 0)
+    {
+        printf("capture: skipped %llu frames that changed size\n",
+               static_cast<unsigned long long>(
+                   c.encoder->mismatched_frames_count));
+    }
+    printf("capture: %llu frames, %llu dropped\n",
+           static_cast<unsigned long long>(c.frames_count),
+           static_cast<unsigned long long>(c.frames_dropped_count));
+
+    delete c.encoder;
+    c.encoder = nullptr;
+    c.active = false;
+}
+
+void capture_frame(Capture &c, sg_image img, int width, int height)
+{
+    if (!c.active)
+    {
+        return;
+    }
+
+#if defined(CAPTURE_GL)
+    capture_poll(c, false);
+
+    if (!capture_done(c))
+    {
+        if (c.staging_count == capture_staging_count)
+        {
+            // The GPU is more than capture_staging_count frames behind.
+            c.frames_dropped_count += 1;
+        }
+        else
+        {
+            int index =
+                (c.staging_first + c.staging_count) % capture_staging_count;
+            auto &s = c.staging[index];
+            sg_gl_image_info info = sg_gl_query_image_info(img);
+
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, c.fbo);
+            glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, info.tex[info.active_slot],
+                                   0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+            if (s.width != width || s.height != height)
+            {
+                glBufferData(GL_PIXEL_PACK_BUFFER,
+                             static_cast<GLsizeiptr>(width) * height * 4,
+                             nullptr, GL_STREAM_READ);
+                s.width = width;
+                s.height = height;
+            }
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                         nullptr);
+            s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            s.frame_index = c.frames_count;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+            c.staging_count += 1;
+            c.frames_count += 1;
+        }
+    }
+
+    // sokol_gfx caches GL state, and it doesn't know about any of the above.
+    sg_reset_state_cache();
+#else
+    (void)img;
+    (void)width;
+    (void)height;
+#endif
+}
+
+bool capture_done(const Capture &c)
+{
+    return c.frames_max > 0 &&
+           c.frames_count >= static_cast<uint64_t>(c.frames_max);
+}
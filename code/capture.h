@@ -0,0 +1,70 @@
+#pragma once
+
+#include "sokol_gfx.h"
+#include <cstdint>
+
+// Frames in flight between issuing a read and mapping its result. The GPU
+// gets this many frames to finish the copy before the frame is dropped.
+inline constexpr int capture_staging_count = 3;
+// Frames waiting for the encoder thread. Frames are dropped, not waited
+// on, when it falls further behind than this.
+inline constexpr int capture_queue_max_count = 8;
+// While capturing, every frame steps the game by 1 / capture_frames_per_sec
+// seconds, whatever the display's refresh rate, so the video plays back at
+// the speed the game ran.
+inline constexpr int capture_frames_per_sec = 60;
+
+enum Capture_Format
+{
+    CAPTURE_FORMAT_NONE,
+    // One PNG per frame in a directory, for image-diff regression tests.
+    CAPTURE_FORMAT_PNG,
+    // Uncompressed 4:4:4 YUV video in a single file.
+    CAPTURE_FORMAT_Y4M,
+};
+
+// A GL pixel pack buffer the display image is copied into, with the fence
+// that tells when the copy has finished.
+struct Capture_Staging
+{
+    uint32_t pbo;
+    void *fence;
+    int width;
+    int height;
+    uint64_t frame_index;
+};
+
+struct Capture_Encoder;
+
+struct Capture
+{
+    Capture_Format format;
+    const char *path;
+    // Stops capturing after this many frames, 0 captures until exit.
+    int frames_max;
+    bool active;
+    uint32_t fbo;
+    Capture_Staging staging[capture_staging_count];
+    // In flight reads, oldest first.
+    int staging_first;
+    int staging_count;
+    uint64_t frames_count;
+    uint64_t frames_dropped_count;
+    Capture_Encoder *encoder;
+};
+
+// Parses a capture spec, "png:<directory>" or "y4m:<file>". The spec string
+// has to outlive the capture.
+bool capture_parse(Capture &c, const char *spec);
+// Starts the encoder thread. Only works on the GL backend, anywhere else it
+// logs that capture is unsupported and leaves the capture inactive.
+void capture_init(Capture &c, int frames_max);
+// Waits for the reads still in flight and for the encoder to write out
+// every queued frame.
+void capture_shutdown(Capture &c);
+// Copies the top left width x height part of img into a staging buffer and
+// hands the reads issued in earlier frames that have completed by now to the
+// encoder. Never waits on the GPU.
+void capture_frame(Capture &c, sg_image img, int width, int height);
+// True once frames_max frames have been captured.
+bool capture_done(const Capture &c);
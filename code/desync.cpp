@@ -0,0 +1,228 @@
+#include "desync.h"
+#include "file_map.h"
+#include "game.h"
+#include "input.h"
+#include "jobs.h"
+#include "renderer.h"
+#include "replay.h"
+#include "sokol_time.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Rows of hashes in the native byte order: the chain of every game_hash()
+// so far, then the hash of each field. Every platform the game runs on is
+// little endian.
+static constexpr char desync_trace_magic[4] = {'P', '3', 'D', 'T'};
+static constexpr uint32_t desync_trace_version = 1;
+// Magic, version, fields count and padding to keep the rows aligned.
+static constexpr size_t desync_trace_header_size = 16;
+static constexpr int desync_trace_row_count = 1 + GAME_HASH_FIELD_COUNT;
+
+// State differences can heal, a paddle that drifted is snapped back when it
+// hits a boundary. Chained hashes can't, once two chains differ they keep
+// differing, which is what lets desync_bisect() bisect.
+static uint64_t desync_chain(uint64_t chain, uint64_t hash)
+{
+    chain = (chain ^ hash) * 0x9e3779b97f4a7c15ull;
+    return chain ^ (chain >> 29);
+}
+
+int desync_trace(const char *replay_path, const char *trace_path)
+{
+    Replay_Reader replay;
+    if (!replay_reader_open(replay, replay_path))
+    {
+        return 1;
+    }
+    FILE *file = fopen(trace_path, "wb");
+    if (!file)
+    {
+        printf("desync: can't open %s\n", trace_path);
+        replay_reader_close(replay);
+        return 1;
+    }
+    uint32_t header[desync_trace_header_size / 4] = {};
+    memcpy(header, desync_trace_magic, 4);
+    header[1] = desync_trace_version;
+    header[2] = GAME_HASH_FIELD_COUNT;
+    fwrite(header, sizeof(header), 1, file);
+
+    // Nothing is drawn. The sim's aspect ratio comes with the recorded
+    // state, not from the framebuffer.
+    auto *renderer = static_cast<Renderer *>(calloc(1, sizeof(Renderer)));
+    Input input = {};
+    input_init(input);
+    Job_System jobs;
+    jobs_init(jobs, 0);
+    auto *game = static_cast<Game *>(calloc(1, sizeof(Game)));
+    game_init(*game, input, *renderer, jobs, replay.seed,
+              game_default_config());
+
+    auto &controller = input.controllers[0];
+    uint64_t tick =
+        replay_reader_seek(replay, *game, 0, controller.last_state);
+    uint64_t desync_tick = replay.ticks_count;
+    uint64_t start_time = stm_now();
+    uint64_t hash_ticks = 0;
+    uint64_t chain = 0;
+    while (replay_reader_next(replay, controller.current_state))
+    {
+        game_tick(*game, tick);
+        input_update(input);
+        game->events_count = 0;
+
+        uint64_t hash_time = stm_now();
+        uint64_t hash = game_hash(*game);
+        hash_ticks += stm_since(hash_time);
+        uint64_t row[desync_trace_row_count];
+        chain = desync_chain(chain, hash);
+        row[0] = chain;
+        game_hash_fields(*game, row + 1);
+        fwrite(row, sizeof(row), 1, file);
+
+        if (desync_tick == replay.ticks_count &&
+            hash != replay_reader_hash(replay, tick))
+        {
+            desync_tick = tick;
+        }
+        tick += 1;
+    }
+    double secs = stm_sec(stm_since(start_time));
+    fclose(file);
+
+    printf("desync: traced %llu ticks in %.1fms, %.2fms of it hashing\n",
+           static_cast<unsigned long long>(tick), secs * 1000.0,
+           stm_ms(hash_ticks));
+    if (desync_tick < replay.ticks_count)
+    {
+        printf("desync: differs from the recording from tick %llu\n",
+               static_cast<unsigned long long>(desync_tick));
+    }
+    else
+    {
+        printf("desync: matches the recording\n");
+    }
+
+    game_shutdown(*game);
+    free(game);
+    jobs_shutdown(jobs);
+    free(renderer);
+    replay_reader_close(replay);
+    return 0;
+}
+
+static bool desync_open_trace(File_Map &map, const char *path)
+{
+    if (!file_map_open(map, path))
+    {
+        printf("desync: can't open %s\n", path);
+        return false;
+    }
+    uint32_t header[desync_trace_header_size / 4] = {};
+    if (map.size >= desync_trace_header_size)
+    {
+        memcpy(header, map.data, sizeof(header));
+    }
+    if (memcmp(header, desync_trace_magic, 4) != 0 ||
+        header[1] != desync_trace_version ||
+        header[2] != GAME_HASH_FIELD_COUNT)
+    {
+        printf("desync: %s is not a trace of this version\n", path);
+        file_map_close(map);
+        return false;
+    }
+    return true;
+}
+
+static const uint64_t *desync_trace_row(const File_Map &map, uint64_t tick)
+{
+    const auto *rows = reinterpret_cast<const uint64_t *>(
+        map.data + desync_trace_header_size);
+    return rows + tick * desync_trace_row_count;
+}
+
+static uint64_t desync_trace_ticks_count(const File_Map &map)
+{
+    return (map.size - desync_trace_header_size) /
+           (sizeof(uint64_t) * desync_trace_row_count);
+}
+
+int desync_bisect(const char *traces)
+{
+    const char *comma = strchr(traces, ',');
+    if (!comma)
+    {
+        printf("desync: expected two traces, <a>,<b>\n");
+        return 1;
+    }
+    char path_a[1024];
+    snprintf(path_a, sizeof(path_a), "%.*s", static_cast<int>(comma - traces),
+             traces);
+    const char *path_b = comma + 1;
+
+    File_Map a;
+    File_Map b;
+    if (!desync_open_trace(a, path_a))
+    {
+        return 1;
+    }
+    if (!desync_open_trace(b, path_b))
+    {
+        file_map_close(a);
+        return 1;
+    }
+
+    uint64_t ticks_count =
+        std::min(desync_trace_ticks_count(a), desync_trace_ticks_count(b));
+    auto differs = [&](uint64_t tick)
+    { return desync_trace_row(a, tick)[0] != desync_trace_row(b, tick)[0]; };
+
+    int result = 0;
+    if (ticks_count == 0 || !differs(ticks_count - 1))
+    {
+        printf("desync: the traces match for %llu ticks\n",
+               static_cast<unsigned long long>(ticks_count));
+    }
+    else
+    {
+        // Only the rows the bisection visits are read in.
+        uint64_t first = 0;
+        uint64_t last = ticks_count - 1;
+        int steps = 0;
+        while (first < last)
+        {
+            uint64_t middle = first + (last - first) / 2;
+            if (differs(middle))
+            {
+                last = middle;
+            }
+            else
+            {
+                first = middle + 1;
+            }
+            steps += 1;
+        }
+
+        printf("desync: first differing tick %llu of %llu, found in %d "
+               "steps\n",
+               static_cast<unsigned long long>(first),
+               static_cast<unsigned long long>(ticks_count), steps);
+        const uint64_t *row_a = desync_trace_row(a, first);
+        const uint64_t *row_b = desync_trace_row(b, first);
+        for (int i = 0; i < GAME_HASH_FIELD_COUNT; i += 1)
+        {
+            if (row_a[1 + i] != row_b[1 + i])
+            {
+                printf("  %s\n",
+                       game_hash_field_name(static_cast<Game_Hash_Field>(i)));
+            }
+        }
+        result = 1;
+    }
+
+    file_map_close(a);
+    file_map_close(b);
+    return result;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Headless tools for finding where two builds, or two configurations of
+// one build, stop simulating the same game. Both return an exit code.
+
+// Plays a replay with this build and writes the hash of every
+// Game_Hash_Field after every tick to trace_path. Also reports the first
+// tick that differs from the hashes recorded in the replay.
+int desync_trace(const char *replay_path, const char *trace_path);
+// Bisects two traces of the same replay, given as "<a>,<b>", for the first
+// tick where they differ and prints the fields that differ there.
+int desync_bisect(const char *traces);
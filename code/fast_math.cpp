@@ -0,0 +1,551 @@
+#include "fast_math.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// This file is built with floating point contraction off, a fused a * b + c
+// rounds differently and would make the results depend on the target.
+
+static constexpr float fast_two_over_pi = 0.636619772367581343f;
+// pi/2 in 4 parts, Cody and Waite. The first three have at most 12 bits,
+// so multiplying them by a quadrant below 2^12 is exact and even inputs
+// right next to a multiple of pi/2 keep their bits.
+static constexpr float fast_pio2_1 = 1.5703125f;
+static constexpr float fast_pio2_2 = 4.837512969970703125e-4f;
+static constexpr float fast_pio2_3 = 7.54953362047672271729e-8f;
+static constexpr float fast_pio2_4 = 2.56334406825708960298e-12f;
+// Adding and subtracting 1.5 * 2^23 rounds to the nearest integer, which
+// ends up in the low mantissa bits of the sum.
+static constexpr float fast_round_magic = 12582912.0f;
+
+// sin(r) = r + r^3 (s1 + s2 r^2 + s3 r^4) on [-pi/4, pi/4].
+static constexpr float fast_sin_1 = -1.6666654611e-1f;
+static constexpr float fast_sin_2 = 8.3321608736e-3f;
+static constexpr float fast_sin_3 = -1.9515295891e-4f;
+// cos(r) = 1 - r^2 / 2 + r^4 (c1 + c2 r^2 + c3 r^4) on [-pi/4, pi/4].
+static constexpr float fast_cos_1 = 4.166664568298827e-2f;
+static constexpr float fast_cos_2 = -1.388731625493765e-3f;
+static constexpr float fast_cos_3 = 2.443315711809948e-5f;
+
+static Fast_Math_Mode fast_math_current_mode = FAST_MATH_MODE_FAST;
+
+void fast_math_set_mode(Fast_Math_Mode mode)
+{
+    fast_math_current_mode = mode;
+}
+
+Fast_Math_Mode fast_math_mode()
+{
+    return fast_math_current_mode;
+}
+
+bool fast_math_parse(const char *name, Fast_Math_Mode &mode)
+{
+    if (strcmp(name, "fast") == 0)
+    {
+        mode = FAST_MATH_MODE_FAST;
+        return true;
+    }
+    if (strcmp(name, "libm") == 0)
+    {
+        mode = FAST_MATH_MODE_LIBM;
+        return true;
+    }
+    return false;
+}
+
+// The SIMD forms below repeat these exact operations lane by lane.
+static inline void fast_sincos_kernel(float x, float &s, float &c)
+{
+    float biased = x * fast_two_over_pi + fast_round_magic;
+    float q = biased - fast_round_magic;
+    uint32_t quadrant;
+    memcpy(&quadrant, &biased, sizeof(quadrant));
+
+    float r = x - q * fast_pio2_1;
+    r = r - q * fast_pio2_2;
+    r = r - q * fast_pio2_3;
+    r = r - q * fast_pio2_4;
+    float r2 = r * r;
+    float ps =
+        r + r * r2 * (fast_sin_1 + r2 * (fast_sin_2 + r2 * fast_sin_3));
+    float pc = 1.0f - 0.5f * r2 +
+               r2 * r2 * (fast_cos_1 + r2 * (fast_cos_2 + r2 * fast_cos_3));
+
+    // Quadrant 1 is (cos, -sin), 2 is (-sin, -cos) and 3 is (-cos, sin).
+    bool swap = (quadrant & 1) != 0;
+    float sv = swap ? pc : ps;
+    float cv = swap ? ps : pc;
+    uint32_t bits;
+    memcpy(&bits, &sv, sizeof(bits));
+    bits ^= (quadrant & 2) << 30;
+    memcpy(&s, &bits, sizeof(s));
+    memcpy(&bits, &cv, sizeof(bits));
+    bits ^= ((quadrant + 1) & 2) << 30;
+    memcpy(&c, &bits, sizeof(c));
+}
+
+float fast_sin(float x)
+{
+    if (fast_math_current_mode == FAST_MATH_MODE_LIBM)
+    {
+        return sinf(x);
+    }
+    float s, c;
+    fast_sincos_kernel(x, s, c);
+    return s;
+}
+
+float fast_cos(float x)
+{
+    if (fast_math_current_mode == FAST_MATH_MODE_LIBM)
+    {
+        return cosf(x);
+    }
+    float s, c;
+    fast_sincos_kernel(x, s, c);
+    return c;
+}
+
+void fast_sincos(float x, float &s, float &c)
+{
+    if (fast_math_current_mode == FAST_MATH_MODE_LIBM)
+    {
+        s = sinf(x);
+        c = cosf(x);
+        return;
+    }
+    fast_sincos_kernel(x, s, c);
+}
+
+float fast_tan(float x)
+{
+    if (fast_math_current_mode == FAST_MATH_MODE_LIBM)
+    {
+        return tanf(x);
+    }
+    float s, c;
+    fast_sincos_kernel(x, s, c);
+    return s / c;
+}
+
+#if defined(SIMD_SSE2)
+
+static inline void fast_sincos_kernel4(F32x4 x, F32x4 &s, F32x4 &c)
+{
+    F32x4 magic = f32x4_set1(fast_round_magic);
+    F32x4 biased =
+        f32x4_add(f32x4_mul(x, f32x4_set1(fast_two_over_pi)), magic);
+    F32x4 q = f32x4_sub(biased, magic);
+    __m128i quadrant = _mm_castps_si128(biased);
+
+    F32x4 r = f32x4_sub(x, f32x4_mul(q, f32x4_set1(fast_pio2_1)));
+    r = f32x4_sub(r, f32x4_mul(q, f32x4_set1(fast_pio2_2)));
+    r = f32x4_sub(r, f32x4_mul(q, f32x4_set1(fast_pio2_3)));
+    r = f32x4_sub(r, f32x4_mul(q, f32x4_set1(fast_pio2_4)));
+    F32x4 r2 = f32x4_mul(r, r);
+    F32x4 ps = f32x4_mul(r2, f32x4_set1(fast_sin_3));
+    ps = f32x4_mul(r2, f32x4_add(f32x4_set1(fast_sin_2), ps));
+    ps = f32x4_add(f32x4_set1(fast_sin_1), ps);
+    ps = f32x4_add(r, f32x4_mul(f32x4_mul(r, r2), ps));
+    F32x4 pc = f32x4_mul(r2, f32x4_set1(fast_cos_3));
+    pc = f32x4_mul(r2, f32x4_add(f32x4_set1(fast_cos_2), pc));
+    pc = f32x4_add(f32x4_set1(fast_cos_1), pc);
+    pc = f32x4_add(
+        f32x4_sub(f32x4_set1(1.0f), f32x4_mul(f32x4_set1(0.5f), r2)),
+        f32x4_mul(f32x4_mul(r2, r2), pc));
+
+    __m128i one = _mm_set1_epi32(1);
+    __m128i two = _mm_set1_epi32(2);
+    F32x4 swap = _mm_castsi128_ps(
+        _mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+    F32x4 sv = _mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps));
+    F32x4 cv = _mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc));
+    __m128i sin_sign = _mm_slli_epi32(_mm_and_si128(quadrant, two), 30);
+    __m128i cos_sign = _mm_slli_epi32(
+        _mm_and_si128(_mm_add_epi32(quadrant, one), two), 30);
+    s = _mm_xor_ps(sv, _mm_castsi128_ps(sin_sign));
+    c = _mm_xor_ps(cv, _mm_castsi128_ps(cos_sign));
+}
+
+static inline F32x4 fast_div4(F32x4 a, F32x4 b)
+{
+    return _mm_div_ps(a, b);
+}
+
+#elif defined(SIMD_NEON)
+
+static inline void fast_sincos_kernel4(F32x4 x, F32x4 &s, F32x4 &c)
+{
+    F32x4 magic = f32x4_set1(fast_round_magic);
+    F32x4 biased =
+        f32x4_add(f32x4_mul(x, f32x4_set1(fast_two_over_pi)), magic);
+    F32x4 q = f32x4_sub(biased, magic);
+    uint32x4_t quadrant = vreinterpretq_u32_f32(biased);
+
+    F32x4 r = f32x4_sub(x, f32x4_mul(q, f32x4_set1(fast_pio2_1)));
+    r = f32x4_sub(r, f32x4_mul(q, f32x4_set1(fast_pio2_2)));
+    r = f32x4_sub(r, f32x4_mul(q, f32x4_set1(fast_pio2_3)));
+    r = f32x4_sub(r, f32x4_mul(q, f32x4_set1(fast_pio2_4)));
+    F32x4 r2 = f32x4_mul(r, r);
+    F32x4 ps = f32x4_mul(r2, f32x4_set1(fast_sin_3));
+    ps = f32x4_mul(r2, f32x4_add(f32x4_set1(fast_sin_2), ps));
+    ps = f32x4_add(f32x4_set1(fast_sin_1), ps);
+    ps = f32x4_add(r, f32x4_mul(f32x4_mul(r, r2), ps));
+    F32x4 pc = f32x4_mul(r2, f32x4_set1(fast_cos_3));
+    pc = f32x4_mul(r2, f32x4_add(f32x4_set1(fast_cos_2), pc));
+    pc = f32x4_add(f32x4_set1(fast_cos_1), pc);
+    pc = f32x4_add(
+        f32x4_sub(f32x4_set1(1.0f), f32x4_mul(f32x4_set1(0.5f), r2)),
+        f32x4_mul(f32x4_mul(r2, r2), pc));
+
+    uint32x4_t one = vdupq_n_u32(1);
+    uint32x4_t two = vdupq_n_u32(2);
+    uint32x4_t swap = vtstq_u32(quadrant, one);
+    F32x4 sv = vbslq_f32(swap, pc, ps);
+    F32x4 cv = vbslq_f32(swap, ps, pc);
+    uint32x4_t sin_sign = vshlq_n_u32(vandq_u32(quadrant, two), 30);
+    uint32x4_t cos_sign =
+        vshlq_n_u32(vandq_u32(vaddq_u32(quadrant, one), two), 30);
+    s = vreinterpretq_f32_u32(
+        veorq_u32(vreinterpretq_u32_f32(sv), sin_sign));
+    c = vreinterpretq_f32_u32(
+        veorq_u32(vreinterpretq_u32_f32(cv), cos_sign));
+}
+
+static inline F32x4 fast_div4(F32x4 a, F32x4 b)
+{
+#if defined(__aarch64__) || defined(_M_ARM64)
+    return vdivq_f32(a, b);
+#else
+    alignas(16) float fa[4];
+    alignas(16) float fb[4];
+    f32x4_store(fa, a);
+    f32x4_store(fb, b);
+    for (int i = 0; i < 4; i += 1)
+    {
+        fa[i] /= fb[i];
+    }
+    return f32x4_load(fa);
+#endif
+}
+
+#else
+
+static inline void fast_sincos_kernel4(F32x4 x, F32x4 &s, F32x4 &c)
+{
+    for (int i = 0; i < 4; i += 1)
+    {
+        fast_sincos_kernel(x.e[i], s.e[i], c.e[i]);
+    }
+}
+
+static inline F32x4 fast_div4(F32x4 a, F32x4 b)
+{
+    return {{a.e[0] / b.e[0], a.e[1] / b.e[1], a.e[2] / b.e[2],
+             a.e[3] / b.e[3]}};
+}
+
+#endif
+
+F32x4 fast_sin4(F32x4 x)
+{
+    F32x4 s, c;
+    fast_sincos_kernel4(x, s, c);
+    return s;
+}
+
+F32x4 fast_cos4(F32x4 x)
+{
+    F32x4 s, c;
+    fast_sincos_kernel4(x, s, c);
+    return c;
+}
+
+void fast_sincos4(F32x4 x, F32x4 &s, F32x4 &c)
+{
+    fast_sincos_kernel4(x, s, c);
+}
+
+F32x4 fast_tan4(F32x4 x)
+{
+    F32x4 s, c;
+    fast_sincos_kernel4(x, s, c);
+    return fast_div4(s, c);
+}
+
+F32x8 fast_sin8(F32x8 x)
+{
+    F32x8 s, c;
+    fast_sincos8(x, s, c);
+    return s;
+}
+
+F32x8 fast_cos8(F32x8 x)
+{
+    F32x8 s, c;
+    fast_sincos8(x, s, c);
+    return c;
+}
+
+void fast_sincos8(F32x8 x, F32x8 &s, F32x8 &c)
+{
+    fast_sincos_kernel4(x.lo, s.lo, c.lo);
+    fast_sincos_kernel4(x.hi, s.hi, c.hi);
+}
+
+F32x8 fast_tan8(F32x8 x)
+{
+    F32x8 s, c;
+    fast_sincos8(x, s, c);
+    return {fast_div4(s.lo, c.lo), fast_div4(s.hi, c.hi)};
+}
+
+// Largest error seen for one function over one range.
+struct Fast_Math_Error
+{
+    double max_ulp;
+    float max_ulp_x;
+    double max_abs;
+};
+
+static double fast_math_ulp(double reference)
+{
+    int exponent;
+    frexp(static_cast<double>(static_cast<float>(reference)), &exponent);
+    // Denormals all have the same spacing.
+    return ldexp(1.0, exponent - 24 < -149 ? -149 : exponent - 24);
+}
+
+static void fast_math_measure(Fast_Math_Error &e, float x, float value,
+                              double reference)
+{
+    double error = fabs(static_cast<double>(value) - reference);
+    double ulp = error / fast_math_ulp(reference);
+    if (ulp > e.max_ulp)
+    {
+        e.max_ulp = ulp;
+        e.max_ulp_x = x;
+    }
+    if (error > e.max_abs)
+    {
+        e.max_abs = error;
+    }
+}
+
+enum Fast_Math_Function
+{
+    FAST_MATH_FUNCTION_SIN,
+    FAST_MATH_FUNCTION_COS,
+    FAST_MATH_FUNCTION_TAN,
+    FAST_MATH_FUNCTION_COUNT,
+};
+
+static const char *fast_math_function_names[FAST_MATH_FUNCTION_COUNT] = {
+    "sin",
+    "cos",
+    "tan",
+};
+
+// Runs 8 inputs through every width, checks they agree bit for bit and
+// measures against double precision. Returns the number of mismatches.
+static int fast_math_check8(const float *x, Fast_Math_Error *errors)
+{
+    alignas(16) float s8[8];
+    alignas(16) float c8[8];
+    alignas(16) float t8[8];
+    F32x8 v = {f32x4_load(x), f32x4_load(x + 4)};
+    F32x8 s, c;
+    fast_sincos8(v, s, c);
+    F32x8 t = fast_tan8(v);
+    f32x4_store(s8, s.lo);
+    f32x4_store(s8 + 4, s.hi);
+    f32x4_store(c8, c.lo);
+    f32x4_store(c8 + 4, c.hi);
+    f32x4_store(t8, t.lo);
+    f32x4_store(t8 + 4, t.hi);
+
+    int mismatches_count = 0;
+    for (int i = 0; i < 8; i += 1)
+    {
+        float ss, sc;
+        fast_sincos_kernel(x[i], ss, sc);
+        float st = ss / sc;
+        if (memcmp(&ss, &s8[i], 4) != 0 || memcmp(&sc, &c8[i], 4) != 0 ||
+            memcmp(&st, &t8[i], 4) != 0)
+        {
+            mismatches_count += 1;
+        }
+
+        double xd = static_cast<double>(x[i]);
+        double sd = sin(xd);
+        double cd = cos(xd);
+        fast_math_measure(errors[FAST_MATH_FUNCTION_SIN], x[i], s8[i], sd);
+        fast_math_measure(errors[FAST_MATH_FUNCTION_COS], x[i], c8[i], cd);
+        fast_math_measure(errors[FAST_MATH_FUNCTION_TAN], x[i], t8[i],
+                          sd / cd);
+    }
+    return mismatches_count;
+}
+
+// Checks the floats from 0 up to limit, every stride-th one, and their
+// negations for symmetry. Returns the number of mismatches.
+static int fast_math_check_range(float limit, uint32_t stride,
+                                 Fast_Math_Error *errors)
+{
+    uint32_t end;
+    memcpy(&end, &limit, sizeof(end));
+    int mismatches_count = 0;
+    alignas(16) float x[8];
+    alignas(16) float negated[8];
+    int count = 0;
+    for (uint64_t bits = 0; bits <= end; bits += stride)
+    {
+        auto b = static_cast<uint32_t>(bits);
+        memcpy(&x[count], &b, sizeof(float));
+        count += 1;
+        if (count < 8 && bits + stride <= end)
+        {
+            continue;
+        }
+        for (int i = count; i < 8; i += 1)
+        {
+            x[i] = x[0];
+        }
+        count = 0;
+        mismatches_count += fast_math_check8(x, errors);
+
+        // sin and tan are odd, cos is even, exactly. Compared as values, as
+        // sin(-0) comes out as +0.
+        for (int i = 0; i < 8; i += 1)
+        {
+            negated[i] = -x[i];
+        }
+        F32x8 s, c, ns, nc;
+        fast_sincos8({f32x4_load(x), f32x4_load(x + 4)}, s, c);
+        fast_sincos8({f32x4_load(negated), f32x4_load(negated + 4)}, ns, nc);
+        alignas(16) float values[4][8];
+        f32x4_store(values[0], s.lo);
+        f32x4_store(values[0] + 4, s.hi);
+        f32x4_store(values[1], c.lo);
+        f32x4_store(values[1] + 4, c.hi);
+        f32x4_store(values[2], ns.lo);
+        f32x4_store(values[2] + 4, ns.hi);
+        f32x4_store(values[3], nc.lo);
+        f32x4_store(values[3] + 4, nc.hi);
+        for (int i = 0; i < 8; i += 1)
+        {
+            if (-values[0][i] != values[2][i] || values[1][i] != values[3][i])
+            {
+                mismatches_count += 1;
+            }
+        }
+    }
+    return mismatches_count;
+}
+
+static void fast_math_print_errors(const char *range,
+                                   const Fast_Math_Error *errors)
+{
+    for (int i = 0; i < FAST_MATH_FUNCTION_COUNT; i += 1)
+    {
+        const Fast_Math_Error &e = errors[i];
+        printf("fast_math: %-3s %-16s max %.2f ULP at %.9g, max abs %.3g\n",
+               fast_math_function_names[i], range, e.max_ulp,
+               static_cast<double>(e.max_ulp_x), e.max_abs);
+    }
+}
+
+// ns per value of sinf() against the kernels, over the same inputs.
+static void fast_math_print_timings()
+{
+    constexpr int count = 4096;
+    constexpr int rounds_count = 2000;
+    alignas(16) static float x[count];
+    alignas(16) static float y[count];
+    for (int i = 0; i < count; i += 1)
+    {
+        x[i] = static_cast<float>(i) * 0.01f - 20.0f;
+    }
+    using Clock = std::chrono::steady_clock;
+    auto time = [](auto &&body)
+    {
+        Clock::time_point start = Clock::now();
+        for (int round = 0; round < rounds_count; round += 1)
+        {
+            body();
+        }
+        std::chrono::duration<double, std::nano> elapsed =
+            Clock::now() - start;
+        return elapsed.count() / (count * static_cast<double>(rounds_count));
+    };
+    double libm_ns = time(
+        [&]
+        {
+            for (int i = 0; i < count; i += 1)
+            {
+                y[i] = sinf(x[i]);
+            }
+        });
+    double scalar_ns = time(
+        [&]
+        {
+            for (int i = 0; i < count; i += 1)
+            {
+                float c;
+                fast_sincos_kernel(x[i], y[i], c);
+            }
+        });
+    double wide4_ns = time(
+        [&]
+        {
+            for (int i = 0; i < count; i += 4)
+            {
+                f32x4_store(y + i, fast_sin4(f32x4_load(x + i)));
+            }
+        });
+    double wide8_ns = time(
+        [&]
+        {
+            for (int i = 0; i < count; i += 8)
+            {
+                F32x8 s = fast_sin8({f32x4_load(x + i), f32x4_load(x + i + 4)});
+                f32x4_store(y + i, s.lo);
+                f32x4_store(y + i + 4, s.hi);
+            }
+        });
+    printf("fast_math: sin %.2fns libm, %.2fns scalar, %.2fns 4 wide, "
+           "%.2fns 8 wide per value\n",
+           libm_ns, scalar_ns, wide4_ns, wide8_ns);
+}
+
+int fast_math_accuracy()
+{
+    struct Range
+    {
+        const char *name;
+        float limit;
+        uint32_t stride;
+    };
+    // Every float up to 2pi, then samples further out where the reduction
+    // starts to lose bits.
+    const Range ranges[] = {
+        {"|x| <= 2pi", 6.28318548f, 1},
+        {"|x| <= 8192", 8192.0f, 61},
+        {"|x| <= 65536", 65536.0f, 61},
+    };
+    int mismatches_count = 0;
+    for (const Range &range : ranges)
+    {
+        Fast_Math_Error errors[FAST_MATH_FUNCTION_COUNT] = {};
+        mismatches_count +=
+            fast_math_check_range(range.limit, range.stride, errors);
+        fast_math_print_errors(range.name, errors);
+    }
+    printf("fast_math: %d results differ between widths or signs\n",
+           mismatches_count);
+    fast_math_print_timings();
+    return mismatches_count == 0 ? 0 : 1;
+}
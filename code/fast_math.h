@@ -0,0 +1,62 @@
+#pragma once
+
+#include "simd.h"
+
+// Polynomial sin, cos and tan for the hot loops, in scalar, 4 and 8 wide
+// forms. The argument is reduced to [-pi/4, pi/4] with a 4 part pi/2 and
+// the results are polynomials of degree 7 and 8 there.
+//
+// Measured against double precision by fast_math_accuracy():
+//   sin, cos  1.6 ULP for |x| <= 2pi, 2.1 ULP for |x| <= 8192
+//   tan       3.7 ULP for |x| <= 8192
+// Beyond 8192 the reduction loses bits, sin and cos stay within 1e-6 of
+// the true value up to 65536.
+//
+// Every form runs the same float operations in the same order and nothing
+// is fused, so the result is the same bit for bit on every platform, in
+// every width. libm isn't, which is what matters for replays.
+
+// Eight lanes as two interleaved halves, which hides the latency of the
+// polynomial chains.
+struct F32x8
+{
+    F32x4 lo;
+    F32x4 hi;
+};
+
+enum Fast_Math_Mode
+{
+    // The kernels below, the same on every platform.
+    FAST_MATH_MODE_FAST,
+    // The C library, as before. For comparison.
+    FAST_MATH_MODE_LIBM,
+    FAST_MATH_MODE_COUNT,
+};
+
+// Picks what fast_sin() and friends use at the call sites. Set once at
+// startup. A replay only plays back right in the mode it was recorded in, so
+// replay_reader_open() switches to the mode the replay header names.
+void fast_math_set_mode(Fast_Math_Mode mode);
+Fast_Math_Mode fast_math_mode();
+// "fast" or "libm".
+bool fast_math_parse(const char *name, Fast_Math_Mode &mode);
+
+float fast_sin(float x);
+float fast_cos(float x);
+void fast_sincos(float x, float &s, float &c);
+float fast_tan(float x);
+
+// Always the kernels, whatever the mode.
+F32x4 fast_sin4(F32x4 x);
+F32x4 fast_cos4(F32x4 x);
+void fast_sincos4(F32x4 x, F32x4 &s, F32x4 &c);
+F32x4 fast_tan4(F32x4 x);
+F32x8 fast_sin8(F32x8 x);
+F32x8 fast_cos8(F32x8 x);
+void fast_sincos8(F32x8 x, F32x8 &s, F32x8 &c);
+F32x8 fast_tan8(F32x8 x);
+
+// Headless. Checks every float in [-2pi, 2pi] and a sweep out to 65536
+// against double precision, and that every width gives the same bits.
+// Prints the max error per function. Returns an exit code.
+int fast_math_accuracy();
@@ -0,0 +1,98 @@
+#include "file_map.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+bool file_map_open(File_Map &m, const char *path)
+{
+    m = {};
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping =
+        CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m.data = static_cast<const uint8_t *>(data);
+    m.size = static_cast<size_t>(size.QuadPart);
+    m.file = file;
+    m.mapping = mapping;
+    return true;
+}
+
+void file_map_close(File_Map &m)
+{
+    if (m.data)
+    {
+        UnmapViewOfFile(m.data);
+        CloseHandle(m.mapping);
+        CloseHandle(m.file);
+    }
+    m = {};
+}
+#else
+bool file_map_open(File_Map &m, const char *path)
+{
+    m = {};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                      MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive on its own.
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    m.data = static_cast<const uint8_t *>(data);
+    m.size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void file_map_close(File_Map &m)
+{
+    if (m.data)
+    {
+        munmap(const_cast<uint8_t *>(m.data), m.size);
+    }
+    m = {};
+}
+#endif
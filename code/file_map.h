@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A whole file mapped read-only into memory. Pages are only read in when
+// they are touched, so opening costs the same no matter how big the file
+// is.
+struct File_Map
+{
+    const uint8_t *data;
+    size_t size;
+    // Windows only, the file and mapping handles.
+    void *file;
+    void *mapping;
+};
+
+bool file_map_open(File_Map &m, const char *path);
+void file_map_close(File_Map &m);
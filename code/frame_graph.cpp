@@ -0,0 +1,299 @@
+#include "frame_graph.h"
+#include <cassert>
+#include <cstdio>
+
+static uint64_t frame_graph_bytes_per_pixel(sg_pixel_format format)
+{
+    switch (format)
+    {
+    case SG_PIXELFORMAT_RGBA32F:
+        return 16;
+    case SG_PIXELFORMAT_RGBA16F:
+        return 8;
+    default:
+        // RG11B10F, RGBA8 and the packed depth-stencil formats.
+        return 4;
+    }
+}
+
+static uint64_t frame_graph_desc_bytes(const Frame_Graph_Resource_Desc &desc)
+{
+    uint64_t bytes = 0;
+    uint64_t width = desc.width;
+    uint64_t height = desc.height;
+    for (int i = 0; i < desc.mips_count; i += 1)
+    {
+        bytes += width * height * desc.sample_count *
+                 frame_graph_bytes_per_pixel(desc.format);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return bytes;
+}
+
+static bool frame_graph_desc_equal(const Frame_Graph_Resource_Desc &a,
+                                   const Frame_Graph_Resource_Desc &b)
+{
+    return a.width == b.width && a.height == b.height &&
+           a.format == b.format && a.sample_count == b.sample_count &&
+           a.mips_count == b.mips_count;
+}
+
+static void frame_graph_use(Frame_Graph &fg, int pass, int resource)
+{
+    auto &res = fg.resources[resource];
+    if (res.first_pass < 0 || pass < res.first_pass)
+    {
+        res.first_pass = pass;
+    }
+    if (pass > res.last_pass)
+    {
+        res.last_pass = pass;
+    }
+}
+
+// Swaps the last image into the freed slot and points the resources that
+// used it at its new index.
+static void frame_graph_remove_image(Frame_Graph &fg, int index)
+{
+    sg_destroy_image(fg.images[index].img);
+
+    int last = fg.images_count - 1;
+    fg.images[index] = fg.images[last];
+    for (int i = 0; i < fg.resources_count; i += 1)
+    {
+        if (fg.resources[i].image_index == last)
+        {
+            fg.resources[i].image_index = index;
+        }
+    }
+    fg.images_count -= 1;
+}
+
+void frame_graph_reset(Frame_Graph &fg)
+{
+    fg.resources_count = 0;
+    fg.passes_count = 0;
+
+    for (int i = fg.images_count - 1; i >= 0; i -= 1)
+    {
+        auto &image = fg.images[i];
+        image.idle_count = image.in_use ? 0 : image.idle_count + 1;
+        image.in_use = false;
+        image.last_pass = -1;
+        if (image.idle_count > frame_graph_image_max_idle_count)
+        {
+            frame_graph_remove_image(fg, i);
+        }
+    }
+}
+
+int frame_graph_add_resource(Frame_Graph &fg, const char *name,
+                             const Frame_Graph_Resource_Desc &desc)
+{
+    assert(fg.resources_count < frame_graph_resources_max_count);
+
+    auto &res = fg.resources[fg.resources_count];
+    res.name = name;
+    res.desc = desc;
+    res.first_pass = -1;
+    res.last_pass = -1;
+    res.image_index = -1;
+
+    fg.resources_count += 1;
+    return fg.resources_count - 1;
+}
+
+int frame_graph_add_pass(Frame_Graph &fg, const char *name)
+{
+    assert(fg.passes_count < frame_graph_passes_max_count);
+
+    auto &pass = fg.passes[fg.passes_count];
+    pass.name = name;
+    pass.reads_count = 0;
+    pass.writes_count = 0;
+
+    fg.passes_count += 1;
+    return fg.passes_count - 1;
+}
+
+void frame_graph_read(Frame_Graph &fg, int pass, int resource)
+{
+    auto &p = fg.passes[pass];
+    assert(p.reads_count < frame_graph_pass_resources_max_count);
+
+    p.reads[p.reads_count] = resource;
+    p.reads_count += 1;
+    frame_graph_use(fg, pass, resource);
+}
+
+void frame_graph_write(Frame_Graph &fg, int pass, int resource)
+{
+    auto &p = fg.passes[pass];
+    assert(p.writes_count < frame_graph_pass_resources_max_count);
+
+    p.writes[p.writes_count] = resource;
+    p.writes_count += 1;
+    frame_graph_use(fg, pass, resource);
+}
+
+// Whether any pass up to and including last_pass writes resource.
+static bool frame_graph_written(const Frame_Graph &fg, int resource,
+                                int last_pass)
+{
+    for (int pass = 0; pass <= last_pass; pass += 1)
+    {
+        const auto &p = fg.passes[pass];
+        for (int i = 0; i < p.writes_count; i += 1)
+        {
+            if (p.writes[i] == resource)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void frame_graph_compile(Frame_Graph &fg)
+{
+    // Passes run in declaration order, so every read needs a write before
+    // it. A pass that reads what it writes itself orders that internally.
+    for (int pass = 0; pass < fg.passes_count; pass += 1)
+    {
+        const auto &p = fg.passes[pass];
+        for (int i = 0; i < p.reads_count; i += 1)
+        {
+            assert(frame_graph_written(fg, p.reads[i], pass) &&
+                   "resource is read before any pass writes it");
+        }
+    }
+
+    // Greedy interval allocation: walk the resources in order of their first
+    // use and hand each one the first compatible image that is no longer in
+    // use by then. Pooled images count as free from the start.
+    for (int pass = 0; pass < fg.passes_count; pass += 1)
+    {
+        for (int i = 0; i < fg.resources_count; i += 1)
+        {
+            auto &res = fg.resources[i];
+            if (res.first_pass != pass)
+            {
+                continue;
+            }
+
+            for (int j = 0; j < fg.images_count; j += 1)
+            {
+                auto &image = fg.images[j];
+                if (image.last_pass < pass &&
+                    frame_graph_desc_equal(image.desc, res.desc))
+                {
+                    res.image_index = j;
+                    image.last_pass = res.last_pass;
+                    image.in_use = true;
+                    break;
+                }
+            }
+            if (res.image_index < 0)
+            {
+                assert(fg.images_count < frame_graph_images_max_count);
+
+                auto &image = fg.images[fg.images_count];
+                image.desc = res.desc;
+                image.last_pass = res.last_pass;
+                image.in_use = true;
+                image.idle_count = 0;
+
+                sg_image_desc desc = {};
+                desc.render_target = true;
+                desc.width = res.desc.width;
+                desc.height = res.desc.height;
+                desc.pixel_format = res.desc.format;
+                desc.sample_count = res.desc.sample_count;
+                desc.num_mipmaps = res.desc.mips_count;
+                image.img = sg_make_image(desc);
+
+                res.image_index = fg.images_count;
+                fg.images_count += 1;
+            }
+        }
+    }
+}
+
+sg_image frame_graph_image(const Frame_Graph &fg, int resource)
+{
+    const auto &res = fg.resources[resource];
+    assert(res.image_index >= 0 && "resource is never used by any pass");
+    return fg.images[res.image_index].img;
+}
+
+uint64_t frame_graph_resources_bytes(const Frame_Graph &fg)
+{
+    uint64_t bytes = 0;
+    for (int i = 0; i < fg.resources_count; i += 1)
+    {
+        bytes += frame_graph_desc_bytes(fg.resources[i].desc);
+    }
+    return bytes;
+}
+
+uint64_t frame_graph_images_bytes(const Frame_Graph &fg)
+{
+    uint64_t bytes = 0;
+    for (int i = 0; i < fg.images_count; i += 1)
+    {
+        if (fg.images[i].in_use)
+        {
+            bytes += frame_graph_desc_bytes(fg.images[i].desc);
+        }
+    }
+    return bytes;
+}
+
+uint64_t frame_graph_pooled_bytes(const Frame_Graph &fg)
+{
+    uint64_t bytes = 0;
+    for (int i = 0; i < fg.images_count; i += 1)
+    {
+        if (!fg.images[i].in_use)
+        {
+            bytes += frame_graph_desc_bytes(fg.images[i].desc);
+        }
+    }
+    return bytes;
+}
+
+void frame_graph_print_report(const Frame_Graph &fg)
+{
+    static constexpr double mb = 1024.0 * 1024.0;
+
+    int pooled_count = 0;
+    for (int i = 0; i < fg.images_count; i += 1)
+    {
+        pooled_count += fg.images[i].in_use ? 0 : 1;
+    }
+
+    printf("frame graph: %d passes, %d resources, %d images, %d pooled\n",
+           fg.passes_count, fg.resources_count,
+           fg.images_count - pooled_count, pooled_count);
+    for (int i = 0; i < fg.resources_count; i += 1)
+    {
+        const auto &res = fg.resources[i];
+        if (res.image_index < 0)
+        {
+            printf("  %-18s unused\n", res.name);
+            continue;
+        }
+        printf("  %-18s %5dx%-5d x%d mips %d  passes %s..%s  image %d  "
+               "%7.2fMB\n",
+               res.name, res.desc.width, res.desc.height,
+               res.desc.sample_count, res.desc.mips_count,
+               fg.passes[res.first_pass].name, fg.passes[res.last_pass].name,
+               res.image_index,
+               static_cast<double>(frame_graph_desc_bytes(res.desc)) / mb);
+    }
+    printf("  resources %.2fMB, images %.2fMB after aliasing, pool %.2fMB\n",
+           static_cast<double>(frame_graph_resources_bytes(fg)) / mb,
+           static_cast<double>(frame_graph_images_bytes(fg)) / mb,
+           static_cast<double>(frame_graph_pooled_bytes(fg)) / mb);
+}
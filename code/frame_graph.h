@@ -0,0 +1,87 @@
+#pragma once
+
+#include "sokol_gfx.h"
+
+inline constexpr int frame_graph_resources_max_count = 16;
+inline constexpr int frame_graph_passes_max_count = 16;
+// The bloom passes write every mip as its own image on backends that can't
+// render into one mip of an image while sampling another.
+inline constexpr int frame_graph_pass_resources_max_count = 8;
+// Holds the images of the current build plus whatever the previous build
+// left behind in the pool.
+inline constexpr int frame_graph_images_max_count = 32;
+// Number of rebuilds a pooled image survives without being used.
+inline constexpr int frame_graph_image_max_idle_count = 1;
+
+struct Frame_Graph_Resource_Desc
+{
+    int width;
+    int height;
+    sg_pixel_format format;
+    int sample_count;
+    int mips_count;
+};
+
+// A render target as the passes see it. Several resources with the same
+// desc and non-overlapping lifetimes end up sharing one physical image.
+struct Frame_Graph_Resource
+{
+    const char *name;
+    Frame_Graph_Resource_Desc desc;
+    int first_pass;
+    int last_pass;
+    int image_index;
+};
+
+struct Frame_Graph_Pass
+{
+    const char *name;
+    int reads[frame_graph_pass_resources_max_count];
+    int reads_count;
+    int writes[frame_graph_pass_resources_max_count];
+    int writes_count;
+};
+
+struct Frame_Graph_Image
+{
+    Frame_Graph_Resource_Desc desc;
+    sg_image img;
+    int last_pass;
+    bool in_use;
+    int idle_count;
+};
+
+// The passes are declared in the order they execute. The graph is rebuilt
+// whenever the render targets change (resize, quality change), not every
+// frame. Images are pooled across rebuilds by desc, so switching back and
+// forth between two sizes or quality tiers doesn't allocate anything.
+struct Frame_Graph
+{
+    Frame_Graph_Resource resources[frame_graph_resources_max_count];
+    int resources_count;
+    Frame_Graph_Pass passes[frame_graph_passes_max_count];
+    int passes_count;
+    Frame_Graph_Image images[frame_graph_images_max_count];
+    int images_count;
+};
+
+// Forgets every declared pass and resource. The images go back to the pool,
+// and the ones that have sat unused for too long are destroyed.
+void frame_graph_reset(Frame_Graph &fg);
+int frame_graph_add_resource(Frame_Graph &fg, const char *name,
+                             const Frame_Graph_Resource_Desc &desc);
+int frame_graph_add_pass(Frame_Graph &fg, const char *name);
+void frame_graph_read(Frame_Graph &fg, int pass, int resource);
+void frame_graph_write(Frame_Graph &fg, int pass, int resource);
+// Computes resource lifetimes and aliases resources onto shared images,
+// taking them from the pool when possible and creating the rest.
+void frame_graph_compile(Frame_Graph &fg);
+sg_image frame_graph_image(const Frame_Graph &fg, int resource);
+
+// Bytes needed if every resource had its own image.
+uint64_t frame_graph_resources_bytes(const Frame_Graph &fg);
+// Bytes actually used after aliasing.
+uint64_t frame_graph_images_bytes(const Frame_Graph &fg);
+// Bytes held by unused images in the pool.
+uint64_t frame_graph_pooled_bytes(const Frame_Graph &fg);
+void frame_graph_print_report(const Frame_Graph &fg);
@@ -0,0 +1,198 @@
+#include "frame_timing.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+static constexpr int frame_histogram_octave_count =
+    frame_histogram_linear_count / 2;
+// What the frame part stands for in a stutter.
+static constexpr const char *frame_timing_part_names[] = {
+    "sim",
+    "draw",
+    "render",
+    "waiting",
+};
+
+static int frame_histogram_index(uint64_t value_us)
+{
+    if (value_us < frame_histogram_linear_count)
+    {
+        return static_cast<int>(value_us);
+    }
+    // Shifted down into [linear_count / 2, linear_count).
+    int shift = 1;
+    while ((value_us >> shift) >= frame_histogram_linear_count)
+    {
+        shift += 1;
+    }
+    int index = frame_histogram_linear_count +
+                (shift - 1) * frame_histogram_octave_count +
+                static_cast<int>(value_us >> shift) -
+                frame_histogram_octave_count;
+    return std::min(index, frame_histogram_buckets_count - 1);
+}
+
+// The largest value that lands in the bucket.
+static uint64_t frame_histogram_bucket_end(int index)
+{
+    if (index < frame_histogram_linear_count)
+    {
+        return static_cast<uint64_t>(index);
+    }
+    int octave_index = index - frame_histogram_linear_count;
+    int shift = octave_index / frame_histogram_octave_count + 1;
+    uint64_t sub = static_cast<uint64_t>(
+        octave_index % frame_histogram_octave_count +
+        frame_histogram_octave_count);
+    return ((sub + 1) << shift) - 1;
+}
+
+void frame_histogram_record(Frame_Histogram &h, uint64_t value_us)
+{
+    h.counts[frame_histogram_index(value_us)] += 1;
+    h.total_count += 1;
+    h.max_us = std::max(h.max_us, value_us);
+}
+
+uint64_t frame_histogram_percentile(const Frame_Histogram &h,
+                                    double fraction)
+{
+    auto target = static_cast<uint64_t>(
+        std::ceil(fraction * static_cast<double>(h.total_count)));
+    target = std::max<uint64_t>(target, 1);
+    uint64_t count = 0;
+    for (int i = 0; i < frame_histogram_buckets_count; i += 1)
+    {
+        count += h.counts[i];
+        if (count >= target && i < frame_histogram_buckets_count - 1)
+        {
+            return std::min(frame_histogram_bucket_end(i), h.max_us);
+        }
+    }
+    return h.max_us;
+}
+
+static double frame_timing_median(const double *window, int count)
+{
+    double values[frame_timing_window_count];
+    std::copy(window, window + count, values);
+    std::nth_element(values, values + count / 2, values + count);
+    return values[count / 2];
+}
+
+void frame_timing_record(Frame_Timing &t, const double *timings,
+                         int ticks_count)
+{
+    double frame_secs = timings[FRAME_TIMING_PART_FRAME];
+    frame_histogram_record(
+        t.histogram, static_cast<uint64_t>(std::max(frame_secs, 0.0) * 1e6));
+
+    double parts[FRAME_TIMING_PART_COUNT];
+    std::copy(timings, timings + FRAME_TIMING_PART_COUNT, parts);
+    parts[FRAME_TIMING_PART_FRAME] =
+        std::max(frame_secs - timings[FRAME_TIMING_PART_SIM] -
+                     timings[FRAME_TIMING_PART_DRAW] -
+                     timings[FRAME_TIMING_PART_RENDER],
+                 0.0);
+
+    // Against the frames before, so a stutter doesn't raise its own bar.
+    if (t.window_count >= frame_timing_window_count / 2)
+    {
+        double median_secs =
+            frame_timing_median(t.frames_window, t.window_count);
+        if (frame_secs > 2.0 * median_secs)
+        {
+            int part = 0;
+            double excess_secs = 0.0;
+            for (int i = 0; i < FRAME_TIMING_PART_COUNT; i += 1)
+            {
+                double excess =
+                    parts[i] - frame_timing_median(t.window[i],
+                                                   t.window_count);
+                if (i == 0 || excess > excess_secs)
+                {
+                    part = i;
+                    excess_secs = excess;
+                }
+            }
+            t.stutters_counts[part] += 1;
+            printf("frame_timing: frame %llu took %.2fms, %.1fx the median, "
+                   "%s +%.2fms, %d ticks\n",
+                   static_cast<unsigned long long>(t.frames_count),
+                   frame_secs * 1000.0, frame_secs / median_secs,
+                   frame_timing_part_names[part], excess_secs * 1000.0,
+                   ticks_count);
+        }
+    }
+
+    for (int i = 0; i < FRAME_TIMING_PART_COUNT; i += 1)
+    {
+        t.window[i][t.window_index] = parts[i];
+    }
+    t.frames_window[t.window_index] = frame_secs;
+    t.window_index = (t.window_index + 1) % frame_timing_window_count;
+    t.window_count = std::min(t.window_count + 1, frame_timing_window_count);
+    t.frames_count += 1;
+}
+
+void frame_timing_format(const Frame_Timing &t, char *text, int text_size)
+{
+    const auto &h = t.histogram;
+    auto ms = [&h](double fraction)
+    { return frame_histogram_percentile(h, fraction) / 1000.0; };
+    snprintf(text, static_cast<size_t>(text_size),
+             "p50 %.1f p95 %.1f p99 %.1f p99.9 %.1f max %.1fms\n"
+             "stutters: sim %llu draw %llu render %llu wait %llu\n",
+             ms(0.5), ms(0.95), ms(0.99), ms(0.999), h.max_us / 1000.0,
+             static_cast<unsigned long long>(
+                 t.stutters_counts[FRAME_TIMING_PART_SIM]),
+             static_cast<unsigned long long>(
+                 t.stutters_counts[FRAME_TIMING_PART_DRAW]),
+             static_cast<unsigned long long>(
+                 t.stutters_counts[FRAME_TIMING_PART_RENDER]),
+             static_cast<unsigned long long>(
+                 t.stutters_counts[FRAME_TIMING_PART_FRAME]));
+}
+
+void frame_timing_report(const Frame_Timing &t, const char *path)
+{
+    const auto &h = t.histogram;
+    if (h.total_count == 0)
+    {
+        return;
+    }
+    char text[256];
+    frame_timing_format(t, text, sizeof(text));
+    printf("frame_timing: %llu frames\n%s",
+           static_cast<unsigned long long>(h.total_count), text);
+
+    if (!path)
+    {
+        return;
+    }
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        printf("frame_timing: can't write %s\n", path);
+        return;
+    }
+    // One row per bucket that has frames in it, with the share of frames
+    // at or below it.
+    fprintf(file, "frame_ms_max,count,percentile\n");
+    uint64_t count = 0;
+    for (int i = 0; i < frame_histogram_buckets_count; i += 1)
+    {
+        if (h.counts[i] == 0)
+        {
+            continue;
+        }
+        count += h.counts[i];
+        fprintf(file, "%.3f,%u,%.6f\n",
+                std::min(frame_histogram_bucket_end(i), h.max_us) / 1000.0,
+                h.counts[i],
+                static_cast<double>(count) /
+                    static_cast<double>(h.total_count) * 100.0);
+    }
+    fclose(file);
+    printf("frame_timing: histogram written to %s\n", path);
+}
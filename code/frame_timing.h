@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+// Microseconds below this each get a bucket of their own, above it every
+// power of two is split into half as many buckets, so a bucket is never
+// more than 1/32 of its value wide.
+inline constexpr int frame_histogram_linear_count = 64;
+// Up to 2^32us, over an hour.
+inline constexpr int frame_histogram_buckets_count =
+    frame_histogram_linear_count + 26 * (frame_histogram_linear_count / 2);
+// Frames the median that stutters are measured against is taken over.
+inline constexpr int frame_timing_window_count = 120;
+
+enum Frame_Timing_Part
+{
+    // Fixed steps and the interpolated step, game_tick() and game_sim().
+    FRAME_TIMING_PART_SIM,
+    // game_draw(), building the draw calls and instances.
+    FRAME_TIMING_PART_DRAW,
+    // renderer_render() and the commit, on the CPU.
+    FRAME_TIMING_PART_RENDER,
+    // From one frame to the next. What the parts above don't account for
+    // is waiting for the GPU, for vsync or for the OS.
+    FRAME_TIMING_PART_FRAME,
+    FRAME_TIMING_PART_COUNT,
+};
+
+struct Frame_Histogram
+{
+    uint32_t counts[frame_histogram_buckets_count];
+    uint64_t total_count;
+    uint64_t max_us;
+};
+
+struct Frame_Timing
+{
+    // Every frame's raw time, not sapp_frame_duration()'s smoothed one.
+    Frame_Histogram histogram;
+    // The last frames' part times in seconds, with FRAME_TIMING_PART_FRAME
+    // replaced by the time the other parts don't account for.
+    double window[FRAME_TIMING_PART_COUNT][frame_timing_window_count];
+    double frames_window[frame_timing_window_count];
+    int window_index;
+    int window_count;
+    uint64_t frames_count;
+    // Frames over twice the median, by the part that took the extra time.
+    uint64_t stutters_counts[FRAME_TIMING_PART_COUNT];
+};
+
+void frame_histogram_record(Frame_Histogram &h, uint64_t value_us);
+// The smallest value at least fraction of the values are at or below,
+// rounded up to the end of its bucket.
+uint64_t frame_histogram_percentile(const Frame_Histogram &h,
+                                    double fraction);
+
+// Takes one frame's part times in seconds, see Frame_Timing_Part, and the
+// fixed steps it simulated. Logs the frame if it stuttered.
+void frame_timing_record(Frame_Timing &t, const double *timings,
+                         int ticks_count);
+// p50, p95, p99, p99.9 and max in milliseconds, and the stutters so far.
+// Two lines for the debug text.
+void frame_timing_format(const Frame_Timing &t, char *text, int text_size);
+// Prints the percentiles and stutters, and writes the histogram to a CSV
+// file when path isn't null.
+void frame_timing_report(const Frame_Timing &t, const char *path);
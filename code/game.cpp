@@ -1,6 +1,16 @@
 #include "game.h"
+#include "fast_math.h"
 #include "input.h"
+#include "jobs.h"
+#include "philox.h"
 #include "renderer.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 enum Color
 {
@@ -39,13 +49,42 @@ static constexpr HMM_Vec3 colors[COLOR_COUNT] = {
 static constexpr float ball_speed = 50.0f;
 static constexpr float ball_max_speed = 100.0f;
 static constexpr float paddle_speed = 30.0f;
+static constexpr int menu_stars_default_count = 256;
+static constexpr int gameplay_stars_default_count = 128;
+static constexpr int background_stars_sim_grain_size = 2048;
+static constexpr int background_stars_draw_grain_size = 512;
+// Stars respawned at a time, with 3 random blocks each.
+static constexpr int background_stars_respawn_batch_count = 64;
+static constexpr int menu_balls_sim_grain_size = 2048;
+static constexpr int menu_balls_draw_grain_size = 512;
+static constexpr int menu_boxes_sim_grain_size = 2048;
+
+// The counter based random streams, see philox.h.
+enum Game_Rand_Stream
+{
+    GAME_RAND_STREAM_MENU_STARS,
+    GAME_RAND_STREAM_GAMEPLAY_STARS,
+    GAME_RAND_STREAM_PARTICLES,
+};
+static constexpr float score_text_size = 5.0f;
+static constexpr float score_text_glow = 2.0f;
+static constexpr int paddle_hit_sparks_count = 6000;
+static constexpr int boundary_hit_sparks_count = 2500;
+static constexpr float spark_glow = 8.0f;
+static constexpr float ball_trail_particles_per_sec = 4000.0f;
+// The sim's aspect ratio when there is no framebuffer to take it from, and
+// the widest a saved state may have.
+static constexpr float game_default_aspect = 16.0f / 9.0f;
+static constexpr float game_aspect_max = 16.0f;
 
 // General functions.
 static float pulsate(float time, float min, float max, float speed);
 static float ease_in_out(float time);
 static float rand_float(rnd_gamerand_t &rand);
 static float rand_float(rnd_gamerand_t &rand, float min, float max);
-static int rand_int(rnd_gamerand_t &rand, int min, int max);
+static Philox_Key rand_key(const Game &g, Game_Rand_Stream stream);
+
+static float game_view_aspect(const Game &g);
 
 // Bounding box functions.
 static Bounding_Box bounding_box_entity_bounds(HMM_Vec3 position,
@@ -55,31 +94,84 @@ static Bounding_Box bounding_box_view_bounds_at_z(const Camera &c,
 static bool bounding_box_colliding(Bounding_Box a, Bounding_Box b);
 
 // Background star functions.
-static void background_star_reset(Background_Star &star, Game &g);
-static void background_star_update(Background_Star &star, Game &g,
-                                   float total_time, float delta_time);
+static void background_star_reset(Background_Star &star, const Camera &camera,
+                                  const Philox_Block *blocks);
+static void background_stars_respawn(Background_Star *stars, int begin,
+                                     int end, const Camera &camera,
+                                     Philox_Key key, bool all);
+static void background_star_update(Background_Star &star, float total_time,
+                                   float delta_time);
+static void background_stars_sim(Background_Star *stars, int count,
+                                 float &stars_time, Game &g,
+                                 Game_Rand_Stream stream, float total_time,
+                                 float delta_time);
+static void background_stars_draw(const Background_Star *stars, int count,
+                                  float stars_time, Game_Rand_Stream stream,
+                                  const Game &g);
+
+// Particle effect functions.
+static void sparks_emit(Game &g, HMM_Vec3 position, HMM_Vec3 direction,
+                        HMM_Vec3 color, int count);
+static void ball_trail_emit(Game &g, const Ball &ball, float delta_time);
+static void game_event_push(Game &g, Game_Event_Type type, HMM_Vec3 position);
 
 static void menu_state_init(Game &g)
 {
-    auto &ball = g.menu.ball;
-    ball.position = HMM_V3(0.0f, 0.0f, -10.0f);
-    ball.scale = HMM_V3(0.66f, 0.66f, 0.66f);
-    ball.color = colors[COLOR_LIGHT_BLUE];
-    ball.glow = 10.0f;
-    ball.bounds = bounding_box_entity_bounds(ball.position, ball.scale);
-    ball.velocity.X =
-        rand_float(g.rand, -ball_max_speed * 0.8f, ball_max_speed * 0.8f);
-    ball.velocity.Y =
-        rand_float(g.rand, -ball_max_speed * 0.5f, ball_max_speed * 0.5f);
+    // The first ball starts in the middle, any others anywhere in view.
+    auto view_bounds =
+        bounding_box_view_bounds_at_z(g.camera, g.camera.eye.Z + 10.0f);
+    for (int i = 0; i < g.config.menu_balls_count; i += 1)
+    {
+        auto &ball = g.arrays.menu_balls[i];
+        ball.position = HMM_V3(0.0f, 0.0f, -10.0f);
+        ball.scale = HMM_V3(0.66f, 0.66f, 0.66f);
+        ball.color = colors[COLOR_LIGHT_BLUE];
+        ball.glow = 10.0f;
+        ball.velocity.X =
+            rand_float(g.rand, -ball_max_speed * 0.8f, ball_max_speed * 0.8f);
+        ball.velocity.Y =
+            rand_float(g.rand, -ball_max_speed * 0.5f, ball_max_speed * 0.5f);
+        if (i > 0)
+        {
+            ball.position.X = rand_float(g.rand, view_bounds.min.X * 0.9f,
+                                         view_bounds.max.X * 0.9f);
+            ball.position.Y = rand_float(g.rand, view_bounds.min.Y * 0.9f,
+                                         view_bounds.max.Y * 0.9f);
+            ball.color =
+                colors[rnd_gamerand_range(&g.rand, 0, COLOR_COUNT - 1)];
+            ball.glow = 2.0f;
+        }
+        ball.bounds = bounding_box_entity_bounds(ball.position, ball.scale);
+    }
 
-    for (int i = 0; i < menu_background_stars_count; i += 1)
+    for (int i = 0; i < g.config.menu_boxes_count; i += 1)
     {
-        background_star_reset(g.menu.background_stars[i], g);
+        auto &box = g.arrays.menu_boxes[i];
+        float z = rand_float(g.rand, 30.0f, 200.0f);
+        auto bounds =
+            bounding_box_view_bounds_at_z(g.camera, g.camera.eye.Z + z);
+        box.position =
+            HMM_V3(rand_float(g.rand, bounds.min.X, bounds.max.X),
+                   rand_float(g.rand, bounds.min.Y, bounds.max.Y), -z);
+        box.rotation = HMM_V3(0.0f, 0.0f, 0.0f);
+        box.rotation_speed = HMM_V3(rand_float(g.rand, 0.0f, 1.5f),
+                                    rand_float(g.rand, 0.0f, 1.5f),
+                                    rand_float(g.rand, 0.0f, 1.5f));
+        float size = rand_float(g.rand, 1.0f, 4.0f);
+        box.scale = HMM_V3(size, size, size);
+        box.color = colors[rnd_gamerand_range(&g.rand, 0, COLOR_COUNT - 1)];
     }
 
+    background_stars_respawn(g.arrays.menu_stars, 0,
+                             g.config.menu_stars_count, g.camera,
+                             rand_key(g, GAME_RAND_STREAM_MENU_STARS), true);
+    g.menu.stars_time = 0.0f;
+
+    const auto &ball = g.arrays.menu_balls[0];
     auto &point_light = g.renderer->game_pass.point_lights[0];
-    point_light.position = g.menu.ball.position;
-    point_light.diffuse_color = g.menu.ball.color * g.menu.ball.glow * 0.5f;
+    point_light.enabled = true;
+    point_light.position = ball.position;
+    point_light.diffuse_color = ball.color * ball.glow * 0.5f;
     point_light.ambient_color = HMM_V3(0.0f, 0.0f, 0.0f);
     point_light.falloff = 0.125f;
     point_light.radius = 10.0f;
@@ -132,6 +224,11 @@ static void gameplay_state_init(Game &g)
     ball.velocity.X = -50.0f;
     ball.velocity.Y = -4.0f;
 
+    g.gameplay.score_left = 0;
+    g.gameplay.score_right = 0;
+    g.gameplay.particles.count = 0;
+    g.gameplay.trail_accumulator = 0.0f;
+
     auto &paddle_left = g.gameplay.paddle_left;
     paddle_left.position =
         boundary_left.position +
@@ -152,12 +249,13 @@ static void gameplay_state_init(Game &g)
     paddle_right.bounds =
         bounding_box_entity_bounds(paddle_right.position, paddle_right.scale);
 
-    for (int i = 0; i < gameplay_background_stars_count; i += 1)
-    {
-        background_star_reset(g.gameplay.background_stars[i], g);
-    }
+    background_stars_respawn(
+        g.arrays.gameplay_stars, 0, g.config.gameplay_stars_count, g.camera,
+        rand_key(g, GAME_RAND_STREAM_GAMEPLAY_STARS), true);
+    g.gameplay.stars_time = 0.0f;
 
     auto &point_light = g.renderer->game_pass.point_lights[0];
+    point_light.enabled = true;
     point_light.position = ball.position;
     point_light.diffuse_color = ball.color * ball.glow * 0.5f;
     point_light.ambient_color = HMM_V3(0.0f, 0.0f, 0.0f);
@@ -170,24 +268,248 @@ static void gameplay_state_init(Game &g)
     dir_light.ambient_color = HMM_V3(0.005f, 0.004f, 0.004f);
 }
 
-void game_init(Game &g, Input &input, Renderer &renderer, uint32_t rand_seed)
+// The particle pool is the last member of the game state, so everything in
+// front of it is copied in one go.
+static_assert(offsetof(Game, gameplay) + sizeof(Gameplay_State) ==
+              sizeof(Game));
+static_assert(offsetof(Gameplay_State, particles) + sizeof(Particles) ==
+              sizeof(Gameplay_State));
+
+// Every runtime sized array, in the order they are saved, with its size in
+// bytes.
+static constexpr int game_arrays_count = 4;
+
+struct Game_Array_Bytes
+{
+    void *items;
+    size_t size;
+};
+
+// The counts must not be negative.
+static std::array<size_t, game_arrays_count> game_array_sizes(
+    const Game_Config &config)
+{
+    auto size = [](size_t item_size, int count)
+    { return item_size * static_cast<size_t>(count); };
+    return {{
+        size(sizeof(Background_Star), config.menu_stars_count),
+        size(sizeof(Ball), config.menu_balls_count),
+        size(sizeof(Menu_Box), config.menu_boxes_count),
+        size(sizeof(Background_Star), config.gameplay_stars_count),
+    }};
+}
+
+static std::array<Game_Array_Bytes, game_arrays_count> game_arrays(
+    const Game &g)
+{
+    auto sizes = game_array_sizes(g.config);
+    const auto &arrays = g.arrays;
+    return {{
+        {arrays.menu_stars, sizes[0]},
+        {arrays.menu_balls, sizes[1]},
+        {arrays.menu_boxes, sizes[2]},
+        {arrays.gameplay_stars, sizes[3]},
+    }};
+}
+
+static bool game_config_equal(const Game_Config &a, const Game_Config &b)
+{
+    return a.start_state == b.start_state &&
+           a.menu_stars_count == b.menu_stars_count &&
+           a.gameplay_stars_count == b.gameplay_stars_count &&
+           a.menu_balls_count == b.menu_balls_count &&
+           a.menu_boxes_count == b.menu_boxes_count;
+}
+
+// Zeroed, so a state that doesn't use an array still copies and saves the
+// same bytes every time.
+template <typename T>
+static T *game_alloc_array(int count)
+{
+    assert(count >= 0);
+    auto *items = static_cast<T *>(
+        calloc(static_cast<size_t>(std::max(count, 1)), sizeof(T)));
+    assert(items);
+    return items;
+}
+
+// Sizes g's arrays for config, if they aren't already.
+static void game_reserve_arrays(Game &g, const Game_Config &config)
+{
+    if (g.arrays.menu_stars && game_config_equal(g.config, config))
+    {
+        return;
+    }
+    game_shutdown(g);
+    g.config = config;
+    g.arrays.menu_stars = game_alloc_array<Background_Star>(
+        config.menu_stars_count);
+    g.arrays.menu_balls = game_alloc_array<Ball>(config.menu_balls_count);
+    g.arrays.menu_boxes = game_alloc_array<Menu_Box>(config.menu_boxes_count);
+    g.arrays.gameplay_stars = game_alloc_array<Background_Star>(
+        config.gameplay_stars_count);
+}
+
+void game_shutdown(Game &g)
+{
+    free(g.arrays.menu_stars);
+    free(g.arrays.menu_balls);
+    free(g.arrays.menu_boxes);
+    free(g.arrays.gameplay_stars);
+    g.arrays = {};
+}
+
+void game_copy(Game &dst, const Game &src)
+{
+    game_reserve_arrays(dst, src.config);
+    Game_Arrays arrays = dst.arrays;
+    memcpy(&dst, &src,
+           offsetof(Game, gameplay) + offsetof(Gameplay_State, particles));
+    dst.arrays = arrays;
+    auto dst_arrays = game_arrays(dst);
+    auto src_arrays = game_arrays(src);
+    for (int i = 0; i < game_arrays_count; i += 1)
+    {
+        memcpy(dst_arrays[i].items, src_arrays[i].items, src_arrays[i].size);
+    }
+    particles_copy(dst.gameplay.particles, src.gameplay.particles);
+}
+
+// Everything from rand up to the particle pool is plain data.
+static constexpr size_t game_state_begin = offsetof(Game, rand);
+static constexpr size_t game_state_end =
+    offsetof(Game, gameplay) + offsetof(Gameplay_State, particles);
+static_assert(offsetof(Game, rand) > offsetof(Game, arrays));
+
+size_t game_state_size(const Game &g)
 {
+    size_t size = sizeof(Game_Config) + game_state_end - game_state_begin;
+    for (const auto &array : game_arrays(g))
+    {
+        size += array.size;
+    }
+    return size + particles_state_size(g.gameplay.particles);
+}
+
+size_t game_state_max_size(const Game &g)
+{
+    return game_state_size(g) - particles_state_size(g.gameplay.particles) +
+           particles_state_max_size();
+}
+
+void game_save_state(const Game &g, uint8_t *dst)
+{
+    memcpy(dst, &g.config, sizeof(Game_Config));
+    dst += sizeof(Game_Config);
+    const auto *src = reinterpret_cast<const uint8_t *>(&g);
+    memcpy(dst, src + game_state_begin, game_state_end - game_state_begin);
+    dst += game_state_end - game_state_begin;
+    for (const auto &array : game_arrays(g))
+    {
+        memcpy(dst, array.items, array.size);
+        dst += array.size;
+    }
+    particles_save(g.gameplay.particles, dst);
+}
+
+void game_load_state(Game &g, const uint8_t *src)
+{
+    Game_Config config;
+    memcpy(&config, src, sizeof(Game_Config));
+    src += sizeof(Game_Config);
+    game_reserve_arrays(g, config);
+    auto *dst = reinterpret_cast<uint8_t *>(&g);
+    memcpy(dst + game_state_begin, src, game_state_end - game_state_begin);
+    src += game_state_end - game_state_begin;
+    for (const auto &array : game_arrays(g))
+    {
+        memcpy(array.items, src, array.size);
+        src += array.size;
+    }
+    particles_load(g.gameplay.particles, src);
+}
+
+bool game_state_valid(const uint8_t *src, size_t size)
+{
+    size_t fixed_size =
+        sizeof(Game_Config) + game_state_end - game_state_begin;
+    if (size < fixed_size)
+    {
+        return false;
+    }
+    Camera camera;
+    memcpy(&camera,
+           src + sizeof(Game_Config) + offsetof(Game, camera) -
+               game_state_begin,
+           sizeof(Camera));
+    if (!(camera.aspect > 0.0f && camera.aspect < game_aspect_max))
+    {
+        return false;
+    }
+    Game_Config config;
+    memcpy(&config, src, sizeof(Game_Config));
+    if ((config.start_state != GAME_STATE_MENU &&
+         config.start_state != GAME_STATE_GAMEPLAY) ||
+        config.menu_stars_count < 0 || config.gameplay_stars_count < 0 ||
+        config.menu_balls_count < 1 || config.menu_boxes_count < 0)
+    {
+        return false;
+    }
+    size -= fixed_size;
+    src += fixed_size;
+    for (size_t array_size : game_array_sizes(config))
+    {
+        if (size < array_size)
+        {
+            return false;
+        }
+        size -= array_size;
+        src += array_size;
+    }
+    return particles_state_valid(src, size);
+}
+
+Game_Config game_default_config()
+{
+    Game_Config config = {};
+    config.start_state = GAME_STATE_GAMEPLAY;
+    config.menu_stars_count = menu_stars_default_count;
+    config.gameplay_stars_count = gameplay_stars_default_count;
+    config.menu_balls_count = 1;
+    config.menu_boxes_count = 0;
+    return config;
+}
+
+void game_init(Game &g, Input &input, Renderer &renderer, Job_System &jobs,
+               uint32_t rand_seed, const Game_Config &config)
+{
+    assert(config.menu_balls_count >= 1);
     g.input = &input;
     g.renderer = &renderer;
+    g.jobs = &jobs;
+    game_reserve_arrays(g, config);
 
     rnd_gamerand_seed(&g.rand, rand_seed);
+    g.rand_seed = rand_seed;
 
     g.camera.eye = HMM_V3(0.0f, 0.0f, 100.0f);
     g.camera.center = HMM_V3(0.0f, 0.0f, 0.0f);
     g.camera.up = HMM_V3(0.0f, 1.0f, 0.0f);
     g.camera.fov_rad = HMM_DegToRad * 40.0f;
-    g.camera.aspect = static_cast<float>(g.renderer->framebuffer_width) /
-                      static_cast<float>(g.renderer->framebuffer_height);
+    g.camera.aspect = game_view_aspect(g);
     g.camera.z_min = 0.1f;
     g.camera.z_max = 1000.0f;
 
-    g.current_state = GAME_STATE_GAMEPLAY;
-    gameplay_state_init(g);
+    g.current_state = config.start_state;
+    switch (g.current_state)
+    {
+    case GAME_STATE_MENU:
+        menu_state_init(g);
+        break;
+    case GAME_STATE_GAMEPLAY:
+        gameplay_state_init(g);
+        break;
+    }
 }
 
 static void intro_state_input(Game &g)
@@ -238,8 +560,10 @@ static void ball_paddle_bounce(Ball &ball, const Paddle &paddle)
         (ball.position.Y - paddle.position.Y) / paddle.bounds.half_extent.Y;
     float abs_angle = HMM_ABS(angle);
 
-    ball.velocity.Y = ball_speed * HMM_SinF(angle);
-    ball.velocity.X = ball_speed * HMM_CosF(angle);
+    float sin_angle, cos_angle;
+    fast_sincos(angle, sin_angle, cos_angle);
+    ball.velocity.Y = ball_speed * sin_angle;
+    ball.velocity.X = ball_speed * cos_angle;
 
     if (abs_angle > 0.6f)
     {
@@ -275,38 +599,54 @@ static void paddle_move(Paddle &paddle, float delta_time)
 
 static void menu_state_sim(Game &g, float total_time, float delta_time)
 {
-    auto &ball = g.menu.ball;
-
-    // Update.
+    // Update and collision, the balls only bounce off the edges of the view.
     {
-        ball_move(ball, delta_time);
-        ball.bounds = bounding_box_entity_bounds(ball.position, ball.scale);
-
-        g.camera.center = HMM_LerpV3(g.camera.center, delta_time * 0.8f,
-                                     ball.position * 0.1f);
-
-        for (int i = 0; i < menu_background_stars_count; i += 1)
+        auto *balls = g.arrays.menu_balls;
+        auto update = [balls, &camera = g.camera, delta_time](int begin,
+                                                              int end)
         {
-            background_star_update(g.menu.background_stars[i], g, total_time,
-                                   delta_time);
-        }
-    }
+            for (int i = begin; i < end; i += 1)
+            {
+                auto &ball = balls[i];
+                ball_move(ball, delta_time);
+                ball.bounds =
+                    bounding_box_entity_bounds(ball.position, ball.scale);
+
+                auto view_bounds = bounding_box_view_bounds_at_z(
+                    camera, camera.eye.Z + HMM_ABS(ball.position.Z));
+                if (ball.bounds.min.X <= view_bounds.min.X ||
+                    ball.bounds.max.X >= view_bounds.max.X)
+                {
+                    ball.velocity.X *= -1.0f;
+                }
+                if (ball.bounds.min.Y <= view_bounds.min.Y ||
+                    ball.bounds.max.Y >= view_bounds.max.Y)
+                {
+                    ball.velocity.Y *= -1.0f;
+                }
+            }
+        };
+        jobs_parallel_for(*g.jobs, g.config.menu_balls_count,
+                          menu_balls_sim_grain_size, update);
 
-    // Collision.
-    {
-        auto view_bounds = bounding_box_view_bounds_at_z(
-            g.camera, g.camera.eye.Z + HMM_ABS(ball.position.Z));
+        g.camera.center = HMM_LerpV3(g.camera.center, delta_time * 0.8f,
+                                     balls[0].position * 0.1f);
 
-        if (ball.bounds.min.X <= view_bounds.min.X ||
-            ball.bounds.max.X >= view_bounds.max.X)
+        auto *boxes = g.arrays.menu_boxes;
+        auto spin = [boxes, delta_time](int begin, int end)
         {
-            ball.velocity.X *= -1.0f;
-        }
-        if (ball.bounds.min.Y <= view_bounds.min.Y ||
-            ball.bounds.max.Y >= view_bounds.max.Y)
-        {
-            ball.velocity.Y *= -1.0f;
-        }
+            for (int i = begin; i < end; i += 1)
+            {
+                boxes[i].rotation += boxes[i].rotation_speed * delta_time;
+            }
+        };
+        jobs_parallel_for(*g.jobs, g.config.menu_boxes_count,
+                          menu_boxes_sim_grain_size, spin);
+
+        background_stars_sim(g.arrays.menu_stars, g.config.menu_stars_count,
+                             g.menu.stars_time, g,
+                             GAME_RAND_STREAM_MENU_STARS, total_time,
+                             delta_time);
     }
 }
 
@@ -321,6 +661,9 @@ static void gameplay_state_sim(Game &g, float total_time, float delta_time)
         ball_move(ball, delta_time);
         ball.bounds = bounding_box_entity_bounds(ball.position, ball.scale);
 
+        particles_sim(g.gameplay.particles, delta_time);
+        ball_trail_emit(g, ball, delta_time);
+
         paddle_move(paddle_left, delta_time);
         paddle_left.bounds =
             bounding_box_entity_bounds(paddle_left.position, paddle_left.scale);
@@ -332,11 +675,11 @@ static void gameplay_state_sim(Game &g, float total_time, float delta_time)
         g.camera.center = HMM_LerpV3(g.camera.center, delta_time * 0.8f,
                                      ball.position * 0.1f);
 
-        for (int i = 0; i < gameplay_background_stars_count; i += 1)
-        {
-            background_star_update(g.gameplay.background_stars[i], g,
-                                   total_time, delta_time);
-        }
+        background_stars_sim(g.arrays.gameplay_stars,
+                             g.config.gameplay_stars_count,
+                             g.gameplay.stars_time, g,
+                             GAME_RAND_STREAM_GAMEPLAY_STARS, total_time,
+                             delta_time);
     }
 
     // Collision.
@@ -353,6 +696,11 @@ static void gameplay_state_sim(Game &g, float total_time, float delta_time)
             ball.position.X =
                 paddle_left.bounds.max.X + ball.bounds.half_extent.X;
             ball_paddle_bounce(ball, paddle_left);
+            game_event_push(g, GAME_EVENT_PADDLE_HIT, ball.position);
+            sparks_emit(g, HMM_V3(paddle_left.bounds.max.X, ball.position.Y,
+                                  ball.position.Z),
+                        HMM_V3(1.0f, 0.0f, 0.0f), paddle_left.color,
+                        paddle_hit_sparks_count);
         }
         // Ball to right paddle.
         if (ball.velocity.X > 0.0f &&
@@ -361,35 +709,62 @@ static void gameplay_state_sim(Game &g, float total_time, float delta_time)
             ball.position.X =
                 paddle_right.bounds.min.X - ball.bounds.half_extent.X;
             ball_paddle_bounce(ball, paddle_right);
+            game_event_push(g, GAME_EVENT_PADDLE_HIT, ball.position);
+            sparks_emit(g, HMM_V3(paddle_right.bounds.min.X, ball.position.Y,
+                                  ball.position.Z),
+                        HMM_V3(-1.0f, 0.0f, 0.0f), paddle_right.color,
+                        paddle_hit_sparks_count);
         }
 
         // Ball to left boundary.
         if (bounding_box_colliding(ball.bounds, boundary_left.bounds))
         {
+            g.gameplay.score_right += 1;
+            game_event_push(g, GAME_EVENT_SCORE, ball.position);
             ball.position.X =
                 boundary_left.bounds.max.X + ball.bounds.half_extent.X;
             ball.velocity.X *= -1.0f;
+            sparks_emit(g, HMM_V3(boundary_left.bounds.max.X, ball.position.Y,
+                                  ball.position.Z),
+                        HMM_V3(1.0f, 0.0f, 0.0f), boundary_left.color,
+                        boundary_hit_sparks_count);
         }
         // Ball to right boundary.
         if (bounding_box_colliding(ball.bounds, boundary_right.bounds))
         {
+            g.gameplay.score_left += 1;
+            game_event_push(g, GAME_EVENT_SCORE, ball.position);
             ball.position.X =
                 boundary_right.bounds.min.X - ball.bounds.half_extent.X;
             ball.velocity.X *= -1.0f;
+            sparks_emit(g, HMM_V3(boundary_right.bounds.min.X, ball.position.Y,
+                                  ball.position.Z),
+                        HMM_V3(-1.0f, 0.0f, 0.0f), boundary_right.color,
+                        boundary_hit_sparks_count);
         }
         // Ball to top boundary.
         if (bounding_box_colliding(ball.bounds, boundary_top.bounds))
         {
             ball.position.Y =
                 boundary_top.bounds.min.Y - ball.bounds.half_extent.Y;
+            game_event_push(g, GAME_EVENT_WALL_HIT, ball.position);
             ball.velocity.Y *= -1.0f;
+            sparks_emit(g, HMM_V3(ball.position.X, boundary_top.bounds.min.Y,
+                                  ball.position.Z),
+                        HMM_V3(0.0f, -1.0f, 0.0f), boundary_top.color,
+                        boundary_hit_sparks_count);
         }
         // Ball to bottom boundary.
         if (bounding_box_colliding(ball.bounds, boundary_bottom.bounds))
         {
             ball.position.Y =
                 boundary_bottom.bounds.max.Y + ball.bounds.half_extent.Y;
+            game_event_push(g, GAME_EVENT_WALL_HIT, ball.position);
             ball.velocity.Y *= -1.0f;
+            sparks_emit(g, HMM_V3(ball.position.X, boundary_bottom.bounds.max.Y,
+                                  ball.position.Z),
+                        HMM_V3(0.0f, 1.0f, 0.0f), boundary_bottom.color,
+                        boundary_hit_sparks_count);
         }
 
         // Left paddle to top boundary.
@@ -413,9 +788,6 @@ static void gameplay_state_sim(Game &g, float total_time, float delta_time)
 
 void game_sim(Game &g, float total_time_secs, float delta_time_secs)
 {
-    g.camera.aspect = static_cast<float>(g.renderer->framebuffer_width) /
-                      static_cast<float>(g.renderer->framebuffer_height);
-
     switch (g.current_state)
     {
     case GAME_STATE_MENU:
@@ -427,9 +799,157 @@ void game_sim(Game &g, float total_time_secs, float delta_time_secs)
     }
 }
 
+void game_tick(Game &g, uint64_t tick)
+{
+    game_input(g);
+    game_sim(g, static_cast<float>(static_cast<double>(tick) * game_tick_secs),
+             static_cast<float>(game_tick_secs));
+}
+
+void game_get_entities(const Game &g, Game_Entities &entities)
+{
+    entities.ball_position = g.gameplay.ball.position.XY;
+    entities.paddle_left_y = g.gameplay.paddle_left.position.Y;
+    entities.paddle_right_y = g.gameplay.paddle_right.position.Y;
+    entities.score_left = g.gameplay.score_left;
+    entities.score_right = g.gameplay.score_right;
+}
+
+void game_spectate(Game &g, const Game_Entities &entities,
+                   float total_time_secs, float delta_time_secs)
+{
+    auto &gameplay = g.gameplay;
+    auto &ball = gameplay.ball;
+    // The trail follows the velocity, which a spectator only sees as
+    // movement. Jumps, after the stream stalled, don't leave a trail.
+    HMM_Vec2 velocity = HMM_V2(0.0f, 0.0f);
+    if (delta_time_secs > 0.0f)
+    {
+        velocity = (entities.ball_position - ball.position.XY) /
+                   delta_time_secs;
+    }
+    ball.velocity = HMM_LenV2(velocity) <= ball_max_speed * 2.0f
+                        ? velocity
+                        : HMM_V2(0.0f, 0.0f);
+    ball.position.XY = entities.ball_position;
+    ball.bounds = bounding_box_entity_bounds(ball.position, ball.scale);
+
+    auto &paddle_left = gameplay.paddle_left;
+    paddle_left.position.Y = entities.paddle_left_y;
+    paddle_left.bounds =
+        bounding_box_entity_bounds(paddle_left.position, paddle_left.scale);
+    auto &paddle_right = gameplay.paddle_right;
+    paddle_right.position.Y = entities.paddle_right_y;
+    paddle_right.bounds =
+        bounding_box_entity_bounds(paddle_right.position, paddle_right.scale);
+
+    gameplay.score_left = entities.score_left;
+    gameplay.score_right = entities.score_right;
+
+    particles_sim(gameplay.particles, delta_time_secs);
+    ball_trail_emit(g, ball, delta_time_secs);
+    g.camera.center = HMM_LerpV3(g.camera.center, delta_time_secs * 0.8f,
+                                 ball.position * 0.1f);
+    background_stars_sim(g.arrays.gameplay_stars,
+                         g.config.gameplay_stars_count, gameplay.stars_time, g,
+                         GAME_RAND_STREAM_GAMEPLAY_STARS, total_time_secs,
+                         delta_time_secs);
+}
+
+// Multiplies in 8 bytes at a time. The hashed state is around 100 bytes,
+// which takes well under 100ns.
+static inline uint64_t game_hash_bytes(uint64_t hash, const void *data,
+                                       size_t size)
+{
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i += 8)
+    {
+        uint64_t word = 0;
+        memcpy(&word, bytes + i, std::min<size_t>(8, size - i));
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+template <typename... T>
+static uint64_t game_hash_values(const T &...values)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    ((hash = game_hash_bytes(hash, &values, sizeof(values))), ...);
+    return hash;
+}
+
+void game_hash_fields(const Game &g, uint64_t *hashes)
+{
+    const auto &gameplay = g.gameplay;
+    hashes[GAME_HASH_FIELD_RAND] = game_hash_values(g.rand);
+    hashes[GAME_HASH_FIELD_STATE] = game_hash_values(g.current_state);
+    // Only simulated in the menu.
+    uint64_t menu_balls_hash = 0;
+    if (g.current_state == GAME_STATE_MENU)
+    {
+        for (int i = 0; i < g.config.menu_balls_count; i += 1)
+        {
+            const auto &ball = g.arrays.menu_balls[i];
+            uint64_t hash = game_hash_values(ball.position, ball.velocity);
+            menu_balls_hash = game_hash_bytes(menu_balls_hash, &hash,
+                                              sizeof(hash));
+        }
+    }
+    hashes[GAME_HASH_FIELD_MENU_BALLS] = menu_balls_hash;
+    const auto &ball = gameplay.ball;
+    hashes[GAME_HASH_FIELD_BALL] =
+        game_hash_values(ball.position, ball.velocity, ball.glow);
+    const auto &paddle_left = gameplay.paddle_left;
+    hashes[GAME_HASH_FIELD_PADDLE_LEFT] = game_hash_values(
+        paddle_left.position, paddle_left.y_target, paddle_left.glow);
+    const auto &paddle_right = gameplay.paddle_right;
+    hashes[GAME_HASH_FIELD_PADDLE_RIGHT] = game_hash_values(
+        paddle_right.position, paddle_right.y_target, paddle_right.glow);
+    hashes[GAME_HASH_FIELD_SCORES] =
+        game_hash_values(gameplay.score_left, gameplay.score_right);
+    hashes[GAME_HASH_FIELD_TRAIL] =
+        game_hash_values(gameplay.trail_accumulator);
+}
+
+const char *game_hash_field_name(Game_Hash_Field field)
+{
+    switch (field)
+    {
+    case GAME_HASH_FIELD_RAND:
+        return "rand";
+    case GAME_HASH_FIELD_STATE:
+        return "current_state";
+    case GAME_HASH_FIELD_MENU_BALLS:
+        return "menu.balls";
+    case GAME_HASH_FIELD_BALL:
+        return "gameplay.ball";
+    case GAME_HASH_FIELD_PADDLE_LEFT:
+        return "gameplay.paddle_left";
+    case GAME_HASH_FIELD_PADDLE_RIGHT:
+        return "gameplay.paddle_right";
+    case GAME_HASH_FIELD_SCORES:
+        return "gameplay.score_*";
+    case GAME_HASH_FIELD_TRAIL:
+        return "gameplay.trail_accumulator";
+    case GAME_HASH_FIELD_COUNT:
+        break;
+    }
+    return "unknown";
+}
+
+uint64_t game_hash(const Game &g)
+{
+    uint64_t hashes[GAME_HASH_FIELD_COUNT];
+    game_hash_fields(g, hashes);
+    return game_hash_bytes(0, hashes, sizeof(hashes));
+}
+
 static void menu_state_draw(const Game &g)
 {
-    const auto &ball = g.menu.ball;
+    const auto *balls = g.arrays.menu_balls;
+    const auto &ball = balls[0];
 
     auto &point_light = g.renderer->game_pass.point_lights[0];
     point_light.position = ball.position;
@@ -438,19 +958,38 @@ static void menu_state_draw(const Game &g)
     g.renderer->game_pass.world_to_view_transform =
         HMM_LookAt_RH(g.camera.eye, g.camera.center, g.camera.up);
     g.renderer->game_pass.view_to_clip_transform = HMM_Perspective_RH_ZO(
-        g.camera.fov_rad, g.camera.aspect, g.camera.z_min, g.camera.z_max);
+        g.camera.fov_rad, game_view_aspect(g), g.camera.z_min,
+        g.camera.z_max);
 
-    renderer_draw_basic_box_instance(*g.renderer, ball.position,
-                                     HMM_V3(0.0f, 0.0f, 0.0f), ball.scale,
-                                     ball.color * ball.glow);
+    int balls_count = g.config.menu_balls_count;
+    auto *instances = renderer_push_basic_box_instances(*g.renderer,
+                                                        balls_count);
+    auto build = [balls, instances](int begin, int end)
+    {
+        for (int i = begin; i < end; i += 1)
+        {
+            const auto &ball = balls[i];
+            renderer_set_basic_box_instance(instances[i], ball.position,
+                                            HMM_V3(0.0f, 0.0f, 0.0f),
+                                            ball.scale,
+                                            ball.color * ball.glow);
+        }
+    };
+    jobs_parallel_for(*g.jobs, balls_count, menu_balls_draw_grain_size,
+                      build);
 
-    for (int i = 0; i < menu_background_stars_count; i += 1)
+    for (int i = 0; i < g.config.menu_boxes_count; i += 1)
     {
-        const auto &star = g.menu.background_stars[i];
-        renderer_draw_basic_box_instance(
-            *g.renderer, star.position, star.rotation,
-            HMM_V3(star.scale, star.scale, star.scale), star.color * star.glow);
+        const auto &box = g.arrays.menu_boxes[i];
+        renderer_draw_phong_box(*g.renderer, box.position, box.rotation,
+                                box.scale, box.color);
     }
+
+    renderer_draw_text(*g.renderer, "PONG 3D", HMM_V3(0.0f, 4.0f, -20.0f), {},
+                       8.0f, colors[COLOR_WHITE] * 3.0f, TEXT_ALIGN_CENTER);
+
+    background_stars_draw(g.arrays.menu_stars, g.config.menu_stars_count,
+                          g.menu.stars_time, GAME_RAND_STREAM_MENU_STARS, g);
 }
 
 static void gameplay_state_draw(const Game &g)
@@ -464,7 +1003,8 @@ static void gameplay_state_draw(const Game &g)
     g.renderer->game_pass.world_to_view_transform =
         HMM_LookAt_RH(g.camera.eye, g.camera.center, g.camera.up);
     g.renderer->game_pass.view_to_clip_transform = HMM_Perspective_RH_ZO(
-        g.camera.fov_rad, g.camera.aspect, g.camera.z_min, g.camera.z_max);
+        g.camera.fov_rad, game_view_aspect(g), g.camera.z_min,
+        g.camera.z_max);
 
     auto draw_boundary = [&g](const Boundary &boundary)
     {
@@ -488,13 +1028,23 @@ static void gameplay_state_draw(const Game &g)
     renderer_draw_basic_box_instance(*g.renderer, ball.position, {}, ball.scale,
                                      ball.color * ball.glow);
 
-    for (int i = 0; i < gameplay_background_stars_count; i += 1)
+    // Behind the play field, so the ball passes in front of the scores.
+    auto draw_score = [&g](int score, float x, const Paddle &paddle)
     {
-        const auto &star = g.gameplay.background_stars[i];
-        renderer_draw_basic_box_instance(
-            *g.renderer, star.position, star.rotation,
-            HMM_V3(star.scale, star.scale, star.scale), star.color * star.glow);
-    }
+        char text[16];
+        snprintf(text, sizeof(text), "%d", score);
+        renderer_draw_text(*g.renderer, text, HMM_V3(x, 22.0f, -2.0f), {},
+                           score_text_size, paddle.color * score_text_glow,
+                           TEXT_ALIGN_CENTER);
+    };
+    draw_score(g.gameplay.score_left, -15.0f, g.gameplay.paddle_left);
+    draw_score(g.gameplay.score_right, 15.0f, g.gameplay.paddle_right);
+
+    particles_draw(g.gameplay.particles, *g.renderer, *g.jobs);
+
+    background_stars_draw(g.arrays.gameplay_stars,
+                          g.config.gameplay_stars_count, g.gameplay.stars_time,
+                          GAME_RAND_STREAM_GAMEPLAY_STARS, g);
 }
 
 void game_draw(const Game &g)
@@ -512,7 +1062,7 @@ void game_draw(const Game &g)
 
 static float pulsate(float time, float min, float max, float speed)
 {
-    float pulse = (HMM_SinF(time * speed) + 1.0f) * 0.5f;
+    float pulse = (fast_sin(time * speed) + 1.0f) * 0.5f;
     return pulse * (max - min) + min;
 }
 
@@ -525,6 +1075,17 @@ static float ease_in_out(float time)
     return -1.0f + (4.0f - 2.0f * time) * time; // Ease out
 }
 
+static float game_view_aspect(const Game &g)
+{
+    if (g.renderer->framebuffer_width <= 0 ||
+        g.renderer->framebuffer_height <= 0)
+    {
+        return game_default_aspect;
+    }
+    return static_cast<float>(g.renderer->framebuffer_width) /
+           static_cast<float>(g.renderer->framebuffer_height);
+}
+
 static float rand_float(rnd_gamerand_t &rand)
 {
     return rnd_gamerand_nextf(&rand);
@@ -535,9 +1096,9 @@ static float rand_float(rnd_gamerand_t &rand, float min, float max)
     return min + rnd_gamerand_nextf(&rand) * (max - min);
 }
 
-static int rand_int(rnd_gamerand_t &rand, int min, int max)
+static Philox_Key rand_key(const Game &g, Game_Rand_Stream stream)
 {
-    return rnd_gamerand_range(&rand, min, max);
+    return philox_key(g.rand_seed, static_cast<uint32_t>(stream));
 }
 
 static Bounding_Box bounding_box_entity_bounds(HMM_Vec3 position,
@@ -552,7 +1113,7 @@ static Bounding_Box bounding_box_entity_bounds(HMM_Vec3 position,
 
 static Bounding_Box bounding_box_view_bounds_at_z(const Camera &c, float z_dist)
 {
-    float visible_height = 2.0f * z_dist * HMM_TanF(c.fov_rad * 0.5f);
+    float visible_height = 2.0f * z_dist * fast_tan(c.fov_rad * 0.5f);
     float visible_width = visible_height * c.aspect;
     Bounding_Box bounds;
     bounds.min.X = -visible_width * 0.5f;
@@ -570,32 +1131,82 @@ static bool bounding_box_colliding(Bounding_Box a, Bounding_Box b)
            (a.max.Z >= b.min.Z && a.min.Z <= b.max.Z);
 }
 
-static void background_star_reset(Background_Star &star, Game &g)
+// Takes 3 random blocks.
+static void background_star_reset(Background_Star &star, const Camera &camera,
+                                  const Philox_Block *blocks)
 {
-    float z = rand_float(g.rand, g.camera.eye.Z * 2.0f, g.camera.z_max * 0.9f);
-    auto view_bounds =
-        bounding_box_view_bounds_at_z(g.camera, g.camera.eye.Z + z);
+    auto rand = [blocks](int i, float min, float max)
+    { return philox_float(blocks[i / 4].v[i % 4], min, max); };
+
+    float z = rand(0, camera.eye.Z * 2.0f, camera.z_max * 0.9f);
+    auto view_bounds = bounding_box_view_bounds_at_z(camera, camera.eye.Z + z);
 
-    star.position =
-        HMM_V3(rand_float(g.rand, view_bounds.min.X, view_bounds.max.X),
-               rand_float(g.rand, view_bounds.min.Y, view_bounds.max.Y), -z);
+    star.position = HMM_V3(rand(1, view_bounds.min.X, view_bounds.max.X),
+                           rand(2, view_bounds.min.Y, view_bounds.max.Y), -z);
 
-    star.rotation_speed =
-        HMM_V3(rand_float(g.rand, 0.0f, 2.5f), rand_float(g.rand, 0.0f, 2.5f),
-               rand_float(g.rand, 0.0f, 2.5f));
+    star.rotation_speed = HMM_V3(rand(3, 0.0f, 2.5f), rand(4, 0.0f, 2.5f),
+                                 rand(5, 0.0f, 2.5f));
 
     star.scale = 0.0f;
-    star.color = colors[rand_int(g.rand, 0, COLOR_COUNT - 1)];
-    star.glow_min = rand_float(g.rand, 5.0f, 10.0f);
-    star.glow_max = rand_float(g.rand, star.glow_min, 15.0f);
-    star.glow_speed = rand_float(g.rand, 0.25f, 5.0f);
+    star.color = colors[philox_range(blocks[1].v[2], 0, COLOR_COUNT - 1)];
+    star.glow_min = rand(7, 5.0f, 10.0f);
+    star.glow_max = rand(8, star.glow_min, 15.0f);
+    star.glow_speed = rand(9, 0.25f, 5.0f);
     star.glow = star.glow_min;
-    star.max_lifetime = rand_float(g.rand, 2.0f, 10.0f);
+    star.max_lifetime = rand(10, 2.0f, 10.0f);
     star.lifetime = 0.0f;
 }
 
-void background_star_update(Background_Star &star, Game &g, float total_time,
-                            float delta_time)
+// Respawns the stars in [begin, end) that burned out, or all of them. Each
+// star draws from its own counters, its index and how often it spawned, so
+// any range can be respawned on any thread and the result is the same.
+static void background_stars_respawn(Background_Star *stars, int begin,
+                                     int end, const Camera &camera,
+                                     Philox_Key key, bool all)
+{
+    constexpr int blocks_per_star = 3;
+    constexpr int blocks_count =
+        background_stars_respawn_batch_count * blocks_per_star;
+    int i = begin;
+    while (i < end)
+    {
+        int indices[background_stars_respawn_batch_count];
+        int indices_count = 0;
+        for (; i < end && indices_count < background_stars_respawn_batch_count;
+             i += 1)
+        {
+            if (all || stars[i].lifetime >= stars[i].max_lifetime * 2.0f)
+            {
+                indices[indices_count] = i;
+                indices_count += 1;
+            }
+        }
+
+        Philox_Counter counters[blocks_count];
+        Philox_Block blocks[blocks_count];
+        for (int j = 0; j < indices_count; j += 1)
+        {
+            auto index = static_cast<uint32_t>(indices[j]);
+            for (int k = 0; k < blocks_per_star; k += 1)
+            {
+                counters[j * blocks_per_star + k] = {
+                    {index, stars[index].spawn_count,
+                     static_cast<uint32_t>(k), 0}};
+            }
+        }
+        philox4x32_blocks(key, counters, blocks,
+                          indices_count * blocks_per_star);
+        for (int j = 0; j < indices_count; j += 1)
+        {
+            auto &star = stars[indices[j]];
+            background_star_reset(star, camera, blocks + j * blocks_per_star);
+            star.spawn_count += 1;
+        }
+    }
+}
+
+static void background_star_update(Background_Star &star, float total_time,
+                                   float delta_time)
 {
     float progress = star.lifetime / star.max_lifetime;
     if (progress < 1.0f)
@@ -608,12 +1219,129 @@ void background_star_update(Background_Star &star, Game &g, float total_time,
     }
 
     star.lifetime += delta_time;
-    if (star.lifetime >= star.max_lifetime * 2.0f)
-    {
-        background_star_reset(star, g);
-    }
-
     star.rotation += star.rotation_speed * delta_time;
     star.glow =
         pulsate(total_time, star.glow_min, star.glow_max, star.glow_speed);
 }
+
+static void background_stars_sim(Background_Star *stars, int count,
+                                 float &stars_time, Game &g,
+                                 Game_Rand_Stream stream, float total_time,
+                                 float delta_time)
+{
+    stars_time += delta_time;
+    if (g.procedural_stars_count > 0)
+    {
+        return;
+    }
+
+    Philox_Key key = rand_key(g, stream);
+    auto update = [stars, &camera = g.camera, key, total_time,
+                   delta_time](int begin, int end)
+    {
+        for (int i = begin; i < end; i += 1)
+        {
+            background_star_update(stars[i], total_time, delta_time);
+        }
+        background_stars_respawn(stars, begin, end, camera, key, false);
+    };
+    jobs_parallel_for(*g.jobs, count, background_stars_sim_grain_size, update);
+}
+
+static void background_stars_draw(const Background_Star *stars, int count,
+                                  float stars_time, Game_Rand_Stream stream,
+                                  const Game &g)
+{
+    if (g.procedural_stars_count > 0)
+    {
+        // The same spawn volume as background_star_reset().
+        Star_Field_Desc desc = {};
+        desc.count = g.procedural_stars_count;
+        desc.seed = g.rand_seed;
+        desc.stream = static_cast<uint32_t>(stream);
+        desc.time = stars_time;
+        desc.eye_z = g.camera.eye.Z;
+        desc.z_near = g.camera.eye.Z * 2.0f;
+        desc.z_far = g.camera.z_max * 0.9f;
+        desc.fov_rad = g.camera.fov_rad;
+        desc.aspect = g.camera.aspect;
+        static_assert(COLOR_COUNT <= star_field_colors_max_count);
+        for (int i = 0; i < COLOR_COUNT; i += 1)
+        {
+            desc.colors[i] = colors[i];
+        }
+        desc.colors_count = COLOR_COUNT;
+        renderer_draw_star_field(*g.renderer, desc);
+        return;
+    }
+
+    auto *instances = renderer_push_basic_box_instances(*g.renderer, count);
+    auto build = [stars, instances](int begin, int end)
+    {
+        for (int i = begin; i < end; i += 1)
+        {
+            const auto &star = stars[i];
+            renderer_set_basic_box_instance(
+                instances[i], star.position, star.rotation,
+                HMM_V3(star.scale, star.scale, star.scale),
+                star.color * star.glow);
+        }
+    };
+    jobs_parallel_for(*g.jobs, count, background_stars_draw_grain_size, build);
+}
+
+static void sparks_emit(Game &g, HMM_Vec3 position, HMM_Vec3 direction,
+                        HMM_Vec3 color, int count)
+{
+    Particle_Emitter emitter = {};
+    emitter.direction = direction;
+    emitter.spread = 0.7f;
+    emitter.speed_min = 10.0f;
+    emitter.speed_max = 60.0f;
+    emitter.lifetime_min = 0.3f;
+    emitter.lifetime_max = 1.2f;
+    emitter.size_min = 0.06f;
+    emitter.size_max = 0.18f;
+    emitter.color = color * spark_glow;
+    particles_emit(g.gameplay.particles,
+                   rand_key(g, GAME_RAND_STREAM_PARTICLES), emitter, position,
+                   count);
+}
+
+static void ball_trail_emit(Game &g, const Ball &ball, float delta_time)
+{
+    g.gameplay.trail_accumulator += ball_trail_particles_per_sec * delta_time;
+    int count = static_cast<int>(g.gameplay.trail_accumulator);
+    g.gameplay.trail_accumulator -= static_cast<float>(count);
+
+    // Spread along the distance the ball covered this step.
+    Particle_Emitter emitter = {};
+    emitter.direction = HMM_V3(0.0f, 0.0f, 1.0f);
+    emitter.spread = 1.0f;
+    emitter.speed_min = 0.5f;
+    emitter.speed_max = 3.0f;
+    emitter.lifetime_min = 0.2f;
+    emitter.lifetime_max = 0.6f;
+    emitter.size_min = 0.15f;
+    emitter.size_max = 0.4f;
+    emitter.color = ball.color * ball.glow * 0.5f;
+    emitter.path = HMM_V3(-ball.velocity.X, -ball.velocity.Y, 0.0f) *
+                   delta_time;
+    particles_emit(g.gameplay.particles,
+                   rand_key(g, GAME_RAND_STREAM_PARTICLES), emitter,
+                   ball.position, count);
+}
+
+static void game_event_push(Game &g, Game_Event_Type type, HMM_Vec3 position)
+{
+    if (g.events_count == game_events_max_count)
+    {
+        return;
+    }
+
+    float half_width = g.gameplay.boundary_right.position.X;
+    auto &event = g.events[g.events_count];
+    event.type = type;
+    event.pan = HMM_Clamp(-1.0f, position.X / half_width, 1.0f);
+    g.events_count += 1;
+}
@@ -1,13 +1,17 @@
 #pragma once
 
 #include "HandmadeMath.h"
+#include "particles.h"
 #include "rnd.h"
+#include <cstddef>
 #include <cstdint>
 
-inline constexpr int menu_background_stars_count = 256;
-inline constexpr int gameplay_background_stars_count = 128;
+inline constexpr int game_events_max_count = 16;
+// Length of a fixed step.
+inline constexpr double game_tick_secs = 1.0 / 60.0;
 
 struct Input;
+struct Job_System;
 struct Renderer;
 
 enum Game_State
@@ -16,6 +20,46 @@ enum Game_State
     GAME_STATE_GAMEPLAY,
 };
 
+// The parts of the state that decide how the game plays out, hashed one by
+// one so a desync can be traced to where it started.
+enum Game_Hash_Field
+{
+    GAME_HASH_FIELD_RAND,
+    GAME_HASH_FIELD_STATE,
+    GAME_HASH_FIELD_MENU_BALLS,
+    GAME_HASH_FIELD_BALL,
+    GAME_HASH_FIELD_PADDLE_LEFT,
+    GAME_HASH_FIELD_PADDLE_RIGHT,
+    GAME_HASH_FIELD_SCORES,
+    GAME_HASH_FIELD_TRAIL,
+    GAME_HASH_FIELD_COUNT,
+};
+
+enum Game_Event_Type
+{
+    GAME_EVENT_PADDLE_HIT,
+    GAME_EVENT_WALL_HIT,
+    GAME_EVENT_SCORE,
+};
+
+// Something the player should hear about.
+struct Game_Event
+{
+    Game_Event_Type type;
+    // Where it happened, from -1 (left edge) to 1 (right edge).
+    float pan;
+};
+
+// What a spectator gets to see of a match, see broadcast.h.
+struct Game_Entities
+{
+    HMM_Vec2 ball_position;
+    float paddle_left_y;
+    float paddle_right_y;
+    int score_left;
+    int score_right;
+};
+
 struct Bounding_Box
 {
     HMM_Vec3 min;
@@ -64,6 +108,18 @@ struct Background_Star
     float glow;
     float max_lifetime;
     float lifetime;
+    // Respawns so far, part of the counter the next one draws from.
+    uint32_t spawn_count;
+};
+
+// Spins behind the menu title.
+struct Menu_Box
+{
+    HMM_Vec3 position;
+    HMM_Vec3 rotation;
+    HMM_Vec3 rotation_speed;
+    HMM_Vec3 scale;
+    HMM_Vec3 color;
 };
 
 struct Camera
@@ -72,15 +128,41 @@ struct Camera
     HMM_Vec3 center;
     HMM_Vec3 up;
     float fov_rad;
+    // Taken from the framebuffer by game_init() and kept from then on. Balls
+    // bounce and stars spawn off the view bounds, which have to come out the
+    // same in any window for replays to play back. The projection uses the
+    // framebuffer's own.
     float aspect;
     float z_min;
     float z_max;
 };
 
+// Entity counts, fixed from game_init() on. The defaults are what the game
+// is played with, the stress scenes (see stress.h) raise them.
+struct Game_Config
+{
+    Game_State start_state;
+    int menu_stars_count;
+    int gameplay_stars_count;
+    // At least 1. The first ball lights the menu and the camera follows it.
+    int menu_balls_count;
+    // Drawn with one draw call each.
+    int menu_boxes_count;
+};
+
+// Sized by the config and owned by the Game they are in.
+struct Game_Arrays
+{
+    Background_Star *menu_stars;
+    Ball *menu_balls;
+    Menu_Box *menu_boxes;
+    Background_Star *gameplay_stars;
+};
+
 struct Menu_State
 {
-    Ball ball;
-    Background_Star background_stars[menu_background_stars_count];
+    // Seconds since the stars first spawned, all procedural stars need.
+    float stars_time;
 };
 
 struct Gameplay_State
@@ -92,21 +174,78 @@ struct Gameplay_State
     Ball ball;
     Paddle paddle_left;
     Paddle paddle_right;
-    Background_Star background_stars[gameplay_background_stars_count];
+    int score_left;
+    int score_right;
+    // Fractional trail particles carried over to the next step.
+    float trail_accumulator;
+    float stars_time;
+    // Last, see game_copy().
+    Particles particles;
 };
 
 struct Game
 {
     Input *input;
     Renderer *renderer;
+    Job_System *jobs;
+    // Above zero, this many background stars are drawn procedurally on the
+    // GPU instead of the simulated ones, which are then left alone. Not
+    // state, it survives game_load_state().
+    int procedural_stars_count;
+    Game_Config config;
+    // Not part of the plain data below, game_copy() and game_save_state()
+    // handle them separately.
+    Game_Arrays arrays;
+    // Gameplay randomness, drawn in order.
     rnd_gamerand_t rand;
+    // Keys the counter based streams that stars and particles draw from.
+    uint32_t rand_seed;
     Camera camera;
     Game_State current_state;
     Menu_State menu;
+    // Added to by game_sim(), the caller handles and clears them.
+    Game_Event events[game_events_max_count];
+    int events_count;
+    // Last, see game_copy().
     Gameplay_State gameplay;
 };
 
-void game_init(Game &g, Input &input, Renderer &renderer, uint32_t rand_seed);
+Game_Config game_default_config();
+void game_init(Game &g, Input &input, Renderer &renderer, Job_System &jobs,
+               uint32_t rand_seed, const Game_Config &config);
+// Frees the arrays. g can be initialized or copied into again after.
+void game_shutdown(Game &g);
+// Copies the whole game state, but only the live part of the particle pool.
+// dst's arrays are reallocated if its config differs.
+void game_copy(Game &dst, const Game &src);
+// Serializes the config and everything game_sim() reads and writes into
+// game_state_size() bytes, in the native byte order and struct layout.
+// Loading keeps g's input, renderer and jobs, and takes on the saved config.
+size_t game_state_size(const Game &g);
+// The most game_state_size() can get to with g's config.
+size_t game_state_max_size(const Game &g);
+void game_save_state(const Game &g, uint8_t *dst);
+void game_load_state(Game &g, const uint8_t *src);
+// Whether size bytes at src are a state game_load_state() can load: a
+// config it can reserve the arrays for, a particle count that fits the pool
+// and exactly the size those imply. For states read from files.
+bool game_state_valid(const uint8_t *src, size_t size);
 void game_input(Game &g);
 void game_sim(Game &g, float total_time_secs, float delta_time_secs);
+// Runs game_input() and the fixed step of game_sim() for tick.
+void game_tick(Game &g, uint64_t tick);
+void game_get_entities(const Game &g, Game_Entities &entities);
+// Puts the entities where a broadcast says they are instead of simulating
+// them. The camera, stars and ball trail run as usual.
+void game_spectate(Game &g, const Game_Entities &entities,
+                   float total_time_secs, float delta_time_secs);
+// Cosmetic state, the camera, stars and the particles themselves, isn't
+// hashed. It never feeds back into play, and draws its random numbers from
+// its own counters rather than rand. Neither are sizes, colors and the
+// boundaries, which never change, or bounds, which follow from positions.
+// hashes has GAME_HASH_FIELD_COUNT entries.
+void game_hash_fields(const Game &g, uint64_t *hashes);
+const char *game_hash_field_name(Game_Hash_Field field);
+// Every field hash combined. Cheap enough to compute every tick.
+uint64_t game_hash(const Game &g);
 void game_draw(const Game &g);
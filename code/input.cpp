@@ -1,9 +1,114 @@
 #include "input.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+// evdev and uinput only exist on Linux.
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#define INPUT_EVDEV
+#endif
+
+static constexpr int input_evdev_devices_max_count = 16;
+// Devices in /dev/input looked at, most machines have a few dozen.
+static constexpr int input_evdev_paths_max_count = 64;
+// How long the check waits for each event to arrive.
+static constexpr uint64_t input_check_timeout_ns = 1000000000;
+
+struct Input_Key_Binding
+{
+    sapp_keycode key;
+    uint8_t controller;
+    Input_Controller_Button button;
+};
+
+static constexpr Input_Key_Binding input_window_key_bindings[] = {
+    {SAPP_KEYCODE_UP, 0, INPUT_CONTROLLER_BUTTON_UP},
+    {SAPP_KEYCODE_DOWN, 0, INPUT_CONTROLLER_BUTTON_DOWN},
+    {SAPP_KEYCODE_W, 1, INPUT_CONTROLLER_BUTTON_UP},
+    {SAPP_KEYCODE_S, 1, INPUT_CONTROLLER_BUTTON_DOWN},
+};
+
+struct Input_Evdev_Device
+{
+    int fd;
+    char path[32];
+    char name[64];
+    // A keyboard otherwise.
+    bool gamepad;
+    // The controller a gamepad drives, keyboards drive both.
+    uint8_t controller;
+    // Between a SYN_DROPPED and the next SYN_REPORT, after which the state
+    // is read again instead.
+    bool dropping;
+    // Buttons held through keys, per controller.
+    uint16_t keys[2];
+    bool has_stick;
+    int stick[2];
+    int stick_center[2];
+    // How far from the center the stick has to be to count as a press.
+    int stick_threshold[2];
+    int hat[2];
+    // The buttons last sent to the sim, per controller.
+    uint16_t held[2];
+};
+
+struct Input_Evdev
+{
+    std::thread thread;
+    std::atomic<bool> running;
+    // Wakes the thread for shutdown.
+    int wake_fd;
+    Input_Evdev_Device devices[input_evdev_devices_max_count];
+    int devices_count;
+
+    // Single producer, single consumer ring from the evdev thread.
+    Input_Event events[input_events_max_count];
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+    alignas(64) std::atomic<uint64_t> dropped_events_count;
+
+    // Main thread only, from the kernel's timestamp to input_poll().
+    alignas(64) uint64_t applied_events_count;
+    uint64_t latency_sum_ns;
+    uint64_t latency_max_ns;
+    uint64_t last_event_time_ns;
+};
+
+uint64_t input_now_ns()
+{
+#if defined(INPUT_EVDEV)
+    // The clock evdev is told to stamp events with.
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 +
+           static_cast<uint64_t>(ts.tv_nsec);
+#else
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+#endif
+}
 
 void input_init(Input &inp)
 {
-    inp.controllers_count = 1;
+    inp.controllers_count = 2;
     inp.controllers[0].enabled = true;
+    inp.controllers[1].enabled = true;
+    inp.window_keys = true;
 }
 
 static void input_controller_set_button(Input_Controller &c,
@@ -22,30 +127,90 @@ static void input_controller_set_button(Input_Controller &c,
 
 void input_handle_event(Input &inp, const sapp_event *ev)
 {
-    if (ev->type == SAPP_EVENTTYPE_KEY_DOWN)
+    if ((ev->type != SAPP_EVENTTYPE_KEY_DOWN &&
+         ev->type != SAPP_EVENTTYPE_KEY_UP) ||
+        ev->key_repeat || !inp.window_keys)
+    {
+        return;
+    }
+    for (const auto &binding : input_window_key_bindings)
     {
-        if (ev->key_code == SAPP_KEYCODE_UP)
+        if (ev->key_code != binding.key)
         {
-            input_controller_set_button(inp.controllers[0],
-                                        INPUT_CONTROLLER_BUTTON_UP, true);
+            continue;
         }
-        if (ev->key_code == SAPP_KEYCODE_DOWN)
+        if (inp.window_events_count == input_events_max_count)
         {
-            input_controller_set_button(inp.controllers[0],
-                                        INPUT_CONTROLLER_BUTTON_DOWN, true);
+            inp.dropped_events_count += 1;
+            return;
         }
+        int index = (inp.window_events_first + inp.window_events_count) %
+                    input_events_max_count;
+        inp.window_events[index] = {input_now_ns(),
+                                    static_cast<uint16_t>(binding.button),
+                                    binding.controller,
+                                    ev->type == SAPP_EVENTTYPE_KEY_DOWN};
+        inp.window_events_count += 1;
     }
-    if (ev->type == SAPP_EVENTTYPE_KEY_UP)
+}
+
+void input_poll(Input &inp, uint64_t until_ns)
+{
+    uint64_t now_ns = input_now_ns();
+    uint16_t changed[2] = {};
+    for (;;)
     {
-        if (ev->key_code == SAPP_KEYCODE_UP)
+        // The earlier of the two sources' next events.
+        const Input_Event *window_event =
+            inp.window_events_count > 0
+                ? &inp.window_events[inp.window_events_first]
+                : nullptr;
+        const Input_Event *evdev_event = nullptr;
+        uint32_t tail = 0;
+        if (inp.evdev)
+        {
+            Input_Evdev &e = *inp.evdev;
+            tail = e.tail.load(std::memory_order_relaxed);
+            if (tail != e.head.load(std::memory_order_acquire))
+            {
+                evdev_event = &e.events[tail % input_events_max_count];
+            }
+        }
+        const Input_Event *event = window_event;
+        if (evdev_event &&
+            (!event || evdev_event->time_ns < event->time_ns))
         {
-            input_controller_set_button(inp.controllers[0],
-                                        INPUT_CONTROLLER_BUTTON_UP, false);
+            event = evdev_event;
         }
-        if (ev->key_code == SAPP_KEYCODE_DOWN)
+        if (!event || event->time_ns > until_ns ||
+            (changed[event->controller] & event->button) != 0)
         {
-            input_controller_set_button(inp.controllers[0],
-                                        INPUT_CONTROLLER_BUTTON_DOWN, false);
+            break;
+        }
+
+        auto &c = inp.controllers[event->controller];
+        uint16_t state = c.current_state;
+        input_controller_set_button(
+            c, static_cast<Input_Controller_Button>(event->button),
+            event->down);
+        changed[event->controller] |= state ^ c.current_state;
+
+        if (event == evdev_event)
+        {
+            Input_Evdev &e = *inp.evdev;
+            uint64_t latency_ns =
+                now_ns > event->time_ns ? now_ns - event->time_ns : 0;
+            e.applied_events_count += 1;
+            e.latency_sum_ns += latency_ns;
+            e.latency_max_ns = std::max(e.latency_max_ns, latency_ns);
+            e.last_event_time_ns = event->time_ns;
+            e.tail.store(tail + 1, std::memory_order_release);
+        }
+        else
+        {
+            inp.window_events_first =
+                (inp.window_events_first + 1) % input_events_max_count;
+            inp.window_events_count -= 1;
         }
     }
 }
@@ -84,3 +249,700 @@ bool input_controller_button_released(const Input_Controller &c,
 {
     return (c.current_state & button) == 0 && (c.last_state & button) != 0;
 }
+
+#if defined(INPUT_EVDEV)
+
+struct Input_Evdev_Binding
+{
+    uint16_t code;
+    uint8_t controller;
+    Input_Controller_Button button;
+};
+
+// The same keys as the window's.
+static constexpr Input_Evdev_Binding input_evdev_keyboard_bindings[] = {
+    {KEY_UP, 0, INPUT_CONTROLLER_BUTTON_UP},
+    {KEY_DOWN, 0, INPUT_CONTROLLER_BUTTON_DOWN},
+    {KEY_W, 1, INPUT_CONTROLLER_BUTTON_UP},
+    {KEY_S, 1, INPUT_CONTROLLER_BUTTON_DOWN},
+};
+// The controller is the gamepad's own.
+static constexpr Input_Evdev_Binding input_evdev_gamepad_bindings[] = {
+    {BTN_SOUTH, 0, INPUT_CONTROLLER_BUTTON_A},
+    {BTN_EAST, 0, INPUT_CONTROLLER_BUTTON_B},
+    {BTN_DPAD_UP, 0, INPUT_CONTROLLER_BUTTON_UP},
+    {BTN_DPAD_DOWN, 0, INPUT_CONTROLLER_BUTTON_DOWN},
+    {BTN_DPAD_LEFT, 0, INPUT_CONTROLLER_BUTTON_LEFT},
+    {BTN_DPAD_RIGHT, 0, INPUT_CONTROLLER_BUTTON_RIGHT},
+};
+
+static constexpr int input_evdev_long_bits = 8 * sizeof(unsigned long);
+
+static bool input_evdev_test_bit(const unsigned long *bits, int bit)
+{
+    return ((bits[bit / input_evdev_long_bits] >>
+             (bit % input_evdev_long_bits)) &
+            1) != 0;
+}
+
+static uint64_t input_evdev_time_ns(const input_event &ev)
+{
+    return static_cast<uint64_t>(ev.input_event_sec) * 1000000000 +
+           static_cast<uint64_t>(ev.input_event_usec) * 1000;
+}
+
+static void input_evdev_push(Input_Evdev &e, uint64_t time_ns,
+                             uint8_t controller, uint16_t button, bool down)
+{
+    uint32_t head = e.head.load(std::memory_order_relaxed);
+    if (head - e.tail.load(std::memory_order_acquire) ==
+        input_events_max_count)
+    {
+        e.dropped_events_count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    e.events[head % input_events_max_count] = {time_ns, button, controller,
+                                               down};
+    e.head.store(head + 1, std::memory_order_release);
+}
+
+// Sends the sim every button the device started or stopped holding.
+static void input_evdev_emit(Input_Evdev &e, Input_Evdev_Device &d,
+                             uint64_t time_ns)
+{
+    uint16_t axes = 0;
+    if (d.has_stick)
+    {
+        if (d.stick[0] < d.stick_center[0] - d.stick_threshold[0])
+        {
+            axes |= INPUT_CONTROLLER_BUTTON_LEFT;
+        }
+        if (d.stick[0] > d.stick_center[0] + d.stick_threshold[0])
+        {
+            axes |= INPUT_CONTROLLER_BUTTON_RIGHT;
+        }
+        if (d.stick[1] < d.stick_center[1] - d.stick_threshold[1])
+        {
+            axes |= INPUT_CONTROLLER_BUTTON_UP;
+        }
+        if (d.stick[1] > d.stick_center[1] + d.stick_threshold[1])
+        {
+            axes |= INPUT_CONTROLLER_BUTTON_DOWN;
+        }
+    }
+    axes |= d.hat[0] < 0 ? INPUT_CONTROLLER_BUTTON_LEFT : 0;
+    axes |= d.hat[0] > 0 ? INPUT_CONTROLLER_BUTTON_RIGHT : 0;
+    axes |= d.hat[1] < 0 ? INPUT_CONTROLLER_BUTTON_UP : 0;
+    axes |= d.hat[1] > 0 ? INPUT_CONTROLLER_BUTTON_DOWN : 0;
+
+    for (int c = 0; c < 2; c += 1)
+    {
+        uint16_t state = d.keys[c];
+        if (d.gamepad && c == d.controller)
+        {
+            state |= axes;
+        }
+        uint16_t changed = state ^ d.held[c];
+        for (int bit = 0; bit < 16; bit += 1)
+        {
+            auto button = static_cast<uint16_t>(1 << bit);
+            if ((changed & button) != 0)
+            {
+                input_evdev_push(e, time_ns, static_cast<uint8_t>(c), button,
+                                 (state & button) != 0);
+            }
+        }
+        d.held[c] = state;
+    }
+}
+
+static void input_evdev_set_key(Input_Evdev_Device &d, uint16_t code,
+                                bool down)
+{
+    const Input_Evdev_Binding *bindings = input_evdev_keyboard_bindings;
+    int bindings_count = static_cast<int>(
+        sizeof(input_evdev_keyboard_bindings) / sizeof(*bindings));
+    if (d.gamepad)
+    {
+        bindings = input_evdev_gamepad_bindings;
+        bindings_count = static_cast<int>(
+            sizeof(input_evdev_gamepad_bindings) / sizeof(*bindings));
+    }
+    for (int i = 0; i < bindings_count; i += 1)
+    {
+        if (bindings[i].code != code)
+        {
+            continue;
+        }
+        int c = d.gamepad ? d.controller : bindings[i].controller;
+        if (down)
+        {
+            d.keys[c] |= bindings[i].button;
+        }
+        else
+        {
+            d.keys[c] &= ~bindings[i].button;
+        }
+    }
+}
+
+// Reads the whole state of the device, for when it is opened and after the
+// kernel dropped events.
+static void input_evdev_resync(Input_Evdev &e, Input_Evdev_Device &d,
+                               uint64_t time_ns)
+{
+    unsigned long key_bits[KEY_MAX / input_evdev_long_bits + 1] = {};
+    ioctl(d.fd, EVIOCGKEY(sizeof(key_bits)), key_bits);
+    d.keys[0] = 0;
+    d.keys[1] = 0;
+    for (int code = 0; code < KEY_MAX; code += 1)
+    {
+        if (input_evdev_test_bit(key_bits, code))
+        {
+            input_evdev_set_key(d, static_cast<uint16_t>(code), true);
+        }
+    }
+    if (d.gamepad)
+    {
+        static constexpr int axes[4] = {ABS_X, ABS_Y, ABS_HAT0X, ABS_HAT0Y};
+        int *values[4] = {&d.stick[0], &d.stick[1], &d.hat[0], &d.hat[1]};
+        for (int i = 0; i < 4; i += 1)
+        {
+            input_absinfo info = {};
+            if (ioctl(d.fd, EVIOCGABS(axes[i]), &info) == 0)
+            {
+                *values[i] = info.value;
+            }
+        }
+    }
+    input_evdev_emit(e, d, time_ns);
+}
+
+static bool input_evdev_open(Input_Evdev &e, const char *path,
+                             int &gamepads_count, int &denied_count)
+{
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        denied_count += errno == EACCES ? 1 : 0;
+        return false;
+    }
+    unsigned long key_bits[KEY_MAX / input_evdev_long_bits + 1] = {};
+    unsigned long abs_bits[ABS_MAX / input_evdev_long_bits + 1] = {};
+    ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits);
+    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits);
+    bool gamepad = input_evdev_test_bit(key_bits, BTN_GAMEPAD);
+    bool keyboard = input_evdev_test_bit(key_bits, KEY_UP) &&
+                    input_evdev_test_bit(key_bits, KEY_DOWN) &&
+                    input_evdev_test_bit(key_bits, KEY_W) &&
+                    input_evdev_test_bit(key_bits, KEY_S);
+    // Timestamps on the clock the sim runs on, not the wall clock.
+    int clock = CLOCK_MONOTONIC;
+    if ((!gamepad && !keyboard) || (gamepad && gamepads_count == 2) ||
+        e.devices_count == input_evdev_devices_max_count ||
+        ioctl(fd, EVIOCSCLOCKID, &clock) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    Input_Evdev_Device &d = e.devices[e.devices_count];
+    e.devices_count += 1;
+    d = {};
+    d.fd = fd;
+    snprintf(d.path, sizeof(d.path), "%s", path);
+    if (ioctl(fd, EVIOCGNAME(sizeof(d.name)), d.name) < 0)
+    {
+        snprintf(d.name, sizeof(d.name), "unknown");
+    }
+    d.gamepad = gamepad;
+    if (gamepad)
+    {
+        d.controller = static_cast<uint8_t>(gamepads_count);
+        gamepads_count += 1;
+        d.has_stick = input_evdev_test_bit(abs_bits, ABS_X) &&
+                      input_evdev_test_bit(abs_bits, ABS_Y);
+        for (int i = 0; d.has_stick && i < 2; i += 1)
+        {
+            input_absinfo info = {};
+            ioctl(fd, EVIOCGABS(i == 0 ? ABS_X : ABS_Y), &info);
+            d.stick_center[i] = info.minimum / 2 + info.maximum / 2;
+            d.stick_threshold[i] = info.maximum / 4 - info.minimum / 4;
+        }
+    }
+    input_evdev_resync(e, d, input_now_ns());
+    return true;
+}
+
+static void input_evdev_handle(Input_Evdev &e, Input_Evdev_Device &d,
+                               const input_event &ev)
+{
+    uint64_t time_ns = input_evdev_time_ns(ev);
+    if (ev.type == EV_SYN)
+    {
+        if (ev.code == SYN_DROPPED)
+        {
+            d.dropping = true;
+        }
+        else if (ev.code == SYN_REPORT && d.dropping)
+        {
+            d.dropping = false;
+            input_evdev_resync(e, d, time_ns);
+        }
+        return;
+    }
+    if (d.dropping)
+    {
+        return;
+    }
+    // A value of 2 is a key repeating.
+    if (ev.type == EV_KEY && ev.value != 2)
+    {
+        input_evdev_set_key(d, ev.code, ev.value != 0);
+        input_evdev_emit(e, d, time_ns);
+    }
+    else if (ev.type == EV_ABS && d.gamepad)
+    {
+        switch (ev.code)
+        {
+        case ABS_X:
+            d.stick[0] = ev.value;
+            break;
+        case ABS_Y:
+            d.stick[1] = ev.value;
+            break;
+        case ABS_HAT0X:
+            d.hat[0] = ev.value;
+            break;
+        case ABS_HAT0Y:
+            d.hat[1] = ev.value;
+            break;
+        }
+        input_evdev_emit(e, d, time_ns);
+    }
+}
+
+static void input_evdev_read(Input_Evdev &e, Input_Evdev_Device &d)
+{
+    input_event events[64];
+    for (;;)
+    {
+        ssize_t size = read(d.fd, events, sizeof(events));
+        if (size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (size < 0 && errno == EAGAIN)
+        {
+            return;
+        }
+        if (size <= 0)
+        {
+            // Unplugged, let go of whatever it held.
+            printf("input: %s disconnected\n", d.name);
+            close(d.fd);
+            d.fd = -1;
+            d.keys[0] = 0;
+            d.keys[1] = 0;
+            d.stick[0] = d.stick_center[0];
+            d.stick[1] = d.stick_center[1];
+            d.hat[0] = 0;
+            d.hat[1] = 0;
+            input_evdev_emit(e, d, input_now_ns());
+            return;
+        }
+        int count = static_cast<int>(size / sizeof(input_event));
+        for (int i = 0; i < count; i += 1)
+        {
+            input_evdev_handle(e, d, events[i]);
+        }
+    }
+}
+
+static void input_evdev_main(Input_Evdev &e)
+{
+    pollfd fds[input_evdev_devices_max_count + 1];
+    int devices[input_evdev_devices_max_count];
+    while (e.running.load(std::memory_order_acquire))
+    {
+        int fds_count = 0;
+        for (int i = 0; i < e.devices_count; i += 1)
+        {
+            if (e.devices[i].fd >= 0)
+            {
+                fds[fds_count] = {e.devices[i].fd, POLLIN, 0};
+                devices[fds_count] = i;
+                fds_count += 1;
+            }
+        }
+        fds[fds_count] = {e.wake_fd, POLLIN, 0};
+        if (poll(fds, static_cast<nfds_t>(fds_count + 1), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            printf("input: poll failed: %s\n", strerror(errno));
+            return;
+        }
+        for (int i = 0; i < fds_count; i += 1)
+        {
+            if (fds[i].revents != 0)
+            {
+                input_evdev_read(e, e.devices[devices[i]]);
+            }
+        }
+    }
+}
+
+// Opens the devices among paths that are gamepads or keyboards and starts
+// reading them.
+static void input_evdev_start(Input &inp, const char *const *paths,
+                              int paths_count)
+{
+    auto *e = new Input_Evdev();
+    int gamepads_count = 0;
+    int denied_count = 0;
+    for (int i = 0; i < paths_count; i += 1)
+    {
+        input_evdev_open(*e, paths[i], gamepads_count, denied_count);
+    }
+    if (e->devices_count == 0)
+    {
+        printf("input: no readable gamepads or keyboards%s\n",
+               denied_count > 0 ? ", is the user in the input group?" : "");
+        delete e;
+        return;
+    }
+    for (int i = 0; i < e->devices_count; i += 1)
+    {
+        const auto &d = e->devices[i];
+        if (d.gamepad)
+        {
+            printf("input: %s \"%s\", gamepad of controller %d\n", d.path,
+                   d.name, d.controller);
+        }
+        else
+        {
+            printf("input: %s \"%s\", keyboard\n", d.path, d.name);
+            inp.window_keys = false;
+        }
+    }
+
+    e->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    e->running.store(true, std::memory_order_relaxed);
+    e->thread = std::thread(input_evdev_main, std::ref(*e));
+    inp.evdev = e;
+}
+
+#endif
+
+void input_evdev_init(Input &inp)
+{
+#if defined(INPUT_EVDEV)
+    DIR *dir = opendir("/dev/input");
+    if (!dir)
+    {
+        printf("input: can't open /dev/input: %s\n", strerror(errno));
+        return;
+    }
+    // In the order the kernel numbered them, which is the order they were
+    // plugged in.
+    int numbers[input_evdev_paths_max_count];
+    int numbers_count = 0;
+    while (dirent *entry = readdir(dir))
+    {
+        int number;
+        if (numbers_count < input_evdev_paths_max_count &&
+            sscanf(entry->d_name, "event%d", &number) == 1)
+        {
+            numbers[numbers_count] = number;
+            numbers_count += 1;
+        }
+    }
+    closedir(dir);
+    std::sort(numbers, numbers + numbers_count);
+
+    char paths[input_evdev_paths_max_count][32];
+    const char *path_pointers[input_evdev_paths_max_count];
+    for (int i = 0; i < numbers_count; i += 1)
+    {
+        snprintf(paths[i], sizeof(paths[i]), "/dev/input/event%d",
+                 numbers[i]);
+        path_pointers[i] = paths[i];
+    }
+    input_evdev_start(inp, path_pointers, numbers_count);
+#else
+    (void)inp;
+    printf("input: evdev is only supported on Linux\n");
+#endif
+}
+
+void input_shutdown(Input &inp)
+{
+    if (!inp.evdev)
+    {
+        return;
+    }
+    Input_Evdev &e = *inp.evdev;
+#if defined(INPUT_EVDEV)
+    e.running.store(false, std::memory_order_release);
+    uint64_t one = 1;
+    if (write(e.wake_fd, &one, sizeof(one)) < 0)
+    {
+        // Only fails when the counter is full, the thread is awake then.
+    }
+    e.thread.join();
+    for (int i = 0; i < e.devices_count; i += 1)
+    {
+        if (e.devices[i].fd >= 0)
+        {
+            close(e.devices[i].fd);
+        }
+    }
+    close(e.wake_fd);
+#endif
+    uint64_t count = std::max<uint64_t>(e.applied_events_count, 1);
+    printf("input: %llu evdev events, %.3fms mean and %.3fms worst from the "
+           "kernel to the sim, %llu dropped\n",
+           static_cast<unsigned long long>(e.applied_events_count),
+           static_cast<double>(e.latency_sum_ns) / count / 1000000.0,
+           static_cast<double>(e.latency_max_ns) / 1000000.0,
+           static_cast<unsigned long long>(
+               e.dropped_events_count.load(std::memory_order_relaxed) +
+               inp.dropped_events_count));
+    delete inp.evdev;
+    inp.evdev = nullptr;
+}
+
+#if defined(INPUT_EVDEV)
+
+// A virtual device, and the evdev node the kernel made for it.
+struct Input_Uinput_Device
+{
+    int fd;
+    char path[32];
+};
+
+static bool input_uinput_create(Input_Uinput_Device &u, bool gamepad)
+{
+    u.fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (u.fd < 0)
+    {
+        printf("input: can't open /dev/uinput: %s\n", strerror(errno));
+        return false;
+    }
+    ioctl(u.fd, UI_SET_EVBIT, EV_KEY);
+    if (gamepad)
+    {
+        for (const auto &binding : input_evdev_gamepad_bindings)
+        {
+            ioctl(u.fd, UI_SET_KEYBIT, binding.code);
+        }
+        ioctl(u.fd, UI_SET_EVBIT, EV_ABS);
+        for (int code : {ABS_X, ABS_Y})
+        {
+            ioctl(u.fd, UI_SET_ABSBIT, code);
+            uinput_abs_setup abs = {};
+            abs.code = static_cast<uint16_t>(code);
+            abs.absinfo.minimum = -32768;
+            abs.absinfo.maximum = 32767;
+            ioctl(u.fd, UI_ABS_SETUP, &abs);
+        }
+    }
+    else
+    {
+        for (const auto &binding : input_evdev_keyboard_bindings)
+        {
+            ioctl(u.fd, UI_SET_KEYBIT, binding.code);
+        }
+    }
+    uinput_setup setup = {};
+    setup.id.bustype = BUS_VIRTUAL;
+    snprintf(setup.name, sizeof(setup.name), "pong3d virtual %s",
+             gamepad ? "gamepad" : "keyboard");
+    char sysname[32] = {};
+    if (ioctl(u.fd, UI_DEV_SETUP, &setup) != 0 ||
+        ioctl(u.fd, UI_DEV_CREATE) != 0 ||
+        ioctl(u.fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0)
+    {
+        printf("input: can't create a virtual %s: %s\n",
+               gamepad ? "gamepad" : "keyboard", strerror(errno));
+        return false;
+    }
+
+    // The evdev node is listed next to the device in sysfs, and appears in
+    // /dev once udev gets to it.
+    char sys_path[64];
+    snprintf(sys_path, sizeof(sys_path), "/sys/devices/virtual/input/%s",
+             sysname);
+    u.path[0] = '\0';
+    uint64_t start_ns = input_now_ns();
+    while (input_now_ns() - start_ns < input_check_timeout_ns)
+    {
+        if (DIR *dir = opendir(sys_path))
+        {
+            while (dirent *entry = readdir(dir))
+            {
+                int number;
+                if (sscanf(entry->d_name, "event%d", &number) == 1)
+                {
+                    snprintf(u.path, sizeof(u.path), "/dev/input/event%d",
+                             number);
+                }
+            }
+            closedir(dir);
+        }
+        if (u.path[0] != '\0' && access(u.path, R_OK) == 0)
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    printf("input: no evdev node for the virtual %s\n",
+           gamepad ? "gamepad" : "keyboard");
+    return false;
+}
+
+static void input_uinput_write(const Input_Uinput_Device &u, uint16_t type,
+                               uint16_t code, int32_t value)
+{
+    input_event ev = {};
+    ev.type = type;
+    ev.code = code;
+    ev.value = value;
+    if (write(u.fd, &ev, sizeof(ev)) != sizeof(ev))
+    {
+        printf("input: can't write to the virtual device: %s\n",
+               strerror(errno));
+    }
+}
+
+static void input_uinput_destroy(Input_Uinput_Device &u)
+{
+    if (u.fd >= 0)
+    {
+        ioctl(u.fd, UI_DEV_DESTROY);
+        close(u.fd);
+    }
+}
+
+struct Input_Check_Step
+{
+    const char *name;
+    bool gamepad;
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+    // What the controller holds once the event has arrived.
+    uint8_t controller;
+    uint16_t state;
+};
+
+static constexpr Input_Check_Step input_check_steps[] = {
+    {"gamepad south", true, EV_KEY, BTN_SOUTH, 1, 0,
+     INPUT_CONTROLLER_BUTTON_A},
+    {"gamepad south up", true, EV_KEY, BTN_SOUTH, 0, 0, 0},
+    {"gamepad dpad up", true, EV_KEY, BTN_DPAD_UP, 1, 0,
+     INPUT_CONTROLLER_BUTTON_UP},
+    {"gamepad dpad up up", true, EV_KEY, BTN_DPAD_UP, 0, 0, 0},
+    {"gamepad stick down", true, EV_ABS, ABS_Y, 32767, 0,
+     INPUT_CONTROLLER_BUTTON_DOWN},
+    {"gamepad stick left", true, EV_ABS, ABS_X, -32768, 0,
+     INPUT_CONTROLLER_BUTTON_DOWN | INPUT_CONTROLLER_BUTTON_LEFT},
+    {"gamepad stick centered", true, EV_ABS, ABS_Y, 0, 0,
+     INPUT_CONTROLLER_BUTTON_LEFT},
+    {"gamepad stick released", true, EV_ABS, ABS_X, 0, 0, 0},
+    {"keyboard up", false, EV_KEY, KEY_UP, 1, 0, INPUT_CONTROLLER_BUTTON_UP},
+    {"keyboard up up", false, EV_KEY, KEY_UP, 0, 0, 0},
+    {"keyboard w", false, EV_KEY, KEY_W, 1, 1, INPUT_CONTROLLER_BUTTON_UP},
+    {"keyboard s", false, EV_KEY, KEY_S, 1, 1,
+     INPUT_CONTROLLER_BUTTON_UP | INPUT_CONTROLLER_BUTTON_DOWN},
+    {"keyboard w up", false, EV_KEY, KEY_W, 0, 1,
+     INPUT_CONTROLLER_BUTTON_DOWN},
+    {"keyboard s up", false, EV_KEY, KEY_S, 0, 1, 0},
+};
+
+// Polls until the controller holds state. Returns false on timeout.
+static bool input_check_wait(Input &inp, int controller, uint16_t state)
+{
+    uint64_t start_ns = input_now_ns();
+    while (input_now_ns() - start_ns < input_check_timeout_ns)
+    {
+        input_poll(inp, input_now_ns());
+        if (inp.controllers[controller].current_state == state)
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return false;
+}
+
+#endif
+
+int input_evdev_check()
+{
+#if defined(INPUT_EVDEV)
+    Input_Uinput_Device gamepad = {-1, {}};
+    Input_Uinput_Device keyboard = {-1, {}};
+    if (!input_uinput_create(gamepad, true) ||
+        !input_uinput_create(keyboard, false))
+    {
+        input_uinput_destroy(gamepad);
+        input_uinput_destroy(keyboard);
+        return 1;
+    }
+    // Only the virtual devices, so a real gamepad can't take controller 0.
+    Input inp = {};
+    input_init(inp);
+    const char *paths[2] = {gamepad.path, keyboard.path};
+    input_evdev_start(inp, paths, 2);
+    if (!inp.evdev || inp.evdev->devices_count != 2)
+    {
+        printf("input: can't read the virtual devices\n");
+        input_shutdown(inp);
+        input_uinput_destroy(gamepad);
+        input_uinput_destroy(keyboard);
+        return 1;
+    }
+
+    int failed_count = 0;
+    for (const auto &step : input_check_steps)
+    {
+        const auto &device = step.gamepad ? gamepad : keyboard;
+        uint64_t sent_ns = input_now_ns();
+        input_uinput_write(device, step.type, step.code, step.value);
+        input_uinput_write(device, EV_SYN, SYN_REPORT, 0);
+        bool ok = input_check_wait(inp, step.controller, step.state);
+        uint64_t arrived_ns = input_now_ns();
+        // The kernel's timestamp, not the time the sim got to it.
+        uint64_t time_ns = inp.evdev->last_event_time_ns;
+        ok = ok && time_ns >= sent_ns && time_ns <= arrived_ns;
+        printf("input: %-24s %s, %.3fms\n", step.name, ok ? "ok" : "FAILED",
+               static_cast<double>(arrived_ns - sent_ns) / 1000000.0);
+        failed_count += ok ? 0 : 1;
+    }
+
+    // Down and up within one report is still one tick of the button held.
+    input_uinput_write(gamepad, EV_KEY, BTN_EAST, 1);
+    input_uinput_write(gamepad, EV_KEY, BTN_EAST, 0);
+    input_uinput_write(gamepad, EV_SYN, SYN_REPORT, 0);
+    bool tap_ok = input_check_wait(inp, 0, INPUT_CONTROLLER_BUTTON_B);
+    input_update(inp);
+    tap_ok = tap_ok && input_check_wait(inp, 0, 0) &&
+             input_controller_button_released(inp.controllers[0],
+                                              INPUT_CONTROLLER_BUTTON_B);
+    printf("input: %-24s %s\n", "gamepad east tap", tap_ok ? "ok" : "FAILED");
+    failed_count += tap_ok ? 0 : 1;
+
+    input_shutdown(inp);
+    input_uinput_destroy(gamepad);
+    input_uinput_destroy(keyboard);
+    printf("input: %d checks failed\n", failed_count);
+    return failed_count == 0 ? 0 : 1;
+#else
+    printf("input: evdev is only supported on Linux\n");
+    return 1;
+#endif
+}
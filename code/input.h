@@ -1,6 +1,10 @@
 #pragma once
 
 #include "sokol_app.h"
+#include <cstdint>
+
+// Button changes waiting for the sim, per source.
+inline constexpr int input_events_max_count = 256;
 
 enum Input_Controller_Button
 {
@@ -19,15 +23,55 @@ struct Input_Controller
     uint16_t last_state;
 };
 
+// One button going down or up.
+struct Input_Event
+{
+    // CLOCK_MONOTONIC nanoseconds, see input_now_ns(). Stamped by the kernel
+    // for evdev events and when the window event was handled otherwise.
+    uint64_t time_ns;
+    uint16_t button;
+    uint8_t controller;
+    bool down;
+};
+
+struct Input_Evdev;
+
 struct Input
 {
     Input_Controller controllers[2];
     int controllers_count;
+    // Events from the window, only touched on the main thread.
+    Input_Event window_events[input_events_max_count];
+    int window_events_first;
+    int window_events_count;
+    // Off while evdev reads the keyboards itself, so no key counts twice.
+    bool window_keys;
+    uint64_t dropped_events_count;
+    Input_Evdev *evdev;
 };
 
 void input_init(Input &inp);
+// Stops the evdev thread, if there is one.
+void input_shutdown(Input &inp);
 void input_handle_event(Input &inp, const sapp_event *ev);
+// Applies the queued events up to until_ns, in the order they happened. A
+// button that changes twice stops there, so presses shorter than a tick
+// still last one tick.
+void input_poll(Input &inp, uint64_t until_ns);
 void input_update(Input &inp);
+// The clock input events are stamped with.
+uint64_t input_now_ns();
+
+// Reads the gamepads and keyboards in /dev/input on a thread of its own, so
+// input doesn't wait for the window's event loop and every event keeps the
+// kernel's timestamp. Gamepads go to the controllers in the order they are
+// found, keyboards drive both: the arrows the first and W and S the second.
+// Linux only, and needs read access to the devices.
+void input_evdev_init(Input &inp);
+// Creates a virtual gamepad and keyboard through /dev/uinput, plays button
+// presses on them and checks that each arrives on the right controller.
+// Returns the process exit code.
+int input_evdev_check();
 
 bool input_controller_button_down(const Input_Controller &c,
                                   Input_Controller_Button button);
@@ -0,0 +1,221 @@
+#include "jobs.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static constexpr int job_deque_capacity = 256;
+
+struct Job
+{
+    Job_Func *func;
+    void *data;
+    int begin;
+    int end;
+    std::atomic<int> *pending;
+};
+
+// Each thread owns a deque. The owner pushes and pops at the bottom, other
+// threads steal from the top, so the owner works on its most recently split
+// (cache warm) ranges while thieves take the oldest, largest chunks.
+struct Job_Worker
+{
+    std::thread thread;
+    std::mutex mutex;
+    Job jobs[job_deque_capacity];
+    int top;
+    int bottom;
+};
+
+struct Job_Signal
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::atomic<int> queued;
+};
+
+static thread_local int job_thread_index = 0;
+
+static bool job_worker_push(Job_Worker &w, const Job &job)
+{
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (w.bottom - w.top >= job_deque_capacity)
+    {
+        return false;
+    }
+    w.jobs[w.bottom % job_deque_capacity] = job;
+    w.bottom += 1;
+    return true;
+}
+
+static bool job_worker_pop(Job_Worker &w, Job &job)
+{
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (w.bottom == w.top)
+    {
+        return false;
+    }
+    w.bottom -= 1;
+    job = w.jobs[w.bottom % job_deque_capacity];
+    return true;
+}
+
+static bool job_worker_steal(Job_Worker &w, Job &job)
+{
+    std::lock_guard<std::mutex> lock(w.mutex);
+    if (w.bottom == w.top)
+    {
+        return false;
+    }
+    job = w.jobs[w.top % job_deque_capacity];
+    w.top += 1;
+    return true;
+}
+
+static bool jobs_take(Job_System &js, int thread_index, Job &job)
+{
+    bool found = job_worker_pop(js.workers[thread_index], job);
+    for (int i = 1; !found && i < js.threads_count; i += 1)
+    {
+        int victim = (thread_index + i) % js.threads_count;
+        found = job_worker_steal(js.workers[victim], job);
+    }
+    if (found)
+    {
+        js.signal->queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return found;
+}
+
+static void job_run(const Job &job)
+{
+    job.func(job.data, job.begin, job.end);
+    job.pending->fetch_sub(1, std::memory_order_release);
+}
+
+static void job_worker_main(Job_System *js, int thread_index)
+{
+    job_thread_index = thread_index;
+
+    while (js->running.load(std::memory_order_acquire))
+    {
+        Job job;
+        if (jobs_take(*js, thread_index, job))
+        {
+            job_run(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(js->signal->mutex);
+        auto has_work = [js]()
+        {
+            return js->signal->queued.load(std::memory_order_relaxed) > 0 ||
+                   !js->running.load(std::memory_order_acquire);
+        };
+        js->signal->cond.wait(lock, has_work);
+    }
+}
+
+void jobs_init(Job_System &js, int threads_count)
+{
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    threads_count = 1;
+#endif
+    if (threads_count <= 0)
+    {
+        threads_count = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    js.threads_count = std::clamp(threads_count, 1, jobs_max_threads_count);
+    js.workers = new Job_Worker[js.threads_count]();
+    js.signal = new Job_Signal();
+    js.running.store(true, std::memory_order_release);
+
+    for (int i = 1; i < js.threads_count; i += 1)
+    {
+        js.workers[i].thread = std::thread(job_worker_main, &js, i);
+    }
+}
+
+void jobs_shutdown(Job_System &js)
+{
+    {
+        std::lock_guard<std::mutex> lock(js.signal->mutex);
+        js.running.store(false, std::memory_order_release);
+    }
+    js.signal->cond.notify_all();
+
+    for (int i = 1; i < js.threads_count; i += 1)
+    {
+        js.workers[i].thread.join();
+    }
+
+    delete[] js.workers;
+    delete js.signal;
+    js.workers = nullptr;
+    js.signal = nullptr;
+    js.threads_count = 0;
+}
+
+void jobs_parallel_for(Job_System &js, int count, int grain_size,
+                       Job_Func *func, void *data)
+{
+    grain_size = std::max(grain_size, 1);
+    if (count <= 0)
+    {
+        return;
+    }
+    if (js.threads_count <= 1 || count <= grain_size)
+    {
+        func(data, 0, count);
+        return;
+    }
+
+    int ranges_count = (count + grain_size - 1) / grain_size;
+    std::atomic<int> pending(ranges_count);
+    auto &self = js.workers[job_thread_index];
+
+    // Queue every range but the first, which this thread starts on right away.
+    int queued_count = 0;
+    for (int i = 1; i < ranges_count; i += 1)
+    {
+        Job job = {};
+        job.func = func;
+        job.data = data;
+        job.begin = i * grain_size;
+        job.end = std::min(job.begin + grain_size, count);
+        job.pending = &pending;
+        if (job_worker_push(self, job))
+        {
+            queued_count += 1;
+        }
+        else
+        {
+            job_run(job);
+        }
+    }
+    if (queued_count > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(js.signal->mutex);
+            js.signal->queued.fetch_add(queued_count,
+                                        std::memory_order_relaxed);
+        }
+        js.signal->cond.notify_all();
+    }
+
+    func(data, 0, std::min(grain_size, count));
+    pending.fetch_sub(1, std::memory_order_release);
+
+    while (pending.load(std::memory_order_acquire) > 0)
+    {
+        Job job;
+        if (jobs_take(js, job_thread_index, job))
+        {
+            job_run(job);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
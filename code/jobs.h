@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+inline constexpr int jobs_max_threads_count = 16;
+
+struct Job_Worker;
+struct Job_Signal;
+
+// Processes the items in the range [begin, end).
+typedef void Job_Func(void *data, int begin, int end);
+
+struct Job_System
+{
+    // Includes the calling (main) thread, which is always thread 0.
+    int threads_count;
+    Job_Worker *workers;
+    Job_Signal *signal;
+    std::atomic<bool> running;
+};
+
+// Starts threads_count - 1 worker threads. A threads_count of 0 picks one
+// thread per hardware core.
+void jobs_init(Job_System &js, int threads_count);
+void jobs_shutdown(Job_System &js);
+
+// Splits [0, count) into ranges of at most grain_size items and runs func on
+// them across all threads. Returns once every range has been processed. The
+// caller takes part in the work, so this is safe to call with no workers.
+void jobs_parallel_for(Job_System &js, int count, int grain_size,
+                       Job_Func *func, void *data);
+
+template <typename F>
+void jobs_parallel_for(Job_System &js, int count, int grain_size, F &&f)
+{
+    using Func = std::remove_reference_t<F>;
+    auto thunk = [](void *data, int begin, int end)
+    { (*static_cast<Func *>(data))(begin, end); };
+    jobs_parallel_for(js, count, grain_size, thunk,
+                      const_cast<void *>(static_cast<const void *>(&f)));
+}
@@ -0,0 +1,225 @@
+#include "latency.h"
+#include "sokol_gfx.h"
+#include "sokol_time.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+// Waiting on the GPU goes through GL fences, which the other backends don't
+// expose through sokol_gfx.
+#if defined(__linux__) && !defined(__ANDROID__)
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#define LATENCY_GL
+#endif
+
+// Frames measured before the low latency mode starts sleeping.
+static constexpr int latency_warmup_frames_count = 16;
+// Slack left before the deadline for the frames that cost more than any
+// recent one.
+static constexpr double latency_margin_secs = 0.001;
+// The last part of the wait is spun, sleeps overshoot by about this much.
+static constexpr double latency_spin_secs = 0.001;
+// How much of a late frame start the predicted vblanks move by.
+static constexpr double latency_phase_gain = 0.25;
+// Taken off the refresh interval so the predicted vblanks drift early,
+// where the late frame starts pull them back, rather than late, where
+// nothing would.
+static constexpr double latency_refresh_bias_secs = 0.0001;
+// A hung GPU shouldn't hang the game with it.
+static constexpr uint64_t latency_fence_timeout_ns = 1000000000;
+
+bool latency_parse(const char *name, Latency_Mode &mode)
+{
+    if (strcmp(name, "default") == 0)
+    {
+        mode = LATENCY_MODE_DEFAULT;
+        return true;
+    }
+    if (strcmp(name, "low") == 0)
+    {
+        mode = LATENCY_MODE_LOW;
+        return true;
+    }
+    return false;
+}
+
+void latency_init(Latency &l, Latency_Mode mode, int frames_in_flight_max)
+{
+    l = {};
+    l.mode = mode;
+    l.frames_in_flight_max =
+        std::min(frames_in_flight_max, latency_frames_in_flight_max_count);
+#if defined(LATENCY_GL)
+    l.gpu_waits = sg_query_backend() == SG_BACKEND_GLCORE;
+#endif
+    if (!l.gpu_waits && (mode == LATENCY_MODE_LOW || frames_in_flight_max))
+    {
+        printf("latency: can't wait for the GPU on this backend, only the "
+               "CPU's part of a frame is paced\n");
+    }
+}
+
+#if defined(LATENCY_GL)
+// Waits until at most keep_count frames are still in flight.
+static void latency_wait_fences(Latency &l, int keep_count)
+{
+    while (l.fences_count > keep_count)
+    {
+        GLsync fence = static_cast<GLsync>(l.fences[l.fences_first]);
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                         latency_fence_timeout_ns);
+        glDeleteSync(fence);
+        l.fences_first =
+            (l.fences_first + 1) % latency_frames_in_flight_max_count;
+        l.fences_count -= 1;
+    }
+}
+#endif
+
+void latency_shutdown(Latency &l)
+{
+#if defined(LATENCY_GL)
+    latency_wait_fences(l, 0);
+#endif
+    if (l.paced_frames_count == 0)
+    {
+        return;
+    }
+    double count = static_cast<double>(l.paced_frames_count);
+    printf("latency: %llu frames paced, %.2fms mean cost, %.2fms mean "
+           "sleep, %llu missed the predicted vblank\n",
+           static_cast<unsigned long long>(l.paced_frames_count),
+           l.costs_secs_sum / count * 1000.0, l.slept_secs / count * 1000.0,
+           static_cast<unsigned long long>(l.missed_frames_count));
+    printf("latency: input sampled %.2fms before the predicted vblank on "
+           "average\n",
+           l.input_age_secs_sum / count * 1000.0);
+}
+
+// The median of the recent frame intervals. With vsync on that is the
+// refresh interval times the swap interval, as long as fewer than half the
+// frames miss their vblank. A late frame is followed by a short interval
+// to the next vblank, so the low ones are no better.
+static double latency_refresh_secs(const Latency &l)
+{
+    double intervals[latency_history_count];
+    std::copy(l.intervals_secs, l.intervals_secs + l.history_count,
+              intervals);
+    int index = l.history_count / 2;
+    std::nth_element(intervals, intervals + index,
+                     intervals + l.history_count);
+    return intervals[index];
+}
+
+void latency_frame_begin(Latency &l)
+{
+    double now_secs = stm_sec(stm_now());
+    if (l.frames_count > 0)
+    {
+        l.intervals_secs[l.history_index] = now_secs - l.frame_start_secs;
+    }
+    l.frame_start_secs = now_secs;
+
+#if defined(LATENCY_GL)
+    if (l.gpu_waits && l.frames_in_flight_max > 0)
+    {
+        latency_wait_fences(l, l.frames_in_flight_max - 1);
+    }
+#endif
+
+    l.work_start_secs = stm_sec(stm_now());
+    if (l.mode != LATENCY_MODE_LOW ||
+        l.history_count < latency_warmup_frames_count)
+    {
+        return;
+    }
+
+    // The vblanks are refresh_secs apart, the next deadline is the first
+    // one still ahead on the grid of the previous ones. A frame starting
+    // shortly after a predicted vblank means the swap waited for a later
+    // one, the grid is moved towards it a bit at a time so one late wakeup
+    // doesn't throw it off.
+    double refresh_secs = latency_refresh_secs(l) - latency_refresh_bias_secs;
+    if (l.deadline_secs == 0.0)
+    {
+        l.deadline_secs = now_secs;
+    }
+    double late_secs = std::fmod(
+        std::max(now_secs - l.deadline_secs, 0.0), refresh_secs);
+    if (late_secs < refresh_secs * 0.5)
+    {
+        l.deadline_secs += late_secs * latency_phase_gain;
+    }
+    // The previous frame is queued for the previous deadline even when
+    // the swap didn't wait for it.
+    do
+    {
+        l.deadline_secs += refresh_secs;
+    } while (l.deadline_secs <= now_secs);
+    double cost_secs = *std::max_element(l.costs_secs,
+                                         l.costs_secs + l.history_count);
+    double wake_secs = l.deadline_secs - cost_secs - latency_margin_secs;
+    if (wake_secs <= l.work_start_secs)
+    {
+        return;
+    }
+    if (wake_secs - l.work_start_secs > latency_spin_secs)
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double>(
+            wake_secs - l.work_start_secs - latency_spin_secs));
+    }
+    double woken_secs = stm_sec(stm_now());
+    while (woken_secs < wake_secs)
+    {
+        // Spin the rest, a sleep could wake too late.
+        woken_secs = stm_sec(stm_now());
+    }
+    l.slept_secs += woken_secs - l.work_start_secs;
+    l.work_start_secs = woken_secs;
+}
+
+void latency_frame_end(Latency &l)
+{
+#if defined(LATENCY_GL)
+    if (l.gpu_waits &&
+        (l.mode == LATENCY_MODE_LOW || l.frames_in_flight_max > 0))
+    {
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        int index = (l.fences_first + l.fences_count) %
+                    latency_frames_in_flight_max_count;
+        l.fences[index] = fence;
+        l.fences_count += 1;
+        if (l.mode == LATENCY_MODE_LOW)
+        {
+            // Present only finished frames, the swap then flips at the next
+            // vblank instead of queueing behind other frames.
+            latency_wait_fences(l, 0);
+        }
+    }
+#endif
+
+    double now_secs = stm_sec(stm_now());
+    double cost_secs = now_secs - l.work_start_secs;
+    l.costs_secs[l.history_index] = cost_secs;
+    // The first frame has no interval to go with its cost.
+    if (l.frames_count > 0)
+    {
+        l.history_index = (l.history_index + 1) % latency_history_count;
+        l.history_count =
+            std::min(l.history_count + 1, latency_history_count);
+    }
+
+    l.frames_count += 1;
+    if (l.mode == LATENCY_MODE_LOW && l.deadline_secs > 0.0)
+    {
+        l.paced_frames_count += 1;
+        l.costs_secs_sum += cost_secs;
+        l.input_age_secs_sum += l.deadline_secs - l.work_start_secs;
+        l.missed_frames_count += now_secs > l.deadline_secs ? 1 : 0;
+    }
+}
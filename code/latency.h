@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+// Frames the refresh interval and the cost of a frame are estimated from.
+inline constexpr int latency_history_count = 64;
+inline constexpr int latency_frames_in_flight_max_count = 4;
+
+enum Latency_Mode
+{
+    // Each frame starts as soon as the last one has been handed over.
+    LATENCY_MODE_DEFAULT,
+    // Each frame starts as late as it can and still make the next vblank,
+    // and waits for the GPU before presenting, so nothing sits in the swap
+    // queue and the input it samples is as fresh as possible.
+    LATENCY_MODE_LOW,
+};
+
+struct Latency
+{
+    Latency_Mode mode;
+    // How many frames the GPU may still be working on when a new one
+    // starts. 0 leaves it to the driver.
+    int frames_in_flight_max;
+    // GL fences are available to wait on the GPU with.
+    bool gpu_waits;
+    // One per frame in flight, oldest first.
+    void *fences[latency_frames_in_flight_max_count];
+    int fences_first;
+    int fences_count;
+
+    // Seconds since stm_setup().
+    double frame_start_secs;
+    double work_start_secs;
+    // The vblank the frame is meant for, predicted.
+    double deadline_secs;
+    // Between frame starts, and from the start of the work to the GPU
+    // finishing it, in seconds.
+    double intervals_secs[latency_history_count];
+    double costs_secs[latency_history_count];
+    int history_index;
+    int history_count;
+
+    uint64_t frames_count;
+    // Frames the low latency mode predicted a deadline for.
+    uint64_t paced_frames_count;
+    uint64_t missed_frames_count;
+    double slept_secs;
+    double costs_secs_sum;
+    // From sampling the input to the predicted vblank.
+    double input_age_secs_sum;
+};
+
+// "default" or "low".
+bool latency_parse(const char *name, Latency_Mode &mode);
+void latency_init(Latency &l, Latency_Mode mode, int frames_in_flight_max);
+// Prints how the frames were paced.
+void latency_shutdown(Latency &l);
+// Call first thing in a frame, before any input is sampled. Waits for the
+// frames in flight over the limit, and in the low latency mode sleeps until
+// just before the predicted deadline.
+void latency_frame_begin(Latency &l);
+// Call after sg_commit().
+void latency_frame_end(Latency &l);
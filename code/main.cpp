@@ -7,98 +7,489 @@
   Written by Anthony Del Ciotto.
 
   TODO:
-    - Add 3D text drawing.
     - Add paddles, implement basic gameplay.
     - Add A.I player.
-    - Add sound effects.
     - Add options to menu. Audio, graphics etc.
     - Add cool intro with demo gameplay if user is inactive.
     - Maintain correct aspect ratio when resizing window.
 */
 
+#include "arena.h"
+#include "audio.h"
+#include "broadcast.h"
+#include "capture.h"
+#include "desync.h"
+#include "fast_math.h"
+#include "frame_timing.h"
 #include "game.h"
 #include "input.h"
+#include "jobs.h"
+#include "latency.h"
+#include "power.h"
 #include "renderer.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "stress.h"
 #include "sokol_debugtext.h"
 #include "sokol_glue.h"
 #include "sokol_log.h"
 #include "sokol_time.h"
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 
-static constexpr double sims_per_sec = 1.0 / 60.0;
+// Per frame. Fits the instances of a full particle pool without growing.
+static constexpr size_t frame_arena_capacity = 8 * 1024 * 1024;
+// How far the arrow keys seek while a replay plays.
+static constexpr double replay_seek_step_secs = 10.0;
+
+// Parsed from the command line in sokol_main(), before App_State exists.
+struct App_Options
+{
+    const char *capture;
+    int capture_frames_count;
+    const char *audio;
+    const char *record;
+    const char *replay;
+    double replay_seek_secs;
+    const char *desync_trace;
+    const char *desync_bisect;
+    const char *broadcast;
+    const char *spectate;
+    const char *broadcast_load;
+    int broadcast_load_count;
+    double broadcast_load_secs;
+    bool math_accuracy;
+    int procedural_stars_count;
+    bool stress;
+    Stress_Scene stress_scene;
+    bool menu;
+    // Entity counts, -1 keeps the default or the stress scene's.
+    int menu_stars_count;
+    int gameplay_stars_count;
+    int menu_balls_count;
+    int menu_boxes_count;
+    bool evdev;
+    bool evdev_check;
+    Latency_Mode latency_mode;
+    int frames_in_flight_max;
+    int swap_interval;
+    const char *frame_times;
+    const char *snapshot;
+    Power_Mode power_mode;
+    double quit_after_secs;
+};
+
+// Seconds spent in each startup phase, printed after the first frame.
+struct Startup_Timings
+{
+    double window_secs;
+    double sg_setup_secs;
+    double sdtx_setup_secs;
+    double jobs_init_secs;
+    double renderer_init_secs;
+    double game_init_secs;
+    uint64_t init_done_time;
+    bool reported;
+};
 
 struct App_State
 {
     Input input;
+    Job_System jobs;
+    Frame_Arena frame_arena;
     Renderer renderer;
     Game game;
     Game game_temp;
-    uint64_t start_time;
+    Capture capture;
+    Latency latency;
+    Power power;
+    Audio audio;
+    Replay_Writer recorder;
+    Replay_Reader replay;
+    bool recording;
+    bool replaying;
+    bool replay_finished;
+    bool replay_desynced;
+    Broadcast_Server broadcast;
+    // Shows a broadcast instead of simulating a game.
+    Broadcast_Client spectator;
+    bool spectating;
+    Render_Quality_Tier quality_tier;
+    Startup_Timings startup;
     uint64_t last_sim_time;
+    uint64_t last_frame_time;
     double accumulated_time_secs;
+    Stress stress;
+    Snapshot snapshot;
+    Frame_Timing frame_timing;
+    // Where this frame's time went, see Frame_Timing_Part.
+    double timings[FRAME_TIMING_PART_COUNT];
+    int frame_ticks_count;
+    // Fixed steps simulated so far, the game's clock.
+    uint64_t sim_tick;
 };
 
+static App_Options app_options = {};
+static uint64_t app_main_time = 0;
 static App_State *as = nullptr;
 
+static void replay_seek(uint64_t tick);
+
 static void init()
 {
+    as = static_cast<App_State *>(calloc(1, sizeof(App_State)));
+    auto &startup = as->startup;
+    uint64_t phase_time = stm_now();
+    startup.window_secs = stm_sec(stm_diff(phase_time, app_main_time));
+
     {
-        // TODO: Reduce pool allocation size to what's actually needed.
+        // Sized for what the renderer can create at most, plus
+        // sokol_debugtext's own buffer, image, sampler, shader and pipeline.
         sg_desc desc = {};
         desc.environment = sglue_environment();
         desc.logger.func = slog_func;
+        desc.buffer_pool_size = renderer_buffers_max_count + 1;
+        desc.image_pool_size = renderer_images_max_count + 1;
+        desc.sampler_pool_size = renderer_samplers_max_count + 1;
+        desc.shader_pool_size = renderer_shaders_max_count + 1;
+        desc.pipeline_pool_size = renderer_pipelines_max_count + 1;
+        desc.attachments_pool_size = renderer_attachments_max_count;
+        // A frame applies a few dozen uniform blocks of at most 256 bytes.
+        desc.uniform_buffer_size = 256 * 1024;
         sg_setup(desc);
     }
+    startup.sg_setup_secs = stm_sec(stm_laptime(&phase_time));
     {
+        // One context for the debug overlay, which prints a few short lines.
         sdtx_desc_t desc = {};
+        desc.context_pool_size = 1;
+        desc.printf_buf_size = 256;
+        desc.context.char_buf_size = 1024;
         desc.fonts[0] = sdtx_font_c64();
         sdtx_setup(desc);
     }
+    startup.sdtx_setup_secs = stm_sec(stm_laptime(&phase_time));
 
-    as = static_cast<App_State *>(calloc(1, sizeof(App_State)));
+    latency_init(as->latency, app_options.latency_mode,
+                 app_options.frames_in_flight_max);
+    // Both need every frame at full rate.
+    power_init(as->power, app_options.stress || app_options.capture
+                              ? POWER_MODE_OFF
+                              : app_options.power_mode);
 
-    stm_setup();
-    as->start_time = stm_now();
+    as->last_sim_time = stm_now();
 
     input_init(as->input);
-    renderer_init(as->renderer, sapp_width(), sapp_height());
+    if (app_options.evdev)
+    {
+        input_evdev_init(as->input);
+    }
+    jobs_init(as->jobs, 0);
+    startup.jobs_init_secs = stm_sec(stm_laptime(&phase_time));
+    frame_arena_init(as->frame_arena, frame_arena_capacity);
+    renderer_init(as->renderer, as->frame_arena, sapp_width(), sapp_height());
+    as->quality_tier = RENDER_QUALITY_TIER_HIGH;
+    startup.renderer_init_secs = stm_sec(stm_laptime(&phase_time));
+
+    if (app_options.capture)
+    {
+        capture_parse(as->capture, app_options.capture);
+        capture_init(as->capture, app_options.capture_frames_count);
+        if (as->capture.active)
+        {
+            renderer_set_offscreen_display(as->renderer, true);
+        }
+    }
+
+    if (app_options.audio)
+    {
+        audio_parse(as->audio, app_options.audio);
+    }
+    audio_init(as->audio);
 
     time_t seconds;
     time(&seconds);
-    game_init(as->game, as->input, as->renderer,
-              static_cast<uint32_t>(seconds));
+    auto seed = static_cast<uint32_t>(seconds);
+    if (app_options.replay)
+    {
+        as->replaying = replay_reader_open(as->replay, app_options.replay);
+        if (as->replaying)
+        {
+            seed = as->replay.seed;
+        }
+    }
+    Game_Config config = app_options.stress
+                             ? stress_config(app_options.stress_scene)
+                             : game_default_config();
+    if (app_options.menu)
+    {
+        config.start_state = GAME_STATE_MENU;
+    }
+    auto set_count = [](int &count, int option)
+    {
+        if (option >= 0)
+        {
+            count = option;
+        }
+    };
+    set_count(config.menu_stars_count, app_options.menu_stars_count);
+    set_count(config.gameplay_stars_count, app_options.gameplay_stars_count);
+    set_count(config.menu_balls_count, app_options.menu_balls_count);
+    set_count(config.menu_boxes_count, app_options.menu_boxes_count);
+    game_init(as->game, as->input, as->renderer, as->jobs, seed, config);
+    if (app_options.stress)
+    {
+        stress_init(as->stress, app_options.stress_scene);
+    }
+    as->game.procedural_stars_count = app_options.procedural_stars_count;
+    // A replay or a broadcast decides the game state itself.
+    if (app_options.snapshot &&
+        (as->replaying || app_options.record || app_options.spectate))
+    {
+        printf("snapshot: not used with --replay, --record or --spectate\n");
+    }
+    else if (app_options.snapshot)
+    {
+        snapshot_restore(app_options.snapshot, as->game, as->renderer,
+                         as->sim_tick);
+        snapshot_open(as->snapshot, app_options.snapshot, as->game);
+    }
+    if (as->replaying)
+    {
+        replay_seek(static_cast<uint64_t>(app_options.replay_seek_secs /
+                                          game_tick_secs));
+    }
+    else if (app_options.record)
+    {
+        as->recording =
+            replay_writer_open(as->recorder, app_options.record, seed);
+    }
+    if (app_options.broadcast)
+    {
+        broadcast_server_init(as->broadcast, app_options.broadcast);
+    }
+    if (app_options.spectate)
+    {
+        broadcast_client_init(as->spectator, app_options.spectate);
+        as->spectating = as->spectator.active;
+    }
+    startup.game_init_secs = stm_sec(stm_laptime(&phase_time));
+    startup.init_done_time = phase_time;
 }
 
-static void frame()
+// Shader and pipeline creation is counted up to the end of the first frame,
+// as some of it only happens on first use.
+static void print_startup_timings()
+{
+    const auto &startup = as->startup;
+    const auto &stats = as->renderer.create_stats;
+    double first_frame_secs = stm_sec(stm_since(startup.init_done_time));
+    double total_secs = stm_sec(stm_since(app_main_time));
+
+    printf("startup: %.1fms to first frame\n", total_secs * 1000.0);
+    printf("  window and context %7.1fms\n", startup.window_secs * 1000.0);
+    printf("  sg_setup           %7.1fms\n", startup.sg_setup_secs * 1000.0);
+    printf("  sdtx_setup         %7.1fms\n",
+           startup.sdtx_setup_secs * 1000.0);
+    printf("  jobs_init          %7.1fms\n", startup.jobs_init_secs * 1000.0);
+    printf("  renderer_init      %7.1fms\n",
+           startup.renderer_init_secs * 1000.0);
+    printf("  game_init          %7.1fms\n", startup.game_init_secs * 1000.0);
+    printf("  first frame        %7.1fms\n", first_frame_secs * 1000.0);
+    printf("  of which: %d/%d shaders %.1fms, %d/%d pipelines %.1fms, "
+           "%d render target allocations %.1fms\n",
+           stats.shaders_count, renderer_shaders_max_count,
+           stats.shaders_secs * 1000.0, stats.pipelines_count,
+           renderer_pipelines_max_count, stats.pipelines_secs * 1000.0,
+           stats.target_allocations_count, stats.targets_secs * 1000.0);
+}
+
+// Runs one fixed step. While a replay plays its input replaces the
+// player's. Returns false once the replay has run out.
+static bool sim_tick()
+{
+    auto &controller = as->input.controllers[0];
+    if (as->replaying &&
+        !replay_reader_next(as->replay, controller.current_state))
+    {
+        return false;
+    }
+    if (as->recording)
+    {
+        replay_writer_tick(as->recorder, as->game, controller.last_state,
+                           controller.current_state);
+    }
+
+    game_tick(as->game, as->sim_tick);
+    input_update(as->input);
+
+    if (as->recording)
+    {
+        replay_writer_hash(as->recorder, game_hash(as->game));
+    }
+    if (as->replaying && !as->replay_desynced &&
+        game_hash(as->game) != replay_reader_hash(as->replay, as->sim_tick))
+    {
+        printf("replay: desync at tick %llu, trace it with --desync-trace\n",
+               static_cast<unsigned long long>(as->sim_tick));
+        as->replay_desynced = true;
+    }
+    broadcast_server_tick(as->broadcast, as->game, as->sim_tick);
+    as->sim_tick += 1;
+    return true;
+}
+
+// Restores the nearest keyframe and simulates forward from there, so the
+// cost is bounded by the keyframe interval, not the length of the replay.
+static void replay_seek(uint64_t tick)
 {
-    game_input(as->game);
+    uint64_t start_time = stm_now();
+    uint64_t keyframe_tick =
+        replay_reader_seek(as->replay, as->game, tick,
+                           as->input.controllers[0].last_state);
+    as->sim_tick = keyframe_tick;
+    while (as->sim_tick < tick && sim_tick())
+    {
+        // Skipped over ticks are not heard.
+        as->game.events_count = 0;
+    }
+    printf("replay: seeked to tick %llu in %.2fms, %llu ticks simulated\n",
+           static_cast<unsigned long long>(as->sim_tick),
+           stm_ms(stm_since(start_time)),
+           static_cast<unsigned long long>(as->sim_tick - keyframe_tick));
+}
 
-    // At the moment the game uses the sokol provided sapp_frame_duration() for
-    // it's fixed timestep simulation. This is a smoothed value over N frames.
-    // Let's revisit if we should use this or a non-smoothed one we calculate
-    // manually.
-    double frame_time_secs = sapp_frame_duration();
+// Turns what happened in the last sim step into sounds.
+static void play_game_events(Audio &audio, Game &g)
+{
+    for (int i = 0; i < g.events_count; i += 1)
+    {
+        const auto &event = g.events[i];
+        switch (event.type)
+        {
+        case GAME_EVENT_PADDLE_HIT:
+            audio_play(audio, AUDIO_SOUND_PADDLE_HIT, 1.0f, event.pan);
+            break;
+        case GAME_EVENT_WALL_HIT:
+            audio_play(audio, AUDIO_SOUND_WALL_HIT, 0.7f, event.pan);
+            break;
+        case GAME_EVENT_SCORE:
+            audio_play(audio, AUDIO_SOUND_SCORE, 1.0f, event.pan);
+            break;
+        }
+    }
+    g.events_count = 0;
+}
+
+// Runs the fixed steps that are due and draws the game interpolated to now.
+static void simulate(double frame_time_secs, bool draw)
+{
+    uint64_t start_time = stm_now();
+    uint64_t now_ns = input_now_ns();
     as->accumulated_time_secs += frame_time_secs;
-    while (as->accumulated_time_secs >= sims_per_sec)
+    while (as->accumulated_time_secs >= game_tick_secs)
     {
-        double total_time_secs = stm_sec(stm_since(as->start_time));
-        game_sim(as->game, total_time_secs, sims_per_sec);
+        // Each tick sees the input from before its end, which is as far
+        // behind now as the time still left to simulate after it.
+        double ahead_secs = as->accumulated_time_secs - game_tick_secs;
+        input_poll(as->input,
+                   now_ns - static_cast<uint64_t>(ahead_secs * 1e9));
+        // Held buttons count too, evdev input never reaches event().
+        if (!as->replaying && (as->input.controllers[0].current_state ||
+                               as->input.controllers[1].current_state))
+        {
+            power_activity(as->power);
+        }
+        if (!sim_tick())
+        {
+            if (!as->replay_finished)
+            {
+                printf("replay: finished at tick %llu\n",
+                       static_cast<unsigned long long>(as->sim_tick));
+                as->replay_finished = true;
+                sapp_request_quit();
+            }
+            as->accumulated_time_secs = 0.0;
+            break;
+        }
+        as->frame_ticks_count += 1;
+        snapshot_tick(as->snapshot, as->game, as->renderer, as->sim_tick);
+        play_game_events(as->audio, as->game);
         as->last_sim_time = stm_now();
-        as->accumulated_time_secs -= sims_per_sec;
+        as->accumulated_time_secs -= game_tick_secs;
     }
+
+    if (!draw)
     {
-        double total_time_secs = stm_sec(stm_since(as->start_time));
-        double delta_time_secs = stm_sec(stm_since(as->last_sim_time));
-        memcpy(&as->game_temp, &as->game, sizeof(Game));
-        game_sim(as->game_temp, total_time_secs, delta_time_secs);
-        game_draw(as->game_temp);
+        as->timings[FRAME_TIMING_PART_SIM] = stm_sec(stm_since(start_time));
+        as->timings[FRAME_TIMING_PART_DRAW] = 0.0;
+        return;
     }
+    // Since the last tick. A capture steps the game time by whole frames,
+    // there it is the time left over from them.
+    double delta_time_secs = as->capture.active
+                                 ? as->accumulated_time_secs
+                                 : stm_sec(stm_since(as->last_sim_time));
+    double total_time_secs =
+        static_cast<double>(as->sim_tick) * game_tick_secs + delta_time_secs;
+    game_copy(as->game_temp, as->game);
+    game_sim(as->game_temp, total_time_secs, delta_time_secs);
+    as->timings[FRAME_TIMING_PART_SIM] = stm_sec(stm_laptime(&start_time));
+    game_draw(as->game_temp);
+    as->timings[FRAME_TIMING_PART_DRAW] = stm_sec(stm_laptime(&start_time));
+}
 
-    input_update(as->input);
+// The broadcast is the simulation, only the cosmetics run here.
+static void spectate(double frame_time_secs, bool draw)
+{
+    uint64_t start_time = stm_now();
+    Game_Entities entities;
+    if (broadcast_client_update(as->spectator, frame_time_secs, entities))
+    {
+        as->accumulated_time_secs += frame_time_secs;
+        game_spectate(as->game, entities,
+                      static_cast<float>(as->accumulated_time_secs),
+                      static_cast<float>(frame_time_secs));
+    }
+    as->timings[FRAME_TIMING_PART_SIM] = stm_sec(stm_laptime(&start_time));
+    if (!draw)
+    {
+        as->timings[FRAME_TIMING_PART_DRAW] = 0.0;
+        return;
+    }
+    game_draw(as->game);
+    as->timings[FRAME_TIMING_PART_DRAW] = stm_sec(stm_laptime(&start_time));
+}
 
+// Renders the drawn game and the debug text on top. Returns the ticks
+// renderer_render() took.
+static uint64_t render(double frame_time_secs, double raw_frame_time_secs)
+{
+    // The render scaler needs the raw frame time, the smoothed one would hide
+    // the frames that go over budget. Throttled frames are long on purpose.
+    renderer_update_resize(as->renderer, raw_frame_time_secs);
+    if (!power_throttled(as->power))
+    {
+        renderer_update_render_scale(as->renderer, raw_frame_time_secs);
+    }
+    uint64_t render_start_time = stm_now();
     renderer_render(as->renderer, sglue_swapchain());
+    uint64_t render_ticks = stm_since(render_start_time);
+
+    // Captured before the debug text is drawn on top.
+    if (as->capture.active)
+    {
+        capture_frame(as->capture, as->renderer.display_pass.image,
+                      as->renderer.framebuffer_width,
+                      as->renderer.framebuffer_height);
+        if (capture_done(as->capture))
+        {
+            sapp_request_quit();
+        }
+    }
 
     // Draw some debug info.
     sdtx_canvas(sapp_widthf() * 0.5f, sapp_heightf() * 0.5f);
@@ -109,7 +500,29 @@ static void frame()
     double fps = 1000.0 / ms_per_frame;
     sdtx_printf("%.3fms/f\n", ms_per_frame);
     sdtx_crlf();
-    sdtx_printf("%.1f FPS", fps);
+    sdtx_printf("%.1f FPS\n", fps);
+    sdtx_crlf();
+
+    const auto &quality = as->renderer.quality;
+    Render_Quality_Cost cost = renderer_estimate_quality_cost(
+        quality, as->renderer.render_width, as->renderer.render_height);
+    sdtx_printf("%s: MSAA %dx%s %s\n",
+                renderer_quality_tier_name(as->quality_tier),
+                quality.msaa_sample_count, quality.fxaa ? " + FXAA" : "",
+                quality.hdr_format == SG_PIXELFORMAT_RGBA16F ? "RGBA16F"
+                                                             : "RG11B10F");
+    sdtx_printf("%.1fMB targets, %.1fMB/f\n",
+                static_cast<double>(cost.target_bytes) / (1024.0 * 1024.0),
+                static_cast<double>(cost.frame_bandwidth_bytes) /
+                    (1024.0 * 1024.0));
+    // Raw frame times, up to the last frame.
+    char frame_timing_text[128];
+    frame_timing_format(as->frame_timing, frame_timing_text,
+                        sizeof(frame_timing_text));
+    sdtx_puts(frame_timing_text);
+    sdtx_printf("power: %s, %.0f%% CPU\n",
+                power_state_name(as->power.state),
+                as->power.cpu_load * 100.0);
 
     sg_pass pass = {};
     pass.action.colors[0].load_action = SG_LOADACTION_DONTCARE;
@@ -118,11 +531,105 @@ static void frame()
     sdtx_draw();
     sg_end_pass();
 
+    return render_ticks;
+}
+
+static void frame()
+{
+    // Sleeps out the rest of a throttled frame. Frame pacing would only
+    // fight it, and its estimates would be thrown off by the long frames.
+    bool draw = power_frame_begin(as->power);
+    bool throttled = power_throttled(as->power);
+    if (!throttled)
+    {
+        // Nothing before this may sample input, it can sleep for most of a
+        // frame.
+        latency_frame_begin(as->latency);
+    }
+    frame_arena_begin(as->frame_arena);
+    as->frame_ticks_count = 0;
+    renderer_begin_frame(as->renderer);
+
+    // The fixed timestep simulation uses the sokol provided
+    // sapp_frame_duration(), a smoothed value over N frames, unless the
+    // frames are being throttled, see power_frame_time().
+    double raw_frame_time_secs = stm_sec(stm_laptime(&as->last_frame_time));
+    double frame_time_secs = power_frame_time(
+        as->power, sapp_frame_duration(), raw_frame_time_secs);
+    if (as->capture.active)
+    {
+        frame_time_secs = 1.0 / capture_frames_per_sec;
+    }
+    if (as->spectating)
+    {
+        spectate(frame_time_secs, draw);
+    }
+    else
+    {
+        simulate(frame_time_secs, draw);
+    }
+
+    // Hidden frames draw nothing, the swap chain is left alone.
+    uint64_t render_ticks = 0;
+    if (draw)
+    {
+        render_ticks = render(frame_time_secs, raw_frame_time_secs);
+    }
+
+    uint64_t commit_start_time = stm_now();
     sg_commit();
+    render_ticks += stm_since(commit_start_time);
+    if (!throttled)
+    {
+        latency_frame_end(as->latency);
+    }
+
+    as->timings[FRAME_TIMING_PART_RENDER] = stm_sec(render_ticks);
+    as->timings[FRAME_TIMING_PART_FRAME] = raw_frame_time_secs;
+    // Throttled frames would all count as stutters.
+    if (!throttled)
+    {
+        frame_timing_record(as->frame_timing, as->timings,
+                            as->frame_ticks_count);
+    }
+    if (stress_frame(as->stress, as->timings))
+    {
+        sapp_request_quit();
+    }
+    if (app_options.quit_after_secs > 0.0 &&
+        stm_sec(stm_since(app_main_time)) >= app_options.quit_after_secs)
+    {
+        sapp_request_quit();
+    }
+
+    if (!as->startup.reported)
+    {
+        print_startup_timings();
+        as->startup.reported = true;
+    }
 }
 
 static void cleanup()
 {
+    capture_shutdown(as->capture);
+    audio_shutdown(as->audio);
+    if (as->recording)
+    {
+        replay_writer_close(as->recorder);
+    }
+    replay_reader_close(as->replay);
+    broadcast_server_shutdown(as->broadcast);
+    broadcast_client_shutdown(as->spectator);
+    input_shutdown(as->input);
+    snapshot_close(as->snapshot, as->game, as->renderer, as->sim_tick);
+    game_shutdown(as->game);
+    game_shutdown(as->game_temp);
+    jobs_shutdown(as->jobs);
+    frame_arena_print_report(as->frame_arena);
+    frame_arena_shutdown(as->frame_arena);
+    latency_shutdown(as->latency);
+    power_shutdown(as->power);
+    frame_timing_report(as->frame_timing, app_options.frame_times);
     free(as);
 
     sdtx_shutdown();
@@ -138,6 +645,7 @@ static void event(const sapp_event *ev)
     }
 
     input_handle_event(as->input, ev);
+    power_handle_event(as->power, ev);
 
     // Allow user to quickly toggle fullscreen with alt-enter.
     if (ev->type == SAPP_EVENTTYPE_KEY_DOWN)
@@ -147,11 +655,321 @@ static void event(const sapp_event *ev)
         {
             sapp_toggle_fullscreen();
         }
+
+        // Seek through a replay with the arrow keys, the paddles follow the
+        // recorded input anyway.
+        if (as->replaying && (ev->key_code == SAPP_KEYCODE_LEFT ||
+                              ev->key_code == SAPP_KEYCODE_RIGHT))
+        {
+            auto step = static_cast<int64_t>(replay_seek_step_secs /
+                                             game_tick_secs);
+            auto tick = static_cast<int64_t>(as->sim_tick);
+            tick += ev->key_code == SAPP_KEYCODE_LEFT ? -step : step;
+            replay_seek(static_cast<uint64_t>(std::max<int64_t>(tick, 0)));
+        }
+
+        // Cycle through the render quality tiers with F2.
+        if (ev->key_code == SAPP_KEYCODE_F2)
+        {
+            as->quality_tier = static_cast<Render_Quality_Tier>(
+                (as->quality_tier + 1) % RENDER_QUALITY_TIER_COUNT);
+            renderer_set_quality(as->renderer,
+                                 renderer_quality_tier(as->quality_tier));
+        }
+    }
+}
+
+static void print_usage()
+{
+    printf("usage: pong3d [options]\n"
+           "  --capture=png:<directory>  write every frame to a PNG\n"
+           "  --capture=y4m:<file>       write every frame to a Y4M video\n"
+           "  --capture-frames=<count>   quit after capturing count frames\n"
+           "  --audio=null               mix audio without playing it\n"
+           "  --audio=wav:<file>         mix audio into a WAV file\n"
+           "  --record=<file>            record a replay\n"
+           "  --replay=<file>            play a replay, arrow keys seek\n"
+           "  --replay-seek=<seconds>    start the replay this far in\n"
+           "  --desync-trace=<file>      write the replay's per-tick state\n"
+           "                             hashes to a trace and quit\n"
+           "  --desync-bisect=<a>,<b>    find where two traces diverge\n"
+           "  --broadcast=<address>      stream the game to spectators at\n"
+           "                             tcp:[<ip>:]<port> or unix:<path>\n"
+           "  --spectate=<address>       watch a broadcast\n"
+           "  --broadcast-load=<address> connect many headless spectators\n"
+           "                             to a broadcast and print stats\n"
+           "  --broadcast-load-count=<n> spectators to connect, 1000\n"
+           "  --broadcast-load-secs=<s>  seconds to run for, 10\n"
+           "  --math=fast|libm           trig for the simulation, fast is\n"
+           "                             the same on every platform\n"
+           "  --math-accuracy            check the fast trig and quit\n"
+           "  --procedural-stars=<n>     draw n background stars entirely\n"
+           "                             on the GPU instead of simulating\n"
+           "                             them\n"
+           "  --stress=<scene>           run a stress scene, print timings\n"
+           "                             and quit: stars-10k, stars-100k,\n"
+           "                             stars-1m, phong-boxes or balls\n"
+           "  --menu                     start in the menu\n"
+           "  --menu-stars=<n>           background stars in the menu\n"
+           "  --gameplay-stars=<n>       background stars in gameplay\n"
+           "  --menu-balls=<n>           balls bouncing around the menu\n"
+           "  --menu-boxes=<n>           phong boxes behind the menu\n"
+           "  --evdev                    read gamepads and keyboards from\n"
+           "                             /dev/input on a thread of their\n"
+           "                             own, Linux only. Keyboards are\n"
+           "                             read even while unfocused\n"
+           "  --evdev-check              check evdev input with virtual\n"
+           "                             uinput devices and quit\n"
+           "  --latency=default|low      low starts each frame just in time\n"
+           "                             for the next vblank and presents\n"
+           "                             only finished frames\n"
+           "  --frames-in-flight=<n>     frames the GPU may lag behind, 1\n"
+           "                             to 4, the driver decides if unset\n"
+           "  --swap-interval=<n>        present every nth vblank, 1\n"
+           "  --frame-times=<file>       write the frame time histogram to\n"
+           "                             a CSV file on exit\n"
+           "  --snapshot=<file>          carry on from the game saved in\n"
+           "                             file, and keep saving it there\n"
+           "                             every few seconds\n"
+           "  --power=auto|off           auto lowers the frame rate while\n"
+           "                             idle, unfocused or iconified\n"
+           "  --power=<state>            pin idle, unfocused or hidden to\n"
+           "                             measure what it saves\n"
+           "  --quit-after=<seconds>     quit after running this long\n");
+}
+
+static const char *parse_broadcast_address(const char *address)
+{
+    if (!broadcast_parse(address))
+    {
+        printf("invalid broadcast address: %s\n", address);
+        print_usage();
+        exit(1);
+    }
+    return address;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i += 1)
+    {
+        const char *arg = argv[i];
+        if (strncmp(arg, "--capture=", 10) == 0)
+        {
+            Capture capture = {};
+            if (!capture_parse(capture, arg + 10))
+            {
+                printf("invalid capture spec: %s\n", arg + 10);
+                print_usage();
+                exit(1);
+            }
+            app_options.capture = arg + 10;
+        }
+        else if (strncmp(arg, "--capture-frames=", 17) == 0)
+        {
+            app_options.capture_frames_count = atoi(arg + 17);
+        }
+        else if (strncmp(arg, "--audio=", 8) == 0)
+        {
+            Audio audio = {};
+            if (!audio_parse(audio, arg + 8))
+            {
+                printf("invalid audio spec: %s\n", arg + 8);
+                print_usage();
+                exit(1);
+            }
+            app_options.audio = arg + 8;
+        }
+        else if (strncmp(arg, "--record=", 9) == 0)
+        {
+            app_options.record = arg + 9;
+        }
+        else if (strncmp(arg, "--replay=", 9) == 0)
+        {
+            app_options.replay = arg + 9;
+        }
+        else if (strncmp(arg, "--replay-seek=", 14) == 0)
+        {
+            app_options.replay_seek_secs = atof(arg + 14);
+        }
+        else if (strncmp(arg, "--desync-trace=", 15) == 0)
+        {
+            app_options.desync_trace = arg + 15;
+        }
+        else if (strncmp(arg, "--desync-bisect=", 16) == 0)
+        {
+            app_options.desync_bisect = arg + 16;
+        }
+        else if (strncmp(arg, "--broadcast=", 12) == 0)
+        {
+            app_options.broadcast = parse_broadcast_address(arg + 12);
+        }
+        else if (strncmp(arg, "--spectate=", 11) == 0)
+        {
+            app_options.spectate = parse_broadcast_address(arg + 11);
+        }
+        else if (strncmp(arg, "--broadcast-load=", 17) == 0)
+        {
+            app_options.broadcast_load = parse_broadcast_address(arg + 17);
+        }
+        else if (strncmp(arg, "--broadcast-load-count=", 23) == 0)
+        {
+            app_options.broadcast_load_count = atoi(arg + 23);
+        }
+        else if (strncmp(arg, "--broadcast-load-secs=", 22) == 0)
+        {
+            app_options.broadcast_load_secs = atof(arg + 22);
+        }
+        else if (strncmp(arg, "--math=", 7) == 0)
+        {
+            Fast_Math_Mode mode;
+            if (!fast_math_parse(arg + 7, mode))
+            {
+                printf("invalid math mode: %s\n", arg + 7);
+                print_usage();
+                exit(1);
+            }
+            fast_math_set_mode(mode);
+        }
+        else if (strcmp(arg, "--math-accuracy") == 0)
+        {
+            app_options.math_accuracy = true;
+        }
+        else if (strncmp(arg, "--procedural-stars=", 19) == 0)
+        {
+            app_options.procedural_stars_count = atoi(arg + 19);
+        }
+        else if (strncmp(arg, "--stress=", 9) == 0)
+        {
+            if (!stress_parse(arg + 9, app_options.stress_scene))
+            {
+                printf("unknown stress scene: %s\n", arg + 9);
+                print_usage();
+                exit(1);
+            }
+            app_options.stress = true;
+        }
+        else if (strcmp(arg, "--menu") == 0)
+        {
+            app_options.menu = true;
+        }
+        else if (strncmp(arg, "--menu-stars=", 13) == 0)
+        {
+            app_options.menu_stars_count = std::max(atoi(arg + 13), 0);
+        }
+        else if (strncmp(arg, "--gameplay-stars=", 17) == 0)
+        {
+            app_options.gameplay_stars_count = std::max(atoi(arg + 17), 0);
+        }
+        else if (strncmp(arg, "--menu-balls=", 13) == 0)
+        {
+            app_options.menu_balls_count = std::max(atoi(arg + 13), 1);
+        }
+        else if (strncmp(arg, "--menu-boxes=", 13) == 0)
+        {
+            app_options.menu_boxes_count = std::max(atoi(arg + 13), 0);
+        }
+        else if (strcmp(arg, "--evdev") == 0)
+        {
+            app_options.evdev = true;
+        }
+        else if (strcmp(arg, "--evdev-check") == 0)
+        {
+            app_options.evdev_check = true;
+        }
+        else if (strncmp(arg, "--latency=", 10) == 0)
+        {
+            if (!latency_parse(arg + 10, app_options.latency_mode))
+            {
+                printf("unknown latency mode: %s\n", arg + 10);
+                print_usage();
+                exit(1);
+            }
+        }
+        else if (strncmp(arg, "--frames-in-flight=", 19) == 0)
+        {
+            app_options.frames_in_flight_max =
+                std::clamp(atoi(arg + 19), 1,
+                           latency_frames_in_flight_max_count);
+        }
+        else if (strncmp(arg, "--swap-interval=", 16) == 0)
+        {
+            app_options.swap_interval = std::max(atoi(arg + 16), 1);
+        }
+        else if (strncmp(arg, "--frame-times=", 14) == 0)
+        {
+            app_options.frame_times = arg + 14;
+        }
+        else if (strncmp(arg, "--snapshot=", 11) == 0)
+        {
+            app_options.snapshot = arg + 11;
+        }
+        else if (strncmp(arg, "--power=", 8) == 0)
+        {
+            if (!power_parse(arg + 8, app_options.power_mode))
+            {
+                printf("unknown power mode: %s\n", arg + 8);
+                print_usage();
+                exit(1);
+            }
+        }
+        else if (strncmp(arg, "--quit-after=", 13) == 0)
+        {
+            app_options.quit_after_secs = atof(arg + 13);
+        }
+        else
+        {
+            printf("unknown option: %s\n", arg);
+            print_usage();
+            exit(1);
+        }
     }
 }
 
 sapp_desc sokol_main(int argc, char *argv[])
 {
+    stm_setup();
+    app_main_time = stm_now();
+
+    app_options.broadcast_load_count = 1000;
+    app_options.broadcast_load_secs = 10.0;
+    app_options.menu_stars_count = -1;
+    app_options.gameplay_stars_count = -1;
+    app_options.menu_balls_count = -1;
+    app_options.menu_boxes_count = -1;
+    app_options.power_mode = POWER_MODE_AUTO;
+    parse_args(argc, argv);
+
+    // The desync tools run headless and never open a window.
+    if (app_options.desync_trace)
+    {
+        if (!app_options.replay)
+        {
+            printf("--desync-trace needs a --replay\n");
+            print_usage();
+            exit(1);
+        }
+        exit(desync_trace(app_options.replay, app_options.desync_trace));
+    }
+    if (app_options.desync_bisect)
+    {
+        exit(desync_bisect(app_options.desync_bisect));
+    }
+    if (app_options.broadcast_load)
+    {
+        exit(broadcast_load(app_options.broadcast_load,
+                            app_options.broadcast_load_count,
+                            app_options.broadcast_load_secs));
+    }
+    if (app_options.math_accuracy)
+    {
+        exit(fast_math_accuracy());
+    }
+    if (app_options.evdev_check)
+    {
+        exit(input_evdev_check());
+    }
+
     sapp_desc desc = {};
     desc.init_cb = init;
     desc.frame_cb = frame;
@@ -162,5 +980,6 @@ sapp_desc sokol_main(int argc, char *argv[])
     desc.window_title = "Pong3D";
     desc.logger.func = slog_func;
     desc.high_dpi = true;
+    desc.swap_interval = app_options.swap_interval;
     return desc;
 }
@@ -0,0 +1,302 @@
+#include "particles.h"
+#include "fast_math.h"
+#include "jobs.h"
+#include "renderer.h"
+#include "simd.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+
+static_assert(particles_max_count % 4 == 0);
+
+// Fraction of velocity lost per second.
+static constexpr float particles_drag = 2.5f;
+static constexpr int particles_draw_grain_size = 4096;
+
+// Particles emitted at a time, with 2 random blocks each.
+static constexpr int particles_emit_batch_count = 64;
+
+// Every per-particle field, in the order they are saved.
+static constexpr int particles_fields_count = 12;
+
+template <typename P>
+static auto particles_fields(P &p)
+{
+    using Field = decltype(&p.position_x[0]);
+    return std::array<Field, particles_fields_count>{
+        p.position_x, p.position_y, p.position_z, p.velocity_x,
+        p.velocity_y, p.velocity_z, p.life,       p.inv_lifetime,
+        p.size,       p.color_r,    p.color_g,    p.color_b,
+    };
+}
+
+// particles_sim() runs over the particles 4 at a time, so the slots from
+// count up to the next multiple of 4 are kept zeroed.
+static void particles_clear_padding(Particles &p)
+{
+    int end = (p.count + 3) & ~3;
+    for (float *field : particles_fields(p))
+    {
+        std::fill(field + p.count, field + end, 0.0f);
+    }
+}
+
+static HMM_Vec3 particles_rand_direction(float u, float v)
+{
+    float z = u * 2.0f - 1.0f;
+    float angle = v * 2.0f * HMM_PI32;
+    float r = HMM_SqrtF(1.0f - z * z);
+    float sin_angle, cos_angle;
+    fast_sincos(angle, sin_angle, cos_angle);
+    return HMM_V3(r * cos_angle, r * sin_angle, z);
+}
+
+void particles_emit(Particles &p, Philox_Key key,
+                    const Particle_Emitter &emitter, HMM_Vec3 position,
+                    int count)
+{
+    constexpr int blocks_per_particle = 2;
+    constexpr int blocks_count =
+        particles_emit_batch_count * blocks_per_particle;
+    int emit_count = std::min(count, particles_max_count - p.count);
+    p.dropped_count += static_cast<uint64_t>(count - emit_count);
+
+    for (int first = 0; first < emit_count;
+         first += particles_emit_batch_count)
+    {
+        int batch_count =
+            std::min(emit_count - first, particles_emit_batch_count);
+        Philox_Counter counters[blocks_count];
+        Philox_Block blocks[blocks_count];
+        for (int j = 0; j < batch_count; j += 1)
+        {
+            uint64_t serial =
+                p.emitted_count + static_cast<uint64_t>(first + j);
+            for (int k = 0; k < blocks_per_particle; k += 1)
+            {
+                counters[j * blocks_per_particle + k] = {
+                    {static_cast<uint32_t>(serial),
+                     static_cast<uint32_t>(serial >> 32),
+                     static_cast<uint32_t>(k), 0}};
+            }
+        }
+        philox4x32_blocks(key, counters, blocks,
+                          batch_count * blocks_per_particle);
+
+        for (int j = 0; j < batch_count; j += 1)
+        {
+            const Philox_Block *r = blocks + j * blocks_per_particle;
+            HMM_Vec3 direction = HMM_LerpV3(
+                emitter.direction, emitter.spread,
+                particles_rand_direction(philox_float(r[0].v[0]),
+                                         philox_float(r[0].v[1])));
+            float length = HMM_LenV3(direction);
+            direction =
+                length > 0.0001f ? direction / length : emitter.direction;
+            HMM_Vec3 velocity =
+                direction * philox_float(r[0].v[2], emitter.speed_min,
+                                         emitter.speed_max);
+            HMM_Vec3 start = position + emitter.path * philox_float(r[0].v[3]);
+            float lifetime = philox_float(r[1].v[0], emitter.lifetime_min,
+                                          emitter.lifetime_max);
+
+            int i = p.count + first + j;
+            p.position_x[i] = start.X;
+            p.position_y[i] = start.Y;
+            p.position_z[i] = start.Z;
+            p.velocity_x[i] = velocity.X;
+            p.velocity_y[i] = velocity.Y;
+            p.velocity_z[i] = velocity.Z;
+            p.life[i] = lifetime;
+            p.inv_lifetime[i] = 1.0f / lifetime;
+            p.size[i] =
+                philox_float(r[1].v[1], emitter.size_min, emitter.size_max);
+            p.color_r[i] = emitter.color.X;
+            p.color_g[i] = emitter.color.Y;
+            p.color_b[i] = emitter.color.Z;
+        }
+    }
+    p.count += emit_count;
+    p.emitted_count += static_cast<uint64_t>(emit_count);
+    particles_clear_padding(p);
+}
+
+void particles_copy(Particles &dst, const Particles &src)
+{
+    auto copy = [count = src.count](float *dst_field, const float *src_field)
+    { std::copy(src_field, src_field + count, dst_field); };
+    copy(dst.position_x, src.position_x);
+    copy(dst.position_y, src.position_y);
+    copy(dst.position_z, src.position_z);
+    copy(dst.velocity_x, src.velocity_x);
+    copy(dst.velocity_y, src.velocity_y);
+    copy(dst.velocity_z, src.velocity_z);
+    copy(dst.life, src.life);
+    copy(dst.inv_lifetime, src.inv_lifetime);
+    copy(dst.size, src.size);
+    copy(dst.color_r, src.color_r);
+    copy(dst.color_g, src.color_g);
+    copy(dst.color_b, src.color_b);
+    dst.count = src.count;
+    dst.dropped_count = src.dropped_count;
+    dst.emitted_count = src.emitted_count;
+    particles_clear_padding(dst);
+}
+
+size_t particles_state_size(const Particles &p)
+{
+    return sizeof(p.count) + sizeof(p.dropped_count) +
+           sizeof(p.emitted_count) +
+           sizeof(float) * particles_fields_count *
+               static_cast<size_t>(p.count);
+}
+
+size_t particles_state_max_size()
+{
+    return sizeof(Particles::count) + sizeof(Particles::dropped_count) +
+           sizeof(Particles::emitted_count) +
+           sizeof(float) * particles_fields_count * particles_max_count;
+}
+
+void particles_save(const Particles &p, uint8_t *dst)
+{
+    memcpy(dst, &p.count, sizeof(p.count));
+    dst += sizeof(p.count);
+    memcpy(dst, &p.dropped_count, sizeof(p.dropped_count));
+    dst += sizeof(p.dropped_count);
+    memcpy(dst, &p.emitted_count, sizeof(p.emitted_count));
+    dst += sizeof(p.emitted_count);
+    size_t field_size = sizeof(float) * static_cast<size_t>(p.count);
+    for (const float *field : particles_fields(p))
+    {
+        memcpy(dst, field, field_size);
+        dst += field_size;
+    }
+}
+
+bool particles_state_valid(const uint8_t *src, size_t size)
+{
+    size_t header_size = sizeof(Particles::count) +
+                         sizeof(Particles::dropped_count) +
+                         sizeof(Particles::emitted_count);
+    if (size < header_size)
+    {
+        return false;
+    }
+    decltype(Particles::count) count;
+    memcpy(&count, src, sizeof(count));
+    return count >= 0 && count <= particles_max_count &&
+           size == header_size + sizeof(float) * particles_fields_count *
+                                     static_cast<size_t>(count);
+}
+
+size_t particles_load(Particles &p, const uint8_t *src)
+{
+    const uint8_t *start = src;
+    memcpy(&p.count, src, sizeof(p.count));
+    assert(p.count >= 0 && p.count <= particles_max_count);
+    src += sizeof(p.count);
+    memcpy(&p.dropped_count, src, sizeof(p.dropped_count));
+    src += sizeof(p.dropped_count);
+    memcpy(&p.emitted_count, src, sizeof(p.emitted_count));
+    src += sizeof(p.emitted_count);
+    size_t field_size = sizeof(float) * static_cast<size_t>(p.count);
+    for (float *field : particles_fields(p))
+    {
+        memcpy(field, src, field_size);
+        src += field_size;
+    }
+    particles_clear_padding(p);
+    return static_cast<size_t>(src - start);
+}
+
+static void particles_move(Particles &p, int from, int to)
+{
+    p.position_x[to] = p.position_x[from];
+    p.position_y[to] = p.position_y[from];
+    p.position_z[to] = p.position_z[from];
+    p.velocity_x[to] = p.velocity_x[from];
+    p.velocity_y[to] = p.velocity_y[from];
+    p.velocity_z[to] = p.velocity_z[from];
+    p.life[to] = p.life[from];
+    p.inv_lifetime[to] = p.inv_lifetime[from];
+    p.size[to] = p.size[from];
+    p.color_r[to] = p.color_r[from];
+    p.color_g[to] = p.color_g[from];
+    p.color_b[to] = p.color_b[from];
+}
+
+void particles_sim(Particles &p, float delta_time)
+{
+    F32x4 dt = f32x4_set1(delta_time);
+    F32x4 damping =
+        f32x4_set1(std::max(1.0f - particles_drag * delta_time, 0.0f));
+
+    // The last group of 4 runs past count into the zeroed padding slots,
+    // which are cleared again once the dead particles are removed.
+    for (int i = 0; i < p.count; i += 4)
+    {
+        F32x4 vx = f32x4_mul(f32x4_load(&p.velocity_x[i]), damping);
+        F32x4 vy = f32x4_mul(f32x4_load(&p.velocity_y[i]), damping);
+        F32x4 vz = f32x4_mul(f32x4_load(&p.velocity_z[i]), damping);
+        f32x4_store(&p.velocity_x[i], vx);
+        f32x4_store(&p.velocity_y[i], vy);
+        f32x4_store(&p.velocity_z[i], vz);
+
+        f32x4_store(&p.position_x[i],
+                    f32x4_mul_add(vx, dt, f32x4_load(&p.position_x[i])));
+        f32x4_store(&p.position_y[i],
+                    f32x4_mul_add(vy, dt, f32x4_load(&p.position_y[i])));
+        f32x4_store(&p.position_z[i],
+                    f32x4_mul_add(vz, dt, f32x4_load(&p.position_z[i])));
+
+        f32x4_store(&p.life[i], f32x4_sub(f32x4_load(&p.life[i]), dt));
+    }
+
+    // Swap and pop. The particle moved into slot i is checked again.
+    int i = 0;
+    while (i < p.count)
+    {
+        if (p.life[i] > 0.0f)
+        {
+            i += 1;
+            continue;
+        }
+        p.count -= 1;
+        particles_move(p, p.count, i);
+    }
+    particles_clear_padding(p);
+}
+
+void particles_draw(const Particles &p, Renderer &r, Job_System &jobs)
+{
+    if (p.count == 0)
+    {
+        return;
+    }
+
+    auto *instances = renderer_push_basic_box_instances(r, p.count);
+    auto build = [&p, instances](int begin, int end)
+    {
+        for (int i = begin; i < end; i += 1)
+        {
+            float fade = p.life[i] * p.inv_lifetime[i];
+            float size = p.size[i] * fade;
+
+            // Particles don't rotate, so the transform is written column by
+            // column instead of going through a quaternion. This loop is
+            // bound by the writes to the instance array.
+            auto &transform = instances[i].obj_to_world_transform;
+            transform.Columns[0] = HMM_V4(size, 0.0f, 0.0f, 0.0f);
+            transform.Columns[1] = HMM_V4(0.0f, size, 0.0f, 0.0f);
+            transform.Columns[2] = HMM_V4(0.0f, 0.0f, size, 0.0f);
+            transform.Columns[3] = HMM_V4(p.position_x[i], p.position_y[i],
+                                          p.position_z[i], 1.0f);
+            instances[i].color =
+                HMM_V3(p.color_r[i] * fade, p.color_g[i] * fade,
+                       p.color_b[i] * fade);
+        }
+    };
+    jobs_parallel_for(jobs, p.count, particles_draw_grain_size, build);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "HandmadeMath.h"
+#include "philox.h"
+#include <cstddef>
+#include <cstdint>
+
+// A multiple of 4, the SIMD width the simulation runs at.
+inline constexpr int particles_max_count = 65536;
+
+struct Job_System;
+struct Renderer;
+
+struct Particle_Emitter
+{
+    HMM_Vec3 direction;
+    // 0 emits straight along direction, 1 in every direction.
+    float spread;
+    float speed_min;
+    float speed_max;
+    float lifetime_min;
+    float lifetime_max;
+    float size_min;
+    float size_max;
+    HMM_Vec3 color;
+    // Particles start at random points on position + path * [0, 1], so an
+    // emitter that moved since the last emit leaves an even trail.
+    HMM_Vec3 path;
+};
+
+// Structure of arrays, so each pass over the particles only streams through
+// the fields it needs, 4 particles at a time. Live particles are packed at
+// the front: a dead particle is overwritten by the last live one. Capacity
+// is fixed, emitting into a full pool drops the new particles.
+struct Particles
+{
+    alignas(16) float position_x[particles_max_count];
+    alignas(16) float position_y[particles_max_count];
+    alignas(16) float position_z[particles_max_count];
+    alignas(16) float velocity_x[particles_max_count];
+    alignas(16) float velocity_y[particles_max_count];
+    alignas(16) float velocity_z[particles_max_count];
+    // Seconds left to live.
+    alignas(16) float life[particles_max_count];
+    alignas(16) float inv_lifetime[particles_max_count];
+    alignas(16) float size[particles_max_count];
+    alignas(16) float color_r[particles_max_count];
+    alignas(16) float color_g[particles_max_count];
+    alignas(16) float color_b[particles_max_count];
+    int count;
+    uint64_t dropped_count;
+    // Particles ever emitted. Each one draws its random numbers from its
+    // own counter, its place in this sequence.
+    uint64_t emitted_count;
+};
+
+// The random numbers for a whole burst are generated together, 4 particles
+// at a time.
+void particles_emit(Particles &p, Philox_Key key,
+                    const Particle_Emitter &emitter, HMM_Vec3 position,
+                    int count);
+// Copies only the live particles.
+void particles_copy(Particles &dst, const Particles &src);
+// Serializes the live particles into particles_state_size() bytes, in the
+// native byte order.
+size_t particles_state_size(const Particles &p);
+// particles_state_size() with every particle alive.
+size_t particles_state_max_size();
+void particles_save(const Particles &p, uint8_t *dst);
+// Whether size bytes at src are a state particles_load() can load, with a
+// count that fits the pool and exactly the fields it implies.
+bool particles_state_valid(const uint8_t *src, size_t size);
+// Returns the number of bytes read.
+size_t particles_load(Particles &p, const uint8_t *src);
+// Moves every particle and removes the ones that died.
+void particles_sim(Particles &p, float delta_time);
+// Draws the particles as basic box instances, shrinking and fading out
+// towards the end of their life. The color is HDR, so bright particles
+// bloom.
+void particles_draw(const Particles &p, Renderer &r, Job_System &jobs);
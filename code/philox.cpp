@@ -0,0 +1,202 @@
+#include "philox.h"
+#include "simd.h"
+
+static constexpr uint32_t philox_m0 = 0xD2511F53u;
+static constexpr uint32_t philox_m1 = 0xCD9E8D57u;
+// Added to the key every round, the golden ratio and sqrt(3) - 1.
+static constexpr uint32_t philox_w0 = 0x9E3779B9u;
+static constexpr uint32_t philox_w1 = 0xBB67AE85u;
+static constexpr int philox_rounds_count = 10;
+
+Philox_Key philox_key(uint32_t seed, uint32_t stream)
+{
+    return {{seed, stream}};
+}
+
+Philox_Block philox4x32(Philox_Key key, Philox_Counter counter)
+{
+    uint32_t c0 = counter.c[0];
+    uint32_t c1 = counter.c[1];
+    uint32_t c2 = counter.c[2];
+    uint32_t c3 = counter.c[3];
+    uint32_t k0 = key.k[0];
+    uint32_t k1 = key.k[1];
+    for (int i = 0; i < philox_rounds_count; i += 1)
+    {
+        uint64_t p0 = static_cast<uint64_t>(philox_m0) * c0;
+        uint64_t p1 = static_cast<uint64_t>(philox_m1) * c2;
+        c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+        c1 = static_cast<uint32_t>(p1);
+        c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+        c3 = static_cast<uint32_t>(p0);
+        k0 += philox_w0;
+        k1 += philox_w1;
+    }
+    return {{c0, c1, c2, c3}};
+}
+
+#if defined(SIMD_SSE2) || defined(SIMD_NEON)
+
+#if defined(SIMD_SSE2)
+typedef __m128i U32x4;
+
+static inline U32x4 u32x4_set1(uint32_t u)
+{
+    return _mm_set1_epi32(static_cast<int>(u));
+}
+
+static inline U32x4 u32x4_xor(U32x4 a, U32x4 b)
+{
+    return _mm_xor_si128(a, b);
+}
+
+static inline U32x4 u32x4_add(U32x4 a, U32x4 b)
+{
+    return _mm_add_epi32(a, b);
+}
+
+// SSE2 only multiplies the even lanes into 64 bits, the odd ones are
+// shifted down for a second multiply and the halves gathered back up.
+static inline void u32x4_mulhilo(U32x4 a, uint32_t m, U32x4 &lo, U32x4 &hi)
+{
+    U32x4 mm = u32x4_set1(m);
+    U32x4 even = _mm_mul_epu32(a, mm);
+    U32x4 odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), mm);
+    lo = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    hi = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 3, 1)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 3, 1)));
+}
+
+// Transposes 4 rows of 4 in place.
+static inline void u32x4_transpose(U32x4 &r0, U32x4 &r1, U32x4 &r2,
+                                   U32x4 &r3)
+{
+    U32x4 t0 = _mm_unpacklo_epi32(r0, r1);
+    U32x4 t1 = _mm_unpacklo_epi32(r2, r3);
+    U32x4 t2 = _mm_unpackhi_epi32(r0, r1);
+    U32x4 t3 = _mm_unpackhi_epi32(r2, r3);
+    r0 = _mm_unpacklo_epi64(t0, t1);
+    r1 = _mm_unpackhi_epi64(t0, t1);
+    r2 = _mm_unpacklo_epi64(t2, t3);
+    r3 = _mm_unpackhi_epi64(t2, t3);
+}
+
+// Lane j of x[i] is element i of the 4 words at p + j * 4.
+static inline void u32x4_load_transposed(const uint32_t *p, U32x4 *x)
+{
+    for (int i = 0; i < 4; i += 1)
+    {
+        x[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 4));
+    }
+    u32x4_transpose(x[0], x[1], x[2], x[3]);
+}
+
+static inline void u32x4_store_transposed(uint32_t *p, U32x4 *x)
+{
+    u32x4_transpose(x[0], x[1], x[2], x[3]);
+    for (int i = 0; i < 4; i += 1)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p + i * 4), x[i]);
+    }
+}
+#else
+typedef uint32x4_t U32x4;
+
+static inline U32x4 u32x4_set1(uint32_t u)
+{
+    return vdupq_n_u32(u);
+}
+
+static inline U32x4 u32x4_xor(U32x4 a, U32x4 b)
+{
+    return veorq_u32(a, b);
+}
+
+static inline U32x4 u32x4_add(U32x4 a, U32x4 b)
+{
+    return vaddq_u32(a, b);
+}
+
+static inline void u32x4_mulhilo(U32x4 a, uint32_t m, U32x4 &lo, U32x4 &hi)
+{
+    uint32x2_t mm = vdup_n_u32(m);
+    uint64x2_t p01 = vmull_u32(vget_low_u32(a), mm);
+    uint64x2_t p23 = vmull_u32(vget_high_u32(a), mm);
+    uint32x4x2_t halves = vuzpq_u32(vreinterpretq_u32_u64(p01),
+                                    vreinterpretq_u32_u64(p23));
+    lo = halves.val[0];
+    hi = halves.val[1];
+}
+
+static inline void u32x4_load_transposed(const uint32_t *p, U32x4 *x)
+{
+    uint32x4x4_t v = vld4q_u32(p);
+    for (int i = 0; i < 4; i += 1)
+    {
+        x[i] = v.val[i];
+    }
+}
+
+static inline void u32x4_store_transposed(uint32_t *p, U32x4 *x)
+{
+    uint32x4x4_t v;
+    for (int i = 0; i < 4; i += 1)
+    {
+        v.val[i] = x[i];
+    }
+    vst4q_u32(p, v);
+}
+#endif
+
+// The same rounds as philox4x32(), for 4 counters in the lanes of c.
+static inline void philox4x32_x4(Philox_Key key, U32x4 *c)
+{
+    U32x4 k0 = u32x4_set1(key.k[0]);
+    U32x4 k1 = u32x4_set1(key.k[1]);
+    U32x4 w0 = u32x4_set1(philox_w0);
+    U32x4 w1 = u32x4_set1(philox_w1);
+    for (int i = 0; i < philox_rounds_count; i += 1)
+    {
+        U32x4 lo0, hi0, lo1, hi1;
+        u32x4_mulhilo(c[0], philox_m0, lo0, hi0);
+        u32x4_mulhilo(c[2], philox_m1, lo1, hi1);
+        c[0] = u32x4_xor(u32x4_xor(hi1, c[1]), k0);
+        c[1] = lo1;
+        c[2] = u32x4_xor(u32x4_xor(hi0, c[3]), k1);
+        c[3] = lo0;
+        k0 = u32x4_add(k0, w0);
+        k1 = u32x4_add(k1, w1);
+    }
+}
+
+void philox4x32_blocks(Philox_Key key, const Philox_Counter *counters,
+                       Philox_Block *blocks, int count)
+{
+    static_assert(sizeof(Philox_Counter) == 16 && sizeof(Philox_Block) == 16);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        U32x4 c[4];
+        u32x4_load_transposed(counters[i].c, c);
+        philox4x32_x4(key, c);
+        u32x4_store_transposed(blocks[i].v, c);
+    }
+    for (; i < count; i += 1)
+    {
+        blocks[i] = philox4x32(key, counters[i]);
+    }
+}
+
+#else
+
+void philox4x32_blocks(Philox_Key key, const Philox_Counter *counters,
+                       Philox_Block *blocks, int count)
+{
+    for (int i = 0; i < count; i += 1)
+    {
+        blocks[i] = philox4x32(key, counters[i]);
+    }
+}
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Counter based random numbers, Philox4x32-10 from "Parallel Random
+// Numbers: As Easy as 1, 2, 3" (Salmon et al.). Where rnd_gamerand_t has to
+// be advanced in order, every block of four numbers here is a function of
+// just a key and a counter. An entity that draws from its own counters, e.g.
+// its index, how often it spawned and a block number, gets the same numbers
+// whichever order, thread or SIMD lane it is spawned in.
+
+struct Philox_Key
+{
+    uint32_t k[2];
+};
+
+struct Philox_Counter
+{
+    uint32_t c[4];
+};
+
+struct Philox_Block
+{
+    uint32_t v[4];
+};
+
+// One key per seed and stream, so unrelated users of the same counters
+// don't see the same numbers.
+Philox_Key philox_key(uint32_t seed, uint32_t stream);
+Philox_Block philox4x32(Philox_Key key, Philox_Counter counter);
+// blocks[i] = philox4x32(key, counters[i]), 4 at a time with SSE2 or NEON.
+void philox4x32_blocks(Philox_Key key, const Philox_Counter *counters,
+                       Philox_Block *blocks, int count);
+
+// [0, 1), mapped the same way as rnd_gamerand_nextf().
+inline float philox_float(uint32_t value)
+{
+    uint32_t bits = (127u << 23) | (value >> 9);
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f - 1.0f;
+}
+
+inline float philox_float(uint32_t value, float min, float max)
+{
+    return min + philox_float(value) * (max - min);
+}
+
+// [min, max], like rnd_gamerand_range().
+inline int philox_range(uint32_t value, int min, int max)
+{
+    int range = max - min + 1;
+    if (range <= 0)
+    {
+        return min;
+    }
+    return min + static_cast<int>(philox_float(value) *
+                                  static_cast<float>(range));
+}
@@ -0,0 +1,249 @@
+#include "power.h"
+#include "sokol_time.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Seconds from one frame start to the next in each state, 0 for as fast
+// as the swap interval allows.
+static constexpr double power_frame_secs[POWER_STATE_COUNT] = {
+    0.0,
+    1.0 / 15.0,
+    1.0 / 30.0,
+    1.0 / 5.0,
+};
+// sapp_frame_duration() averages up to 256 frames, and only starts over
+// after 20 outliers in a row. This many frames after a throttled one it no
+// longer remembers any.
+static constexpr int power_raw_frames_count = 300;
+// How often the CPU load on the overlay is updated.
+static constexpr double power_load_secs = 1.0;
+
+static const char *power_state_names[POWER_STATE_COUNT] = {
+    "active",
+    "idle",
+    "unfocused",
+    "hidden",
+};
+
+// CPU time of every thread in the process, user and kernel.
+static double power_cpu_secs()
+{
+#if defined(_WIN32)
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time,
+                    &kernel_time, &user_time);
+    auto secs = [](FILETIME t)
+    {
+        uint64_t ticks = (static_cast<uint64_t>(t.dwHighDateTime) << 32) |
+                         t.dwLowDateTime;
+        return static_cast<double>(ticks) * 1e-7;
+    };
+    return secs(kernel_time) + secs(user_time);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    auto secs = [](timeval t)
+    { return static_cast<double>(t.tv_sec) + t.tv_usec * 1e-6; };
+    return secs(usage.ru_utime) + secs(usage.ru_stime);
+#endif
+}
+
+bool power_parse(const char *name, Power_Mode &mode)
+{
+    static const char *names[] = {"off", "auto", "idle", "unfocused",
+                                  "hidden"};
+    for (int i = 0; i < static_cast<int>(sizeof(names) / sizeof(names[0]));
+         i += 1)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            mode = static_cast<Power_Mode>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *power_state_name(Power_State state)
+{
+    return power_state_names[state];
+}
+
+void power_init(Power &p, Power_Mode mode)
+{
+    p = {};
+    p.mode = mode;
+    p.last_activity_secs = stm_sec(stm_now());
+    p.last_cpu_secs = power_cpu_secs();
+    p.last_wall_secs = p.last_activity_secs;
+    p.load_start_cpu_secs = p.last_cpu_secs;
+    p.load_start_wall_secs = p.last_wall_secs;
+}
+
+void power_shutdown(Power &p)
+{
+    for (int i = 0; i < POWER_STATE_COUNT; i += 1)
+    {
+        if (p.frames_counts[i] == 0)
+        {
+            continue;
+        }
+        printf("power: %-9s %8.1fs %7llu frames, %6.1fms CPU per second\n",
+               power_state_names[i], p.wall_secs_sum[i],
+               static_cast<unsigned long long>(p.frames_counts[i]),
+               p.cpu_secs_sum[i] / p.wall_secs_sum[i] * 1000.0);
+    }
+    if (p.skipped_secs > 0.0)
+    {
+        printf("power: skipped %.1fs the game couldn't catch up on\n",
+               p.skipped_secs);
+    }
+}
+
+void power_handle_event(Power &p, const sapp_event *ev)
+{
+    switch (ev->type)
+    {
+    case SAPP_EVENTTYPE_ICONIFIED:
+        p.iconified = true;
+        break;
+    case SAPP_EVENTTYPE_RESTORED:
+        p.iconified = false;
+        power_activity(p);
+        break;
+    case SAPP_EVENTTYPE_UNFOCUSED:
+        p.unfocused = true;
+        break;
+    case SAPP_EVENTTYPE_FOCUSED:
+        p.unfocused = false;
+        power_activity(p);
+        break;
+    case SAPP_EVENTTYPE_SUSPENDED:
+        p.suspended = true;
+        break;
+    case SAPP_EVENTTYPE_RESUMED:
+        p.suspended = false;
+        power_activity(p);
+        break;
+    case SAPP_EVENTTYPE_KEY_DOWN:
+    case SAPP_EVENTTYPE_KEY_UP:
+    case SAPP_EVENTTYPE_MOUSE_DOWN:
+    case SAPP_EVENTTYPE_MOUSE_UP:
+    case SAPP_EVENTTYPE_MOUSE_MOVE:
+    case SAPP_EVENTTYPE_MOUSE_SCROLL:
+    case SAPP_EVENTTYPE_TOUCHES_BEGAN:
+    case SAPP_EVENTTYPE_TOUCHES_MOVED:
+        power_activity(p);
+        break;
+    default:
+        break;
+    }
+}
+
+void power_activity(Power &p)
+{
+    p.last_activity_secs = stm_sec(stm_now());
+}
+
+static Power_State power_next_state(const Power &p, double now_secs)
+{
+    switch (p.mode)
+    {
+    case POWER_MODE_OFF:
+        return POWER_STATE_ACTIVE;
+    case POWER_MODE_IDLE:
+        return POWER_STATE_IDLE;
+    case POWER_MODE_UNFOCUSED:
+        return POWER_STATE_UNFOCUSED;
+    case POWER_MODE_HIDDEN:
+        return POWER_STATE_HIDDEN;
+    case POWER_MODE_AUTO:
+        break;
+    }
+    if (p.iconified || p.suspended)
+    {
+        return POWER_STATE_HIDDEN;
+    }
+    if (p.unfocused)
+    {
+        return POWER_STATE_UNFOCUSED;
+    }
+    if (now_secs - p.last_activity_secs > power_idle_secs)
+    {
+        return POWER_STATE_IDLE;
+    }
+    return POWER_STATE_ACTIVE;
+}
+
+bool power_frame_begin(Power &p)
+{
+    double now_secs = stm_sec(stm_now());
+    Power_State state = power_next_state(p, now_secs);
+    if (state != p.state)
+    {
+        printf("power: %s\n", power_state_names[state]);
+        p.state = state;
+    }
+    if (power_throttled(p))
+    {
+        p.raw_frames_count = power_raw_frames_count;
+        double wake_secs = p.frame_start_secs + power_frame_secs[state];
+        if (wake_secs > now_secs)
+        {
+            // No spinning to wake up on time, that would burn what the
+            // sleep saves.
+            std::this_thread::sleep_for(
+                std::chrono::duration<double>(wake_secs - now_secs));
+            now_secs = stm_sec(stm_now());
+        }
+    }
+    else if (p.raw_frames_count > 0)
+    {
+        p.raw_frames_count -= 1;
+    }
+    p.frame_start_secs = now_secs;
+
+    // The frame that just ended, and the sleep before this one, go to the
+    // state the sleep was for.
+    double cpu_secs = power_cpu_secs();
+    p.cpu_secs_sum[state] += cpu_secs - p.last_cpu_secs;
+    p.wall_secs_sum[state] += now_secs - p.last_wall_secs;
+    p.frames_counts[state] += 1;
+    p.last_cpu_secs = cpu_secs;
+    p.last_wall_secs = now_secs;
+    if (now_secs - p.load_start_wall_secs >= power_load_secs)
+    {
+        p.cpu_load = (cpu_secs - p.load_start_cpu_secs) /
+                     (now_secs - p.load_start_wall_secs);
+        p.load_start_cpu_secs = cpu_secs;
+        p.load_start_wall_secs = now_secs;
+    }
+    return state != POWER_STATE_HIDDEN;
+}
+
+double power_frame_time(Power &p, double smoothed_secs, double raw_secs)
+{
+    double secs = power_throttled(p) || p.raw_frames_count > 0
+                      ? raw_secs
+                      : smoothed_secs;
+    if (secs > power_catch_up_max_secs)
+    {
+        p.skipped_secs += secs - power_catch_up_max_secs;
+        secs = power_catch_up_max_secs;
+    }
+    return secs;
+}
+
+bool power_throttled(const Power &p)
+{
+    return p.state != POWER_STATE_ACTIVE;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "sokol_app.h"
+#include <cstdint>
+
+// Seconds without any input before the game counts as idle.
+inline constexpr double power_idle_secs = 60.0;
+// Most of a gap between frames the fixed steps catch up on, the rest of a
+// longer one, a suspend or a stall, is skipped. Above the longest throttled
+// frame, so throttling alone never loses time.
+inline constexpr double power_catch_up_max_secs = 0.25;
+
+enum Power_State
+{
+    // Every frame, at the swap interval.
+    POWER_STATE_ACTIVE,
+    // Nobody has touched the game for power_idle_secs, it keeps running and
+    // drawing at a low frame rate.
+    POWER_STATE_IDLE,
+    // Another window has the focus, the game is likely still in view.
+    POWER_STATE_UNFOCUSED,
+    // Iconified or suspended. The game keeps running at a very low frame
+    // rate and nothing is drawn.
+    POWER_STATE_HIDDEN,
+    POWER_STATE_COUNT,
+};
+
+enum Power_Mode
+{
+    POWER_MODE_OFF,
+    // The state follows the window and the input.
+    POWER_MODE_AUTO,
+    // The state is pinned, to measure what it saves.
+    POWER_MODE_IDLE,
+    POWER_MODE_UNFOCUSED,
+    POWER_MODE_HIDDEN,
+};
+
+struct Power
+{
+    Power_Mode mode;
+    Power_State state;
+    bool iconified;
+    bool unfocused;
+    bool suspended;
+    // Seconds since stm_setup().
+    double last_activity_secs;
+    double frame_start_secs;
+    // Frames left that use the raw frame time after a throttled one, see
+    // power_frame_time().
+    int raw_frames_count;
+
+    // CPU time is what the energy use is measured by, it is what the
+    // throttling saves and it can be read on a headless machine.
+    double cpu_secs_sum[POWER_STATE_COUNT];
+    double wall_secs_sum[POWER_STATE_COUNT];
+    uint64_t frames_counts[POWER_STATE_COUNT];
+    double last_cpu_secs;
+    double last_wall_secs;
+    // CPU seconds per second over the last second.
+    double cpu_load;
+    double load_start_cpu_secs;
+    double load_start_wall_secs;
+    // Time a gap between frames had over power_catch_up_max_secs.
+    double skipped_secs;
+};
+
+// "off", "auto", "idle", "unfocused" or "hidden".
+bool power_parse(const char *name, Power_Mode &mode);
+const char *power_state_name(Power_State state);
+void power_init(Power &p, Power_Mode mode);
+// Prints the CPU time spent per second in each state.
+void power_shutdown(Power &p);
+// Follows the window being iconified, suspended or losing the focus, and
+// counts input events as activity.
+void power_handle_event(Power &p, const sapp_event *ev);
+// Input from outside the window's events, like evdev's.
+void power_activity(Power &p);
+// Call first thing in a frame. Sleeps out the rest of a throttled frame and
+// returns whether the frame should be drawn.
+bool power_frame_begin(Power &p);
+// The frame time the fixed steps should catch up on. sapp_frame_duration()
+// is averaged over many frames and drops the long ones as outliers, so it
+// is wrong for throttled frames and for a while after them. Those use the
+// raw frame time instead. Either is capped at power_catch_up_max_secs.
+double power_frame_time(Power &p, double smoothed_secs, double raw_secs);
+// Whether frames are being slowed down, frame pacing is off meanwhile.
+bool power_throttled(const Power &p);
@@ -1,13 +1,117 @@
 #include "renderer.h"
+#include "fast_math.h"
+#include "frame_graph.h"
+#include "blit.glsl.h"
 #include "bloom.glsl.h"
 #include "combine_display.glsl.h"
+#include "fxaa.glsl.h"
 #include "game_basic.glsl.h"
-#include "game_phong.glsl.h"
+#include "game_phong_l0_s0.glsl.h"
+#include "game_phong_l0_s1.glsl.h"
+#include "game_phong_l1_s0.glsl.h"
+#include "game_phong_l1_s1.glsl.h"
+#include "philox.h"
+#include "sdf_font.h"
+#include "sokol_time.h"
+#include "stars.glsl.h"
+#include "text.glsl.h"
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <iterator>
 
-static constexpr int msaa_sample_count = 4;
+// sokol_gfx doesn't report how many MSAA samples the device supports, GL can
+// be asked directly.
+#if defined(__linux__) && !defined(__ANDROID__)
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#define RENDERER_GL
+#endif
+
+static constexpr Render_Quality
+    render_quality_tiers[RENDER_QUALITY_TIER_COUNT] = {
+        {1, true, SG_PIXELFORMAT_RG11B10F, false}, // RENDER_QUALITY_TIER_LOW
+        {2, false, SG_PIXELFORMAT_RG11B10F, true}, // RENDER_QUALITY_TIER_MEDIUM
+        {4, false, SG_PIXELFORMAT_RGBA16F, true},  // RENDER_QUALITY_TIER_HIGH
+        {8, false, SG_PIXELFORMAT_RGBA16F, true},  // RENDER_QUALITY_TIER_ULTRA
+};
+// Indexed by renderer_phong_permutation(). All permutations share the
+// uniform block layouts of game_phong_l1_s1, which has every block.
+static const sg_shader_desc *(
+    *const phong_shader_descs[phong_permutations_count])(sg_backend) = {
+    game_phong_l0_s0_program_shader_desc,
+    game_phong_l0_s1_program_shader_desc,
+    game_phong_l1_s0_program_shader_desc,
+    game_phong_l1_s1_program_shader_desc,
+};
+// Pipeline cache key for the basic shader, after the phong permutations.
+static constexpr uint32_t basic_pipeline_shader_id = phong_permutations_count;
+static constexpr uint32_t text_pipeline_shader_id =
+    phong_permutations_count + 1;
+static constexpr uint32_t stars_pipeline_shader_id =
+    phong_permutations_count + 2;
+static constexpr const char
+    *render_quality_tier_names[RENDER_QUALITY_TIER_COUNT] = {
+        "LOW",
+        "MEDIUM",
+        "HIGH",
+        "ULTRA",
+};
 static constexpr float bloom_filter_radius = 0.003f;
+static constexpr float bloom_threshold = 1.0f;
+static constexpr float bloom_knee = 0.5f;
+static constexpr float render_scale_min = 0.5f;
+static constexpr float render_scale_max = 1.0f;
+static constexpr float render_scale_step = 0.125f;
+static constexpr double render_scale_default_budget_secs = 1.0 / 60.0;
+static constexpr double render_scale_over_budget = 1.1;
+static constexpr double render_scale_frame_time_smoothing = 0.1;
+// Frames this long are hitches (window drags, alt-tab), not GPU load.
+static constexpr double render_scale_ignored_frame_secs = 0.25;
+static constexpr int render_scale_down_frames = 10;
+static constexpr int render_scale_probe_frames_min = 240;
+static constexpr int render_scale_probe_frames_max = 240 * 16;
+// A resize counts as finished once no other resize came in for this long.
+static constexpr double resize_settle_secs = 0.25;
+// Headroom added to the render targets while a resize is still going on.
+static constexpr float resize_growth = 1.25f;
+static constexpr int resize_alignment = 64;
+// Starting sizes of the per-frame arrays and the stream buffers they are
+// uploaded to. Both grow to whatever the largest frame needs.
+static constexpr int draw_calls_initial_count = 16;
+static constexpr int basic_instances_initial_count = 1024;
+static constexpr int text_glyph_instances_initial_count = 1024;
+// Star seeds are generated this many Philox blocks, 4 seeds each, at a time.
+static constexpr int star_seeds_batch_blocks_count = 256;
+
+// Wrappers that add the time spent creating shaders and pipelines to
+// r.create_stats, which is reported at startup, and keep their counts within
+// the pools sg_setup() was given.
+static sg_shader renderer_make_shader(Renderer &r, const sg_shader_desc *desc)
+{
+    assert(r.create_stats.shaders_count < renderer_shaders_max_count);
+    uint64_t start = stm_now();
+    sg_shader shader = sg_make_shader(desc);
+    r.create_stats.shaders_count += 1;
+    r.create_stats.shaders_secs += stm_sec(stm_since(start));
+    return shader;
+}
+
+static sg_pipeline renderer_make_pipeline(Renderer &r,
+                                          const sg_pipeline_desc &desc)
+{
+    assert(r.create_stats.pipelines_count < renderer_pipelines_max_count);
+    uint64_t start = stm_now();
+    sg_pipeline pip = sg_make_pipeline(desc);
+    r.create_stats.pipelines_count += 1;
+    r.create_stats.pipelines_secs += stm_sec(stm_since(start));
+    return pip;
+}
 
 static void renderer_init_quad_geometry(Renderer &r)
 {
@@ -70,91 +174,275 @@ static void renderer_init_box_geometry(Renderer &r)
     r.box.elements_count = std::size(indices);
 }
 
+static void renderer_init_text_geometry(Renderer &r)
+{
+    {
+        sg_image_desc desc = {};
+        desc.width = sdf_font_atlas_width;
+        desc.height = sdf_font_atlas_height;
+        desc.pixel_format = SG_PIXELFORMAT_R8;
+        desc.data.subimage[0][0] = SG_RANGE(sdf_font_atlas);
+        r.text.atlas = sg_make_image(desc);
+    }
+    {
+        sg_buffer_desc desc = {};
+        desc.usage = SG_USAGE_STREAM;
+        desc.size =
+            sizeof(Text_Glyph_Instance) * text_glyph_instances_initial_count;
+        r.text.instances_buffer = sg_make_buffer(desc);
+        r.text.instances_buffer_size = desc.size;
+    }
+}
+
 static void renderer_init_game_pass(Renderer &r)
 {
     r.game_pass.pass_action.colors[0].load_action = SG_LOADACTION_CLEAR;
     r.game_pass.pass_action.colors[0].store_action = SG_STOREACTION_DONTCARE;
     r.game_pass.pass_action.colors[0].clear_value = {0.0f, 0.0f, 0.0f, 1.0f};
-    r.game_pass.pass_action.colors[1].load_action = SG_LOADACTION_CLEAR;
-    r.game_pass.pass_action.colors[1].store_action = SG_STOREACTION_DONTCARE;
-    r.game_pass.pass_action.colors[1].clear_value = {0.0f, 0.0f, 0.0f, 1.0f};
     {
-        sg_pipeline_desc desc = {};
-        desc.layout.attrs[ATTR_game_phong_program_a_obj_position] = {
-            0, 0, SG_VERTEXFORMAT_FLOAT3};
-        desc.layout.attrs[ATTR_game_phong_program_a_obj_normal] = {
-            0, sizeof(float) * 3, SG_VERTEXFORMAT_FLOAT3};
-        desc.shader =
-            sg_make_shader(game_phong_program_shader_desc(sg_query_backend()));
-        desc.index_type = SG_INDEXTYPE_UINT16;
-        desc.cull_mode = SG_CULLMODE_BACK,
-        desc.sample_count = msaa_sample_count, desc.depth.write_enabled = true;
-        desc.depth.pixel_format = SG_PIXELFORMAT_DEPTH;
-        desc.depth.compare = SG_COMPAREFUNC_LESS_EQUAL;
-        desc.colors[0].pixel_format = SG_PIXELFORMAT_RGBA16F;
-        desc.colors[1].pixel_format = SG_PIXELFORMAT_RGBA16F;
-        desc.color_count = 2;
-        r.game_pass.phong_pip = sg_make_pipeline(desc);
+        sg_buffer_desc desc = {};
+        desc.usage = SG_USAGE_STREAM;
+        desc.size = sizeof(Basic_Box_Instance) * basic_instances_initial_count;
+        r.game_pass.basic_instances_buffer = sg_make_buffer(desc);
+        r.game_pass.basic_instances_buffer_size = desc.size;
     }
+}
+
+// Point light on/off in bit 1, specular on/off in bit 0, matching the
+// game_phong_l<lights>_s<specular> modules.
+static int renderer_phong_permutation(const Renderer &r)
+{
+    int lights = r.game_pass.point_lights[0].enabled ? 1 : 0;
+    int specular = r.quality.specular ? 1 : 0;
+    return lights * 2 + specular;
+}
+
+static sg_pipeline renderer_make_phong_pipeline(Renderer &r, int permutation)
+{
+    auto &shader = r.game_pass.phong_shaders[permutation];
+    if (shader.id == SG_INVALID_ID)
     {
-        sg_pipeline_desc desc = {};
-        desc.layout.buffers[0].stride = sizeof(float) * 6;
-        desc.layout.buffers[1].stride = sizeof(Basic_Box_Instance);
-        desc.layout.buffers[1].step_func = SG_VERTEXSTEP_PER_INSTANCE;
-        desc.layout.attrs[ATTR_game_basic_program_a_obj_position] = {
-            0, 0, SG_VERTEXFORMAT_FLOAT3};
-        desc.layout.attrs[ATTR_game_basic_program_inst_obj_to_world_transform] =
-            {1, 0, SG_VERTEXFORMAT_FLOAT4};
-        desc.layout.attrs[ATTR_game_basic_program_inst_obj_to_world_transform +
-                          1] = {1, sizeof(float) * 4, SG_VERTEXFORMAT_FLOAT4};
-        desc.layout
-            .attrs[ATTR_game_basic_program_inst_obj_to_world_transform + 2] = {
-            1, sizeof(float) * 4 * 2, SG_VERTEXFORMAT_FLOAT4};
-        desc.layout
-            .attrs[ATTR_game_basic_program_inst_obj_to_world_transform + 3] = {
-            1, sizeof(float) * 4 * 3, SG_VERTEXFORMAT_FLOAT4};
-        desc.layout.attrs[ATTR_game_basic_program_inst_color] = {
-            1, sizeof(float) * 4 * 4, SG_VERTEXFORMAT_FLOAT3};
-        desc.shader =
-            sg_make_shader(game_basic_program_shader_desc(sg_query_backend()));
-        desc.index_type = SG_INDEXTYPE_UINT16;
-        desc.cull_mode = SG_CULLMODE_BACK;
-        desc.sample_count = msaa_sample_count;
-        desc.depth.write_enabled = true;
-        desc.depth.pixel_format = SG_PIXELFORMAT_DEPTH;
-        desc.depth.compare = SG_COMPAREFUNC_LESS_EQUAL;
-        desc.colors[0].pixel_format = SG_PIXELFORMAT_RGBA16F;
-        desc.colors[1].pixel_format = SG_PIXELFORMAT_RGBA16F;
-        desc.color_count = 2;
-        r.game_pass.basic_pip = sg_make_pipeline(desc);
+        shader = renderer_make_shader(
+            r, phong_shader_descs[permutation](sg_query_backend()));
     }
+
+    sg_pipeline_desc desc = {};
+    desc.layout.attrs[ATTR_game_phong_l1_s1_program_a_obj_position] = {
+        0, 0, SG_VERTEXFORMAT_FLOAT3};
+    desc.layout.attrs[ATTR_game_phong_l1_s1_program_a_obj_normal] = {
+        0, sizeof(float) * 3, SG_VERTEXFORMAT_FLOAT3};
+    desc.shader = shader;
+    desc.index_type = SG_INDEXTYPE_UINT16;
+    desc.cull_mode = SG_CULLMODE_BACK,
+    desc.sample_count = r.quality.msaa_sample_count;
+    desc.depth.write_enabled = true;
+    desc.depth.pixel_format = SG_PIXELFORMAT_DEPTH;
+    desc.depth.compare = SG_COMPAREFUNC_LESS_EQUAL;
+    desc.colors[0].pixel_format = r.quality.hdr_format;
+    return renderer_make_pipeline(r, desc);
+}
+
+static sg_pipeline renderer_make_basic_pipeline(Renderer &r)
+{
+    if (r.game_pass.basic_shader.id == SG_INVALID_ID)
     {
-        sg_buffer_desc desc = {};
-        desc.usage = SG_USAGE_STREAM;
-        desc.size = sizeof(Basic_Box_Instance) * basic_box_instances_max_count;
-        r.game_pass.basic_instances_buffer = sg_make_buffer(desc);
+        r.game_pass.basic_shader = renderer_make_shader(
+            r, game_basic_program_shader_desc(sg_query_backend()));
+    }
+
+    sg_pipeline_desc desc = {};
+    desc.layout.buffers[0].stride = sizeof(float) * 6;
+    desc.layout.buffers[1].stride = sizeof(Basic_Box_Instance);
+    desc.layout.buffers[1].step_func = SG_VERTEXSTEP_PER_INSTANCE;
+    desc.layout.attrs[ATTR_game_basic_program_a_obj_position] = {
+        0, 0, SG_VERTEXFORMAT_FLOAT3};
+    desc.layout.attrs[ATTR_game_basic_program_inst_obj_to_world_transform] = {
+        1, 0, SG_VERTEXFORMAT_FLOAT4};
+    desc.layout.attrs[ATTR_game_basic_program_inst_obj_to_world_transform +
+                      1] = {1, sizeof(float) * 4, SG_VERTEXFORMAT_FLOAT4};
+    desc.layout.attrs[ATTR_game_basic_program_inst_obj_to_world_transform +
+                      2] = {1, sizeof(float) * 4 * 2, SG_VERTEXFORMAT_FLOAT4};
+    desc.layout.attrs[ATTR_game_basic_program_inst_obj_to_world_transform +
+                      3] = {1, sizeof(float) * 4 * 3, SG_VERTEXFORMAT_FLOAT4};
+    desc.layout.attrs[ATTR_game_basic_program_inst_color] = {
+        1, sizeof(float) * 4 * 4, SG_VERTEXFORMAT_FLOAT3};
+    desc.shader = r.game_pass.basic_shader;
+    desc.index_type = SG_INDEXTYPE_UINT16;
+    desc.cull_mode = SG_CULLMODE_BACK;
+    desc.sample_count = r.quality.msaa_sample_count;
+    desc.depth.write_enabled = true;
+    desc.depth.pixel_format = SG_PIXELFORMAT_DEPTH;
+    desc.depth.compare = SG_COMPAREFUNC_LESS_EQUAL;
+    desc.colors[0].pixel_format = r.quality.hdr_format;
+    return renderer_make_pipeline(r, desc);
+}
+
+static sg_pipeline renderer_make_text_pipeline(Renderer &r)
+{
+    if (r.text.shader.id == SG_INVALID_ID)
+    {
+        r.text.shader = renderer_make_shader(
+            r, text_program_shader_desc(sg_query_backend()));
+    }
+
+    sg_pipeline_desc desc = {};
+    desc.layout.buffers[0].stride = sizeof(float) * 4;
+    desc.layout.buffers[1].stride = sizeof(Text_Glyph_Instance);
+    desc.layout.buffers[1].step_func = SG_VERTEXSTEP_PER_INSTANCE;
+    desc.layout.attrs[ATTR_text_program_a_obj_uv] = {
+        0, sizeof(float) * 2, SG_VERTEXFORMAT_FLOAT2};
+    desc.layout.attrs[ATTR_text_program_inst_origin] = {
+        1, offsetof(Text_Glyph_Instance, origin), SG_VERTEXFORMAT_FLOAT3};
+    desc.layout.attrs[ATTR_text_program_inst_x_axis] = {
+        1, offsetof(Text_Glyph_Instance, x_axis), SG_VERTEXFORMAT_FLOAT3};
+    desc.layout.attrs[ATTR_text_program_inst_y_axis] = {
+        1, offsetof(Text_Glyph_Instance, y_axis), SG_VERTEXFORMAT_FLOAT3};
+    desc.layout.attrs[ATTR_text_program_inst_uv_rect] = {
+        1, offsetof(Text_Glyph_Instance, uv_rect), SG_VERTEXFORMAT_USHORT4N};
+    desc.layout.attrs[ATTR_text_program_inst_color] = {
+        1, offsetof(Text_Glyph_Instance, color), SG_VERTEXFORMAT_FLOAT3};
+    desc.shader = r.text.shader;
+    desc.index_type = SG_INDEXTYPE_UINT16;
+    desc.sample_count = r.quality.msaa_sample_count;
+    desc.depth.pixel_format = SG_PIXELFORMAT_DEPTH;
+    desc.depth.compare = SG_COMPAREFUNC_LESS_EQUAL;
+    desc.colors[0].pixel_format = r.quality.hdr_format;
+    desc.colors[0].blend.enabled = true;
+    desc.colors[0].blend.src_factor_rgb = SG_BLENDFACTOR_SRC_ALPHA;
+    desc.colors[0].blend.dst_factor_rgb = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA;
+    return renderer_make_pipeline(r, desc);
+}
+
+static sg_pipeline renderer_make_stars_pipeline(Renderer &r)
+{
+    if (r.star_field.shader.id == SG_INVALID_ID)
+    {
+        r.star_field.shader = renderer_make_shader(
+            r, stars_program_shader_desc(sg_query_backend()));
+    }
+
+    // UBYTE4N rather than an integer format, which not every backend has.
+    // The shader puts the bytes back together.
+    sg_pipeline_desc desc = {};
+    desc.layout.buffers[0].stride = sizeof(float) * 6;
+    desc.layout.buffers[1].stride = sizeof(uint32_t);
+    desc.layout.buffers[1].step_func = SG_VERTEXSTEP_PER_INSTANCE;
+    desc.layout.attrs[ATTR_stars_program_a_obj_position] = {
+        0, 0, SG_VERTEXFORMAT_FLOAT3};
+    desc.layout.attrs[ATTR_stars_program_inst_seed] = {
+        1, 0, SG_VERTEXFORMAT_UBYTE4N};
+    desc.shader = r.star_field.shader;
+    desc.index_type = SG_INDEXTYPE_UINT16;
+    desc.cull_mode = SG_CULLMODE_BACK;
+    desc.sample_count = r.quality.msaa_sample_count;
+    desc.depth.write_enabled = true;
+    desc.depth.pixel_format = SG_PIXELFORMAT_DEPTH;
+    desc.depth.compare = SG_COMPAREFUNC_LESS_EQUAL;
+    desc.colors[0].pixel_format = r.quality.hdr_format;
+    return renderer_make_pipeline(r, desc);
+}
+
+// The game pass pipelines bake in the MSAA sample count and HDR format on
+// top of the shader, so all three make up the key.
+static sg_pipeline renderer_game_pass_pipeline(Renderer &r, uint32_t shader_id)
+{
+    uint32_t key = (shader_id << 16) |
+                   (static_cast<uint32_t>(r.quality.msaa_sample_count) << 8) |
+                   static_cast<uint32_t>(r.quality.hdr_format);
+
+    auto &cache = r.game_pass.pipelines;
+    for (int i = 0; i < cache.count; i += 1)
+    {
+        if (cache.entries[i].key == key)
+        {
+            return cache.entries[i].pip;
+        }
     }
+
+    assert(cache.count < pipeline_cache_max_count);
+    auto &entry = cache.entries[cache.count];
+    entry.key = key;
+    if (shader_id == basic_pipeline_shader_id)
+    {
+        entry.pip = renderer_make_basic_pipeline(r);
+    }
+    else if (shader_id == text_pipeline_shader_id)
+    {
+        entry.pip = renderer_make_text_pipeline(r);
+    }
+    else if (shader_id == stars_pipeline_shader_id)
+    {
+        entry.pip = renderer_make_stars_pipeline(r);
+    }
+    else
+    {
+        entry.pip = renderer_make_phong_pipeline(r, shader_id);
+    }
+    cache.count += 1;
+    return entry.pip;
 }
 
 static void renderer_init_bloom_pass(Renderer &r)
 {
+    // Metal allows sampling one mip of an image while rendering into
+    // another. GL counts it as a feedback loop whenever the sampler could
+    // reach the rendered mip, which a LOD clamp doesn't change, and D3D11
+    // unbinds the whole image as soon as one of its mips becomes a render
+    // target, so there every mip stays a separate image.
+    sg_backend backend = sg_query_backend();
+    r.bloom_pass.mip_chain = backend == SG_BACKEND_METAL_MACOS ||
+                             backend == SG_BACKEND_METAL_IOS ||
+                             backend == SG_BACKEND_METAL_SIMULATOR;
+    {
+        sg_sampler_desc desc = {};
+        desc.min_filter = SG_FILTER_LINEAR;
+        desc.mag_filter = SG_FILTER_LINEAR;
+        desc.mipmap_filter = SG_FILTER_NEAREST;
+        desc.wrap_u = SG_WRAP_CLAMP_TO_EDGE;
+        desc.wrap_v = SG_WRAP_CLAMP_TO_EDGE;
+        for (int i = 0; i < bloom_mips_count; i += 1)
+        {
+            // Each pass sees only the mip it samples. The half level of
+            // slack keeps max_lod off 0, which sokol takes as unset.
+            if (r.bloom_pass.mip_chain)
+            {
+                desc.min_lod = static_cast<float>(i);
+                desc.max_lod = static_cast<float>(i) + 0.5f;
+            }
+            r.bloom_pass.mips[i].smp = sg_make_sampler(desc);
+        }
+    }
     r.bloom_pass.down_sample_pass_action.colors[0].load_action =
         SG_LOADACTION_DONTCARE;
     r.bloom_pass.up_sample_pass_action.colors[0].load_action =
         SG_LOADACTION_DONTCARE;
+    {
+        sg_pipeline_desc desc = {};
+        desc.layout.attrs[ATTR_bloom_program_prefilter_a_obj_position].format =
+            SG_VERTEXFORMAT_FLOAT2;
+        desc.layout.attrs[ATTR_bloom_program_prefilter_a_obj_uv].format =
+            SG_VERTEXFORMAT_FLOAT2;
+        desc.shader = renderer_make_shader(
+            r, bloom_program_prefilter_shader_desc(sg_query_backend()));
+        desc.index_type = SG_INDEXTYPE_UINT16;
+        desc.cull_mode = SG_CULLMODE_BACK;
+        desc.colors[0].pixel_format = SG_PIXELFORMAT_RG11B10F;
+        desc.depth.pixel_format = SG_PIXELFORMAT_NONE;
+        r.bloom_pass.prefilter_pip = renderer_make_pipeline(r, desc);
+    }
     {
         sg_pipeline_desc desc = {};
         desc.layout.attrs[ATTR_bloom_program_down_sample_a_obj_position]
             .format = SG_VERTEXFORMAT_FLOAT2;
         desc.layout.attrs[ATTR_bloom_program_down_sample_a_obj_uv].format =
             SG_VERTEXFORMAT_FLOAT2;
-        desc.shader = sg_make_shader(
-            bloom_program_down_sample_shader_desc(sg_query_backend()));
+        desc.shader = renderer_make_shader(
+            r, bloom_program_down_sample_shader_desc(sg_query_backend()));
         desc.index_type = SG_INDEXTYPE_UINT16;
         desc.cull_mode = SG_CULLMODE_BACK;
         desc.colors[0].pixel_format = SG_PIXELFORMAT_RG11B10F;
         desc.depth.pixel_format = SG_PIXELFORMAT_NONE;
-        r.bloom_pass.down_sample_pip = sg_make_pipeline(desc);
+        r.bloom_pass.down_sample_pip = renderer_make_pipeline(r, desc);
     }
     {
         sg_pipeline_desc desc = {};
@@ -162,8 +450,8 @@ static void renderer_init_bloom_pass(Renderer &r)
             SG_VERTEXFORMAT_FLOAT2;
         desc.layout.attrs[ATTR_bloom_program_up_sample_a_obj_uv].format =
             SG_VERTEXFORMAT_FLOAT2;
-        desc.shader = sg_make_shader(
-            bloom_program_up_sample_shader_desc(sg_query_backend()));
+        desc.shader = renderer_make_shader(
+            r, bloom_program_up_sample_shader_desc(sg_query_backend()));
         desc.index_type = SG_INDEXTYPE_UINT16;
         desc.cull_mode = SG_CULLMODE_BACK;
         desc.colors[0].pixel_format = SG_PIXELFORMAT_RG11B10F;
@@ -175,7 +463,7 @@ static void renderer_init_bloom_pass(Renderer &r)
         desc.colors[0].blend.dst_factor_alpha = SG_BLENDFACTOR_ONE;
         desc.colors[0].blend.op_alpha = SG_BLENDOP_ADD;
         desc.depth.pixel_format = SG_PIXELFORMAT_NONE;
-        r.bloom_pass.up_sample_pip = sg_make_pipeline(desc);
+        r.bloom_pass.up_sample_pip = renderer_make_pipeline(r, desc);
     }
 }
 
@@ -183,24 +471,157 @@ static void renderer_init_combine_display_pass(Renderer &r)
 {
     r.combine_display_pass.pass_action.colors[0].load_action =
         SG_LOADACTION_DONTCARE;
+}
+
+// The post-process pipelines below are created on first use. Which of them
+// are needed depends on the quality tier and on whether the display is
+// offscreen, and most runs only ever use one or two of them.
+static sg_pipeline renderer_combine_display_pipeline(Renderer &r, bool ldr)
+{
+    auto &pass = r.combine_display_pass;
+    auto &pip = ldr ? pass.ldr_pip : pass.pip;
+    if (pip.id != SG_INVALID_ID)
     {
-        sg_pipeline_desc desc = {};
-        desc.layout.attrs[ATTR_combine_display_program_a_obj_position].format =
-            SG_VERTEXFORMAT_FLOAT2;
-        desc.layout.attrs[ATTR_combine_display_program_a_obj_uv].format =
-            SG_VERTEXFORMAT_FLOAT2;
-        desc.shader = sg_make_shader(
-            combine_display_program_shader_desc(sg_query_backend()));
-        desc.index_type = SG_INDEXTYPE_UINT16;
-        desc.cull_mode = SG_CULLMODE_BACK;
-        r.combine_display_pass.pip = sg_make_pipeline(desc);
+        return pip;
     }
+
+    if (pass.shader.id == SG_INVALID_ID)
+    {
+        pass.shader = renderer_make_shader(
+            r, combine_display_program_shader_desc(sg_query_backend()));
+    }
+    sg_pipeline_desc desc = {};
+    desc.layout.attrs[ATTR_combine_display_program_a_obj_position].format =
+        SG_VERTEXFORMAT_FLOAT2;
+    desc.layout.attrs[ATTR_combine_display_program_a_obj_uv].format =
+        SG_VERTEXFORMAT_FLOAT2;
+    desc.shader = pass.shader;
+    desc.index_type = SG_INDEXTYPE_UINT16;
+    desc.cull_mode = SG_CULLMODE_BACK;
+    if (ldr)
+    {
+        desc.colors[0].pixel_format = SG_PIXELFORMAT_RGBA8;
+        desc.depth.pixel_format = SG_PIXELFORMAT_NONE;
+        desc.sample_count = 1;
+    }
+    pip = renderer_make_pipeline(r, desc);
+    return pip;
 }
 
-void renderer_init(Renderer &r, int framebuffer_width, int framebuffer_height)
+static void renderer_init_fxaa_pass(Renderer &r)
 {
+    r.fxaa_pass.pass_action.colors[0].load_action = SG_LOADACTION_DONTCARE;
+}
+
+static sg_pipeline renderer_fxaa_pipeline(Renderer &r, bool offscreen)
+{
+    auto &pass = r.fxaa_pass;
+    auto &pip = offscreen ? pass.offscreen_pip : pass.pip;
+    if (pip.id != SG_INVALID_ID)
+    {
+        return pip;
+    }
+
+    if (pass.shader.id == SG_INVALID_ID)
+    {
+        pass.shader = renderer_make_shader(
+            r, fxaa_program_shader_desc(sg_query_backend()));
+    }
+    sg_pipeline_desc desc = {};
+    desc.layout.attrs[ATTR_fxaa_program_a_obj_position].format =
+        SG_VERTEXFORMAT_FLOAT2;
+    desc.layout.attrs[ATTR_fxaa_program_a_obj_uv].format =
+        SG_VERTEXFORMAT_FLOAT2;
+    desc.shader = pass.shader;
+    desc.index_type = SG_INDEXTYPE_UINT16;
+    desc.cull_mode = SG_CULLMODE_BACK;
+    if (offscreen)
+    {
+        desc.colors[0].pixel_format = SG_PIXELFORMAT_RGBA8;
+        desc.depth.pixel_format = SG_PIXELFORMAT_NONE;
+        desc.sample_count = 1;
+    }
+    pip = renderer_make_pipeline(r, desc);
+    return pip;
+}
+
+static void renderer_init_display_pass(Renderer &r)
+{
+    r.display_pass.pass_action.colors[0].load_action = SG_LOADACTION_DONTCARE;
+}
+
+static sg_pipeline renderer_display_pipeline(Renderer &r)
+{
+    auto &pass = r.display_pass;
+    if (pass.pip.id != SG_INVALID_ID)
+    {
+        return pass.pip;
+    }
+
+    sg_pipeline_desc desc = {};
+    desc.layout.attrs[ATTR_blit_program_a_obj_position].format =
+        SG_VERTEXFORMAT_FLOAT2;
+    desc.layout.attrs[ATTR_blit_program_a_obj_uv].format =
+        SG_VERTEXFORMAT_FLOAT2;
+    desc.shader =
+        renderer_make_shader(r, blit_program_shader_desc(sg_query_backend()));
+    desc.index_type = SG_INDEXTYPE_UINT16;
+    desc.cull_mode = SG_CULLMODE_BACK;
+    pass.pip = renderer_make_pipeline(r, desc);
+    return pass.pip;
+}
+
+// The most MSAA samples a render target may have. Where the device can't be
+// asked, 4 is what every backend guarantees, and WebGL2 often stops there.
+static int renderer_max_sample_count()
+{
+#if defined(RENDERER_GL)
+    if (sg_query_backend() == SG_BACKEND_GLCORE)
+    {
+        GLint samples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &samples);
+        return std::max(static_cast<int>(samples), 1);
+    }
+#endif
+    return 4;
+}
+
+// Falls back to what the backend can actually render to. Losing MSAA
+// altogether turns on FXAA so the edges stay smoothed.
+static Render_Quality renderer_supported_quality(Render_Quality quality)
+{
+    if (!sg_query_pixelformat(quality.hdr_format).render)
+    {
+        quality.hdr_format = SG_PIXELFORMAT_RGBA16F;
+    }
+
+    int sample_count = 1;
+    if (sg_query_pixelformat(quality.hdr_format).msaa)
+    {
+        int max_count = renderer_max_sample_count();
+        // Sample counts are powers of two.
+        while (sample_count * 2 <= std::min(quality.msaa_sample_count,
+                                            max_count))
+        {
+            sample_count *= 2;
+        }
+    }
+    if (sample_count == 1 && quality.msaa_sample_count > 1)
+    {
+        quality.fxaa = true;
+    }
+    quality.msaa_sample_count = sample_count;
+    return quality;
+}
+
+void renderer_init(Renderer &r, Frame_Arena &frame_arena, int framebuffer_width,
+                   int framebuffer_height)
+{
+    r.frame_arena = &frame_arena;
+
     renderer_init_quad_geometry(r);
     renderer_init_box_geometry(r);
+    renderer_init_text_geometry(r);
 
     {
         sg_sampler_desc desc = {};
@@ -211,115 +632,494 @@ void renderer_init(Renderer &r, int framebuffer_width, int framebuffer_height)
         r.smp = sg_make_sampler(desc);
     }
 
+    r.quality = renderer_supported_quality(
+        renderer_quality_tier(RENDER_QUALITY_TIER_HIGH));
+
     renderer_init_game_pass(r);
     renderer_init_bloom_pass(r);
     renderer_init_combine_display_pass(r);
+    renderer_init_fxaa_pass(r);
+    renderer_init_display_pass(r);
+
+    r.scaler.enabled = true;
+    r.scaler.scale = render_scale_max;
+    r.scaler.budget_secs = render_scale_default_budget_secs;
+    r.scaler.probe_frames = render_scale_probe_frames_min;
 
     // Call resize manually for the first time to ensure render targets are
     // initialized.
+    r.resize_idle_secs = resize_settle_secs;
     renderer_resize(r, framebuffer_width, framebuffer_height);
+    frame_graph_print_report(r.frame_graph);
 }
 
-static void renderer_resize_game_pass(Renderer &r)
+// Declares every render target and the passes that touch them. The frame
+// graph works out how long each target lives and creates the images,
+// aliasing targets with matching descs whose lifetimes don't overlap.
+static void renderer_build_frame_graph(Renderer &r)
 {
-    for (int i = 0; i < 2; ++i)
+    auto &fg = r.frame_graph;
+    frame_graph_reset(fg);
+
+    int width = r.target_width;
+    int height = r.target_height;
+    int samples = r.quality.msaa_sample_count;
+    sg_pixel_format hdr = r.quality.hdr_format;
+
+    int msaa_color = -1;
+    if (samples > 1)
     {
-        sg_destroy_image(r.game_pass.resolve_images[i]);
-        sg_destroy_image(r.game_pass.msaa_images[i]);
+        msaa_color = frame_graph_add_resource(
+            fg, "game_msaa_color", {width, height, hdr, samples, 1});
     }
-    sg_destroy_image(r.game_pass.depth_image);
-    sg_destroy_attachments(r.game_pass.atts);
+    int depth = frame_graph_add_resource(
+        fg, "game_depth", {width, height, SG_PIXELFORMAT_DEPTH, samples, 1});
+    int hdr_color = frame_graph_add_resource(fg, "game_hdr_color",
+                                             {width, height, hdr, 1, 1});
 
-    for (int i = 0; i < 2; ++i)
+    int bloom_width = std::max(width / 2, 1);
+    int bloom_height = std::max(height / 2, 1);
+    int bloom[bloom_mips_count] = {};
+    if (r.bloom_pass.mip_chain)
+    {
+        bloom[0] = frame_graph_add_resource(fg, "bloom_chain",
+                                            {bloom_width, bloom_height,
+                                             SG_PIXELFORMAT_RG11B10F, 1,
+                                             bloom_mips_count});
+    }
+    else
     {
+        static constexpr const char *names[bloom_mips_count] = {
+            "bloom_mip_0", "bloom_mip_1", "bloom_mip_2",
+            "bloom_mip_3", "bloom_mip_4", "bloom_mip_5",
+        };
+        for (int i = 0; i < bloom_mips_count; i += 1)
         {
-            sg_image_desc desc = {};
-            desc.render_target = true;
-            desc.width = r.framebuffer_width;
-            desc.height = r.framebuffer_height;
-            desc.pixel_format = SG_PIXELFORMAT_RGBA16F;
-            desc.sample_count = msaa_sample_count;
-            r.game_pass.msaa_images[i] = sg_make_image(desc);
+            bloom[i] = frame_graph_add_resource(
+                fg, names[i],
+                {std::max(bloom_width >> i, 1), std::max(bloom_height >> i, 1),
+                 SG_PIXELFORMAT_RG11B10F, 1, 1});
         }
+    }
+    int bloom_count = r.bloom_pass.mip_chain ? 1 : bloom_mips_count;
+
+    int ldr_color = -1;
+    if (r.quality.fxaa)
+    {
+        ldr_color = frame_graph_add_resource(
+            fg, "ldr_color", {width, height, SG_PIXELFORMAT_RGBA8, 1, 1});
+    }
+    int display_color = -1;
+    if (r.display_pass.offscreen)
+    {
+        display_color = frame_graph_add_resource(
+            fg, "display_color", {width, height, SG_PIXELFORMAT_RGBA8, 1, 1});
+    }
+
+    int game = frame_graph_add_pass(fg, "game");
+    if (msaa_color >= 0)
+    {
+        frame_graph_write(fg, game, msaa_color);
+    }
+    frame_graph_write(fg, game, depth);
+    frame_graph_write(fg, game, hdr_color);
+
+    // Each mip is down sampled from the one above it and then up sampled
+    // back into it from the one below. In a mip chain that is the same
+    // resource throughout.
+    int bloom_down = frame_graph_add_pass(fg, "bloom_down");
+    frame_graph_read(fg, bloom_down, hdr_color);
+    for (int i = 0; i < bloom_count; i += 1)
+    {
+        frame_graph_write(fg, bloom_down, bloom[i]);
+        if (i + 1 < bloom_count || r.bloom_pass.mip_chain)
         {
-            sg_image_desc desc = {};
-            desc.render_target = true;
-            desc.width = r.framebuffer_width;
-            desc.height = r.framebuffer_height;
-            desc.pixel_format = SG_PIXELFORMAT_RGBA16F;
-            desc.sample_count = 1;
-            r.game_pass.resolve_images[i] = sg_make_image(desc);
+            frame_graph_read(fg, bloom_down, bloom[i]);
         }
     }
+
+    int bloom_up = frame_graph_add_pass(fg, "bloom_up");
+    for (int i = 0; i < bloom_count; i += 1)
     {
-        sg_image_desc desc = {};
-        desc.render_target = true;
-        desc.width = r.framebuffer_width;
-        desc.height = r.framebuffer_height;
-        desc.pixel_format = SG_PIXELFORMAT_DEPTH;
-        desc.sample_count = msaa_sample_count;
-        r.game_pass.depth_image = sg_make_image(desc);
+        if (i > 0 || r.bloom_pass.mip_chain)
+        {
+            frame_graph_read(fg, bloom_up, bloom[i]);
+        }
+        if (i + 1 < bloom_count || r.bloom_pass.mip_chain)
+        {
+            frame_graph_write(fg, bloom_up, bloom[i]);
+        }
     }
+
+    int combine = frame_graph_add_pass(fg, "combine_display");
+    frame_graph_read(fg, combine, hdr_color);
+    frame_graph_read(fg, combine, bloom[0]);
+    int last = combine;
+    if (ldr_color >= 0)
     {
-        sg_attachments_desc desc = {};
-        desc.colors[0].image = r.game_pass.msaa_images[0];
-        desc.colors[1].image = r.game_pass.msaa_images[1];
-        desc.resolves[0].image = r.game_pass.resolve_images[0];
-        desc.resolves[1].image = r.game_pass.resolve_images[1];
-        desc.depth_stencil.image = r.game_pass.depth_image;
-        r.game_pass.atts = sg_make_attachments(desc);
+        frame_graph_write(fg, combine, ldr_color);
+
+        int fxaa = frame_graph_add_pass(fg, "fxaa");
+        frame_graph_read(fg, fxaa, ldr_color);
+        last = fxaa;
+    }
+    if (display_color >= 0)
+    {
+        frame_graph_write(fg, last, display_color);
+
+        int display = frame_graph_add_pass(fg, "display");
+        frame_graph_read(fg, display, display_color);
     }
+
+    frame_graph_compile(fg);
+
+    r.game_pass.msaa_image =
+        msaa_color >= 0 ? frame_graph_image(fg, msaa_color) : sg_image{};
+    r.game_pass.depth_image = frame_graph_image(fg, depth);
+    r.game_pass.resolve_image = frame_graph_image(fg, hdr_color);
+    for (int i = 0; i < bloom_mips_count; i += 1)
+    {
+        auto &mip = r.bloom_pass.mips[i];
+        mip.img = frame_graph_image(fg, bloom[r.bloom_pass.mip_chain ? 0 : i]);
+        mip.mip_level = r.bloom_pass.mip_chain ? i : 0;
+    }
+    r.combine_display_pass.ldr_image =
+        ldr_color >= 0 ? frame_graph_image(fg, ldr_color) : sg_image{};
+    r.display_pass.image =
+        display_color >= 0 ? frame_graph_image(fg, display_color) : sg_image{};
+}
+
+static void renderer_resize_game_pass(Renderer &r)
+{
+    sg_destroy_attachments(r.game_pass.atts);
+
+    sg_attachments_desc desc = {};
+    if (r.game_pass.msaa_image.id != SG_INVALID_ID)
+    {
+        desc.colors[0].image = r.game_pass.msaa_image;
+        desc.resolves[0].image = r.game_pass.resolve_image;
+    }
+    else
+    {
+        desc.colors[0].image = r.game_pass.resolve_image;
+    }
+    desc.depth_stencil.image = r.game_pass.depth_image;
+    r.game_pass.atts = sg_make_attachments(desc);
 }
 
 static void renderer_resize_bloom_pass(Renderer &r)
 {
-    int width_i = r.framebuffer_width;
-    int height_i = r.framebuffer_height;
-    float width_f = (float)r.framebuffer_width;
-    float height_f = (float)r.framebuffer_height;
-    HMM_Vec2 texel_size = HMM_V2(1.0f / width_f, 1.0f / height_f);
     for (auto &mip : r.bloom_pass.mips)
     {
-        sg_destroy_image(mip.img);
         sg_destroy_attachments(mip.atts);
 
-        width_i /= 2;
-        height_i /= 2;
-        width_f *= 0.5f;
-        height_f *= 0.5f;
-        mip.texel_size = texel_size;
-        mip.width = width_i;
-        mip.height = height_i;
-        {
-            sg_image_desc desc = {};
-            desc.render_target = true;
-            desc.width = width_i;
-            desc.height = height_i;
-            desc.pixel_format = SG_PIXELFORMAT_RG11B10F;
-            desc.sample_count = 1;
-            mip.img = sg_make_image(desc);
-        }
-        {
-            sg_attachments_desc desc = {};
-            desc.colors[0].image = mip.img;
-            mip.atts = sg_make_attachments(desc);
-        }
-        texel_size *= 2.0f;
+        sg_attachments_desc desc = {};
+        desc.colors[0].image = mip.img;
+        desc.colors[0].mip_level = mip.mip_level;
+        mip.atts = sg_make_attachments(desc);
+    }
+}
+
+static void renderer_resize_combine_display_pass(Renderer &r)
+{
+    sg_destroy_attachments(r.combine_display_pass.ldr_atts);
+    r.combine_display_pass.ldr_atts = {};
+
+    if (r.combine_display_pass.ldr_image.id != SG_INVALID_ID)
+    {
+        sg_attachments_desc desc = {};
+        desc.colors[0].image = r.combine_display_pass.ldr_image;
+        r.combine_display_pass.ldr_atts = sg_make_attachments(desc);
+    }
+}
+
+// Works out the part of every render target that is rendered into this
+// frame. Only depends on the framebuffer size and the render scale, so it
+// runs whenever either changes without touching the targets themselves.
+static void renderer_update_render_size(Renderer &r)
+{
+    r.render_width = std::clamp(
+        static_cast<int>(std::lround(r.framebuffer_width * r.scaler.scale)), 1,
+        r.target_width);
+    r.render_height = std::clamp(
+        static_cast<int>(std::lround(r.framebuffer_height * r.scaler.scale)),
+        1, r.target_height);
+
+    float target_width = static_cast<float>(r.target_width);
+    float target_height = static_cast<float>(r.target_height);
+    r.render_uv_scale =
+        HMM_V2(static_cast<float>(r.render_width) / target_width,
+               static_cast<float>(r.render_height) / target_height);
+    r.render_uv_max = r.render_uv_scale -
+                      HMM_V2(0.5f / target_width, 0.5f / target_height);
+
+    int width = r.render_width;
+    int height = r.render_height;
+    int mip_target_width = r.target_width;
+    int mip_target_height = r.target_height;
+    for (auto &mip : r.bloom_pass.mips)
+    {
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        mip_target_width = std::max(mip_target_width / 2, 1);
+        mip_target_height = std::max(mip_target_height / 2, 1);
+
+        float mip_width = static_cast<float>(mip_target_width);
+        float mip_height = static_cast<float>(mip_target_height);
+        mip.width = width;
+        mip.height = height;
+        mip.texel_size = HMM_V2(1.0f / mip_width, 1.0f / mip_height);
+        mip.uv_scale = HMM_V2(static_cast<float>(width) / mip_width,
+                              static_cast<float>(height) / mip_height);
+        mip.uv_max = mip.uv_scale - mip.texel_size * 0.5f;
     }
 }
 
+static void renderer_resize_display_pass(Renderer &r)
+{
+    sg_destroy_attachments(r.display_pass.atts);
+    r.display_pass.atts = {};
+
+    if (r.display_pass.image.id != SG_INVALID_ID)
+    {
+        sg_attachments_desc desc = {};
+        desc.colors[0].image = r.display_pass.image;
+        r.display_pass.atts = sg_make_attachments(desc);
+    }
+}
+
+static void renderer_allocate_targets(Renderer &r, int width, int height)
+{
+    uint64_t start = stm_now();
+    r.target_width = width;
+    r.target_height = height;
+    renderer_build_frame_graph(r);
+    renderer_resize_game_pass(r);
+    renderer_resize_bloom_pass(r);
+    renderer_resize_combine_display_pass(r);
+    renderer_resize_display_pass(r);
+    r.create_stats.target_allocations_count += 1;
+    r.create_stats.targets_secs += stm_sec(stm_since(start));
+}
+
 void renderer_resize(Renderer &r, int framebuffer_width, int framebuffer_height)
 {
     r.framebuffer_width = framebuffer_width;
     r.framebuffer_height = framebuffer_height;
-    renderer_resize_game_pass(r);
-    renderer_resize_bloom_pass(r);
+
+    // Dragging a window edge sends a resize event every frame. As long as the
+    // framebuffer still fits, the passes just render into a smaller part of
+    // the targets.
+    bool resizing = r.resize_idle_secs < resize_settle_secs;
+    r.resize_idle_secs = 0.0;
+    if (framebuffer_width > r.target_width ||
+        framebuffer_height > r.target_height)
+    {
+        int width = framebuffer_width;
+        int height = framebuffer_height;
+        if (resizing)
+        {
+            auto grow = [](int size)
+            {
+                int grown = static_cast<int>(size * resize_growth);
+                return (grown + resize_alignment - 1) / resize_alignment *
+                       resize_alignment;
+            };
+            width = std::max(grow(width), r.target_width);
+            height = std::max(grow(height), r.target_height);
+        }
+        renderer_allocate_targets(r, width, height);
+    }
+    renderer_update_render_size(r);
+}
+
+void renderer_update_resize(Renderer &r, double frame_time_secs)
+{
+    if (r.resize_idle_secs >= resize_settle_secs)
+    {
+        return;
+    }
+
+    r.resize_idle_secs += frame_time_secs;
+    if (r.resize_idle_secs >= resize_settle_secs &&
+        (r.target_width != r.framebuffer_width ||
+         r.target_height != r.framebuffer_height))
+    {
+        renderer_allocate_targets(r, r.framebuffer_width,
+                                  r.framebuffer_height);
+        renderer_update_render_size(r);
+        frame_graph_print_report(r.frame_graph);
+    }
+}
+
+void renderer_set_quality(Renderer &r, const Render_Quality &quality)
+{
+    r.quality = renderer_supported_quality(quality);
+    renderer_allocate_targets(r, r.target_width, r.target_height);
+    renderer_update_render_size(r);
+    frame_graph_print_report(r.frame_graph);
+}
+
+void renderer_set_offscreen_display(Renderer &r, bool offscreen)
+{
+    r.display_pass.offscreen = offscreen;
+    renderer_allocate_targets(r, r.target_width, r.target_height);
+    frame_graph_print_report(r.frame_graph);
+}
+
+Render_Quality renderer_quality_tier(Render_Quality_Tier tier)
+{
+    return render_quality_tiers[tier];
+}
+
+const char *renderer_quality_tier_name(Render_Quality_Tier tier)
+{
+    return render_quality_tier_names[tier];
+}
+
+static uint64_t renderer_bytes_per_pixel(sg_pixel_format format)
+{
+    switch (format)
+    {
+    case SG_PIXELFORMAT_RGBA16F:
+        return 8;
+    default:
+        // RG11B10F, RGBA8 and the packed depth-stencil formats.
+        return 4;
+    }
+}
+
+Render_Quality_Cost renderer_estimate_quality_cost(
+    const Render_Quality &quality, int width, int height)
+{
+    uint64_t pixels = static_cast<uint64_t>(width) * height;
+    uint64_t samples = quality.msaa_sample_count;
+    uint64_t hdr_bpp = renderer_bytes_per_pixel(quality.hdr_format);
+    uint64_t depth_bpp = renderer_bytes_per_pixel(SG_PIXELFORMAT_DEPTH);
+    uint64_t bloom_bpp = renderer_bytes_per_pixel(SG_PIXELFORMAT_RG11B10F);
+    uint64_t ldr_bpp = renderer_bytes_per_pixel(SG_PIXELFORMAT_RGBA8);
+
+    Render_Quality_Cost cost = {};
+
+    // Game pass: color and depth are written per sample, depth is tested
+    // (read) once as well, and MSAA color is read again by the resolve.
+    cost.target_bytes += pixels * hdr_bpp + pixels * samples * depth_bpp;
+    cost.frame_bandwidth_bytes +=
+        pixels * samples * (hdr_bpp + depth_bpp * 2) + pixels * hdr_bpp;
+    if (samples > 1)
+    {
+        cost.target_bytes += pixels * samples * hdr_bpp;
+        cost.frame_bandwidth_bytes += pixels * samples * hdr_bpp;
+    }
+
+    // Bloom: every mip is written once on the way down, then read and
+    // blended on the way up.
+    cost.frame_bandwidth_bytes += pixels * hdr_bpp;
+    uint64_t mip_pixels = pixels;
+    for (int i = 0; i < bloom_mips_count; i += 1)
+    {
+        mip_pixels /= 4;
+        cost.target_bytes += mip_pixels * bloom_bpp;
+        cost.frame_bandwidth_bytes += mip_pixels * bloom_bpp * 4;
+    }
+
+    // Combine display reads the HDR image and the first bloom mip.
+    cost.frame_bandwidth_bytes +=
+        pixels * hdr_bpp + pixels / 4 * bloom_bpp + pixels * ldr_bpp;
+    if (quality.fxaa)
+    {
+        cost.target_bytes += pixels * ldr_bpp;
+        cost.frame_bandwidth_bytes += pixels * ldr_bpp * 2;
+    }
+
+    return cost;
+}
+
+void renderer_update_render_scale(Renderer &r, double frame_time_secs)
+{
+    auto &s = r.scaler;
+    if (!s.enabled || frame_time_secs <= 0.0 ||
+        frame_time_secs >= render_scale_ignored_frame_secs)
+    {
+        return;
+    }
+
+    if (s.average_frame_secs == 0.0)
+    {
+        s.average_frame_secs = frame_time_secs;
+    }
+    s.average_frame_secs += (frame_time_secs - s.average_frame_secs) *
+                            render_scale_frame_time_smoothing;
+
+    float scale = s.scale;
+    if (s.average_frame_secs > s.budget_secs * render_scale_over_budget)
+    {
+        s.within_budget_frames = 0;
+        s.over_budget_frames += 1;
+        if (s.over_budget_frames >= render_scale_down_frames &&
+            scale > render_scale_min)
+        {
+            // Going back down straight after a probe means the probe failed,
+            // so wait longer before trying again.
+            if (s.probing)
+            {
+                s.probe_frames = std::min(s.probe_frames * 2,
+                                          render_scale_probe_frames_max);
+            }
+            scale -= render_scale_step;
+            s.probing = false;
+            s.over_budget_frames = 0;
+        }
+    }
+    else
+    {
+        s.over_budget_frames = 0;
+        s.within_budget_frames += 1;
+        if (s.probing && s.within_budget_frames >= render_scale_down_frames)
+        {
+            s.probing = false;
+            s.probe_frames = render_scale_probe_frames_min;
+        }
+        if (s.within_budget_frames >= s.probe_frames &&
+            scale < render_scale_max)
+        {
+            scale += render_scale_step;
+            s.probing = true;
+            s.within_budget_frames = 0;
+        }
+    }
+
+    scale = std::clamp(scale, render_scale_min, render_scale_max);
+    if (scale != s.scale)
+    {
+        s.scale = scale;
+        s.average_frame_secs = 0.0;
+        renderer_update_render_size(r);
+    }
 }
 
 static HMM_Mat4 compute_obj_to_world_transform(HMM_Vec3 pos, HMM_Vec3 rot,
                                                HMM_Vec3 scale)
 {
     HMM_Quat rq = HMM_Q(1.0f, 0.0f, 0.0f, 0.0f);
+    if (fast_math_mode() == FAST_MATH_MODE_FAST)
+    {
+        // All three half angles in one go. A zero angle gives the identity,
+        // so there is nothing to skip.
+        alignas(16) float half[4] = {rot.X * 0.5f, rot.Y * 0.5f,
+                                     rot.Z * 0.5f, 0.0f};
+        alignas(16) float sins[4];
+        alignas(16) float coss[4];
+        F32x4 s, c;
+        fast_sincos4(f32x4_load(half), s, c);
+        f32x4_store(sins, s);
+        f32x4_store(coss, c);
+        HMM_Quat qx = HMM_Q(sins[0], 0.0f, 0.0f, coss[0]);
+        HMM_Quat qy = HMM_Q(0.0f, sins[1], 0.0f, coss[1]);
+        HMM_Quat qz = HMM_Q(0.0f, 0.0f, sins[2], coss[2]);
+        rq = rq * qx * qy * qz;
+        return HMM_Translate(pos) * HMM_QToM4(rq) * HMM_Scale(scale);
+    }
     if (rot.X != 0.0f)
     {
         rq = rq * HMM_QFromAxisAngle_RH(HMM_V3(1.0f, 0.0f, 0.0f), rot.X);
@@ -335,28 +1135,111 @@ static HMM_Mat4 compute_obj_to_world_transform(HMM_Vec3 pos, HMM_Vec3 rot,
     return HMM_Translate(pos) * HMM_QToM4(rq) * HMM_Scale(scale);
 }
 
+// Last frame's sizes are the best guess for this one, so in steady state
+// nothing has to grow mid-frame.
+template <typename T>
+static void renderer_begin_frame_array(Arena &arena, Arena_Array<T> &array,
+                                       int initial_count)
+{
+    int capacity = std::max(array.count, initial_count);
+    array = {};
+    arena_array_reserve(arena, array, capacity);
+}
+
+void renderer_begin_frame(Renderer &r)
+{
+    Arena &arena = frame_arena_current(*r.frame_arena);
+    renderer_begin_frame_array(arena, r.game_pass.draw_calls,
+                               draw_calls_initial_count);
+    renderer_begin_frame_array(arena, r.game_pass.basic_instances,
+                               basic_instances_initial_count);
+    renderer_begin_frame_array(arena, r.text.instances,
+                               text_glyph_instances_initial_count);
+    r.star_field.drawn = false;
+}
+
+// The seeds are the only thing about the stars that is ever uploaded, once.
+static void renderer_make_star_seeds(Star_Field &field, int count,
+                                     uint32_t seed)
+{
+    if (field.seeds_buffer.id != SG_INVALID_ID)
+    {
+        sg_destroy_buffer(field.seeds_buffer);
+    }
+
+    int blocks_count = (count + 3) / 4;
+    auto *blocks = static_cast<Philox_Block *>(
+        malloc(sizeof(Philox_Block) * static_cast<size_t>(blocks_count)));
+    assert(blocks);
+    Philox_Key key = philox_key(seed, 0);
+    for (int i = 0; i < blocks_count; i += star_seeds_batch_blocks_count)
+    {
+        Philox_Counter counters[star_seeds_batch_blocks_count];
+        int batch_count =
+            std::min(star_seeds_batch_blocks_count, blocks_count - i);
+        for (int j = 0; j < batch_count; j += 1)
+        {
+            counters[j] = {{static_cast<uint32_t>(i + j), 0, 0, 0}};
+        }
+        philox4x32_blocks(key, counters, blocks + i, batch_count);
+    }
+
+    sg_buffer_desc desc = {};
+    desc.data.ptr = blocks;
+    desc.data.size = sizeof(uint32_t) * static_cast<size_t>(count);
+    field.seeds_buffer = sg_make_buffer(desc);
+    field.seeds_count = count;
+    field.seed = seed;
+    free(blocks);
+}
+
+void renderer_draw_star_field(Renderer &r, const Star_Field_Desc &desc)
+{
+    assert(!r.star_field.drawn);
+    assert(desc.colors_count > 0 &&
+           desc.colors_count <= star_field_colors_max_count);
+    auto &field = r.star_field;
+    if (desc.count > field.seeds_count || desc.seed != field.seed)
+    {
+        renderer_make_star_seeds(field,
+                                 std::max(desc.count, field.seeds_count),
+                                 desc.seed);
+    }
+    field.drawn = true;
+    field.desc = desc;
+}
+
 void renderer_draw_basic_box_instance(Renderer &r, HMM_Vec3 position,
                                       HMM_Vec3 rotation, HMM_Vec3 scale,
                                       HMM_Vec3 color)
 {
-    assert(r.game_pass.basic_instances_count < basic_box_instances_max_count);
+    auto *instance = renderer_push_basic_box_instances(r, 1);
+    renderer_set_basic_box_instance(*instance, position, rotation, scale,
+                                    color);
+}
 
-    auto &instance =
-        r.game_pass.basic_instances[r.game_pass.basic_instances_count];
+Basic_Box_Instance *renderer_push_basic_box_instances(Renderer &r, int count)
+{
+    return arena_array_push(frame_arena_current(*r.frame_arena),
+                            r.game_pass.basic_instances, count);
+}
+
+void renderer_set_basic_box_instance(Basic_Box_Instance &instance,
+                                     HMM_Vec3 position, HMM_Vec3 rotation,
+                                     HMM_Vec3 scale, HMM_Vec3 color)
+{
     instance.obj_to_world_transform =
         compute_obj_to_world_transform(position, rotation, scale);
     instance.color = color;
-
-    r.game_pass.basic_instances_count += 1;
 }
 
 void renderer_draw_phong_box(Renderer &r, HMM_Vec3 position, HMM_Vec3 rotation,
                              HMM_Vec3 scale, HMM_Vec3 color)
 {
-    assert(r.game_pass.draw_calls_count < draw_calls_max_count);
-
-    auto &draw_call = r.game_pass.draw_calls[r.game_pass.draw_calls_count];
-    draw_call.pip = r.game_pass.phong_pip;
+    auto &draw_call = *arena_array_push(frame_arena_current(*r.frame_arena),
+                                        r.game_pass.draw_calls, 1);
+    draw_call = {};
+    draw_call.shader = GAME_PASS_SHADER_PHONG;
     draw_call.bind.vertex_buffers[0] = r.box.vbuf,
     draw_call.bind.index_buffer = r.box.ibuf;
     draw_call.base_element = 0;
@@ -365,19 +1248,196 @@ void renderer_draw_phong_box(Renderer &r, HMM_Vec3 position, HMM_Vec3 rotation,
     draw_call.obj_to_world_transform =
         compute_obj_to_world_transform(position, rotation, scale);
     draw_call.color = color;
+}
 
-    r.game_pass.draw_calls_count += 1;
+// FNV-1a over the string, then the alignment.
+static uint64_t renderer_text_hash(const char *text, Text_Align align)
+{
+    static constexpr uint64_t prime = 1099511628211ull;
+
+    uint64_t hash = 14695981039346656037ull;
+    for (const char *c = text; *c; c += 1)
+    {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * prime;
+    }
+    return (hash ^ static_cast<uint64_t>(align)) * prime;
+}
+
+static void renderer_layout_text(Text_Layout &layout, const char *text,
+                                 Text_Align align)
+{
+    layout.glyphs_count = 0;
+
+    float y = 0.0f;
+    const char *line = text;
+    while (*line)
+    {
+        const char *line_end = line;
+        while (*line_end && *line_end != '\n')
+        {
+            line_end += 1;
+        }
+
+        // Every line is aligned on its own, by the ink of its glyphs rather
+        // than the advance after the last one.
+        int chars_count = static_cast<int>(line_end - line);
+        float width = 0.0f;
+        if (chars_count > 0)
+        {
+            width = static_cast<float>(chars_count - 1) * sdf_font_advance +
+                    sdf_font_glyph_width;
+        }
+        float x = 0.0f;
+        if (align == TEXT_ALIGN_CENTER)
+        {
+            x = -width * 0.5f;
+        }
+        else if (align == TEXT_ALIGN_RIGHT)
+        {
+            x = -width;
+        }
+
+        for (const char *c = line; c < line_end; c += 1)
+        {
+            auto ch = static_cast<unsigned char>(*c);
+            int cell = ch < 128 ? sdf_font_glyph_cells[std::toupper(ch)] : -1;
+            if (cell >= 0 && layout.glyphs_count < text_layout_glyphs_max_count)
+            {
+                int column = cell % sdf_font_cell_columns;
+                int row = cell / sdf_font_cell_columns;
+                int cell_x = column * sdf_font_cell_width;
+                int cell_y = row * sdf_font_cell_height;
+                auto &glyph = layout.glyphs[layout.glyphs_count];
+                glyph.offset = HMM_V2(x + sdf_font_quad_x, y + sdf_font_quad_y);
+                glyph.uv_rect[0] = static_cast<uint16_t>(
+                    cell_x * 65535 / sdf_font_atlas_width);
+                glyph.uv_rect[1] = static_cast<uint16_t>(
+                    cell_y * 65535 / sdf_font_atlas_height);
+                glyph.uv_rect[2] = static_cast<uint16_t>(
+                    (cell_x + sdf_font_cell_width) * 65535 /
+                    sdf_font_atlas_width);
+                glyph.uv_rect[3] = static_cast<uint16_t>(
+                    (cell_y + sdf_font_cell_height) * 65535 /
+                    sdf_font_atlas_height);
+                layout.glyphs_count += 1;
+            }
+            x += sdf_font_advance;
+        }
+
+        y -= sdf_font_line_height;
+        line = *line_end ? line_end + 1 : line_end;
+    }
+}
+
+static const Text_Layout &renderer_text_layout(Renderer &r, const char *text,
+                                               Text_Align align)
+{
+    uint64_t hash = renderer_text_hash(text, align);
+    size_t length = strlen(text);
+    size_t stored_length =
+        std::min(length, static_cast<size_t>(text_layout_chars_max_count));
+
+    Text_Layout *oldest = nullptr;
+    for (int i = 0; i < r.text.layouts_count; i += 1)
+    {
+        auto &layout = r.text.layouts[i];
+        if (layout.hash == hash && layout.text_length == length &&
+            layout.align == align &&
+            memcmp(layout.text, text, stored_length) == 0)
+        {
+            layout.last_used_frame = r.text.frame_index;
+            return layout;
+        }
+        if (!oldest || layout.last_used_frame < oldest->last_used_frame)
+        {
+            oldest = &layout;
+        }
+    }
+
+    Text_Layout *layout = oldest;
+    if (r.text.layouts_count < text_layouts_max_count)
+    {
+        layout = &r.text.layouts[r.text.layouts_count];
+        r.text.layouts_count += 1;
+    }
+    layout->hash = hash;
+    memcpy(layout->text, text, stored_length);
+    layout->text_length = length;
+    layout->align = align;
+    layout->last_used_frame = r.text.frame_index;
+    renderer_layout_text(*layout, text, align);
+    return *layout;
+}
+
+void renderer_draw_text(Renderer &r, const char *text, HMM_Vec3 position,
+                        HMM_Vec3 rotation, float size, HMM_Vec3 color,
+                        Text_Align align)
+{
+    const auto &layout = renderer_text_layout(r, text, align);
+
+    HMM_Mat4 transform = compute_obj_to_world_transform(
+        position, rotation, HMM_V3(size, size, size));
+    HMM_Vec3 x_axis = transform.Columns[0].XYZ;
+    HMM_Vec3 y_axis = transform.Columns[1].XYZ;
+    HMM_Vec3 quad_x_axis = x_axis * sdf_font_quad_width;
+    HMM_Vec3 quad_y_axis = y_axis * sdf_font_quad_height;
+
+    auto *instances = arena_array_push(frame_arena_current(*r.frame_arena),
+                                       r.text.instances, layout.glyphs_count);
+    for (int i = 0; i < layout.glyphs_count; i += 1)
+    {
+        const auto &glyph = layout.glyphs[i];
+        auto &instance = instances[i];
+        instance.origin =
+            position + x_axis * glyph.offset.X + y_axis * glyph.offset.Y;
+        instance.x_axis = quad_x_axis;
+        instance.y_axis = quad_y_axis;
+        std::copy(std::begin(glyph.uv_rect), std::end(glyph.uv_rect),
+                  instance.uv_rect);
+        instance.color = color;
+    }
+}
+
+// Stream buffers are recreated larger when a frame doesn't fit, which is the
+// only time they are reallocated.
+static void renderer_upload_stream_buffer(sg_buffer &buf, size_t &buf_size,
+                                          const void *data, size_t size)
+{
+    if (size > buf_size)
+    {
+        buf_size = std::max(size, buf_size * 2);
+        sg_destroy_buffer(buf);
+
+        sg_buffer_desc desc = {};
+        desc.usage = SG_USAGE_STREAM;
+        desc.size = buf_size;
+        buf = sg_make_buffer(desc);
+    }
+
+    sg_range range = {};
+    range.ptr = data;
+    range.size = size;
+    sg_update_buffer(buf, range);
+}
+
+// Restricts drawing to the top left width x height part of a render target
+// in texture space. GL stores images bottom row first, so there that part is
+// at the bottom of the framebuffer.
+static void renderer_apply_target_viewport(int width, int height)
+{
+    sg_apply_viewport(0, 0, width, height,
+                      sg_query_features().origin_top_left);
 }
 
 static void renderer_render_game_pass(Renderer &r)
 {
-    game_phong_fs_dir_light_t fs_dir_light = {};
+    game_phong_l1_s1_fs_dir_light_t fs_dir_light = {};
     fs_dir_light.direction = r.game_pass.dir_light.direction;
     fs_dir_light.color = r.game_pass.dir_light.diffuse_color;
     fs_dir_light.ambient = r.game_pass.dir_light.ambient_color;
 
     Point_Light point_light = r.game_pass.point_lights[0];
-    game_phong_fs_point_light_0_t fs_point_light = {};
+    game_phong_l1_s1_fs_point_light_0_t fs_point_light = {};
     fs_point_light.color = point_light.diffuse_color;
     fs_point_light.ambient = point_light.ambient_color;
     fs_point_light.falloff = point_light.falloff;
@@ -387,46 +1447,88 @@ static void renderer_render_game_pass(Renderer &r)
                                     HMM_V4V(point_light.position, 1.0f))
                                        .XYZ;
 
+    uint32_t phong_shader_id =
+        static_cast<uint32_t>(renderer_phong_permutation(r));
+
     sg_pass pass = {};
     pass.action = r.game_pass.pass_action;
     pass.attachments = r.game_pass.atts;
     sg_begin_pass(pass);
+    renderer_apply_target_viewport(r.render_width, r.render_height);
 
     // Add draw call for instanced geometry if required.
-    if (r.game_pass.basic_instances_count > 0)
+    Arena &arena = frame_arena_current(*r.frame_arena);
+    const auto &basic_instances = r.game_pass.basic_instances;
+    if (basic_instances.count > 0)
     {
-        assert(r.game_pass.draw_calls_count < draw_calls_max_count);
-
-        sg_range range = {};
-        range.ptr = r.game_pass.basic_instances;
-        range.size =
-            sizeof(Basic_Box_Instance) * r.game_pass.basic_instances_count;
-        sg_update_buffer(r.game_pass.basic_instances_buffer, range);
+        renderer_upload_stream_buffer(
+            r.game_pass.basic_instances_buffer,
+            r.game_pass.basic_instances_buffer_size, basic_instances.items,
+            sizeof(Basic_Box_Instance) * basic_instances.count);
 
-        auto &draw_call = r.game_pass.draw_calls[r.game_pass.draw_calls_count];
-        draw_call.pip = r.game_pass.basic_pip;
+        auto &draw_call =
+            *arena_array_push(arena, r.game_pass.draw_calls, 1);
+        draw_call = {};
+        draw_call.shader = GAME_PASS_SHADER_BASIC;
         draw_call.bind.vertex_buffers[0] = r.box.vbuf,
         draw_call.bind.vertex_buffers[1] = r.game_pass.basic_instances_buffer,
         draw_call.bind.index_buffer = r.box.ibuf;
         draw_call.base_element = 0;
         draw_call.elements_count = r.box.elements_count;
-        draw_call.instances_count = r.game_pass.basic_instances_count;
+        draw_call.instances_count = basic_instances.count;
+    }
 
-        r.game_pass.draw_calls_count += 1;
-        r.game_pass.basic_instances_count = 0;
+    const auto &star_field = r.star_field;
+    if (star_field.drawn && star_field.desc.count > 0)
+    {
+        auto &draw_call =
+            *arena_array_push(arena, r.game_pass.draw_calls, 1);
+        draw_call = {};
+        draw_call.shader = GAME_PASS_SHADER_STARS;
+        draw_call.bind.vertex_buffers[0] = r.box.vbuf;
+        draw_call.bind.vertex_buffers[1] = star_field.seeds_buffer;
+        draw_call.bind.index_buffer = r.box.ibuf;
+        draw_call.base_element = 0;
+        draw_call.elements_count = r.box.elements_count;
+        draw_call.instances_count = star_field.desc.count;
     }
 
-    if (r.game_pass.draw_calls_count > 0)
+    // All text goes last in a single draw call, as it is blended over
+    // everything else.
+    const auto &text_instances = r.text.instances;
+    if (text_instances.count > 0)
     {
-        for (int i = 0; i < r.game_pass.draw_calls_count; i += 1)
+        renderer_upload_stream_buffer(
+            r.text.instances_buffer, r.text.instances_buffer_size,
+            text_instances.items,
+            sizeof(Text_Glyph_Instance) * text_instances.count);
+
+        auto &draw_call =
+            *arena_array_push(arena, r.game_pass.draw_calls, 1);
+        draw_call = {};
+        draw_call.shader = GAME_PASS_SHADER_TEXT;
+        draw_call.bind.vertex_buffers[0] = r.quad.vbuf;
+        draw_call.bind.vertex_buffers[1] = r.text.instances_buffer;
+        draw_call.bind.index_buffer = r.quad.ibuf;
+        draw_call.bind.images[IMG_text_u_atlas] = r.text.atlas;
+        draw_call.bind.samplers[SMP_text_u_smp] = r.smp;
+        draw_call.base_element = 0;
+        draw_call.elements_count = r.quad.elements_count;
+        draw_call.instances_count = text_instances.count;
+    }
+
+    if (r.game_pass.draw_calls.count > 0)
+    {
+        for (int i = 0; i < r.game_pass.draw_calls.count; i += 1)
         {
-            auto &draw_call = r.game_pass.draw_calls[i];
+            auto &draw_call = r.game_pass.draw_calls.items[i];
 
-            if (draw_call.pip.id == r.game_pass.phong_pip.id)
+            if (draw_call.shader == GAME_PASS_SHADER_PHONG)
             {
-                sg_apply_pipeline(r.game_pass.phong_pip);
+                sg_apply_pipeline(
+                    renderer_game_pass_pipeline(r, phong_shader_id));
 
-                game_phong_vs_params_t vs_params = {};
+                game_phong_l1_s1_vs_params_t vs_params = {};
                 vs_params.u_view_to_clip_transform =
                     r.game_pass.view_to_clip_transform;
                 vs_params.u_obj_to_view_transform =
@@ -434,24 +1536,31 @@ static void renderer_render_game_pass(Renderer &r)
                     draw_call.obj_to_world_transform;
                 vs_params.u_obj_to_view_normal_transform = HMM_Transpose(
                     HMM_InvGeneral(vs_params.u_obj_to_view_transform));
-                sg_apply_uniforms(UB_game_phong_vs_params, SG_RANGE(vs_params));
+                sg_apply_uniforms(UB_game_phong_l1_s1_vs_params,
+                                  SG_RANGE(vs_params));
 
-                game_phong_fs_material_t material = {};
+                game_phong_l1_s1_fs_material_t material = {};
                 material.color = draw_call.color;
                 // TODO: Provide option for this in draw call.
                 material.shininess = 20.0f;
-                sg_apply_uniforms(UB_game_phong_fs_material,
+                sg_apply_uniforms(UB_game_phong_l1_s1_fs_material,
                                   SG_RANGE(material));
 
-                sg_apply_uniforms(UB_game_phong_fs_dir_light,
+                sg_apply_uniforms(UB_game_phong_l1_s1_fs_dir_light,
                                   SG_RANGE(fs_dir_light));
-                sg_apply_uniforms(UB_game_phong_fs_point_light_0,
-                                  SG_RANGE(fs_point_light));
+                // Permutations without the point light don't have its
+                // uniform block at all.
+                if (point_light.enabled)
+                {
+                    sg_apply_uniforms(UB_game_phong_l1_s1_fs_point_light_0,
+                                      SG_RANGE(fs_point_light));
+                }
             }
 
-            else if (draw_call.pip.id == r.game_pass.basic_pip.id)
+            else if (draw_call.shader == GAME_PASS_SHADER_BASIC)
             {
-                sg_apply_pipeline(r.game_pass.basic_pip);
+                sg_apply_pipeline(
+                    renderer_game_pass_pipeline(r, basic_pipeline_shader_id));
 
                 game_basic_vs_params_t vs_params = {};
                 vs_params.u_world_to_clip_transform =
@@ -460,12 +1569,48 @@ static void renderer_render_game_pass(Renderer &r)
                 sg_apply_uniforms(UB_game_basic_vs_params, SG_RANGE(vs_params));
             }
 
+            else if (draw_call.shader == GAME_PASS_SHADER_STARS)
+            {
+                sg_apply_pipeline(
+                    renderer_game_pass_pipeline(r, stars_pipeline_shader_id));
+
+                const auto &desc = star_field.desc;
+                stars_vs_params_t vs_params = {};
+                vs_params.u_world_to_clip_transform =
+                    r.game_pass.view_to_clip_transform *
+                    r.game_pass.world_to_view_transform;
+                for (int c = 0; c < desc.colors_count; c += 1)
+                {
+                    vs_params.u_colors[c] = HMM_V4V(desc.colors[c], 1.0f);
+                }
+                vs_params.u_colors_count =
+                    static_cast<float>(desc.colors_count);
+                vs_params.u_time = desc.time;
+                vs_params.u_stream = static_cast<float>(desc.stream);
+                vs_params.u_eye_z = desc.eye_z;
+                vs_params.u_z_near = desc.z_near;
+                vs_params.u_z_far = desc.z_far;
+                vs_params.u_tan_half_fov = tanf(desc.fov_rad * 0.5f);
+                vs_params.u_aspect = desc.aspect;
+                sg_apply_uniforms(UB_stars_vs_params, SG_RANGE(vs_params));
+            }
+
+            else if (draw_call.shader == GAME_PASS_SHADER_TEXT)
+            {
+                sg_apply_pipeline(
+                    renderer_game_pass_pipeline(r, text_pipeline_shader_id));
+
+                text_vs_params_t vs_params = {};
+                vs_params.u_world_to_clip_transform =
+                    r.game_pass.view_to_clip_transform *
+                    r.game_pass.world_to_view_transform;
+                sg_apply_uniforms(UB_text_vs_params, SG_RANGE(vs_params));
+            }
+
             sg_apply_bindings(&draw_call.bind);
             sg_draw(draw_call.base_element, draw_call.elements_count,
                     draw_call.instances_count);
         }
-
-        r.game_pass.draw_calls_count = 0;
     }
 
     sg_end_pass();
@@ -473,7 +1618,9 @@ static void renderer_render_game_pass(Renderer &r)
 
 static void renderer_render_bloom_pass(Renderer &r)
 {
-    sg_image current_image = r.game_pass.resolve_images[1];
+    // The first down sample also extracts the bright parts of the scene, the
+    // rest of the chain only blurs.
+    const Bloom_Mip *source_mip = nullptr;
     for (const auto &mip : r.bloom_pass.mips)
     {
         sg_pass pass = {};
@@ -481,47 +1628,84 @@ static void renderer_render_bloom_pass(Renderer &r)
         pass.attachments = mip.atts;
         sg_begin_pass(pass);
 
-        sg_apply_viewport(0, 0, mip.width, mip.height, true);
-        sg_apply_pipeline(r.bloom_pass.down_sample_pip);
+        renderer_apply_target_viewport(mip.width, mip.height);
+        if (!source_mip)
+        {
+            sg_apply_pipeline(r.bloom_pass.prefilter_pip);
 
-        bloom_fs_down_sample_uniforms_t fs_params = {};
-        fs_params.u_texel_size = mip.texel_size;
-        sg_apply_uniforms(UB_bloom_fs_down_sample_uniforms,
-                          SG_RANGE(fs_params));
+            bloom_fs_prefilter_uniforms_t fs_params = {};
+            fs_params.u_texel_size =
+                HMM_V2(1.0f / static_cast<float>(r.target_width),
+                       1.0f / static_cast<float>(r.target_height));
+            fs_params.u_uv_scale = r.render_uv_scale;
+            fs_params.u_uv_max = r.render_uv_max;
+            fs_params.u_threshold = bloom_threshold;
+            fs_params.u_knee = bloom_knee;
+            sg_apply_uniforms(UB_bloom_fs_prefilter_uniforms,
+                              SG_RANGE(fs_params));
+        }
+        else
+        {
+            sg_apply_pipeline(r.bloom_pass.down_sample_pip);
+
+            bloom_fs_down_sample_uniforms_t fs_params = {};
+            fs_params.u_texel_size = source_mip->texel_size;
+            fs_params.u_uv_scale = source_mip->uv_scale;
+            fs_params.u_uv_max = source_mip->uv_max;
+            fs_params.u_src_lod = static_cast<float>(source_mip->mip_level);
+            sg_apply_uniforms(UB_bloom_fs_down_sample_uniforms,
+                              SG_RANGE(fs_params));
+        }
 
         sg_bindings bind = {};
         bind.vertex_buffers[0] = r.quad.vbuf;
         bind.index_buffer = r.quad.ibuf;
-        bind.images[IMG_bloom_u_down_sample_tex] = current_image;
-        bind.samplers[SMP_bloom_u_down_sample_smp] = r.smp;
+        if (source_mip)
+        {
+            bind.images[IMG_bloom_u_down_sample_tex] = source_mip->img;
+            bind.samplers[SMP_bloom_u_down_sample_smp] = source_mip->smp;
+        }
+        else
+        {
+            bind.images[IMG_bloom_u_down_sample_tex] =
+                r.game_pass.resolve_image;
+            bind.samplers[SMP_bloom_u_down_sample_smp] = r.smp;
+        }
         sg_apply_bindings(bind);
         sg_draw(0, r.quad.elements_count, 1);
 
         sg_end_pass();
 
-        current_image = mip.img;
+        source_mip = &mip;
     }
 
     for (int i = bloom_mips_count - 1; i > 0; i -= 1)
     {
+        const auto &source_mip = r.bloom_pass.mips[i];
+        const auto &target_mip = r.bloom_pass.mips[i - 1];
+
         sg_pass pass = {};
         pass.action = r.bloom_pass.up_sample_pass_action;
-        pass.attachments = r.bloom_pass.mips[i - 1].atts;
+        pass.attachments = target_mip.atts;
         sg_begin_pass(pass);
-        sg_apply_viewport(0, 0, r.bloom_pass.mips[i - 1].width,
-                          r.bloom_pass.mips[i - 1].height, true);
+        renderer_apply_target_viewport(target_mip.width, target_mip.height);
 
         sg_apply_pipeline(r.bloom_pass.up_sample_pip);
 
+        // The radius is relative to the rendered part, so the blur looks the
+        // same however large the targets are.
         bloom_fs_up_sample_uniforms_t fs_params = {};
-        fs_params.u_filter_radius = bloom_filter_radius;
+        fs_params.u_filter_radius = source_mip.uv_scale * bloom_filter_radius;
+        fs_params.u_uv_scale = source_mip.uv_scale;
+        fs_params.u_uv_max = source_mip.uv_max;
+        fs_params.u_src_lod = static_cast<float>(source_mip.mip_level);
         sg_apply_uniforms(UB_bloom_fs_up_sample_uniforms, SG_RANGE(fs_params));
 
         sg_bindings bind = {};
         bind.vertex_buffers[0] = r.quad.vbuf;
         bind.index_buffer = r.quad.ibuf;
-        bind.images[IMG_bloom_u_up_sample_tex] = r.bloom_pass.mips[i].img;
-        bind.samplers[SMP_bloom_u_up_sample_smp] = r.smp;
+        bind.images[IMG_bloom_u_up_sample_tex] = source_mip.img;
+        bind.samplers[SMP_bloom_u_up_sample_smp] = source_mip.smp;
         sg_apply_bindings(bind);
         sg_draw(0, r.quad.elements_count, 1);
 
@@ -534,12 +1718,31 @@ static void renderer_render_combine_display_pass(Renderer &r,
 {
     sg_pass pass = {};
     pass.action = r.combine_display_pass.pass_action;
-    pass.swapchain = swapchain;
-    sg_begin_pass(pass);
-
-    sg_apply_pipeline(r.combine_display_pass.pip);
+    if (r.quality.fxaa)
+    {
+        pass.attachments = r.combine_display_pass.ldr_atts;
+        sg_begin_pass(pass);
+        renderer_apply_target_viewport(r.render_width, r.render_height);
+        sg_apply_pipeline(renderer_combine_display_pipeline(r, true));
+    }
+    else if (r.display_pass.offscreen)
+    {
+        pass.attachments = r.display_pass.atts;
+        sg_begin_pass(pass);
+        renderer_apply_target_viewport(r.framebuffer_width,
+                                       r.framebuffer_height);
+        sg_apply_pipeline(renderer_combine_display_pipeline(r, true));
+    }
+    else
+    {
+        pass.swapchain = swapchain;
+        sg_begin_pass(pass);
+        sg_apply_pipeline(renderer_combine_display_pipeline(r, false));
+    }
 
     combine_display_fs_params_t fs_params = {};
+    fs_params.u_tex_0_uv_scale = r.render_uv_scale;
+    fs_params.u_tex_1_uv_scale = r.bloom_pass.mips[0].uv_scale;
     fs_params.u_exposure = 1.0f;
     fs_params.u_bloom_strength = 0.04f;
     sg_apply_uniforms(UB_combine_display_fs_params, SG_RANGE(fs_params));
@@ -547,7 +1750,7 @@ static void renderer_render_combine_display_pass(Renderer &r,
     sg_bindings bind = {};
     bind.vertex_buffers[0] = r.quad.vbuf;
     bind.index_buffer = r.quad.ibuf;
-    bind.images[IMG_combine_display_u_tex_0] = r.game_pass.resolve_images[0];
+    bind.images[IMG_combine_display_u_tex_0] = r.game_pass.resolve_image;
     bind.images[IMG_combine_display_u_tex_1] = r.bloom_pass.mips[0].img;
     bind.samplers[SMP_combine_display_u_smp] = r.smp;
     sg_apply_bindings(bind);
@@ -556,9 +1759,85 @@ static void renderer_render_combine_display_pass(Renderer &r,
     sg_end_pass();
 }
 
+static void renderer_render_fxaa_pass(Renderer &r, sg_swapchain swapchain)
+{
+    sg_pass pass = {};
+    pass.action = r.fxaa_pass.pass_action;
+    if (r.display_pass.offscreen)
+    {
+        pass.attachments = r.display_pass.atts;
+        sg_begin_pass(pass);
+        renderer_apply_target_viewport(r.framebuffer_width,
+                                       r.framebuffer_height);
+        sg_apply_pipeline(renderer_fxaa_pipeline(r, true));
+    }
+    else
+    {
+        pass.swapchain = swapchain;
+        sg_begin_pass(pass);
+        sg_apply_pipeline(renderer_fxaa_pipeline(r, false));
+    }
+
+    fxaa_fs_params_t fs_params = {};
+    fs_params.u_texel_size =
+        HMM_V2(1.0f / static_cast<float>(r.target_width),
+               1.0f / static_cast<float>(r.target_height));
+    fs_params.u_uv_scale = r.render_uv_scale;
+    fs_params.u_uv_max = r.render_uv_max;
+    sg_apply_uniforms(UB_fxaa_fs_params, SG_RANGE(fs_params));
+
+    sg_bindings bind = {};
+    bind.vertex_buffers[0] = r.quad.vbuf;
+    bind.index_buffer = r.quad.ibuf;
+    bind.images[IMG_fxaa_u_tex] = r.combine_display_pass.ldr_image;
+    bind.samplers[SMP_fxaa_u_smp] = r.smp;
+    sg_apply_bindings(bind);
+    sg_draw(0, r.quad.elements_count, 1);
+
+    sg_end_pass();
+}
+
+static void renderer_render_display_pass(Renderer &r, sg_swapchain swapchain)
+{
+    sg_pass pass = {};
+    pass.action = r.display_pass.pass_action;
+    pass.swapchain = swapchain;
+    sg_begin_pass(pass);
+
+    sg_apply_pipeline(renderer_display_pipeline(r));
+
+    blit_fs_params_t fs_params = {};
+    fs_params.u_uv_scale =
+        HMM_V2(static_cast<float>(r.framebuffer_width) /
+                   static_cast<float>(r.target_width),
+               static_cast<float>(r.framebuffer_height) /
+                   static_cast<float>(r.target_height));
+    sg_apply_uniforms(UB_blit_fs_params, SG_RANGE(fs_params));
+
+    sg_bindings bind = {};
+    bind.vertex_buffers[0] = r.quad.vbuf;
+    bind.index_buffer = r.quad.ibuf;
+    bind.images[IMG_blit_u_tex] = r.display_pass.image;
+    bind.samplers[SMP_blit_u_smp] = r.smp;
+    sg_apply_bindings(bind);
+    sg_draw(0, r.quad.elements_count, 1);
+
+    sg_end_pass();
+}
+
 void renderer_render(Renderer &r, sg_swapchain swapchain)
 {
     renderer_render_game_pass(r);
     renderer_render_bloom_pass(r);
     renderer_render_combine_display_pass(r, swapchain);
+    if (r.quality.fxaa)
+    {
+        renderer_render_fxaa_pass(r, swapchain);
+    }
+    if (r.display_pass.offscreen)
+    {
+        renderer_render_display_pass(r, swapchain);
+    }
+
+    r.text.frame_index += 1;
 }
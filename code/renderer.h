@@ -1,12 +1,74 @@
 #pragma once
 
 #include "HandmadeMath.h"
+#include "arena.h"
+#include "frame_graph.h"
 #include "sokol_gfx.h"
 
 inline constexpr int point_lights_count = 1;
-inline constexpr int draw_calls_max_count = 16;
-inline constexpr int basic_box_instances_max_count = 1024;
 inline constexpr int bloom_mips_count = 6;
+// One game_phong.glsl permutation per combination of point light on/off and
+// specular on/off.
+inline constexpr int phong_permutations_count = 4;
+inline constexpr int pipeline_cache_max_count = 32;
+// The most GPU objects of each kind the renderer has alive at once, which
+// sg_setup() sizes its pools with. Shaders and pipelines are never destroyed
+// and renderer_make_shader() and renderer_make_pipeline() assert their
+// counts stay within these.
+// Quad and box geometry, the text, basic and star seed instances.
+inline constexpr int renderer_buffers_max_count = 7;
+// The text atlas.
+inline constexpr int renderer_images_max_count =
+    frame_graph_images_max_count + 1;
+// One per bloom mip and the shared linear one.
+inline constexpr int renderer_samplers_max_count = bloom_mips_count + 1;
+// The phong permutations, basic, text, stars, the three bloom shaders,
+// combine display, FXAA and the display blit.
+inline constexpr int renderer_shaders_max_count = phong_permutations_count + 9;
+// The game pass cache, the three bloom pipelines, combine display and FXAA
+// each onscreen and offscreen, and the display blit.
+inline constexpr int renderer_pipelines_max_count =
+    pipeline_cache_max_count + 8;
+// The game pass, one per bloom mip, the LDR target and the offscreen display.
+inline constexpr int renderer_attachments_max_count = bloom_mips_count + 3;
+inline constexpr int text_layouts_max_count = 64;
+inline constexpr int text_layout_glyphs_max_count = 64;
+// Characters of the string kept with its layout to tell apart strings whose
+// hashes collide. Longer strings are told apart by their length as well.
+inline constexpr int text_layout_chars_max_count = 128;
+inline constexpr int star_field_colors_max_count = 16;
+
+enum Render_Quality_Tier
+{
+    RENDER_QUALITY_TIER_LOW,
+    RENDER_QUALITY_TIER_MEDIUM,
+    RENDER_QUALITY_TIER_HIGH,
+    RENDER_QUALITY_TIER_ULTRA,
+    RENDER_QUALITY_TIER_COUNT,
+};
+
+struct Render_Quality
+{
+    // 1, 2, 4 or 8.
+    int msaa_sample_count;
+    // Post-process anti-aliasing, meant to replace MSAA on low-end GPUs.
+    bool fxaa;
+    // SG_PIXELFORMAT_RGBA16F or SG_PIXELFORMAT_RG11B10F. The alpha channel
+    // is never used, so RG11B10F halves the HDR targets for a small loss of
+    // color precision.
+    sg_pixel_format hdr_format;
+    // Without it the phong shader permutation with specular compiled out is
+    // used.
+    bool specular;
+};
+
+// Estimated render target memory, and bytes read and written per frame by
+// all the passes assuming no overdraw, for a game pass of a given size.
+struct Render_Quality_Cost
+{
+    uint64_t target_bytes;
+    uint64_t frame_bandwidth_bytes;
+};
 
 struct Quad_Geometry
 {
@@ -22,8 +84,63 @@ struct Box_Geometry
     int elements_count;
 };
 
+enum Text_Align
+{
+    TEXT_ALIGN_LEFT,
+    TEXT_ALIGN_CENTER,
+    TEXT_ALIGN_RIGHT,
+};
+
+// One glyph quad, spanning origin + x_axis * [0, 1] + y_axis * [0, 1] in
+// world space. uv_rect is the glyph's atlas cell as u0, v0, u1, v1 with v0
+// at the top, normalized to 16 bits.
+struct Text_Glyph_Instance
+{
+    HMM_Vec3 origin;
+    HMM_Vec3 x_axis;
+    HMM_Vec3 y_axis;
+    uint16_t uv_rect[4];
+    HMM_Vec3 color;
+};
+
+struct Text_Layout_Glyph
+{
+    // Lower left corner of the glyph quad relative to the text origin, in
+    // ems.
+    HMM_Vec2 offset;
+    uint16_t uv_rect[4];
+};
+
+// Where the glyphs of one string go, relative to the position it is drawn
+// at. Looked up by a hash of the string and alignment every time it is
+// drawn, so text that doesn't change is only laid out once. Glyphs past
+// text_layout_glyphs_max_count are cut off.
+struct Text_Layout
+{
+    uint64_t hash;
+    char text[text_layout_chars_max_count];
+    size_t text_length;
+    Text_Align align;
+    uint64_t last_used_frame;
+    Text_Layout_Glyph glyphs[text_layout_glyphs_max_count];
+    int glyphs_count;
+};
+
+// All text of a frame is drawn with a single instanced draw call, one
+// instance per glyph, sampling a signed distance field atlas generated at
+// build time (see code/tools/sdf_font_gen.cpp).
 struct Text_Geometry
 {
+    sg_image atlas;
+    // In the frame arena.
+    Arena_Array<Text_Glyph_Instance> instances;
+    sg_buffer instances_buffer;
+    size_t instances_buffer_size;
+    sg_shader shader;
+    // Least recently used layouts are replaced once the cache is full.
+    Text_Layout layouts[text_layouts_max_count];
+    int layouts_count;
+    uint64_t frame_index;
 };
 
 struct Directional_Light
@@ -35,7 +152,8 @@ struct Directional_Light
 
 struct Point_Light
 {
-    // TODO: Add a enabled property.
+    // Disabled lights are compiled out of the shader, not just skipped.
+    bool enabled;
     HMM_Vec3 position;
     HMM_Vec3 diffuse_color;
     HMM_Vec3 ambient_color;
@@ -49,9 +167,17 @@ struct Basic_Box_Instance
     HMM_Vec3 color;
 };
 
+enum Game_Pass_Shader
+{
+    GAME_PASS_SHADER_PHONG,
+    GAME_PASS_SHADER_BASIC,
+    GAME_PASS_SHADER_TEXT,
+    GAME_PASS_SHADER_STARS,
+};
+
 struct Draw_Call
 {
-    sg_pipeline pip;
+    Game_Pass_Shader shader;
     sg_bindings bind;
     int base_element;
     int elements_count;
@@ -60,13 +186,74 @@ struct Draw_Call
     HMM_Vec3 color;
 };
 
+// Background stars that only exist on the GPU. Where a star is, how it
+// spins, grows and glows, and when it respawns, all follow from its seed and
+// time, so drawing them uploads nothing but a few uniforms.
+struct Star_Field_Desc
+{
+    int count;
+    // Picks the seeds. Changing it rewrites the seed buffer.
+    uint32_t seed;
+    // Different streams give different stars from the same seeds.
+    uint32_t stream;
+    // Seconds since the stars first spawned.
+    float time;
+    // Stars spawn between z_near and z_far behind the origin, spread over
+    // what a camera at (0, 0, eye_z) looking down -Z sees at their depth.
+    float eye_z;
+    float z_near;
+    float z_far;
+    float fov_rad;
+    float aspect;
+    HMM_Vec3 colors[star_field_colors_max_count];
+    int colors_count;
+};
+
+struct Star_Field
+{
+    // One 32 bit seed per star, only recreated when more stars are drawn
+    // than it holds or the seed changes.
+    sg_buffer seeds_buffer;
+    int seeds_count;
+    uint32_t seed;
+    sg_shader shader;
+    // Set by renderer_draw_star_field() for the current frame.
+    bool drawn;
+    Star_Field_Desc desc;
+};
+
 struct Bloom_Mip
 {
+    // All mips share one mipmapped image, unless the backend can't sample
+    // one mip while rendering to another.
     sg_image img;
+    int mip_level;
+    // Limited to mip_level, for the pass that samples this mip.
+    sg_sampler smp;
     sg_attachments atts;
+    // The part of the mip that is rendered into, see Renderer.
     int width;
     int height;
     HMM_Vec2 texel_size;
+    // Where the rendered part ends in texture coordinates.
+    HMM_Vec2 uv_scale;
+    // Last texel center inside the rendered part, for clamping taps.
+    HMM_Vec2 uv_max;
+};
+
+struct Pipeline_Cache_Entry
+{
+    uint32_t key;
+    sg_pipeline pip;
+};
+
+// Pipelines are created the first time a combination of shader permutation,
+// MSAA sample count and color format is drawn with, and kept after that, so
+// switching back to a quality tier doesn't create anything.
+struct Pipeline_Cache
+{
+    Pipeline_Cache_Entry entries[pipeline_cache_max_count];
+    int count;
 };
 
 struct Game_Pass
@@ -79,24 +266,31 @@ struct Game_Pass
     HMM_Mat4 view_to_clip_transform;
 
     sg_pass_action pass_action;
-    sg_image msaa_images[2];
-    sg_image resolve_images[2];
+    // Only used when MSAA is enabled, otherwise the pass renders straight
+    // into the resolve image.
+    sg_image msaa_image;
+    sg_image resolve_image;
     sg_image depth_image;
     sg_attachments atts;
-    Draw_Call draw_calls[draw_calls_max_count];
-    int draw_calls_count;
-    sg_pipeline phong_pip;
-    Basic_Box_Instance basic_instances[basic_box_instances_max_count];
-    int basic_instances_count;
+    // The draw calls and instances are in the frame arena, and the instance
+    // buffer grows to fit the largest frame so far.
+    Arena_Array<Draw_Call> draw_calls;
+    // Created on first use.
+    sg_shader phong_shaders[phong_permutations_count];
+    Arena_Array<Basic_Box_Instance> basic_instances;
     sg_buffer basic_instances_buffer;
-    sg_pipeline basic_pip;
+    size_t basic_instances_buffer_size;
+    sg_shader basic_shader;
+    Pipeline_Cache pipelines;
 };
 
 struct Bloom_Pass
 {
     Bloom_Mip mips[bloom_mips_count];
+    bool mip_chain;
     sg_pass_action down_sample_pass_action;
     sg_pass_action up_sample_pass_action;
+    sg_pipeline prefilter_pip;
     sg_pipeline down_sample_pip;
     sg_pipeline up_sample_pip;
 };
@@ -104,30 +298,148 @@ struct Bloom_Pass
 struct Combine_Display_Pass
 {
     sg_pass_action pass_action;
+    // The shader and pipelines are created on first use.
+    sg_shader shader;
+    sg_pipeline pip;
+    // With FXAA the combined image is rendered into ldr_image first.
+    sg_pipeline ldr_pip;
+    sg_image ldr_image;
+    sg_attachments ldr_atts;
+};
+
+struct Fxaa_Pass
+{
+    sg_pass_action pass_action;
+    // The shader and pipelines are created on first use.
+    sg_shader shader;
+    sg_pipeline pip;
+    sg_pipeline offscreen_pip;
+};
+
+// With offscreen enabled the final image is rendered into image instead of
+// the swapchain, then copied to the swapchain. This keeps a copy around that
+// can be read back, e.g. for frame capture.
+struct Display_Pass
+{
+    bool offscreen;
+    sg_pass_action pass_action;
+    // Created on first use.
     sg_pipeline pip;
+    sg_image image;
+    sg_attachments atts;
+};
+
+// Picks the resolution scale of the game pass from the measured frame time.
+// Drops quickly when frames go over budget, and only probes back up after
+// a long run of frames within budget. Each failed probe doubles the wait
+// before the next one, so a GPU sitting right at the budget settles instead
+// of flipping between two scales.
+struct Render_Scaler
+{
+    bool enabled;
+    float scale;
+    double budget_secs;
+    double average_frame_secs;
+    int over_budget_frames;
+    int within_budget_frames;
+    int probe_frames;
+    bool probing;
+};
+
+// Time spent creating GPU objects since startup. Most of it is spent in
+// renderer_init(), the rest whenever a lazily created object is first used.
+struct Renderer_Create_Stats
+{
+    int shaders_count;
+    double shaders_secs;
+    int pipelines_count;
+    double pipelines_secs;
+    int target_allocations_count;
+    double targets_secs;
 };
 
 struct Renderer
 {
+    // Per-frame data lives here, see renderer_begin_frame().
+    Frame_Arena *frame_arena;
     Quad_Geometry quad;
     Box_Geometry box;
     Text_Geometry text;
+    Star_Field star_field;
     sg_sampler smp;
+    Render_Quality quality;
+    Frame_Graph frame_graph;
     int framebuffer_width;
     int framebuffer_height;
+    // Size the full resolution render targets are allocated at. While the
+    // window is being resized this can be larger than the framebuffer, and
+    // every pass renders into the render size part of its targets, starting
+    // at texture coordinate (0, 0).
+    int target_width;
+    int target_height;
+    int render_width;
+    int render_height;
+    HMM_Vec2 render_uv_scale;
+    HMM_Vec2 render_uv_max;
+    double resize_idle_secs;
+    Render_Scaler scaler;
     Game_Pass game_pass;
     Bloom_Pass bloom_pass;
     Combine_Display_Pass combine_display_pass;
+    Fxaa_Pass fxaa_pass;
+    Display_Pass display_pass;
+    Renderer_Create_Stats create_stats;
 };
 
-void renderer_init(Renderer &r, int framebuffer_width, int framebuffer_height);
+void renderer_init(Renderer &r, Frame_Arena &frame_arena, int framebuffer_width,
+                   int framebuffer_height);
+// Starts collecting the draws of a new frame in the current frame arena. Has
+// to be called after frame_arena_begin() and before anything is drawn.
+void renderer_begin_frame(Renderer &r);
+// Cheap to call for every resize event. Only allocates when the framebuffer
+// outgrows the render targets, and then leaves room to keep growing if
+// another resize came in shortly before.
 void renderer_resize(Renderer &r, int framebuffer_width,
                      int framebuffer_height);
+// Reallocates the render targets at the exact framebuffer size once no
+// resize has come in for a while.
+void renderer_update_resize(Renderer &r, double frame_time_secs);
+// Switches anti-aliasing and HDR format at runtime. Rebuilds the game pass
+// pipelines and every render target.
+void renderer_set_quality(Renderer &r, const Render_Quality &quality);
+// The final image ends up in r.display_pass.image, covering the top left
+// framebuffer size part of it.
+void renderer_set_offscreen_display(Renderer &r, bool offscreen);
+Render_Quality renderer_quality_tier(Render_Quality_Tier tier);
+const char *renderer_quality_tier_name(Render_Quality_Tier tier);
+Render_Quality_Cost renderer_estimate_quality_cost(
+    const Render_Quality &quality, int width, int height);
+// Feeds the last frame's duration to the render scaler. The game pass is
+// rendered at the scaled resolution and upscaled when it is displayed.
+// Changing the scale never reallocates the render targets.
+void renderer_update_render_scale(Renderer &r, double frame_time_secs);
 
 void renderer_draw_basic_box_instance(Renderer &r, HMM_Vec3 position,
                                       HMM_Vec3 rotation, HMM_Vec3 scale,
                                       HMM_Vec3 color);
+// Reserves count consecutive instances to be filled in with
+// renderer_set_basic_box_instance(). Each thread can then write its own slice
+// of the instance array without any locking.
+Basic_Box_Instance *renderer_push_basic_box_instances(Renderer &r, int count);
+void renderer_set_basic_box_instance(Basic_Box_Instance &instance,
+                                     HMM_Vec3 position, HMM_Vec3 rotation,
+                                     HMM_Vec3 scale, HMM_Vec3 color);
+// At most once per frame. Costs the same on the CPU whatever the count.
+void renderer_draw_star_field(Renderer &r, const Star_Field_Desc &desc);
 void renderer_draw_phong_box(Renderer &r, HMM_Vec3 position, HMM_Vec3 rotation,
                              HMM_Vec3 scale, HMM_Vec3 color);
+// Draws uppercase text in the game pass, lowercase letters are drawn as
+// uppercase. position is the left, center or right end of the first line's
+// baseline depending on align, size is the cap height in world units, and
+// '\n' starts a new line. Text is blended over the scene after everything
+// else and doesn't write depth.
+void renderer_draw_text(Renderer &r, const char *text, HMM_Vec3 position,
+                        HMM_Vec3 rotation, float size, HMM_Vec3 color,
+                        Text_Align align);
 
 void renderer_render(Renderer &r, sg_swapchain swapchain);
@@ -0,0 +1,528 @@
+#include "replay.h"
+#include "fast_math.h"
+#include "game.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+// Everything is little endian.
+static constexpr char replay_magic[4] = {'P', '3', 'D', 'R'};
+static constexpr char replay_index_magic[4] = {'P', '3', 'D', 'I'};
+// Magic, version, seed, keyframe interval, the size of Game, which changes
+// whenever the layout of the saved state is likely to, and the math mode.
+static constexpr size_t replay_header_size = 24;
+// Index offset, ticks count, keyframes count and index magic.
+static constexpr size_t replay_trailer_size = 24;
+// Tick, last input state and state size, followed by the state. The runs
+// and the hashes that follow are each prefixed with their size.
+static constexpr size_t replay_keyframe_header_size = 14;
+
+static void replay_put_u16(uint8_t *dst, uint32_t value)
+{
+    dst[0] = static_cast<uint8_t>(value);
+    dst[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void replay_put_u32(uint8_t *dst, uint32_t value)
+{
+    for (int i = 0; i < 4; i += 1)
+    {
+        dst[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+static void replay_put_u64(uint8_t *dst, uint64_t value)
+{
+    for (int i = 0; i < 8; i += 1)
+    {
+        dst[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+static uint16_t replay_get_u16(const uint8_t *src)
+{
+    return static_cast<uint16_t>(src[0] | (src[1] << 8));
+}
+
+static uint32_t replay_get_u32(const uint8_t *src)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i += 1)
+    {
+        value |= static_cast<uint32_t>(src[i]) << (i * 8);
+    }
+    return value;
+}
+
+static uint64_t replay_get_u64(const uint8_t *src)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i += 1)
+    {
+        value |= static_cast<uint64_t>(src[i]) << (i * 8);
+    }
+    return value;
+}
+
+// LEB128, 7 bits per byte, lowest first.
+static size_t replay_put_varint(uint8_t *dst, uint32_t value)
+{
+    size_t size = 0;
+    while (value >= 0x80)
+    {
+        dst[size] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+        size += 1;
+    }
+    dst[size] = static_cast<uint8_t>(value);
+    return size + 1;
+}
+
+static uint32_t replay_get_varint(const uint8_t *&src, const uint8_t *end)
+{
+    uint32_t value = 0;
+    for (int shift = 0; src < end && shift < 32; shift += 7)
+    {
+        uint8_t byte = *src++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            break;
+        }
+    }
+    return value;
+}
+
+static void replay_write(Replay_Writer &w, const void *data, size_t size)
+{
+    fwrite(data, 1, size, w.file);
+    w.offset += size;
+}
+
+bool replay_writer_open(Replay_Writer &w, const char *path, uint32_t seed)
+{
+    w = {};
+    w.file = fopen(path, "wb");
+    if (!w.file)
+    {
+        printf("replay: can't open %s\n", path);
+        return false;
+    }
+
+    uint8_t header[replay_header_size];
+    memcpy(header, replay_magic, 4);
+    replay_put_u32(header + 4, replay_version);
+    replay_put_u32(header + 8, seed);
+    replay_put_u32(header + 12, replay_keyframe_interval);
+    replay_put_u32(header + 16, sizeof(Game));
+    replay_put_u32(header + 20, static_cast<uint32_t>(fast_math_mode()));
+    replay_write(w, header, sizeof(header));
+    printf("replay: recording to %s\n", path);
+    return true;
+}
+
+static void replay_writer_end_run(Replay_Writer &w)
+{
+    if (w.run_length == 0)
+    {
+        return;
+    }
+    w.runs_size += replay_put_varint(w.runs + w.runs_size, w.run_length);
+    w.runs_size += replay_put_varint(w.runs + w.runs_size, w.run_state);
+    w.run_length = 0;
+}
+
+static void replay_writer_end_segment(Replay_Writer &w)
+{
+    replay_writer_end_run(w);
+    uint8_t size[4];
+    replay_put_u32(size, static_cast<uint32_t>(w.runs_size));
+    replay_write(w, size, sizeof(size));
+    replay_write(w, w.runs, w.runs_size);
+    w.runs_size = 0;
+
+    replay_put_u32(size, static_cast<uint32_t>(w.hashes_count));
+    replay_write(w, size, sizeof(size));
+    for (int i = 0; i < w.hashes_count; i += 1)
+    {
+        uint8_t hash[8];
+        replay_put_u64(hash, w.hashes[i]);
+        replay_write(w, hash, sizeof(hash));
+    }
+    w.hashes_count = 0;
+}
+
+static void replay_writer_keyframe(Replay_Writer &w, const Game &g,
+                                   uint16_t last_input_state)
+{
+    if (w.keyframes_count == w.keyframes_capacity)
+    {
+        w.keyframes_capacity =
+            w.keyframes_capacity > 0 ? w.keyframes_capacity * 2 : 64;
+        w.keyframe_offsets = static_cast<uint64_t *>(
+            realloc(w.keyframe_offsets,
+                    sizeof(uint64_t) * w.keyframes_capacity));
+    }
+    w.keyframe_offsets[w.keyframes_count] = w.offset;
+    w.keyframes_count += 1;
+
+    size_t state_size = game_state_size(g);
+    if (state_size > w.state_capacity)
+    {
+        w.state_capacity = state_size;
+        w.state = static_cast<uint8_t *>(realloc(w.state, state_size));
+    }
+    game_save_state(g, w.state);
+
+    uint8_t header[replay_keyframe_header_size];
+    replay_put_u64(header, w.ticks_count);
+    replay_put_u16(header + 8, last_input_state);
+    replay_put_u32(header + 10, static_cast<uint32_t>(state_size));
+    replay_write(w, header, sizeof(header));
+    replay_write(w, w.state, state_size);
+}
+
+void replay_writer_tick(Replay_Writer &w, const Game &g,
+                        uint16_t last_input_state, uint16_t input_state)
+{
+    if (w.ticks_count % replay_keyframe_interval == 0)
+    {
+        if (w.keyframes_count > 0)
+        {
+            replay_writer_end_segment(w);
+        }
+        replay_writer_keyframe(w, g, last_input_state);
+    }
+
+    if (w.run_length == 0 || input_state != w.run_state)
+    {
+        replay_writer_end_run(w);
+        w.run_state = input_state;
+    }
+    w.run_length += 1;
+    w.ticks_count += 1;
+}
+
+void replay_writer_hash(Replay_Writer &w, uint64_t hash)
+{
+    assert(w.hashes_count < replay_keyframe_interval);
+    w.hashes[w.hashes_count] = hash;
+    w.hashes_count += 1;
+}
+
+void replay_writer_close(Replay_Writer &w)
+{
+    if (!w.file)
+    {
+        return;
+    }
+
+    if (w.keyframes_count > 0)
+    {
+        replay_writer_end_segment(w);
+    }
+
+    uint64_t index_offset = w.offset;
+    for (int i = 0; i < w.keyframes_count; i += 1)
+    {
+        uint8_t offset[8];
+        replay_put_u64(offset, w.keyframe_offsets[i]);
+        replay_write(w, offset, sizeof(offset));
+    }
+    uint8_t trailer[replay_trailer_size];
+    replay_put_u64(trailer, index_offset);
+    replay_put_u64(trailer + 8, w.ticks_count);
+    replay_put_u32(trailer + 16, static_cast<uint32_t>(w.keyframes_count));
+    memcpy(trailer + 20, replay_index_magic, 4);
+    replay_write(w, trailer, sizeof(trailer));
+    fclose(w.file);
+
+    printf("replay: recorded %llu ticks, %d keyframes, %.2fMB\n",
+           static_cast<unsigned long long>(w.ticks_count), w.keyframes_count,
+           static_cast<double>(w.offset) / (1024.0 * 1024.0));
+    free(w.state);
+    free(w.keyframe_offsets);
+    w = {};
+}
+
+struct Replay_Segment
+{
+    uint64_t tick;
+    uint16_t last_input_state;
+    const uint8_t *state;
+    size_t state_size;
+    const uint8_t *runs;
+    const uint8_t *runs_end;
+    // Count prefixed.
+    const uint8_t *hashes;
+    uint32_t hashes_count;
+    const uint8_t *end;
+};
+
+// False if any part of the segment at offset lies outside the file.
+static bool replay_reader_parse_segment(const Replay_Reader &r,
+                                        uint64_t offset, Replay_Segment &s)
+{
+    const uint8_t *data = r.map.data;
+    uint64_t size = r.map.size;
+    if (offset > size || size - offset < replay_keyframe_header_size)
+    {
+        return false;
+    }
+    s = {};
+    s.tick = replay_get_u64(data + offset);
+    s.last_input_state = replay_get_u16(data + offset + 8);
+    s.state_size = replay_get_u32(data + offset + 10);
+    offset += replay_keyframe_header_size;
+    if (size - offset < s.state_size + 4)
+    {
+        return false;
+    }
+    s.state = data + offset;
+    offset += s.state_size;
+    uint64_t runs_size = replay_get_u32(data + offset);
+    offset += 4;
+    if (size - offset < runs_size + 4)
+    {
+        return false;
+    }
+    s.runs = data + offset;
+    offset += runs_size;
+    s.runs_end = data + offset;
+    s.hashes = data + offset;
+    s.hashes_count = replay_get_u32(data + offset);
+    offset += 4;
+    if ((size - offset) / sizeof(uint64_t) < s.hashes_count)
+    {
+        return false;
+    }
+    s.end = data + offset + s.hashes_count * sizeof(uint64_t);
+    return true;
+}
+
+// Only for segments replay_reader_check() has been through.
+static Replay_Segment replay_reader_segment(const Replay_Reader &r,
+                                            uint64_t offset)
+{
+    Replay_Segment s;
+    bool parsed = replay_reader_parse_segment(r, offset, s);
+    assert(parsed);
+    (void)parsed;
+    return s;
+}
+
+// Whether the runs are whole varints and add up to ticks_count ticks, none
+// of them empty.
+static bool replay_runs_valid(const uint8_t *runs, const uint8_t *runs_end,
+                              uint64_t ticks_count)
+{
+    uint64_t runs_ticks = 0;
+    while (runs < runs_end)
+    {
+        uint32_t length = replay_get_varint(runs, runs_end);
+        if (length == 0 || runs == runs_end || (runs[-1] & 0x80))
+        {
+            return false;
+        }
+        replay_get_varint(runs, runs_end);
+        if (runs[-1] & 0x80)
+        {
+            return false;
+        }
+        runs_ticks += length;
+    }
+    return runs_ticks == ticks_count;
+}
+
+// Walks every segment, so nothing read from the file later can point
+// outside it or load a state that doesn't fit its config. Touches the
+// header, the runs and the particle count of each segment, not the states.
+static bool replay_reader_check(const Replay_Reader &r,
+                                uint64_t index_offset)
+{
+    auto interval = static_cast<uint64_t>(r.keyframe_interval);
+    if (r.ticks_count > interval * static_cast<uint64_t>(r.keyframes_count))
+    {
+        return false;
+    }
+    uint64_t offset = replay_header_size;
+    for (int i = 0; i < r.keyframes_count; i += 1)
+    {
+        Replay_Segment s;
+        if (replay_get_u64(r.index + i * sizeof(uint64_t)) != offset ||
+            !replay_reader_parse_segment(r, offset, s) ||
+            s.tick != static_cast<uint64_t>(i) * interval ||
+            s.tick >= r.ticks_count)
+        {
+            return false;
+        }
+        uint64_t ticks_count = std::min(interval, r.ticks_count - s.tick);
+        if (s.hashes_count != ticks_count ||
+            !replay_runs_valid(s.runs, s.runs_end, ticks_count) ||
+            !game_state_valid(s.state, s.state_size))
+        {
+            return false;
+        }
+        offset = static_cast<uint64_t>(s.end - r.map.data);
+    }
+    return offset == index_offset;
+}
+
+bool replay_reader_open(Replay_Reader &r, const char *path)
+{
+    r = {};
+    if (!file_map_open(r.map, path))
+    {
+        printf("replay: can't open %s\n", path);
+        return false;
+    }
+
+    const uint8_t *data = r.map.data;
+    size_t size = r.map.size;
+    const uint8_t *trailer = nullptr;
+    if (size >= replay_header_size + replay_trailer_size)
+    {
+        trailer = data + size - replay_trailer_size;
+    }
+    if (!trailer || memcmp(data, replay_magic, 4) != 0 ||
+        memcmp(trailer + 20, replay_index_magic, 4) != 0)
+    {
+        printf("replay: %s is not a complete replay\n", path);
+        replay_reader_close(r);
+        return false;
+    }
+    if (replay_get_u32(data + 4) != replay_version ||
+        replay_get_u32(data + 16) != sizeof(Game))
+    {
+        printf("replay: %s was recorded by a different version\n", path);
+        replay_reader_close(r);
+        return false;
+    }
+    // The sim only plays back the same in the math mode it was recorded in.
+    uint32_t math_mode = replay_get_u32(data + 20);
+    if (math_mode >= FAST_MATH_MODE_COUNT)
+    {
+        printf("replay: %s has an unknown math mode\n", path);
+        replay_reader_close(r);
+        return false;
+    }
+    if (math_mode != static_cast<uint32_t>(fast_math_mode()))
+    {
+        printf("replay: %s was recorded with --math=%s, switching to it\n",
+               path, math_mode == FAST_MATH_MODE_LIBM ? "libm" : "fast");
+        fast_math_set_mode(static_cast<Fast_Math_Mode>(math_mode));
+    }
+
+    r.seed = replay_get_u32(data + 8);
+    r.keyframe_interval = static_cast<int>(replay_get_u32(data + 12));
+    uint64_t index_offset = replay_get_u64(trailer);
+    r.ticks_count = replay_get_u64(trailer + 8);
+    uint32_t keyframes_count = replay_get_u32(trailer + 16);
+    uint64_t index_end = size - replay_trailer_size;
+    if (keyframes_count == 0 || keyframes_count > INT32_MAX ||
+        r.keyframe_interval <= 0 || index_offset > index_end ||
+        (index_end - index_offset) / sizeof(uint64_t) != keyframes_count ||
+        (index_end - index_offset) % sizeof(uint64_t) != 0)
+    {
+        printf("replay: %s has a broken index\n", path);
+        replay_reader_close(r);
+        return false;
+    }
+    r.keyframes_count = static_cast<int>(keyframes_count);
+    r.index = data + index_offset;
+    if (!replay_reader_check(r, index_offset))
+    {
+        printf("replay: %s is damaged\n", path);
+        replay_reader_close(r);
+        return false;
+    }
+    printf("replay: playing %s, %llu ticks\n", path,
+           static_cast<unsigned long long>(r.ticks_count));
+    return true;
+}
+
+void replay_reader_close(Replay_Reader &r)
+{
+    file_map_close(r.map);
+    r = {};
+}
+
+static uint64_t replay_reader_segment_offset(const Replay_Reader &r,
+                                             uint64_t tick)
+{
+    uint64_t keyframe = tick / static_cast<uint64_t>(r.keyframe_interval);
+    if (keyframe >= static_cast<uint64_t>(r.keyframes_count))
+    {
+        keyframe = static_cast<uint64_t>(r.keyframes_count) - 1;
+    }
+    return replay_get_u64(r.index + keyframe * sizeof(uint64_t));
+}
+
+// Starts reading the segment at offset. Loads its keyframe into g unless g
+// is null, which is the case when playback just runs into the segment and
+// the game is already in that state.
+static uint64_t replay_reader_enter_segment(Replay_Reader &r, uint64_t offset,
+                                            Game *g,
+                                            uint16_t &last_input_state)
+{
+    Replay_Segment s = replay_reader_segment(r, offset);
+    if (g)
+    {
+        game_load_state(*g, s.state);
+    }
+    last_input_state = s.last_input_state;
+
+    r.tick = s.tick;
+    r.runs = s.runs;
+    r.runs_end = s.runs_end;
+    r.segment_end = s.end;
+    r.run_left = 0;
+    return s.tick;
+}
+
+uint64_t replay_reader_seek(Replay_Reader &r, Game &g, uint64_t tick,
+                            uint16_t &last_input_state)
+{
+    return replay_reader_enter_segment(
+        r, replay_reader_segment_offset(r, tick), &g, last_input_state);
+}
+
+bool replay_reader_next(Replay_Reader &r, uint16_t &input_state)
+{
+    if (r.tick >= r.ticks_count)
+    {
+        return false;
+    }
+
+    if (r.run_left == 0)
+    {
+        if (r.runs == r.runs_end)
+        {
+            // The next segment starts right after this one.
+            uint16_t last_input_state;
+            replay_reader_enter_segment(
+                r, static_cast<uint64_t>(r.segment_end - r.map.data),
+                nullptr, last_input_state);
+        }
+        r.run_left = replay_get_varint(r.runs, r.runs_end);
+        r.run_state =
+            static_cast<uint16_t>(replay_get_varint(r.runs, r.runs_end));
+        assert(r.run_left > 0);
+    }
+
+    input_state = r.run_state;
+    r.run_left -= 1;
+    r.tick += 1;
+    return true;
+}
+
+uint64_t replay_reader_hash(const Replay_Reader &r, uint64_t tick)
+{
+    assert(tick < r.ticks_count);
+    Replay_Segment s =
+        replay_reader_segment(r, replay_reader_segment_offset(r, tick));
+    uint64_t index = tick - s.tick;
+    assert(index < s.hashes_count);
+    return replay_get_u64(s.hashes + 4 + index * sizeof(uint64_t));
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "file_map.h"
+#include <cstdint>
+#include <cstdio>
+
+struct Game;
+
+inline constexpr uint32_t replay_version = 3;
+// Ticks between keyframes. Seeking restores the keyframe at or before the
+// target and re-simulates fewer than this many ticks.
+inline constexpr int replay_keyframe_interval = 300;
+
+// Records the player's input and the game_hash() every tick, and the whole
+// game state every replay_keyframe_interval ticks. The file is a header,
+// then one segment per keyframe: the keyframe, the input of its ticks as
+// runs of equal states and the hashes of its ticks. An index of the
+// segments is written at the end.
+struct Replay_Writer
+{
+    FILE *file;
+    uint64_t offset;
+    uint64_t ticks_count;
+    // The current segment's runs, a varint tick count followed by a varint
+    // input state each. A run is at most 5 bytes and a tick starts at most
+    // one run.
+    uint8_t runs[replay_keyframe_interval * 5];
+    size_t runs_size;
+    uint16_t run_state;
+    uint32_t run_length;
+    uint64_t hashes[replay_keyframe_interval];
+    int hashes_count;
+    uint8_t *state;
+    size_t state_capacity;
+    uint64_t *keyframe_offsets;
+    int keyframes_count;
+    int keyframes_capacity;
+};
+
+bool replay_writer_open(Replay_Writer &w, const char *path, uint32_t seed);
+// Call before each tick is simulated, with the input state the tick sees
+// and the one the tick before saw.
+void replay_writer_tick(Replay_Writer &w, const Game &g,
+                        uint16_t last_input_state, uint16_t input_state);
+// Call after each tick is simulated, with the game_hash() of the result.
+void replay_writer_hash(Replay_Writer &w, uint64_t hash);
+// Writes the index. A replay that wasn't closed can't be played back.
+void replay_writer_close(Replay_Writer &w);
+
+// Plays a replay straight from a memory mapped file, so opening it and
+// seeking only touch the pages that are needed, however long it is.
+struct Replay_Reader
+{
+    File_Map map;
+    uint32_t seed;
+    int keyframe_interval;
+    uint64_t ticks_count;
+    const uint8_t *index;
+    int keyframes_count;
+    // The next tick to be read and where its input is.
+    uint64_t tick;
+    const uint8_t *runs;
+    const uint8_t *runs_end;
+    const uint8_t *segment_end;
+    uint16_t run_state;
+    uint32_t run_left;
+};
+
+bool replay_reader_open(Replay_Reader &r, const char *path);
+void replay_reader_close(Replay_Reader &r);
+// Loads the last keyframe at or before tick into g and continues reading
+// from there. Returns the keyframe's tick, the input state of the tick
+// before it goes into last_input_state.
+uint64_t replay_reader_seek(Replay_Reader &r, Game &g, uint64_t tick,
+                            uint16_t &last_input_state);
+// The input state of the next tick. False once every tick has been read.
+bool replay_reader_next(Replay_Reader &r, uint16_t &input_state);
+// The game_hash() recorded after tick was simulated. Doesn't move the read
+// position.
+uint64_t replay_reader_hash(const Replay_Reader &r, uint64_t tick);
@@ -0,0 +1,34 @@
+@module blit
+
+@ctype vec2 HMM_Vec2
+
+@vs vs
+in vec2 a_obj_position;
+in vec2 a_obj_uv;
+
+out vec2 v_uv;
+
+void main() {
+  v_uv = a_obj_uv;
+  gl_Position = vec4(a_obj_position.xy, 0.0, 1.0);
+}
+@end
+
+@fs fs
+layout(binding=0) uniform texture2D u_tex;
+layout(binding=0) uniform sampler u_smp;
+
+layout(binding=0) uniform fs_params {
+  vec2 u_uv_scale;
+};
+
+in vec2 v_uv;
+
+out vec4 frag_color;
+
+void main() {
+  frag_color = vec4(texture(sampler2D(u_tex, u_smp), v_uv * u_uv_scale).rgb, 1.0);
+}
+@end
+
+@program program vs fs
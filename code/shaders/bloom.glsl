@@ -14,6 +14,71 @@ void main() {
 }
 @end
 
+@block down_sample_13
+// Render targets can be larger than the area that was rendered into (see
+// renderer_resize), so taps are clamped to uv_max instead of relying on the
+// sampler's clamp to edge.
+vec3 down_sample_tap(vec2 uv, vec2 uv_max, float lod) {
+  return textureLod(sampler2D(u_down_sample_tex, u_down_sample_smp), min(uv, uv_max), lod).rgb;
+}
+
+// 13-tap box filter from "Next Generation Post Processing in Call of Duty:
+// Advanced Warfare". The bloom chain lives in the mips of one image, so the
+// source mip is picked explicitly.
+vec3 down_sample_13(vec2 uv, vec2 texel_size, vec2 uv_max, float lod) {
+  float x = texel_size.x;
+  float y = texel_size.y;
+  vec3 a = down_sample_tap(vec2(uv.x - 2*x, uv.y + 2*y), uv_max, lod);
+  vec3 b = down_sample_tap(vec2(uv.x,       uv.y + 2*y), uv_max, lod);
+  vec3 c = down_sample_tap(vec2(uv.x + 2*x, uv.y + 2*y), uv_max, lod);
+  vec3 d = down_sample_tap(vec2(uv.x - 2*x, uv.y), uv_max, lod);
+  vec3 e = down_sample_tap(vec2(uv.x,       uv.y), uv_max, lod);
+  vec3 f = down_sample_tap(vec2(uv.x + 2*x, uv.y), uv_max, lod);
+  vec3 g = down_sample_tap(vec2(uv.x - 2*x, uv.y - 2*y), uv_max, lod);
+  vec3 h = down_sample_tap(vec2(uv.x,       uv.y - 2*y), uv_max, lod);
+  vec3 i = down_sample_tap(vec2(uv.x + 2*x, uv.y - 2*y), uv_max, lod);
+  vec3 j = down_sample_tap(vec2(uv.x - x,   uv.y + y), uv_max, lod);
+  vec3 k = down_sample_tap(vec2(uv.x + x,   uv.y + y), uv_max, lod);
+  vec3 l = down_sample_tap(vec2(uv.x - x,   uv.y - y), uv_max, lod);
+  vec3 m = down_sample_tap(vec2(uv.x + x,   uv.y - y), uv_max, lod);
+  vec3 color = e*0.125;
+  color += (a+c+g+i)*0.03125;
+  color += (b+d+f+h)*0.0625;
+  color += (j+k+l+m)*0.125;
+  return color;
+}
+@end
+
+@fs fs_prefilter
+in vec2 v_uv;
+
+out vec3 frag_color;
+
+layout(binding=0) uniform texture2D u_down_sample_tex;
+layout(binding=0) uniform sampler u_down_sample_smp;
+
+layout(binding=0) uniform fs_prefilter_uniforms {
+  vec2 u_texel_size;
+  vec2 u_uv_scale;
+  vec2 u_uv_max;
+  float u_threshold;
+  float u_knee;
+};
+
+@include_block down_sample_13
+
+void main() {
+  // Keep only the bright part of the scene, with a soft knee below the
+  // threshold so pixels don't pop in and out of the bloom.
+  vec3 color = down_sample_13(v_uv * u_uv_scale, u_texel_size, u_uv_max, 0.0);
+  float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+  float soft = clamp(brightness - u_threshold + u_knee, 0.0, 2.0 * u_knee);
+  soft = soft * soft / (4.0 * u_knee + 0.00001);
+  float contribution = max(soft, brightness - u_threshold) / max(brightness, 0.00001);
+  frag_color = max(color * contribution, 0.0001f);
+}
+@end
+
 @fs fs_down_sample
 in vec2 v_uv;
 
@@ -24,29 +89,16 @@ layout(binding=0) uniform sampler u_down_sample_smp;
 
 layout(binding=0) uniform fs_down_sample_uniforms {
   vec2 u_texel_size;
+  vec2 u_uv_scale;
+  vec2 u_uv_max;
+  float u_src_lod;
 };
 
+@include_block down_sample_13
+
 void main() {
-  float x = u_texel_size.x;
-  float y = u_texel_size.y;
-  vec3 a = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x - 2*x, v_uv.y + 2*y)).rgb;
-  vec3 b = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x,       v_uv.y + 2*y)).rgb;
-  vec3 c = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x + 2*x, v_uv.y + 2*y)).rgb;
-  vec3 d = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x - 2*x, v_uv.y)).rgb;
-  vec3 e = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x,       v_uv.y)).rgb;
-  vec3 f = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x + 2*x, v_uv.y)).rgb;
-  vec3 g = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x - 2*x, v_uv.y - 2*y)).rgb;
-  vec3 h = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x,       v_uv.y - 2*y)).rgb;
-  vec3 i = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x + 2*x, v_uv.y - 2*y)).rgb;
-  vec3 j = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x - x,   v_uv.y + y)).rgb;
-  vec3 k = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x + x,   v_uv.y + y)).rgb;
-  vec3 l = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x - x,   v_uv.y - y)).rgb;
-  vec3 m = texture(sampler2D(u_down_sample_tex, u_down_sample_smp), vec2(v_uv.x + x,   v_uv.y - y)).rgb;
-  frag_color = e*0.125;
-  frag_color += (a+c+g+i)*0.03125;
-  frag_color += (b+d+f+h)*0.0625;
-  frag_color += (j+k+l+m)*0.125;
-  frag_color = max(frag_color, 0.0001f);
+  vec2 uv = v_uv * u_uv_scale;
+  frag_color = max(down_sample_13(uv, u_texel_size, u_uv_max, u_src_lod), 0.0001f);
 }
 @end
 
@@ -59,21 +111,29 @@ layout(binding=0) uniform texture2D u_up_sample_tex;
 layout(binding=0) uniform sampler u_up_sample_smp;
 
 layout(binding=0) uniform fs_up_sample_uniforms {
-  float u_filter_radius;
+  vec2 u_filter_radius;
+  vec2 u_uv_scale;
+  vec2 u_uv_max;
+  float u_src_lod;
 };
 
+vec3 up_sample_tap(vec2 uv) {
+  return textureLod(sampler2D(u_up_sample_tex, u_up_sample_smp), min(uv, u_uv_max), u_src_lod).rgb;
+}
+
 void main() {
-  float x = u_filter_radius;
-  float y = u_filter_radius;
-  vec3 a = texture(sampler2D(u_up_sample_tex, u_up_sample_smp), vec2(v_uv.x - x, v_uv.y + y)).rgb;
-  vec3 b = texture(sampler2D(u_up_sample_tex, u_up_sample_smp), vec2(v_uv.x,     v_uv.y + y)).rgb;
-  vec3 c = texture(sampler2D(u_up_sample_tex, u_up_sample_smp), vec2(v_uv.x + x, v_uv.y + y)).rgb;
-  vec3 d = texture(sampler2D(u_up_sample_tex, u_up_sample_smp), vec2(v_uv.x - x, v_uv.y)).rgb;
-  vec3 e = texture(sampler2D(u_up_sample_tex, u_up_sample_smp), vec2(v_uv.x,     v_uv.y)).rgb;
-  vec3 f = texture(sampler2D(u_up_sample_tex, u_up_sample_smp), vec2(v_uv.x + x, v_uv.y)).rgb;
-  vec3 g = texture(sampler2D(u_up_sample_tex, u_up_sample_smp), vec2(v_uv.x - x, v_uv.y - y)).rgb;
-  vec3 h = texture(sampler2D(u_up_sample_tex, u_up_sample_smp), vec2(v_uv.x,     v_uv.y - y)).rgb;
-  vec3 i = texture(sampler2D(u_up_sample_tex, u_up_sample_smp), vec2(v_uv.x + x, v_uv.y - y)).rgb;
+  vec2 uv = v_uv * u_uv_scale;
+  float x = u_filter_radius.x;
+  float y = u_filter_radius.y;
+  vec3 a = up_sample_tap(vec2(uv.x - x, uv.y + y));
+  vec3 b = up_sample_tap(vec2(uv.x,     uv.y + y));
+  vec3 c = up_sample_tap(vec2(uv.x + x, uv.y + y));
+  vec3 d = up_sample_tap(vec2(uv.x - x, uv.y));
+  vec3 e = up_sample_tap(vec2(uv.x,     uv.y));
+  vec3 f = up_sample_tap(vec2(uv.x + x, uv.y));
+  vec3 g = up_sample_tap(vec2(uv.x - x, uv.y - y));
+  vec3 h = up_sample_tap(vec2(uv.x,     uv.y - y));
+  vec3 i = up_sample_tap(vec2(uv.x + x, uv.y - y));
   frag_color = e*4.0;
   frag_color += (b+d+f+h)*2.0;
   frag_color += (a+c+g+i);
@@ -81,5 +141,6 @@ void main() {
 }
 @end
 
+@program program_prefilter vs fs_prefilter
 @program program_down_sample vs fs_down_sample
 @program program_up_sample vs fs_up_sample
@@ -20,6 +20,8 @@ layout(binding=1) uniform texture2D u_tex_1;
 layout(binding=0) uniform sampler u_smp;
 
 layout(binding=0) uniform fs_params {
+  vec2 u_tex_0_uv_scale;
+  vec2 u_tex_1_uv_scale;
   float u_exposure;
   float u_bloom_strength;
 };
@@ -29,8 +31,8 @@ in vec2 v_uv;
 out vec4 frag_color;
 
 void main() {
-  vec3 hdr_color = texture(sampler2D(u_tex_0, u_smp), v_uv).rgb;
-  vec3 bloom_color = texture(sampler2D(u_tex_1, u_smp), v_uv).rgb;
+  vec3 hdr_color = texture(sampler2D(u_tex_0, u_smp), v_uv * u_tex_0_uv_scale).rgb;
+  vec3 bloom_color = texture(sampler2D(u_tex_1, u_smp), v_uv * u_tex_1_uv_scale).rgb;
   vec3 result = mix(hdr_color, bloom_color, u_bloom_strength);
   result = vec3(1.0) - exp(-result * u_exposure);
   result = pow(abs(result), vec3(1.0 / 2.2));
@@ -0,0 +1,86 @@
+@module fxaa
+
+@ctype vec2 HMM_Vec2
+
+@vs vs
+in vec2 a_obj_position;
+in vec2 a_obj_uv;
+
+out vec2 v_uv;
+
+void main() {
+  v_uv = a_obj_uv;
+  gl_Position = vec4(a_obj_position.xy, 0.0, 1.0);
+}
+@end
+
+@fs fs
+layout(binding=0) uniform texture2D u_tex;
+layout(binding=0) uniform sampler u_smp;
+
+layout(binding=0) uniform fs_params {
+  vec2 u_texel_size;
+  vec2 u_uv_scale;
+  vec2 u_uv_max;
+};
+
+in vec2 v_uv;
+
+out vec4 frag_color;
+
+const float fxaa_reduce_min = 1.0 / 128.0;
+const float fxaa_reduce_mul = 1.0 / 8.0;
+const float fxaa_span_max = 8.0;
+
+vec3 fxaa_tap(vec2 uv) {
+  return texture(sampler2D(u_tex, u_smp), min(uv, u_uv_max)).rgb;
+}
+
+float luma(vec3 color) {
+  return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+// Lottes' original FXAA "lite": estimate the edge direction from the luma of
+// the four diagonal neighbours and blur along it. Runs on the tone mapped,
+// gamma corrected image.
+void main() {
+  vec2 uv = v_uv * u_uv_scale;
+  vec3 rgb_nw = fxaa_tap(uv + vec2(-1.0, -1.0) * u_texel_size);
+  vec3 rgb_ne = fxaa_tap(uv + vec2(1.0, -1.0) * u_texel_size);
+  vec3 rgb_sw = fxaa_tap(uv + vec2(-1.0, 1.0) * u_texel_size);
+  vec3 rgb_se = fxaa_tap(uv + vec2(1.0, 1.0) * u_texel_size);
+  vec3 rgb_m = fxaa_tap(uv);
+
+  float luma_nw = luma(rgb_nw);
+  float luma_ne = luma(rgb_ne);
+  float luma_sw = luma(rgb_sw);
+  float luma_se = luma(rgb_se);
+  float luma_m = luma(rgb_m);
+  float luma_min = min(luma_m, min(min(luma_nw, luma_ne), min(luma_sw, luma_se)));
+  float luma_max = max(luma_m, max(max(luma_nw, luma_ne), max(luma_sw, luma_se)));
+
+  vec2 dir;
+  dir.x = -((luma_nw + luma_ne) - (luma_sw + luma_se));
+  dir.y = ((luma_nw + luma_sw) - (luma_ne + luma_se));
+
+  float dir_reduce = max((luma_nw + luma_ne + luma_sw + luma_se) * (0.25 * fxaa_reduce_mul), fxaa_reduce_min);
+  float rcp_dir_min = 1.0 / (min(abs(dir.x), abs(dir.y)) + dir_reduce);
+  dir = clamp(dir * rcp_dir_min, vec2(-fxaa_span_max), vec2(fxaa_span_max)) * u_texel_size;
+
+  vec3 rgb_a = 0.5 * (
+    fxaa_tap(uv + dir * (1.0 / 3.0 - 0.5)) +
+    fxaa_tap(uv + dir * (2.0 / 3.0 - 0.5)));
+  vec3 rgb_b = rgb_a * 0.5 + 0.25 * (
+    fxaa_tap(uv + dir * -0.5) +
+    fxaa_tap(uv + dir * 0.5));
+
+  float luma_b = luma(rgb_b);
+  if (luma_b < luma_min || luma_b > luma_max) {
+    frag_color = vec4(rgb_a, 1.0);
+  } else {
+    frag_color = vec4(rgb_b, 1.0);
+  }
+}
+@end
+
+@program program vs fs
@@ -23,16 +23,9 @@ void main() {
 @fs fs
 in vec3 color;
 
-layout(location=0) out vec4 frag_color;
-layout(location=1) out vec4 bright_color;
+out vec4 frag_color;
 
 void main() {
-  float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
-  if (brightness > 1.0) {
-    bright_color = vec4(color, 1.0);
-  } else {
-    bright_color = vec4(0.0, 0.0, 0.0, 1.0);
-  }
   frag_color = vec4(color, 1.0);
 }
 @end
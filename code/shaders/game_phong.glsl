@@ -1,5 +1,12 @@
 @module game_phong
 
+// Compiled once per combination of these defines, see CMakeLists.txt:
+//   POINT_LIGHT_0 - evaluate the point light, otherwise only the directional
+//                   light.
+//   SPECULAR      - add specular highlights.
+// Every permutation uses the same bindings and locations, so they share one
+// set of uniform structs and attribute slots.
+
 @ctype vec3 HMM_Vec3
 @ctype mat4 HMM_Mat4
 
@@ -10,11 +17,11 @@ layout(binding=0) uniform vs_params {
   mat4 u_view_to_clip_transform;
 };
 
-in vec3 a_obj_position;
-in vec3 a_obj_normal;
+layout(location=0) in vec3 a_obj_position;
+layout(location=1) in vec3 a_obj_normal;
 
-out vec3 v_view_position;
-out vec3 v_view_normal;
+layout(location=0) out vec3 v_view_position;
+layout(location=1) out vec3 v_view_normal;
 
 void main() {
   vec4 view_position = u_obj_to_view_transform * vec4(a_obj_position, 1.0);
@@ -31,6 +38,7 @@ layout(binding=1) uniform fs_dir_light {
   vec3 ambient;
 } u_dir_light;
 
+#ifdef POINT_LIGHT_0
 layout(binding=2) uniform fs_point_light_0 {
   vec3 view_position;
   vec3 color;
@@ -38,17 +46,17 @@ layout(binding=2) uniform fs_point_light_0 {
   float falloff;
   float radius;
 } u_point_light_0;
+#endif
 
 layout(binding=3) uniform fs_material {
   vec3 color;
   float shininess;
 } u_material;
 
-in vec3 v_view_position;
-in vec3 v_view_normal;
+layout(location=0) in vec3 v_view_position;
+layout(location=1) in vec3 v_view_normal;
 
 layout(location=0) out vec4 frag_color;
-layout(location=1) out vec4 bright_color;
 
 float attenuation(float r, float f, float d) {
   float denom = d / r + 1.0;
@@ -62,8 +70,12 @@ float compute_diffuse(vec3 L, vec3 N) {
 }
 
 float compute_specular(vec3 L, vec3 V, vec3 N, float shininess) {
+#ifdef SPECULAR
   vec3 R = -reflect(L, N);
   return pow(max(0.0, dot(V, R)), shininess);
+#else
+  return 0.0;
+#endif
 }
 
 vec3 point_light(vec3 light_view_pos, vec3 light_color, vec3 light_ambient,
@@ -91,16 +103,12 @@ void main() {
 
   vec3 color = vec3(0.0);
   color += directional_light(u_dir_light.direction, u_dir_light.color, u_dir_light.ambient, V, N);
+#ifdef POINT_LIGHT_0
   color += point_light(u_point_light_0.view_position, u_point_light_0.color,
                             u_point_light_0.ambient, u_point_light_0.falloff,
                             u_point_light_0.radius, V, N);
+#endif
 
-  float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
-  if (brightness > 1.0) {
-    bright_color = vec4(color, 1.0);
-  } else {
-    bright_color = vec4(0.0, 0.0, 0.0, 1.0);
-  }
   frag_color = vec4(color, 1.0);
 }
 @end
@@ -0,0 +1,114 @@
+@module stars
+
+@ctype vec4 HMM_Vec4
+@ctype mat4 HMM_Mat4
+
+@vs vs
+layout(binding=0) uniform vs_params {
+  mat4 u_world_to_clip_transform;
+  // star_field_colors_max_count.
+  vec4 u_colors[16];
+  float u_colors_count;
+  // Seconds since the stars first spawned.
+  float u_time;
+  float u_stream;
+  float u_eye_z;
+  float u_z_near;
+  float u_z_far;
+  float u_tan_half_fov;
+  float u_aspect;
+};
+
+in vec3 a_obj_position;
+// 32 random bits per star, as 4 normalized bytes.
+in vec4 inst_seed;
+
+out vec3 color;
+
+// lowbias32 from Chris Wellons' hash prospector.
+uint hash(uint x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// [0, 1), the k-th number of one spawn of a star.
+float rand(uint seed, uint spawn, uint k) {
+  return float(hash(seed ^ hash(spawn * 16u + k)) >> 8) * (1.0 / 16777216.0);
+}
+
+float ease_in_out(float t) {
+  return t < 0.5 ? 2.0 * t * t : -1.0 + (4.0 - 2.0 * t) * t;
+}
+
+mat3 rotation_x(float a) {
+  float s = sin(a), c = cos(a);
+  return mat3(1.0, 0.0, 0.0, 0.0, c, s, 0.0, -s, c);
+}
+
+mat3 rotation_y(float a) {
+  float s = sin(a), c = cos(a);
+  return mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+}
+
+mat3 rotation_z(float a) {
+  float s = sin(a), c = cos(a);
+  return mat3(c, s, 0.0, -s, c, 0.0, 0.0, 0.0, 1.0);
+}
+
+// The same life as a simulated star (background_star_reset() and
+// background_star_update() in game.cpp): fade in over its lifetime, out
+// over the same again, then respawn somewhere else. The lifetime is drawn
+// once per star rather than once per spawn, so which spawn is current
+// follows from the time alone.
+void main() {
+  uvec4 bytes = uvec4(inst_seed * 255.0 + 0.5);
+  uint seed = (bytes.x | (bytes.y << 8) | (bytes.z << 16) | (bytes.w << 24)) ^
+              hash(uint(u_stream));
+
+  float max_lifetime = mix(2.0, 10.0, rand(seed, 0xffffffffu, 0u));
+  float cycle = u_time / (max_lifetime * 2.0);
+  uint spawn = uint(cycle);
+  float lifetime = (cycle - floor(cycle)) * max_lifetime * 2.0;
+
+  float z = mix(u_z_near, u_z_far, rand(seed, spawn, 0u));
+  vec2 half_view = vec2(u_aspect, 1.0) * (u_eye_z + z) * u_tan_half_fov;
+  vec3 position = vec3(mix(-half_view, half_view,
+                           vec2(rand(seed, spawn, 1u), rand(seed, spawn, 2u))),
+                       -z);
+  vec3 rotation = vec3(rand(seed, spawn, 3u), rand(seed, spawn, 4u),
+                       rand(seed, spawn, 5u)) * 2.5 * lifetime;
+
+  float progress = lifetime / max_lifetime;
+  float scale = ease_in_out(progress < 1.0 ? progress : 2.0 - progress);
+
+  int color_index = min(int(rand(seed, spawn, 6u) * u_colors_count),
+                        int(u_colors_count) - 1);
+  float glow_min = mix(5.0, 10.0, rand(seed, spawn, 7u));
+  float glow_max = mix(glow_min, 15.0, rand(seed, spawn, 8u));
+  float glow_speed = mix(0.25, 5.0, rand(seed, spawn, 9u));
+  float glow = mix(glow_min, glow_max, (sin(u_time * glow_speed) + 1.0) * 0.5);
+
+  color = u_colors[color_index].rgb * glow;
+  vec3 world_position = position + rotation_x(rotation.x) *
+                                   rotation_y(rotation.y) *
+                                   rotation_z(rotation.z) *
+                                   (a_obj_position * scale);
+  gl_Position = u_world_to_clip_transform * vec4(world_position, 1.0);
+}
+@end
+
+@fs fs
+in vec3 color;
+
+out vec4 frag_color;
+
+void main() {
+  frag_color = vec4(color, 1.0);
+}
+@end
+
+@program program vs fs
@@ -0,0 +1,50 @@
+@module text
+
+@ctype mat4 HMM_Mat4
+
+@vs vs
+layout(binding=0) uniform vs_params {
+  mat4 u_world_to_clip_transform;
+};
+
+in vec2 a_obj_uv;
+in vec3 inst_origin;
+in vec3 inst_x_axis;
+in vec3 inst_y_axis;
+in vec4 inst_uv_rect;
+in vec3 inst_color;
+
+out vec2 uv;
+out vec3 color;
+
+// Each instance is one glyph quad. The unit quad's uv doubles as the corner
+// position within the glyph, and atlas rows go top to bottom.
+void main() {
+  vec3 world_position = inst_origin + inst_x_axis * a_obj_uv.x + inst_y_axis * a_obj_uv.y;
+  uv = vec2(mix(inst_uv_rect.x, inst_uv_rect.z, a_obj_uv.x),
+            mix(inst_uv_rect.w, inst_uv_rect.y, a_obj_uv.y));
+  color = inst_color;
+  gl_Position = u_world_to_clip_transform * vec4(world_position, 1.0);
+}
+@end
+
+@fs fs
+layout(binding=0) uniform texture2D u_atlas;
+layout(binding=0) uniform sampler u_smp;
+
+in vec2 uv;
+in vec3 color;
+
+out vec4 frag_color;
+
+// The atlas stores 0.5 on the glyph edge. Blending over about one screen
+// pixel keeps edges sharp at any distance from the camera.
+void main() {
+  float dist = texture(sampler2D(u_atlas, u_smp), uv).r;
+  float width = max(fwidth(dist) * 0.5, 1.0 / 255.0);
+  float alpha = smoothstep(0.5 - width, 0.5 + width, dist);
+  frag_color = vec4(color, alpha);
+}
+@end
+
+@program program vs fs
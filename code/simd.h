@@ -0,0 +1,104 @@
+#pragma once
+
+// Just enough 4-wide float math for the hot loops. Maps to SSE2 on x86,
+// NEON on ARM and plain scalar code everywhere else, e.g. WebAssembly.
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(SIMD_SSE2)
+typedef __m128 F32x4;
+#elif defined(SIMD_NEON)
+typedef float32x4_t F32x4;
+#else
+struct F32x4
+{
+    float e[4];
+};
+#endif
+
+// p has to be 16 byte aligned.
+inline F32x4 f32x4_load(const float *p)
+{
+#if defined(SIMD_SSE2)
+    return _mm_load_ps(p);
+#elif defined(SIMD_NEON)
+    return vld1q_f32(p);
+#else
+    return {{p[0], p[1], p[2], p[3]}};
+#endif
+}
+
+// p has to be 16 byte aligned.
+inline void f32x4_store(float *p, F32x4 v)
+{
+#if defined(SIMD_SSE2)
+    _mm_store_ps(p, v);
+#elif defined(SIMD_NEON)
+    vst1q_f32(p, v);
+#else
+    for (int i = 0; i < 4; i += 1)
+    {
+        p[i] = v.e[i];
+    }
+#endif
+}
+
+inline F32x4 f32x4_set1(float f)
+{
+#if defined(SIMD_SSE2)
+    return _mm_set1_ps(f);
+#elif defined(SIMD_NEON)
+    return vdupq_n_f32(f);
+#else
+    return {{f, f, f, f}};
+#endif
+}
+
+inline F32x4 f32x4_add(F32x4 a, F32x4 b)
+{
+#if defined(SIMD_SSE2)
+    return _mm_add_ps(a, b);
+#elif defined(SIMD_NEON)
+    return vaddq_f32(a, b);
+#else
+    return {{a.e[0] + b.e[0], a.e[1] + b.e[1], a.e[2] + b.e[2],
+             a.e[3] + b.e[3]}};
+#endif
+}
+
+inline F32x4 f32x4_sub(F32x4 a, F32x4 b)
+{
+#if defined(SIMD_SSE2)
+    return _mm_sub_ps(a, b);
+#elif defined(SIMD_NEON)
+    return vsubq_f32(a, b);
+#else
+    return {{a.e[0] - b.e[0], a.e[1] - b.e[1], a.e[2] - b.e[2],
+             a.e[3] - b.e[3]}};
+#endif
+}
+
+inline F32x4 f32x4_mul(F32x4 a, F32x4 b)
+{
+#if defined(SIMD_SSE2)
+    return _mm_mul_ps(a, b);
+#elif defined(SIMD_NEON)
+    return vmulq_f32(a, b);
+#else
+    return {{a.e[0] * b.e[0], a.e[1] * b.e[1], a.e[2] * b.e[2],
+             a.e[3] * b.e[3]}};
+#endif
+}
+
+// a * b + c. Not fused, so every platform rounds the same way.
+inline F32x4 f32x4_mul_add(F32x4 a, F32x4 b, F32x4 c)
+{
+    return f32x4_add(f32x4_mul(a, b), c);
+}
@@ -0,0 +1,340 @@
+#include "snapshot.h"
+#include "file_map.h"
+#include "game.h"
+#include "renderer.h"
+#include "sokol_time.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define SNAPSHOT_MMAP
+#endif
+
+static constexpr char snapshot_magic[4] = {'P', '3', 'D', 'S'};
+// The header has the first page to itself, and each slot starts on a page.
+static constexpr size_t snapshot_page_size = 4096;
+
+// In the native byte order, snapshots never leave the machine.
+struct Snapshot_Header
+{
+    char magic[4];
+    uint32_t version;
+    // sizeof(Game), which changes whenever the layout of the saved state is
+    // likely to.
+    uint64_t game_size;
+    uint64_t slot_size;
+};
+
+// At the start of each slot, followed by the lights and the game state.
+struct Snapshot_Slot
+{
+    // Higher is newer, 0 is a slot never written.
+    uint64_t sequence;
+    uint64_t tick;
+    uint64_t state_size;
+    // Of the fields above, the lights and the game state.
+    uint64_t checksum;
+};
+
+// The renderer state the game sets up once per game state rather than
+// every frame.
+struct Snapshot_Lights
+{
+    Directional_Light dir_light;
+    Point_Light point_lights[point_lights_count];
+};
+
+static constexpr size_t snapshot_slot_header_size =
+    sizeof(Snapshot_Slot) + sizeof(Snapshot_Lights);
+
+static size_t snapshot_round_up(size_t size)
+{
+    return (size + snapshot_page_size - 1) / snapshot_page_size *
+           snapshot_page_size;
+}
+
+// Four independent lanes of 8 bytes, so it isn't held up by the latency of
+// a single chain of multiplies. Runs at several GB/s.
+static uint64_t snapshot_checksum(const Snapshot_Slot &slot,
+                                  const uint8_t *data, size_t size)
+{
+    static constexpr uint64_t k = 0x9e3779b97f4a7c15ull;
+    uint64_t lanes[4] = {slot.sequence, slot.tick, slot.state_size, k};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        for (int j = 0; j < 4; j += 1)
+        {
+            uint64_t word;
+            memcpy(&word, data + i + j * 8, 8);
+            lanes[j] = (lanes[j] ^ word) * k;
+            lanes[j] ^= lanes[j] >> 29;
+        }
+    }
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint64_t lane : lanes)
+    {
+        hash = (hash ^ lane) * k;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i += 1)
+    {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static bool snapshot_header_matches(const Snapshot_Header &header)
+{
+    return memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) ==
+               0 &&
+           header.version == snapshot_version &&
+           header.game_size == sizeof(Game);
+}
+
+// The slot's header if the slot is intact and holds a state this build can
+// load, with sequence 0 otherwise. The checksum only catches torn writes.
+static Snapshot_Slot snapshot_read_slot(const uint8_t *slot_data,
+                                        size_t slot_size)
+{
+    Snapshot_Slot slot;
+    memcpy(&slot, slot_data, sizeof(slot));
+    if (slot.sequence == 0 || slot.state_size < sizeof(Game_Config) ||
+        slot.state_size > slot_size - snapshot_slot_header_size ||
+        snapshot_checksum(slot, slot_data + sizeof(Snapshot_Slot),
+                          sizeof(Snapshot_Lights) + slot.state_size) !=
+            slot.checksum ||
+        !game_state_valid(slot_data + snapshot_slot_header_size,
+                          slot.state_size))
+    {
+        slot = {};
+    }
+    return slot;
+}
+
+// The newest intact slot in a file of size bytes, or -1.
+static int snapshot_newest_slot(const uint8_t *data, size_t slot_size,
+                                Snapshot_Slot &newest)
+{
+    int index = -1;
+    newest = {};
+    for (int i = 0; i < 2; i += 1)
+    {
+        Snapshot_Slot slot = snapshot_read_slot(
+            data + snapshot_page_size + i * slot_size, slot_size);
+        if (slot.sequence > newest.sequence)
+        {
+            newest = slot;
+            index = i;
+        }
+    }
+    return index;
+}
+
+bool snapshot_restore(const char *path, Game &g, Renderer &r,
+                      uint64_t &tick)
+{
+    uint64_t start_time = stm_now();
+    File_Map map;
+    if (!file_map_open(map, path))
+    {
+        printf("snapshot: none in %s, starting a new game\n", path);
+        return false;
+    }
+
+    const char *problem = nullptr;
+    Snapshot_Header header = {};
+    Snapshot_Slot slot = {};
+    int index = -1;
+    if (map.size >= sizeof(header))
+    {
+        memcpy(&header, map.data, sizeof(header));
+    }
+    if (!snapshot_header_matches(header))
+    {
+        problem = "it is from another version";
+    }
+    else if (header.slot_size < snapshot_slot_header_size ||
+             header.slot_size % snapshot_page_size != 0 ||
+             map.size < snapshot_page_size + 2 * header.slot_size)
+    {
+        problem = "it is truncated";
+    }
+    else
+    {
+        index = snapshot_newest_slot(map.data, header.slot_size, slot);
+        if (index < 0)
+        {
+            problem = "neither slot is intact and loadable";
+        }
+    }
+    if (problem)
+    {
+        printf("snapshot: ignoring %s, %s\n", path, problem);
+        file_map_close(map);
+        return false;
+    }
+
+    const uint8_t *slot_data =
+        map.data + snapshot_page_size + index * header.slot_size;
+    Snapshot_Lights lights;
+    memcpy(&lights, slot_data + sizeof(Snapshot_Slot), sizeof(lights));
+    game_load_state(g, slot_data + snapshot_slot_header_size);
+    r.game_pass.dir_light = lights.dir_light;
+    std::copy(lights.point_lights, lights.point_lights + point_lights_count,
+              r.game_pass.point_lights);
+    tick = slot.tick;
+    file_map_close(map);
+    printf("snapshot: restored tick %llu from %s in %.3fms\n",
+           static_cast<unsigned long long>(tick), path,
+           stm_ms(stm_since(start_time)));
+    return true;
+}
+
+#if defined(SNAPSHOT_MMAP)
+static void snapshot_write(Snapshot &s, const Game &g, const Renderer &r,
+                           uint64_t tick)
+{
+    uint64_t start_time = stm_now();
+    int index = 1 - s.newest_slot;
+    uint8_t *slot_data = s.data + snapshot_page_size + index * s.slot_size;
+
+    Snapshot_Lights lights = {};
+    lights.dir_light = r.game_pass.dir_light;
+    std::copy(r.game_pass.point_lights,
+              r.game_pass.point_lights + point_lights_count,
+              lights.point_lights);
+    memcpy(slot_data + sizeof(Snapshot_Slot), &lights, sizeof(lights));
+    size_t state_size = game_state_size(g);
+    assert(state_size <= s.slot_size - snapshot_slot_header_size);
+    game_save_state(g, slot_data + snapshot_slot_header_size);
+
+    // The header goes last, until then the slot fails its checksum.
+    Snapshot_Slot slot = {s.sequence + 1, tick, state_size, 0};
+    slot.checksum = snapshot_checksum(slot, slot_data + sizeof(Snapshot_Slot),
+                                      sizeof(Snapshot_Lights) + state_size);
+    memcpy(slot_data, &slot, sizeof(slot));
+    // Starts writing the pages back without waiting for it.
+    msync(slot_data,
+          snapshot_round_up(snapshot_slot_header_size + state_size),
+          MS_ASYNC);
+
+    s.sequence = slot.sequence;
+    s.newest_slot = index;
+    s.last_tick = tick;
+    double secs = stm_sec(stm_since(start_time));
+    s.writes_count += 1;
+    s.write_secs_sum += secs;
+    s.write_secs_max = std::max(s.write_secs_max, secs);
+}
+#endif
+
+void snapshot_open(Snapshot &s, const char *path, const Game &g)
+{
+    s = {};
+    s.fd = -1;
+#if defined(SNAPSHOT_MMAP)
+    size_t slot_size = snapshot_round_up(snapshot_slot_header_size +
+                                         game_state_max_size(g));
+    size_t size = snapshot_page_size + 2 * slot_size;
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        printf("snapshot: can't open %s: %s\n", path, strerror(errno));
+        return;
+    }
+    Snapshot_Header header = {};
+    bool keep = pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                snapshot_header_matches(header) &&
+                header.slot_size == slot_size;
+    // Unwritten parts of the file are holes, they take no space on disk.
+    if ((!keep && ftruncate(fd, 0) != 0) ||
+        ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        printf("snapshot: can't resize %s: %s\n", path, strerror(errno));
+        close(fd);
+        return;
+    }
+    void *data =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        printf("snapshot: can't map %s: %s\n", path, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    s.fd = fd;
+    s.data = static_cast<uint8_t *>(data);
+    s.size = size;
+    s.slot_size = slot_size;
+    s.newest_slot = 1;
+    if (keep)
+    {
+        Snapshot_Slot newest;
+        int index = snapshot_newest_slot(s.data, slot_size, newest);
+        if (index >= 0)
+        {
+            s.sequence = newest.sequence;
+            s.newest_slot = index;
+        }
+    }
+    else
+    {
+        header = {};
+        memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+        header.version = snapshot_version;
+        header.game_size = sizeof(Game);
+        header.slot_size = slot_size;
+        memcpy(s.data, &header, sizeof(header));
+    }
+    s.active = true;
+    printf("snapshot: writing to %s every %llu ticks, %.1fMB\n", path,
+           static_cast<unsigned long long>(snapshot_interval_ticks),
+           static_cast<double>(size) / (1024.0 * 1024.0));
+#else
+    (void)path;
+    (void)g;
+    printf("snapshot: writing is not supported on this platform\n");
+#endif
+}
+
+void snapshot_tick(Snapshot &s, const Game &g, const Renderer &r,
+                   uint64_t tick)
+{
+    if (!s.active ||
+        (s.writes_count > 0 && tick < s.last_tick + snapshot_interval_ticks))
+    {
+        return;
+    }
+#if defined(SNAPSHOT_MMAP)
+    snapshot_write(s, g, r, tick);
+#endif
+}
+
+void snapshot_close(Snapshot &s, const Game &g, const Renderer &r,
+                    uint64_t tick)
+{
+    if (!s.active)
+    {
+        return;
+    }
+#if defined(SNAPSHOT_MMAP)
+    snapshot_write(s, g, r, tick);
+    msync(s.data, s.size, MS_SYNC);
+    munmap(s.data, s.size);
+    close(s.fd);
+#endif
+    printf("snapshot: %llu written, %.3fms mean and %.3fms worst\n",
+           static_cast<unsigned long long>(s.writes_count),
+           s.write_secs_sum / static_cast<double>(s.writes_count) * 1000.0,
+           s.write_secs_max * 1000.0);
+    s = {};
+    s.fd = -1;
+}
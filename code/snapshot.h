@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct Game;
+struct Renderer;
+
+inline constexpr uint32_t snapshot_version = 1;
+// Fixed steps between snapshots, 3 seconds.
+inline constexpr uint64_t snapshot_interval_ticks = 180;
+
+// Keeps the latest game state in a memory mapped file, so a restarted or
+// crashed game can carry on where it was. The file holds two slots that are
+// written in turn, each with its own checksum, so a write torn by a crash
+// leaves the other one intact. Writing is a copy into the mapping, the
+// kernel writes the pages back in its own time. Unix only.
+struct Snapshot
+{
+    bool active;
+    int fd;
+    uint8_t *data;
+    size_t size;
+    size_t slot_size;
+    // Of the newest slot, 0 for none.
+    uint64_t sequence;
+    int newest_slot;
+    uint64_t last_tick;
+    uint64_t writes_count;
+    double write_secs_sum;
+    double write_secs_max;
+};
+
+// Loads the newest intact snapshot in path into g, and the lights into r.
+// Returns false and leaves both alone if there is none, or if the file is
+// from another version or build, or damaged.
+bool snapshot_restore(const char *path, Game &g, Renderer &r,
+                      uint64_t &tick);
+// Opens path for writing snapshots of g. Keeps the snapshots already in it
+// if they have the same layout, so the last one survives until the first
+// new one is written.
+void snapshot_open(Snapshot &s, const char *path, const Game &g);
+// Writes a snapshot every snapshot_interval_ticks. Call after each tick.
+void snapshot_tick(Snapshot &s, const Game &g, const Renderer &r,
+                   uint64_t tick);
+// Writes a last snapshot and waits for it to reach the disk.
+void snapshot_close(Snapshot &s, const Game &g, const Renderer &r,
+                    uint64_t tick);
@@ -0,0 +1,118 @@
+#include "stress.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static constexpr const char *stress_scene_names[STRESS_SCENE_COUNT] = {
+    "stars-10k", "stars-100k", "stars-1m", "phong-boxes", "balls",
+};
+static constexpr const char *stress_timing_names[FRAME_TIMING_PART_COUNT] = {
+    "sim",
+    "draw",
+    "render",
+    "frame",
+};
+static constexpr int stress_phong_boxes_count = 5000;
+static constexpr int stress_balls_count = 100000;
+
+bool stress_parse(const char *name, Stress_Scene &scene)
+{
+    for (int i = 0; i < STRESS_SCENE_COUNT; i += 1)
+    {
+        if (strcmp(name, stress_scene_names[i]) == 0)
+        {
+            scene = static_cast<Stress_Scene>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *stress_scene_name(Stress_Scene scene)
+{
+    return stress_scene_names[scene];
+}
+
+Game_Config stress_config(Stress_Scene scene)
+{
+    Game_Config config = game_default_config();
+    switch (scene)
+    {
+    case STRESS_SCENE_STARS_10K:
+        config.gameplay_stars_count = 10000;
+        break;
+    case STRESS_SCENE_STARS_100K:
+        config.gameplay_stars_count = 100000;
+        break;
+    case STRESS_SCENE_STARS_1M:
+        config.gameplay_stars_count = 1000000;
+        break;
+    case STRESS_SCENE_PHONG_BOXES:
+        config.start_state = GAME_STATE_MENU;
+        config.menu_boxes_count = stress_phong_boxes_count;
+        break;
+    case STRESS_SCENE_BALLS:
+        config.start_state = GAME_STATE_MENU;
+        config.menu_balls_count = stress_balls_count;
+        break;
+    case STRESS_SCENE_COUNT:
+        break;
+    }
+    return config;
+}
+
+void stress_init(Stress &s, Stress_Scene scene)
+{
+    s.active = true;
+    s.scene = scene;
+    s.frame_index = 0;
+    printf("stress: %s, %d warmup frames then %d measured\n",
+           stress_scene_name(scene), stress_warmup_frames_count,
+           stress_frames_count);
+}
+
+static void stress_print_report(Stress &s)
+{
+    printf("stress: %s, ms per frame\n", stress_scene_name(s.scene));
+    printf("stress:              mean     p50     p99     max\n");
+    for (int i = 0; i < FRAME_TIMING_PART_COUNT; i += 1)
+    {
+        double *samples = s.samples[i];
+        double sum = 0.0;
+        for (int j = 0; j < stress_frames_count; j += 1)
+        {
+            sum += samples[j];
+        }
+        std::sort(samples, samples + stress_frames_count);
+        auto ms = [samples](int j) { return samples[j] * 1000.0; };
+        printf("stress:   %-8s %7.3f %7.3f %7.3f %7.3f\n",
+               stress_timing_names[i], sum / stress_frames_count * 1000.0,
+               ms(stress_frames_count / 2), ms(stress_frames_count * 99 / 100),
+               ms(stress_frames_count - 1));
+    }
+}
+
+bool stress_frame(Stress &s, const double *timings)
+{
+    if (!s.active)
+    {
+        return false;
+    }
+    int index = s.frame_index - stress_warmup_frames_count;
+    s.frame_index += 1;
+    if (index < 0)
+    {
+        return false;
+    }
+    for (int i = 0; i < FRAME_TIMING_PART_COUNT; i += 1)
+    {
+        s.samples[i][index] = timings[i];
+    }
+    if (index + 1 < stress_frames_count)
+    {
+        return false;
+    }
+    stress_print_report(s);
+    s.active = false;
+    return true;
+}
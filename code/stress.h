@@ -0,0 +1,42 @@
+#pragma once
+
+#include "frame_timing.h"
+#include "game.h"
+
+// Frames run before measuring, for the arenas and buffers to reach their
+// peak size and the pipelines to be created.
+inline constexpr int stress_warmup_frames_count = 120;
+inline constexpr int stress_frames_count = 600;
+
+// Built-in scenes for finding where each part of a frame stops scaling on a
+// given machine.
+enum Stress_Scene
+{
+    STRESS_SCENE_STARS_10K,
+    STRESS_SCENE_STARS_100K,
+    STRESS_SCENE_STARS_1M,
+    // Every box is its own draw call with its own uniforms.
+    STRESS_SCENE_PHONG_BOXES,
+    // Instanced, like the stars, but without the respawns.
+    STRESS_SCENE_BALLS,
+    STRESS_SCENE_COUNT,
+};
+
+struct Stress
+{
+    bool active;
+    Stress_Scene scene;
+    int frame_index;
+    double samples[FRAME_TIMING_PART_COUNT][stress_frames_count];
+};
+
+// "stars-10k", "stars-100k", "stars-1m", "phong-boxes" or "balls".
+bool stress_parse(const char *name, Stress_Scene &scene);
+const char *stress_scene_name(Stress_Scene scene);
+// The scene's entity counts on top of the default config.
+Game_Config stress_config(Stress_Scene scene);
+void stress_init(Stress &s, Stress_Scene scene);
+// Takes one frame's timings, as frame_timing_record() does. Prints the
+// mean, median, 99th percentile and worst of each after the last frame and
+// returns true.
+bool stress_frame(Stress &s, const double *timings);
@@ -0,0 +1,272 @@
+/*------------------------------------------------------------------------------
+  sdf_font_gen
+
+  Generates sdf_font.h, the signed distance field glyph atlas used for in-game
+  text. Run by the build, not shipped.
+
+  The font is a monospaced stroke font in the style of the old vector arcade
+  games. Each glyph is a set of polylines on an 8 x 12 grid, with the
+  baseline at y = 0 and the cap height at y = 12. Since the strokes are
+  plain line segments, the distance field is computed exactly instead of
+  being approximated from a rasterized bitmap.
+
+  Usage: sdf_font_gen <output header>
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <vector>
+
+struct Glyph_Strokes
+{
+    char c;
+    // Polylines separated by '|', each a list of grid points written as two
+    // digits, x (0-8) then y (0-9, A-C for 10-12).
+    const char *strokes;
+};
+
+// clang-format off
+static constexpr Glyph_Strokes glyphs[] = {
+    {'0', "00 80 8C 0C 00 8C"},
+    {'1', "2A 4C 40|20 60"},
+    {'2', "0C 8C 86 06 00 80"},
+    {'3', "0C 8C 80 00|06 86"},
+    {'4', "0C 06 86|8C 80"},
+    {'5', "8C 0C 08 68 86 82 60 00"},
+    {'6', "8C 0C 00 80 86 06"},
+    {'7', "0C 8C 80"},
+    {'8', "00 80 8C 0C 00|06 86"},
+    {'9', "80 8C 0C 06 86"},
+    {'A', "00 08 4C 88 80|06 86"},
+    {'B', "00 0C 6C 8A 88 66 06|66 84 82 60 00"},
+    {'C', "80 00 0C 8C"},
+    {'D', "00 0C 4C 88 84 40 00"},
+    {'E', "80 00 0C 8C|06 66"},
+    {'F', "00 0C 8C|06 66"},
+    {'G', "8A 8C 0C 00 80 84 44"},
+    {'H', "00 0C|06 86|8C 80"},
+    {'I', "0C 8C|4C 40|00 80"},
+    {'J', "8C 80 00 04"},
+    {'K', "00 0C|8C 06 80"},
+    {'L', "0C 00 80"},
+    {'M', "00 0C 46 8C 80"},
+    {'N', "00 0C 80 8C"},
+    {'O', "00 80 8C 0C 00"},
+    {'P', "00 0C 8C 86 06"},
+    {'Q', "00 0C 8C 84 40 00|44 80"},
+    {'R', "00 0C 8C 86 06 80"},
+    {'S', "8C 0C 06 86 80 00"},
+    {'T', "0C 8C|4C 40"},
+    {'U', "0C 00 80 8C"},
+    {'V', "0C 40 8C"},
+    {'W', "0C 20 46 60 8C"},
+    {'X', "00 8C|0C 80"},
+    {'Y', "0C 46 8C|46 40"},
+    {'Z', "0C 8C 00 80"},
+    {':', "42 43|49 4A"},
+    {'.', "40 41"},
+    {',', "41 30"},
+    {'-', "26 66"},
+    {'!', "4C 44|41 40"},
+    {'?', "0A 2C 6C 8A 88 46 44|41 40"},
+    {'/', "00 8C"},
+    {'\'', "4C 4A"},
+};
+// clang-format on
+
+static constexpr int grid_width = 8;
+static constexpr int grid_height = 12;
+// Horizontal distance between the left edges of two glyphs, in grid units.
+static constexpr int grid_advance = 11;
+static constexpr int grid_line_height = 18;
+static constexpr float pixels_per_unit = 2.5f;
+static constexpr float stroke_half_width = 0.8f * pixels_per_unit;
+// Distance in pixels from the stroke edge at which the field reaches 0 (on
+// the outside) or 1 (on the inside). Bounds how far outlines and glows can
+// reach when the atlas is sampled.
+static constexpr float spread = 4.0f;
+static constexpr int cell_padding = 6;
+static constexpr int cell_width =
+    static_cast<int>(grid_width * pixels_per_unit) + cell_padding * 2;
+static constexpr int cell_height =
+    static_cast<int>(grid_height * pixels_per_unit) + cell_padding * 2;
+static constexpr int cell_columns = 8;
+
+struct Segment
+{
+    float x0, y0, x1, y1;
+};
+
+static int grid_digit(char c)
+{
+    return c >= 'A' ? c - 'A' + 10 : c - '0';
+}
+
+static std::vector<Segment> parse_strokes(const char *strokes)
+{
+    std::vector<Segment> segments;
+    bool has_previous = false;
+    float px = 0.0f;
+    float py = 0.0f;
+    for (const char *s = strokes; *s;)
+    {
+        if (*s == '|')
+        {
+            has_previous = false;
+            s += 1;
+            continue;
+        }
+        if (*s == ' ')
+        {
+            s += 1;
+            continue;
+        }
+
+        float x = static_cast<float>(grid_digit(s[0]));
+        float y = static_cast<float>(grid_digit(s[1]));
+        if (has_previous)
+        {
+            segments.push_back({px, py, x, y});
+        }
+        px = x;
+        py = y;
+        has_previous = true;
+        s += 2;
+    }
+    return segments;
+}
+
+static float segment_distance(const Segment &seg, float x, float y)
+{
+    float dx = seg.x1 - seg.x0;
+    float dy = seg.y1 - seg.y0;
+    float len_sq = dx * dx + dy * dy;
+    float t = 0.0f;
+    if (len_sq > 0.0f)
+    {
+        t = ((x - seg.x0) * dx + (y - seg.y0) * dy) / len_sq;
+        t = std::clamp(t, 0.0f, 1.0f);
+    }
+    float ex = x - (seg.x0 + dx * t);
+    float ey = y - (seg.y0 + dy * t);
+    return std::sqrt(ex * ex + ey * ey);
+}
+
+// Row 0 of the cell is its top, as images are uploaded top row first.
+static void render_glyph(const std::vector<Segment> &segments,
+                         uint8_t *atlas, int atlas_width, int cell_x,
+                         int cell_y)
+{
+    for (int y = 0; y < cell_height; y += 1)
+    {
+        for (int x = 0; x < cell_width; x += 1)
+        {
+            // Pixel center in grid units, y pointing up from the baseline.
+            float gx = (static_cast<float>(x - cell_padding) + 0.5f) /
+                       pixels_per_unit;
+            float gy = (static_cast<float>(cell_height - cell_padding - y) -
+                        0.5f) /
+                       pixels_per_unit;
+
+            float dist = 1e9f;
+            for (const auto &seg : segments)
+            {
+                dist = std::min(dist, segment_distance(seg, gx, gy));
+            }
+            float edge_dist = dist * pixels_per_unit - stroke_half_width;
+            float value = std::clamp(0.5f - edge_dist / (2.0f * spread), 0.0f,
+                                     1.0f);
+
+            atlas[(cell_y + y) * atlas_width + cell_x + x] =
+                static_cast<uint8_t>(std::lround(value * 255.0f));
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: sdf_font_gen <output header>\n");
+        return 1;
+    }
+
+    constexpr int glyphs_count = static_cast<int>(std::size(glyphs));
+    constexpr int rows = (glyphs_count + cell_columns - 1) / cell_columns;
+    constexpr int atlas_width = cell_columns * cell_width;
+    constexpr int atlas_height = rows * cell_height;
+
+    std::vector<uint8_t> atlas(atlas_width * atlas_height, 0);
+    int cells[128];
+    std::fill(std::begin(cells), std::end(cells), -1);
+    for (int i = 0; i < glyphs_count; i += 1)
+    {
+        render_glyph(parse_strokes(glyphs[i].strokes), atlas.data(),
+                     atlas_width, (i % cell_columns) * cell_width,
+                     (i / cell_columns) * cell_height);
+        cells[static_cast<int>(glyphs[i].c)] = i;
+    }
+
+    FILE *file = fopen(argv[1], "w");
+    if (!file)
+    {
+        fprintf(stderr, "sdf_font_gen: failed to open %s\n", argv[1]);
+        return 1;
+    }
+
+    // Glyph metrics are in ems, where 1 em is the cap height.
+    float em = grid_height * pixels_per_unit;
+    fprintf(file, "// Generated by sdf_font_gen, do not edit.\n\n");
+    fprintf(file, "#pragma once\n\n#include <cstdint>\n\n");
+    fprintf(file, "inline constexpr int sdf_font_atlas_width = %d;\n",
+            atlas_width);
+    fprintf(file, "inline constexpr int sdf_font_atlas_height = %d;\n",
+            atlas_height);
+    fprintf(file, "inline constexpr int sdf_font_cell_width = %d;\n",
+            cell_width);
+    fprintf(file, "inline constexpr int sdf_font_cell_height = %d;\n",
+            cell_height);
+    fprintf(file, "inline constexpr int sdf_font_cell_columns = %d;\n",
+            cell_columns);
+    fprintf(file, "// Glyph metrics in ems, 1 em being the cap height. The "
+                  "quad of a glyph\n// covers its whole atlas cell, starting "
+                  "at (quad_x, quad_y) from the pen\n// position on the "
+                  "baseline.\n");
+    fprintf(file, "inline constexpr float sdf_font_quad_x = %ff;\n",
+            -cell_padding / em);
+    fprintf(file, "inline constexpr float sdf_font_quad_y = %ff;\n",
+            -cell_padding / em);
+    fprintf(file, "inline constexpr float sdf_font_quad_width = %ff;\n",
+            cell_width / em);
+    fprintf(file, "inline constexpr float sdf_font_quad_height = %ff;\n",
+            cell_height / em);
+    fprintf(file, "inline constexpr float sdf_font_advance = %ff;\n",
+            static_cast<float>(grid_advance) / grid_height);
+    fprintf(file, "inline constexpr float sdf_font_glyph_width = %ff;\n",
+            static_cast<float>(grid_width) / grid_height);
+    fprintf(file, "inline constexpr float sdf_font_line_height = %ff;\n",
+            static_cast<float>(grid_line_height) / grid_height);
+
+    fprintf(file, "// Atlas cell of every ASCII character, -1 for the ones "
+                  "without a glyph.\n");
+    fprintf(file, "inline constexpr int8_t sdf_font_glyph_cells[128] = {");
+    for (int i = 0; i < 128; i += 1)
+    {
+        fprintf(file, "%s%d,", i % 16 == 0 ? "\n    " : " ", cells[i]);
+    }
+    fprintf(file, "\n};\n");
+
+    fprintf(file, "inline constexpr uint8_t sdf_font_atlas[%d] = {",
+            atlas_width * atlas_height);
+    for (int i = 0; i < atlas_width * atlas_height; i += 1)
+    {
+        fprintf(file, "%s%d,", i % 16 == 0 ? "\n    " : " ", atlas[i]);
+    }
+    fprintf(file, "\n};\n");
+
+    fclose(file);
+    return 0;
+}